@@ -0,0 +1,269 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+const gchar *const BENCH_SCHEMA[] = {
+	"CREATE TABLE Ships ("
+	" ID INT NOT NULL AUTO_INCREMENT PRIMARY KEY,"
+	" MMSI BIGINT NOT NULL UNIQUE,"
+	" IMO BIGINT NOT NULL DEFAULT 0,"
+	" ShipName VARCHAR(64) NOT NULL DEFAULT '',"
+	" CommentText VARCHAR(255) NOT NULL DEFAULT '',"
+	" ShipLength FLOAT NOT NULL DEFAULT 0,"
+	" Width FLOAT NOT NULL DEFAULT 0,"
+	" Draught FLOAT NOT NULL DEFAULT 0,"
+	" Course FLOAT NOT NULL DEFAULT 0,"
+	" Heading SMALLINT NOT NULL DEFAULT 0,"
+	" ShipSpeed FLOAT NOT NULL DEFAULT 0,"
+	" RefFront SMALLINT NOT NULL DEFAULT 0,"
+	" RefLeft SMALLINT NOT NULL DEFAULT 0,"
+	" PathText VARCHAR(255) NOT NULL DEFAULT '',"
+	" Iclass CHAR(1) NOT NULL DEFAULT '0',"
+	" TargetType CHAR(1) NOT NULL DEFAULT '0',"
+	" SrcCall VARCHAR(32) NOT NULL DEFAULT '',"
+	" DstCall VARCHAR(32) NOT NULL DEFAULT '',"
+	" VesselClass SMALLINT NOT NULL DEFAULT 0,"
+	" NavStat TINYINT NOT NULL DEFAULT 0"
+	") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4",
+	"CREATE TABLE GPS ("
+	" ID INT NOT NULL AUTO_INCREMENT PRIMARY KEY,"
+	" IMO BIGINT NOT NULL,"
+	" Lat DOUBLE NOT NULL,"
+	" Lng DOUBLE NOT NULL,"
+	" RealTime DATETIME NOT NULL,"
+	" LastTime DATETIME NOT NULL,"
+	" Imported TINYINT(1) NOT NULL DEFAULT 0,"
+	" INDEX (IMO)"
+	") ENGINE=InnoDB",
+	NULL
+};
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gint64 ALLOCATIONS = 0;
+
+static inline void _count()
+{
+	__atomic_fetch_add(&ALLOCATIONS, 1, __ATOMIC_RELAXED);
+}
+
+// Interposes the C library functions for the whole process, including
+// GLib and json-glib
+void *malloc(size_t size)
+{
+	_count();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	_count();
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	_count();
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+void bench_init()
+{
+	setenv("G_SLICE", "always-malloc", 1);
+}
+
+gint64 bench_allocations()
+{
+#ifdef __GLIBC__
+	return __atomic_load_n(&ALLOCATIONS, __ATOMIC_RELAXED);
+#else
+	return -1;
+#endif
+}
+
+gdouble bench_now()
+{
+	return g_get_monotonic_time() / (gdouble)G_USEC_PER_SEC;
+}
+
+static const gchar *NAMES[] = {
+	"VIKING GRACE", "SILJA SERENADE", "FINNMAID", "POLARIS",
+	"ÅLANDSFÄRJAN", "MÖRKÖ", "SJÖFRÖKEN",
+	"АРКТИКА",
+	"海洋之星", "\\u00c5BO \\u00d6", "\\\"TUG\\\" 7", "",
+};
+
+static const gchar *COMMENTS[] = {
+	"HELSINKI", "TURKU", "MARIEHAMN", "ST.PETERSBURG", "TALLINN",
+	"FI HEL > SE STO", "KÖPENHAMN", "",
+};
+
+static void _append_int(GString *out, GRand *rand, const gchar *key,
+			const gint64 value)
+{
+	if (g_rand_boolean(rand)) {
+		g_string_append_printf(out, ",\"%s\":\"%" G_GINT64_FORMAT "\"",
+				       key, value);
+	} else {
+		g_string_append_printf(out, ",\"%s\":%" G_GINT64_FORMAT,
+				       key, value);
+	}
+}
+
+static void _append_double(GString *out, GRand *rand, const gchar *key,
+			   const gdouble value, const gchar *format)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_ascii_formatd(buf, sizeof(buf), format, value);
+	if (g_rand_boolean(rand)) {
+		g_string_append_printf(out, ",\"%s\":\"%s\"", key, buf);
+	} else {
+		g_string_append_printf(out, ",\"%s\":%s", key, buf);
+	}
+}
+
+// Optional fields are missing from every fifth entry on average
+static gboolean _present(GRand *rand)
+{
+	return g_rand_int_range(rand, 0, 5) != 0;
+}
+
+static void _append_entry(GString *out, GRand *rand, const guint index)
+{
+	gint64 time = 1514764800 + g_rand_int_range(rand, 0, 86400);
+
+	g_string_append_printf(out, "%s{\"class\":\"i\",\"type\":\"a\"",
+			       index ? "," : "");
+	_append_int(out, rand, "mmsi", 230000000 + index);
+	if (_present(rand)) {
+		_append_int(out, rand, "imo", 9000000 + g_rand_int_range(rand, 0, 999999));
+	}
+	g_string_append_printf(out, ",\"name\":\"%s\"",
+			       NAMES[g_rand_int_range(rand, 0, G_N_ELEMENTS(NAMES))]);
+	_append_int(out, rand, "time", time);
+	_append_int(out, rand, "lasttime", time + g_rand_int_range(rand, 0, 600));
+	_append_double(out, rand, "lat", g_rand_double_range(rand, 53.0, 66.0), "%.5f");
+	_append_double(out, rand, "lng", g_rand_double_range(rand, 9.0, 30.0), "%.5f");
+	_append_double(out, rand, "course", g_rand_double_range(rand, 0.0, 360.0), "%.1f");
+	_append_double(out, rand, "speed", g_rand_double_range(rand, 0.0, 45.0), "%.1f");
+	if (_present(rand)) {
+		_append_int(out, rand, "heading", g_rand_int_range(rand, 0, 360));
+	}
+	_append_int(out, rand, "navstat", g_rand_int_range(rand, 0, 16));
+	_append_int(out, rand, "vesselclass", g_rand_int_range(rand, 30, 90));
+	if (_present(rand)) {
+		_append_double(out, rand, "length", g_rand_int_range(rand, 10, 300), "%.0f");
+		_append_double(out, rand, "width", g_rand_int_range(rand, 3, 50), "%.0f");
+		_append_double(out, rand, "draught", g_rand_double_range(rand, 1.0, 15.0), "%.1f");
+		_append_int(out, rand, "ref_front", g_rand_int_range(rand, 0, 250));
+		_append_int(out, rand, "ref_left", g_rand_int_range(rand, 0, 40));
+	}
+	if (_present(rand)) {
+		g_string_append_printf(out, ",\"comment\":\"%s\"",
+				       COMMENTS[g_rand_int_range(rand, 0, G_N_ELEMENTS(COMMENTS))]);
+	}
+	g_string_append_printf(out, ",\"srccall\":\"OH%u\",\"dstcall\":\"ais\"",
+			       index % 1000);
+	g_string_append(out, ",\"path\":\"TCPIP*,qAI,OH2MP\"}");
+}
+
+gchar *bench_response(const guint entries, const guint32 seed)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	GString *out = g_string_new(NULL);
+
+	g_string_append_printf(out, "{\"command\":\"get\",\"result\":\"ok\","
+			       "\"what\":\"loc\",\"found\":%u,\"entries\":[",
+			       entries);
+	for (guint i = 0; i < entries; ++i) {
+		_append_entry(out, rand, i);
+	}
+	g_string_append(out, "]}");
+
+	g_rand_free(rand);
+
+	return g_string_free(out, FALSE);
+}
+
+struct BenchResult *bench_result_new(const gchar *benchmark,
+				     const gchar *name)
+{
+	struct BenchResult *result = g_new0(struct BenchResult, 1);
+
+	result->line = g_string_new("{");
+	bench_result_string(result, "benchmark", benchmark);
+	bench_result_string(result, "name", name);
+
+	return result;
+}
+
+static void _key(struct BenchResult *result, const gchar *key)
+{
+	if (result->line->len > 1) {
+		g_string_append_c(result->line, ',');
+	}
+	g_string_append_printf(result->line, "\"%s\":", key);
+}
+
+void bench_result_int(struct BenchResult *result, const gchar *key,
+		      const gint64 value)
+{
+	_key(result, key);
+	g_string_append_printf(result->line, "%" G_GINT64_FORMAT, value);
+}
+
+void bench_result_double(struct BenchResult *result, const gchar *key,
+			 const gdouble value)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	_key(result, key);
+	if (!isfinite(value)) {
+		g_string_append(result->line, "null");
+		return;
+	}
+	g_string_append(result->line,
+			g_ascii_formatd(buf, sizeof(buf), "%.6g", value));
+}
+
+void bench_result_string(struct BenchResult *result, const gchar *key,
+			 const gchar *value)
+{
+	_key(result, key);
+	g_string_append_printf(result->line, "\"%s\"", value);
+}
+
+void bench_result_print(struct BenchResult *result)
+{
+	g_string_append_c(result->line, '}');
+	fprintf(stdout, "%s\n", result->line->str);
+	fflush(stdout);
+
+	g_string_free(result->line, TRUE);
+	g_free(result);
+}
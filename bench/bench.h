@@ -0,0 +1,152 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file bench.h
+ * @brief Helpers shared by the benchmarks
+ * @details Benchmarks print one JSON object per line on stdout, so results
+ * can be compared by scripts. Allocations are counted by replacing
+ * malloc(), calloc() and realloc() of the C library, which works only with
+ * glibc. Elsewhere bench_allocations() returns @c -1.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <glib.h>
+
+/**
+ * Default seed of generated data
+ */
+#define BENCH_SEED 20180101
+
+/**
+ * Exit status of a benchmark which can not run on this machine
+ */
+#define BENCH_EXIT_SKIP 77
+
+/**
+ * Statements creating the Ships and GPS tables with the columns used by
+ * database.c, terminated by NULL
+ */
+extern const gchar *const BENCH_SCHEMA[];
+
+/**
+ * @struct BenchResult
+ * @brief Line of machine-readable output
+ */
+struct BenchResult {
+	GString *line; /**< JSON object being built */
+};
+
+/**
+ * @brief Prepare process for benchmarking
+ *
+ * Makes GLib allocate slices with malloc() so they are counted.
+ * Call before any other GLib function.
+ *
+ * @return Nothing
+ */
+void bench_init();
+
+/**
+ * Read number of allocations made by all threads so far
+ *
+ * @return gint64 Allocations or -1 if they are not counted
+ */
+gint64 bench_allocations();
+
+/**
+ * Read monotonic time
+ *
+ * @return gdouble Seconds
+ */
+gdouble bench_now();
+
+/**
+ * @brief Generate aprs.fi response
+ *
+ * Same @p seed gives the same response. Numbers are randomly encoded as JSON
+ * numbers or strings, like aprs.fi does, names contain non-ASCII characters
+ * and escapes, and optional fields are left out of some entries.
+ *
+ * @param[in] entries Number of ships in the response
+ * @param[in] seed Seed of the random numbers
+ * @return gchar* JSON
+ * @note Free with g_free()
+ */
+gchar *bench_response(const guint entries, const guint32 seed);
+
+/**
+ * Start result line
+ *
+ * @param[in] benchmark Name of the benchmark program
+ * @param[in] name Name of the measured case
+ * @return struct BenchResult*
+ * @note Print and free with bench_result_print()
+ */
+struct BenchResult *bench_result_new(const gchar *benchmark,
+				     const gchar *name);
+
+/**
+ * Add integer field to result
+ *
+ * @param[in] result Struct of type BenchResult()
+ * @param[in] key Field name
+ * @param[in] value Value
+ * @return Nothing
+ */
+void bench_result_int(struct BenchResult *result, const gchar *key,
+		      const gint64 value);
+
+/**
+ * @brief Add floating point field to result
+ *
+ * Values which are not finite are written as @c null.
+ *
+ * @param[in] result Struct of type BenchResult()
+ * @param[in] key Field name
+ * @param[in] value Value
+ * @return Nothing
+ */
+void bench_result_double(struct BenchResult *result, const gchar *key,
+			 const gdouble value);
+
+/**
+ * Add string field to result
+ *
+ * @param[in] result Struct of type BenchResult()
+ * @param[in] key Field name
+ * @param[in] value Value, must not need escaping
+ * @return Nothing
+ */
+void bench_result_string(struct BenchResult *result, const gchar *key,
+			 const gchar *value);
+
+/**
+ * Print result line to stdout and free it
+ *
+ * @param[in] result Struct of type BenchResult()
+ * @return Nothing
+ */
+void bench_result_print(struct BenchResult *result);
+
+#endif
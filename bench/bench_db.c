@@ -0,0 +1,505 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Write path benchmark against a local MariaDB server.
+ *
+ * A database named shipsoftware_bench_<pid> is created with the Ships and
+ * GPS tables and dropped at exit. Every case runs on its own connection
+ * opened with db_init(), and round trips are read from the session status
+ * counters of that connection.
+ */
+
+#include <math.h>
+#include <mysql.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "database.h"
+#include "fleet.h"
+
+#define BENCH_DB_TIME 1514764800
+
+struct Ships {
+	struct Ship *ships; /**< Ships, strings are interned */
+	struct ShipPosition *positions; /**< Positions of the ships */
+	guint len; /**< Number of ships */
+};
+
+static struct Config CONFIG;
+static gchar *DATABASE = NULL;
+
+static gboolean _query(MYSQL *con, const gchar *query)
+{
+	if (mysql_query(con, query)) {
+		g_printerr("%s: %s\n", query, mysql_error(con));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static MYSQL *_connect(const gchar *database)
+{
+	MYSQL *con = mysql_init(NULL);
+
+	if (!mysql_real_connect(con, CONFIG.db_hostname, CONFIG.db_username,
+				CONFIG.db_password, database, 0, NULL, 0))
+	{
+		g_printerr("Connection failed: %s\n", mysql_error(con));
+		mysql_close(con);
+		return NULL;
+	}
+
+	return con;
+}
+
+static gboolean _create_schema()
+{
+	MYSQL *con = _connect(NULL);
+	gchar *query;
+	gboolean ret;
+
+	if (!con) {
+		return FALSE;
+	}
+
+	query = g_strdup_printf("CREATE DATABASE %s", DATABASE);
+	ret = _query(con, query) && !mysql_select_db(con, DATABASE);
+	g_free(query);
+
+	for (guint i = 0; ret && BENCH_SCHEMA[i]; ++i) {
+		ret = _query(con, BENCH_SCHEMA[i]);
+	}
+
+	mysql_close(con);
+
+	return ret;
+}
+
+static void _drop_schema()
+{
+	MYSQL *con = _connect(NULL);
+	gchar *query;
+
+	if (!con) {
+		return;
+	}
+
+	query = g_strdup_printf("DROP DATABASE IF EXISTS %s", DATABASE);
+	_query(con, query);
+	g_free(query);
+
+	mysql_close(con);
+}
+
+static struct Ships *_ships_new(const guint len, const guint64 seed)
+{
+	struct Ships *ships = g_new0(struct Ships, 1);
+	struct Fleet *fleet = fleet_new(len, seed, BENCH_DB_TIME);
+
+	ships->len = len;
+	ships->ships = g_new0(struct Ship, len);
+	ships->positions = g_new0(struct ShipPosition, len);
+
+	// A day in, part of the fleet is under way
+	for (guint i = 0; i < len; ++i) {
+		struct Ship *ship = &ships->ships[i];
+
+		fleet_get(fleet, i, BENCH_DB_TIME + 86400, ship);
+
+		ships->positions[i].imo = ship->imo;
+		ships->positions[i].time = ship->time;
+		ships->positions[i].lasttime = ship->lasttime;
+		ships->positions[i].latitude = ship->latitude;
+		ships->positions[i].longitude = ship->longitude;
+	}
+
+	fleet_free(fleet);
+
+	return ships;
+}
+
+static void _ships_free(struct Ships *ships)
+{
+	g_free(ships->ships);
+	g_free(ships->positions);
+	g_free(ships);
+}
+
+// Statements and prepares sent on the connection, including this query
+static gint64 _round_trips(const struct Database *db)
+{
+	MYSQL_RES *result;
+	MYSQL_ROW row;
+	gint64 ret = 0;
+
+	if (mysql_query(db->con, "SHOW SESSION STATUS WHERE Variable_name IN "
+			"('Questions', 'Com_stmt_prepare')"))
+	{
+		return -1;
+	}
+
+	result = mysql_store_result(db->con);
+	if (!result) {
+		return -1;
+	}
+
+	while ((row = mysql_fetch_row(result))) {
+		ret += g_ascii_strtoll(row[1], NULL, 10);
+	}
+	mysql_free_result(result);
+
+	return ret;
+}
+
+static gboolean _reset(const struct Ships *fleet, const guint depth)
+{
+	MYSQL *con = _connect(DATABASE);
+	gboolean ret;
+
+	if (!con) {
+		return FALSE;
+	}
+
+	ret = _query(con, "TRUNCATE TABLE GPS") &&
+	      _query(con, "TRUNCATE TABLE Ships");
+
+	// Ships rows have to exist for the UPDATE statements to match
+	for (guint i = 0; ret && i < fleet->len; i += DB_BULK_ROWS) {
+		GString *query = g_string_new("INSERT INTO Ships (MMSI, IMO) VALUES ");
+
+		for (guint j = i; j < MIN(i + DB_BULK_ROWS, fleet->len); ++j) {
+			g_string_append_printf(query, "%s(%" G_GINT64_FORMAT
+					       ", %" G_GINT64_FORMAT ")",
+					       j > i ? ", " : "",
+					       fleet->ships[j].mmsi,
+					       fleet->ships[j].imo);
+		}
+		ret = _query(con, query->str);
+		g_string_free(query, TRUE);
+	}
+
+	mysql_close(con);
+
+	// Retention depth is the number of GPS records of every ship
+	if (ret && depth > 0) {
+		struct ShipPosition *positions = g_new(struct ShipPosition,
+						       fleet->len);
+		struct Database db;
+		gchar *error = NULL;
+
+		memcpy(positions, fleet->positions,
+		       fleet->len * sizeof(*positions));
+
+		ret = db_init(&db, &CONFIG, &error);
+		for (guint d = 0; ret && d < depth; ++d) {
+			for (guint i = 0; i < fleet->len; ++i) {
+				positions[i].time -= 60;
+				positions[i].lasttime -= 60;
+			}
+			ret = db_insert_ship_gps_bulk(&db, positions, fleet->len,
+						      NULL, &error);
+		}
+		if (!ret) {
+			g_printerr("Failed to fill GPS table: %s\n", error);
+			g_free(error);
+		}
+		db_close_con(&db);
+		g_free(positions);
+	}
+
+	return ret;
+}
+
+enum Case {
+	CASE_UPDATE_SHIP_INFO,
+	CASE_UPDATE_SHIP_GPS,
+	CASE_INSERT_SHIP_GPS_BULK,
+	CASE_CLEAN_SHIP_GPS,
+};
+
+static const gchar *CASES[] = {
+	[CASE_UPDATE_SHIP_INFO] = "db_update_ship_info",
+	[CASE_UPDATE_SHIP_GPS] = "db_update_ship_gps",
+	[CASE_INSERT_SHIP_GPS_BULK] = "db_insert_ship_gps_bulk",
+	[CASE_CLEAN_SHIP_GPS] = "db_clean_ship_gps",
+};
+
+/*
+ * Writes every ship of the fleet once. Bulk inserts take @p batch positions
+ * per call, the other cases commit a transaction after every @p batch ships
+ * and use autocommit if it is 1.
+ */
+static gboolean _write(const enum Case c, const struct Database *db,
+		       struct Ships *fleet, const guint batch, gchar **error)
+{
+	for (guint i = 0; i < fleet->len; i += batch) {
+		guint end = MIN(i + batch, fleet->len);
+		gboolean ret = TRUE;
+
+		if (c == CASE_INSERT_SHIP_GPS_BULK) {
+			if (!db_insert_ship_gps_bulk(db, &fleet->positions[i],
+						     end - i, NULL, error))
+			{
+				return FALSE;
+			}
+			continue;
+		}
+
+		if (batch > 1 && !db_begin(db, error)) {
+			return FALSE;
+		}
+
+		for (guint j = i; ret && j < end; ++j) {
+			struct Ship *ship = &fleet->ships[j];
+
+			switch (c) {
+				case CASE_UPDATE_SHIP_INFO:
+					// Changed every time so the row is written
+					ship->speed += 0.5f;
+					ret = db_update_ship_info(db, ship, error);
+					break;
+				case CASE_UPDATE_SHIP_GPS:
+					ret = db_update_ship_gps(db, ship, error);
+					break;
+				case CASE_CLEAN_SHIP_GPS:
+					ret = db_clean_ship_gps(db, &ship->imo, error);
+					break;
+				default:
+					break;
+			}
+		}
+
+		if (batch > 1) {
+			if (!ret) {
+				db_rollback(db);
+				return FALSE;
+			}
+			if (!db_commit(db, error)) {
+				return FALSE;
+			}
+		}
+
+		if (!ret) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gint64 _count_gps(const struct Database *db)
+{
+	MYSQL_RES *result;
+	MYSQL_ROW row;
+	gint64 ret = -1;
+
+	if (mysql_query(db->con, "SELECT COUNT(*) FROM GPS")) {
+		return -1;
+	}
+
+	result = mysql_store_result(db->con);
+	if (result) {
+		if ((row = mysql_fetch_row(result))) {
+			ret = g_ascii_strtoll(row[0], NULL, 10);
+		}
+		mysql_free_result(result);
+	}
+
+	return ret;
+}
+
+static gboolean _run(const enum Case c, struct Ships *fleet,
+		     const guint depth, const guint batch)
+{
+	struct BenchResult *result;
+	struct Database db;
+	gchar *error = NULL;
+	gint64 round_trips;
+	gint64 rows;
+	gdouble start;
+	gdouble seconds;
+
+	if (!_reset(fleet, c == CASE_CLEAN_SHIP_GPS ? depth : 0)) {
+		return FALSE;
+	}
+
+	if (!db_init(&db, &CONFIG, &error)) {
+		g_printerr("%s\n", error);
+		g_free(error);
+		db_close_con(&db);
+		return FALSE;
+	}
+
+	rows = c == CASE_CLEAN_SHIP_GPS ? _count_gps(&db) : fleet->len;
+	round_trips = _round_trips(&db);
+	start = bench_now();
+	if (!_write(c, &db, fleet, batch, &error)) {
+		g_printerr("%s: %s\n", CASES[c], error);
+		g_free(error);
+		db_close_con(&db);
+		return FALSE;
+	}
+	seconds = bench_now() - start;
+	round_trips = round_trips < 0 ? -1 : _round_trips(&db) - round_trips - 1;
+
+	// Rows written, or deleted by the retention
+	if (c == CASE_CLEAN_SHIP_GPS) {
+		rows -= _count_gps(&db);
+	}
+
+	db_close_con(&db);
+
+	result = bench_result_new("bench_db", CASES[c]);
+	bench_result_int(result, "ships", fleet->len);
+	bench_result_int(result, "retention", c == CASE_CLEAN_SHIP_GPS ? depth : 0);
+	bench_result_int(result, "batch", batch);
+	bench_result_int(result, "rows", rows);
+	bench_result_double(result, "seconds", seconds);
+	bench_result_double(result, "rows_per_second", rows / seconds);
+	bench_result_double(result, "ships_per_second", fleet->len / seconds);
+	bench_result_int(result, "round_trips", round_trips);
+	bench_result_double(result, "round_trips_per_ship",
+			    round_trips < 0 ? NAN :
+			    round_trips / (gdouble)fleet->len);
+	bench_result_print(result);
+
+	return TRUE;
+}
+
+static guint *_parse_list(const gchar *list, guint *len)
+{
+	gchar **split = g_strsplit(list, ",", -1);
+	guint *ret;
+
+	*(len) = g_strv_length(split);
+	ret = g_new(guint, *len);
+	for (guint i = 0; i < *len; ++i) {
+		ret[i] = (guint)g_ascii_strtoull(split[i], NULL, 10);
+	}
+	g_strfreev(split);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	gchar *host = NULL;
+	gchar *user = NULL;
+	gchar *password = NULL;
+	gchar *fleets_arg = NULL;
+	gchar *depths_arg = NULL;
+	gchar *batches_arg = NULL;
+	guint *fleets, *depths, *batches;
+	guint n_fleets, n_depths, n_batches;
+	MYSQL *con;
+	gboolean ret = TRUE;
+	GError *error = NULL;
+	GOptionContext *context;
+	GOptionEntry options[] = {
+		{"host", 'h', 0, G_OPTION_ARG_STRING, &host,
+		 "MariaDB host (default localhost)", "HOST"},
+		{"user", 'u', 0, G_OPTION_ARG_STRING, &user,
+		 "User allowed to create databases (default login name)", "USER"},
+		{"password", 'p', 0, G_OPTION_ARG_STRING, &password,
+		 "Password (default MYSQL_PWD environment variable)", "PASSWORD"},
+		{"ships", 'n', 0, G_OPTION_ARG_STRING, &fleets_arg,
+		 "Comma separated fleet sizes (default 100,1000)", "N,..."},
+		{"retention", 'r', 0, G_OPTION_ARG_STRING, &depths_arg,
+		 "Comma separated GPS records per ship before cleaning (default 20,40)", "N,..."},
+		{"batch", 'b', 0, G_OPTION_ARG_STRING, &batches_arg,
+		 "Comma separated ships per transaction or bulk insert (default 1,64)", "N,..."},
+		{NULL}
+	};
+
+	bench_init();
+
+	context = g_option_context_new("- benchmark database writes");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	fleets = _parse_list(fleets_arg ? fleets_arg : "100,1000", &n_fleets);
+	depths = _parse_list(depths_arg ? depths_arg : "20,40", &n_depths);
+	batches = _parse_list(batches_arg ? batches_arg : "1,64", &n_batches);
+
+	for (guint i = 0; i < n_batches; ++i) {
+		if (batches[i] == 0) {
+			g_printerr("Batch size must be at least 1\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	DATABASE = g_strdup_printf("shipsoftware_bench_%d", (gint)getpid());
+	CONFIG.db_name = DATABASE;
+	CONFIG.db_hostname = host ? host : "localhost";
+	CONFIG.db_username = user ? user : g_get_user_name();
+	CONFIG.db_password = password ? password : g_getenv("MYSQL_PWD");
+
+	if (mysql_library_init(0, NULL, NULL)) {
+		return EXIT_FAILURE;
+	}
+
+	// Without a server there is nothing to measure
+	con = _connect(NULL);
+	if (!con) {
+		mysql_library_end();
+		return BENCH_EXIT_SKIP;
+	}
+	mysql_close(con);
+
+	if (!_create_schema()) {
+		_drop_schema();
+		mysql_library_end();
+		return EXIT_FAILURE;
+	}
+
+	for (guint f = 0; ret && f < n_fleets; ++f) {
+		struct Ships *fleet = _ships_new(fleets[f], BENCH_SEED);
+
+		for (guint b = 0; ret && b < n_batches; ++b) {
+			for (guint c = 0; ret && c < CASE_CLEAN_SHIP_GPS; ++c) {
+				ret = _run(c, fleet, 0, batches[b]);
+			}
+			for (guint d = 0; ret && d < n_depths; ++d) {
+				ret = _run(CASE_CLEAN_SHIP_GPS, fleet, depths[d],
+					   batches[b]);
+			}
+		}
+
+		_ships_free(fleet);
+	}
+
+	_drop_schema();
+	mysql_library_end();
+
+	g_free(fleets);
+	g_free(depths);
+	g_free(batches);
+	g_free(DATABASE);
+
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
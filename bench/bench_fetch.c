@@ -0,0 +1,168 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * API request benchmark against a local mock server, see mock_api.h.
+ */
+
+#include <curl/curl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "api.h"
+#include "bench.h"
+#include "hdr.h"
+#include "mock_api.h"
+
+#define BENCH_FETCH_MIN_TIME 0.5
+
+static gchar *_respond(const gchar *query, gpointer data)
+{
+	return g_strdup(data);
+}
+
+static gboolean _run(const guint entries, const guint32 seed,
+		     const gdouble min_time)
+{
+	struct HdrHistogram *latency = hdr_new();
+	struct BenchResult *result;
+	struct MockApi *mock;
+	gchar *response = bench_response(entries, seed);
+	gchar *error = NULL;
+	gchar *data;
+	gboolean ret = TRUE;
+	gint64 iterations = 0;
+	gint64 allocations;
+	gdouble start;
+	gdouble seconds = 0.0;
+	gsize bytes = strlen(response);
+
+	mock = mock_api_new(_respond, response, &error);
+	if (!mock) {
+		g_printerr("%s\n", error);
+		g_free(error);
+		g_free(response);
+		hdr_free(latency);
+		return FALSE;
+	}
+	api_set_url(mock_api_url(mock));
+
+	allocations = bench_allocations();
+	start = bench_now();
+	do {
+		gdouble started = bench_now();
+
+		if (!api_get_loc("230000000", "bench", &data, &error)) {
+			g_printerr("api_get_loc: %s\n", error);
+			g_free(error);
+			ret = FALSE;
+			break;
+		}
+		g_free(data);
+
+		hdr_record(latency, (gint64)((bench_now() - started) * G_USEC_PER_SEC), 1);
+		++iterations;
+		seconds = bench_now() - start;
+	} while (seconds < min_time);
+	allocations = allocations < 0 ? -1 : bench_allocations() - allocations;
+
+	api_set_url(NULL);
+	mock_api_free(mock);
+	g_free(response);
+
+	if (!ret) {
+		hdr_free(latency);
+		return FALSE;
+	}
+
+	// Server threads allocate too, they are counted with the client
+	result = bench_result_new("bench_fetch", "api_get_loc");
+	bench_result_int(result, "entries", entries);
+	bench_result_int(result, "bytes", bytes);
+	bench_result_int(result, "iterations", iterations);
+	bench_result_double(result, "seconds", seconds);
+	bench_result_double(result, "requests_per_second", iterations / seconds);
+	bench_result_double(result, "bytes_per_second",
+			    bytes * iterations / seconds);
+	bench_result_double(result, "p50_seconds",
+			    hdr_percentile(latency, 50.0) / (gdouble)G_USEC_PER_SEC);
+	bench_result_double(result, "p99_seconds",
+			    hdr_percentile(latency, 99.0) / (gdouble)G_USEC_PER_SEC);
+	bench_result_double(result, "allocations_per_request",
+			    allocations < 0 ? NAN :
+			    allocations / (gdouble)iterations);
+	bench_result_print(result);
+
+	hdr_free(latency);
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	gchar *sizes = NULL;
+	gchar **split;
+	gint seed = BENCH_SEED;
+	gdouble min_time = BENCH_FETCH_MIN_TIME;
+	gboolean ret = TRUE;
+	GError *error = NULL;
+	GOptionContext *context;
+	GOptionEntry options[] = {
+		{"entries", 'n', 0, G_OPTION_ARG_STRING, &sizes,
+		 "Comma separated response sizes (default 1,20,1000)", "N,..."},
+		{"seed", 's', 0, G_OPTION_ARG_INT, &seed,
+		 "Seed of the generated responses", "N"},
+		{"min-time", 'm', 0, G_OPTION_ARG_DOUBLE, &min_time,
+		 "Seconds to repeat each case (default 0.5)", "SECONDS"},
+		{NULL}
+	};
+
+	bench_init();
+
+	context = g_option_context_new("- benchmark API requests against a local server");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	split = g_strsplit(sizes ? sizes : "1,20,1000", ",", -1);
+	for (guint i = 0; ret && split[i]; ++i) {
+		guint entries = (guint)g_ascii_strtoull(split[i], NULL, 10);
+
+		if (entries == 0) {
+			g_printerr("Invalid number of entries: %s\n", split[i]);
+			ret = FALSE;
+			break;
+		}
+
+		ret = _run(entries, (guint32)seed, min_time);
+	}
+
+	g_strfreev(split);
+	g_free(sizes);
+	curl_global_cleanup();
+
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,222 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Decoding benchmark of generated aprs.fi responses, see bench_response().
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "json.h"
+
+#define BENCH_JSON_MIN_TIME 0.5
+
+/*
+ * json_read_entry_*() parse the whole response for every value, so they are
+ * measured only with small responses
+ */
+#define BENCH_JSON_ENTRY_MAX 100
+
+static void _read_entries(const gchar *json, const guint entries,
+			  struct ShipBatch *batch)
+{
+	struct Ship ship;
+
+	for (guint i = 0; i < entries; ++i) {
+		gchar *name = json_read_entry_string("name", json, i);
+		gchar *comment = json_read_entry_string("comment", json, i);
+		gchar *path = json_read_entry_string("path", json, i);
+		gchar *srccall = json_read_entry_string("srccall", json, i);
+		gchar *dstcall = json_read_entry_string("dstcall", json, i);
+
+		ship.imo = json_read_entry_int("imo", json, i);
+		ship.mmsi = json_read_entry_int("mmsi", json, i);
+		ship.time = json_read_entry_int("time", json, i);
+		ship.lasttime = json_read_entry_int("lasttime", json, i);
+		ship.latitude = json_read_entry_double("lat", json, i);
+		ship.longitude = json_read_entry_double("lng", json, i);
+		ship.course = json_read_entry_float("course", json, i);
+		ship.speed = json_read_entry_float("speed", json, i);
+		ship.heading = json_read_entry_int("heading", json, i);
+		ship.length = json_read_entry_float("length", json, i);
+		ship.width = json_read_entry_float("width", json, i);
+		ship.draught = json_read_entry_float("draught", json, i);
+		ship.ref_front = json_read_entry_int("ref_front", json, i);
+		ship.ref_left = json_read_entry_int("ref_left", json, i);
+		ship.vessel_class = json_read_entry_int("vesselclass", json, i);
+		ship.navstat = json_read_entry_int("navstat", json, i);
+		ship.class = json_read_entry_char("class", json, i);
+		ship.type = json_read_entry_char("type", json, i);
+		ship.name = name;
+		ship.comment = comment;
+		ship.path = path;
+		ship.srccall = srccall;
+		ship.dstcall = dstcall;
+
+		ship_batch_append(batch, &ship);
+
+		g_free(name);
+		g_free(comment);
+		g_free(path);
+		g_free(srccall);
+		g_free(dstcall);
+	}
+}
+
+enum Decoder {
+	DECODER_ENTRY,
+	DECODER_SHIPS,
+};
+
+static const gchar *DECODERS[] = {
+	[DECODER_ENTRY] = "json_read_entry",
+	[DECODER_SHIPS] = "json_read_ships",
+};
+
+static gboolean _decode(const enum Decoder decoder, const gchar *json,
+			const guint entries, struct ShipBatch *batch,
+			gchar **error)
+{
+	ship_batch_clear(batch);
+
+	switch (decoder) {
+		case DECODER_ENTRY:
+			_read_entries(json, entries, batch);
+			return TRUE;
+		case DECODER_SHIPS:
+			return json_read_ships(json, batch, error);
+	}
+
+	return FALSE;
+}
+
+static gboolean _run(const enum Decoder decoder, const gchar *json,
+		     const guint entries, const gdouble min_time)
+{
+	struct ShipBatch *batch = ship_batch_new(entries);
+	struct BenchResult *result;
+	gchar *error = NULL;
+	gint64 iterations = 0;
+	gint64 allocations;
+	gdouble start;
+	gdouble seconds;
+	gsize bytes = strlen(json);
+
+	// Warm up, this also interns the callsigns
+	if (!_decode(decoder, json, entries, batch, &error)) {
+		g_printerr("%s: %s\n", DECODERS[decoder], error);
+		g_free(error);
+		ship_batch_free(batch);
+		return FALSE;
+	}
+
+	if (batch->len != entries) {
+		g_printerr("%s: decoded %u of %u entries\n", DECODERS[decoder],
+			   batch->len, entries);
+		ship_batch_free(batch);
+		return FALSE;
+	}
+
+	allocations = bench_allocations();
+	start = bench_now();
+	do {
+		_decode(decoder, json, entries, batch, &error);
+		++iterations;
+		seconds = bench_now() - start;
+	} while (seconds < min_time);
+	allocations = allocations < 0 ? -1 : bench_allocations() - allocations;
+
+	result = bench_result_new("bench_json", DECODERS[decoder]);
+	bench_result_int(result, "entries", entries);
+	bench_result_int(result, "bytes", bytes);
+	bench_result_int(result, "iterations", iterations);
+	bench_result_double(result, "seconds", seconds);
+	bench_result_double(result, "entries_per_second",
+			    entries * iterations / seconds);
+	bench_result_double(result, "bytes_per_second",
+			    bytes * iterations / seconds);
+	bench_result_double(result, "allocations_per_entry",
+			    allocations < 0 ? NAN :
+			    allocations / (gdouble)(entries * iterations));
+	bench_result_print(result);
+
+	ship_batch_free(batch);
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	gchar *sizes = NULL;
+	gchar **split;
+	gint seed = BENCH_SEED;
+	gdouble min_time = BENCH_JSON_MIN_TIME;
+	gboolean ret = TRUE;
+	GError *error = NULL;
+	GOptionContext *context;
+	GOptionEntry options[] = {
+		{"entries", 'n', 0, G_OPTION_ARG_STRING, &sizes,
+		 "Comma separated response sizes (default 10,100,1000,10000,100000)", "N,..."},
+		{"seed", 's', 0, G_OPTION_ARG_INT, &seed,
+		 "Seed of the generated responses", "N"},
+		{"min-time", 'm', 0, G_OPTION_ARG_DOUBLE, &min_time,
+		 "Seconds to repeat each case (default 0.5)", "SECONDS"},
+		{NULL}
+	};
+
+	bench_init();
+
+	context = g_option_context_new("- benchmark decoding of API responses");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	split = g_strsplit(sizes ? sizes : "10,100,1000,10000,100000", ",", -1);
+	for (guint i = 0; ret && split[i]; ++i) {
+		guint entries = (guint)g_ascii_strtoull(split[i], NULL, 10);
+		gchar *json;
+
+		if (entries == 0) {
+			g_printerr("Invalid number of entries: %s\n", split[i]);
+			ret = FALSE;
+			break;
+		}
+
+		json = bench_response(entries, (guint32)seed);
+		for (guint d = 0; ret && d < G_N_ELEMENTS(DECODERS); ++d) {
+			if (d == DECODER_ENTRY && entries > BENCH_JSON_ENTRY_MAX) {
+				continue;
+			}
+			ret = _run(d, json, entries, min_time);
+		}
+		g_free(json);
+	}
+
+	g_strfreev(split);
+	g_free(sizes);
+
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,454 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "fleet.h"
+#include "intern.h"
+
+#define EARTH_RADIUS 6371.0
+#define DEG_TO_RAD (G_PI / 180.0)
+
+struct Port {
+	const gchar *name;
+	gdouble latitude;
+	gdouble longitude;
+};
+
+static const struct Port PORTS[] = {
+	{"HELSINKI", 60.155, 24.957},
+	{"TURKU", 60.435, 22.220},
+	{"MARIEHAMN", 60.090, 19.930},
+	{"STOCKHOLM", 59.320, 18.100},
+	{"TALLINN", 59.450, 24.770},
+	{"RIGA", 57.000, 24.100},
+	{"KLAIPEDA", 55.700, 21.100},
+	{"GDANSK", 54.400, 18.660},
+	{"ROSTOCK", 54.150, 12.100},
+	{"TRAVEMUNDE", 53.960, 10.870},
+	{"KIEL", 54.330, 10.150},
+	{"COPENHAGEN", 55.700, 12.600},
+	{"GOTHENBURG", 57.700, 11.950},
+	{"OSLO", 59.900, 10.750},
+	{"HAMBURG", 53.540, 9.980},
+	{"ROTTERDAM", 51.950, 4.100},
+	{"ANTWERP", 51.270, 4.350},
+	{"ST.PETERSBURG", 59.880, 30.200},
+	{"KOTKA", 60.460, 26.950},
+	{"OULU", 65.000, 25.400},
+	{"VAASA", 63.080, 21.570},
+};
+
+struct VesselType {
+	gint vessel_class; /**< AIS ship type code */
+	guint weight; /**< Share of the fleet */
+	gfloat speed_min; /**< Cruising speed range in km/h */
+	gfloat speed_max;
+	gfloat length_min; /**< Length range in meters */
+	gfloat length_max;
+	gint dwell_min; /**< Hours at port */
+	gint dwell_max;
+};
+
+static const struct VesselType TYPES[] = {
+	{70, 40, 22.0f, 30.0f, 80.0f, 300.0f, 6, 48},  // Cargo
+	{80, 20, 20.0f, 27.0f, 100.0f, 330.0f, 12, 72}, // Tanker
+	{60, 10, 33.0f, 44.0f, 120.0f, 220.0f, 1, 4},   // Passenger
+	{52, 10, 15.0f, 22.0f, 20.0f, 40.0f, 1, 12},    // Tug
+	{30, 20, 11.0f, 19.0f, 15.0f, 60.0f, 4, 24},    // Fishing
+};
+
+static const gchar *PREFIXES[] = {
+	"BALTIC", "NORDIC", "AURORA", "STELLA", "POLAR",
+	"FINN", "VIKING", "SEA", "OCEAN", "CORONA",
+};
+
+static const gchar *SUFFIXES[] = {
+	"STAR", "WIND", "SPIRIT", "TRADER", "EXPRESS",
+	"BREEZE", "CARRIER", "LINK", "QUEEN", "PRIDE",
+};
+
+// SplitMix64, small enough to keep one state per vessel
+static guint64 _next(guint64 *state)
+{
+	guint64 z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+static guint64 _hash(const guint64 seed, const guint64 a, const guint64 b)
+{
+	guint64 state = seed ^ (a * 0xd1b54a32d192ed03ULL) ^
+			(b * 0xabc98388fb8fac03ULL);
+
+	return _next(&state);
+}
+
+static gdouble _uniform(const guint64 value, const gdouble min,
+			const gdouble max)
+{
+	return min + (max - min) * ((value >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static const struct VesselType *_type(const struct Fleet *fleet,
+				      const guint index)
+{
+	guint total = 0;
+	guint pick;
+
+	for (guint i = 0; i < G_N_ELEMENTS(TYPES); ++i) {
+		total += TYPES[i].weight;
+	}
+
+	pick = _hash(fleet->seed, index, 1) % total;
+	for (guint i = 0; i < G_N_ELEMENTS(TYPES); ++i) {
+		if (pick < TYPES[i].weight) {
+			return &TYPES[i];
+		}
+		pick -= TYPES[i].weight;
+	}
+
+	return &TYPES[0];
+}
+
+static gint64 _dwell(struct FleetVessel *vessel,
+		     const struct VesselType *type)
+{
+	return (gint64)_uniform(_next(&vessel->rand), type->dwell_min * 3600.0,
+				type->dwell_max * 3600.0);
+}
+
+static void _to_vector(const gdouble latitude, const gdouble longitude,
+		       gdouble v[3])
+{
+	v[0] = cos(latitude * DEG_TO_RAD) * cos(longitude * DEG_TO_RAD);
+	v[1] = cos(latitude * DEG_TO_RAD) * sin(longitude * DEG_TO_RAD);
+	v[2] = sin(latitude * DEG_TO_RAD);
+}
+
+static gdouble _angle(const struct Port *from, const struct Port *to)
+{
+	gdouble a[3], b[3];
+	gdouble dot;
+
+	_to_vector(from->latitude, from->longitude, a);
+	_to_vector(to->latitude, to->longitude, b);
+	dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+
+	return acos(CLAMP(dot, -1.0, 1.0));
+}
+
+static gdouble _bearing(const gdouble lat1, const gdouble lng1,
+			const gdouble lat2, const gdouble lng2)
+{
+	gdouble dlng = (lng2 - lng1) * DEG_TO_RAD;
+	gdouble y = sin(dlng) * cos(lat2 * DEG_TO_RAD);
+	gdouble x = cos(lat1 * DEG_TO_RAD) * sin(lat2 * DEG_TO_RAD) -
+		    sin(lat1 * DEG_TO_RAD) * cos(lat2 * DEG_TO_RAD) * cos(dlng);
+
+	return fmod(atan2(y, x) / DEG_TO_RAD + 360.0, 360.0);
+}
+
+// Leg time is D / v plus one ramp, the ramps are shorter on short legs
+static gdouble _ramp(const gdouble distance, const gdouble cruise)
+{
+	return MIN((gdouble)FLEET_RAMP_TIME, distance / cruise * 3600.0);
+}
+
+static void _start_leg(struct Fleet *fleet, const guint index,
+		       struct FleetVessel *vessel)
+{
+	const struct VesselType *type = _type(fleet, index);
+	gdouble distance;
+	gdouble cruise;
+
+	vessel->from = vessel->to;
+	vessel->to = (vessel->from + 1 +
+		      _next(&vessel->rand) % (G_N_ELEMENTS(PORTS) - 1)) %
+		     G_N_ELEMENTS(PORTS);
+	vessel->depart = vessel->next;
+
+	cruise = _uniform(_next(&vessel->rand), type->speed_min, type->speed_max);
+	distance = _angle(&PORTS[vessel->from], &PORTS[vessel->to]) * EARTH_RADIUS;
+
+	vessel->cruise = (gfloat)cruise;
+	vessel->arrive = vessel->depart + (gint64)(distance / cruise * 3600.0 +
+						   _ramp(distance, cruise));
+	vessel->next = vessel->arrive + _dwell(vessel, type);
+}
+
+struct Fleet *fleet_new(const guint len, const guint64 seed,
+			const gint64 start)
+{
+	struct Fleet *fleet = g_new0(struct Fleet, 1);
+
+	fleet->seed = seed;
+	fleet->len = len;
+	fleet->vessels = g_new0(struct FleetVessel, len);
+	g_mutex_init(&fleet->lock);
+
+	for (guint i = 0; i < len; ++i) {
+		struct FleetVessel *vessel = &fleet->vessels[i];
+
+		vessel->rand = _hash(seed, i, 0);
+		vessel->to = _next(&vessel->rand) % G_N_ELEMENTS(PORTS);
+		vessel->from = vessel->to;
+		vessel->depart = start;
+		vessel->arrive = start;
+		// Departures are spread over the first dwell
+		vessel->next = start + _dwell(vessel, _type(fleet, i));
+	}
+
+	return fleet;
+}
+
+void fleet_free(struct Fleet *fleet)
+{
+	g_mutex_clear(&fleet->lock);
+	g_free(fleet->vessels);
+	g_free(fleet);
+}
+
+gboolean fleet_lookup(const struct Fleet *fleet, const gint64 mmsi,
+		      guint *index)
+{
+	if (mmsi < FLEET_MMSI_BASE || mmsi >= FLEET_MMSI_BASE + (gint64)fleet->len) {
+		return FALSE;
+	}
+
+	*(index) = (guint)(mmsi - FLEET_MMSI_BASE);
+
+	return TRUE;
+}
+
+static void _info(const struct Fleet *fleet, const guint index,
+		  struct Ship *ship)
+{
+	const struct VesselType *type = _type(fleet, index);
+	guint64 h = _hash(fleet->seed, index, 2);
+	gchar buf[64];
+
+	ship->mmsi = FLEET_MMSI_BASE + index;
+	ship->imo = FLEET_IMO_BASE + index;
+
+	g_snprintf(buf, sizeof(buf), "%s %s %u",
+		   PREFIXES[h % G_N_ELEMENTS(PREFIXES)],
+		   SUFFIXES[(h >> 8) % G_N_ELEMENTS(SUFFIXES)], index);
+	ship->name = (gchar *)intern_string(buf);
+	g_snprintf(buf, sizeof(buf), "%" G_GINT64_FORMAT, ship->mmsi);
+	ship->srccall = (gchar *)intern_string(buf);
+	ship->dstcall = (gchar *)intern_string("ais");
+	ship->path = (gchar *)intern_string("TCPIP*,qAI,OH2MP");
+	ship->class = 'i';
+	ship->type = 'a';
+
+	ship->vessel_class = type->vessel_class;
+	ship->length = roundf((gfloat)_uniform(h, type->length_min, type->length_max));
+	ship->width = roundf(ship->length / 6.5f);
+	ship->draught = roundf(ship->length / 25.0f * 10.0f) / 10.0f;
+	ship->ref_front = (gint)(ship->length * 0.7f);
+	ship->ref_left = (gint)(ship->width / 2.0f);
+}
+
+static void _sailing(const struct Fleet *fleet, const guint index,
+		     const struct FleetVessel *vessel, const gint64 now,
+		     struct Ship *ship)
+{
+	const struct Port *from = &PORTS[vessel->from];
+	const struct Port *to = &PORTS[vessel->to];
+	gdouble angle = _angle(from, to);
+	gdouble distance = angle * EARTH_RADIUS;
+	gdouble cruise = vessel->cruise;
+	gdouble ramp = _ramp(distance, cruise);
+	gdouble duration = (gdouble)(vessel->arrive - vessel->depart);
+	gdouble t = (gdouble)(now - vessel->depart);
+	gdouble v = cruise / 3600.0;
+	gdouble covered;
+	gdouble speed;
+	gdouble f;
+	gdouble a[3], b[3], p[3];
+
+	// Trapezoid speed profile
+	if (t < ramp) {
+		covered = v * t * t / (2.0 * ramp);
+		speed = cruise * t / ramp;
+	} else if (t > duration - ramp) {
+		covered = distance - v * (duration - t) * (duration - t) / (2.0 * ramp);
+		speed = cruise * (duration - t) / ramp;
+	} else {
+		covered = v * (t - ramp / 2.0);
+		// Reported speed wanders a little around the cruising speed
+		speed = cruise * _uniform(_hash(fleet->seed, index, now + 2),
+					  0.97, 1.03);
+	}
+
+	f = distance > 0.0 ? CLAMP(covered / distance, 0.0, 1.0) : 1.0;
+
+	_to_vector(from->latitude, from->longitude, a);
+	_to_vector(to->latitude, to->longitude, b);
+	for (guint i = 0; i < 3; ++i) {
+		p[i] = angle > 0.0 ?
+		       (sin((1.0 - f) * angle) * a[i] + sin(f * angle) * b[i]) / sin(angle) :
+		       a[i];
+	}
+
+	ship->latitude = atan2(p[2], sqrt(p[0] * p[0] + p[1] * p[1])) / DEG_TO_RAD;
+	ship->longitude = atan2(p[1], p[0]) / DEG_TO_RAD;
+	ship->speed = roundf((gfloat)speed * 10.0f) / 10.0f;
+	ship->course = roundf((gfloat)_bearing(ship->latitude, ship->longitude,
+					       to->latitude, to->longitude) * 10.0f) / 10.0f;
+	ship->heading = ((gint)ship->course + 357 +
+			 (gint)(_hash(fleet->seed, index, now) % 7)) % 360;
+	ship->navstat = 0;
+	ship->time = now - (gint64)(_hash(fleet->seed, index, now + 1) % 60);
+	ship->lasttime = ship->time;
+}
+
+static void _moored(const struct Fleet *fleet, const guint index,
+		    const struct FleetVessel *vessel, const gint64 now,
+		    struct Ship *ship)
+{
+	const struct Port *port = &PORTS[vessel->to];
+	guint64 berth = _hash(fleet->seed, index, 3);
+
+	ship->latitude = port->latitude + _uniform(berth, -0.01, 0.01);
+	ship->longitude = port->longitude + _uniform(berth << 20, -0.02, 0.02);
+	ship->speed = 0.0f;
+	ship->course = 0.0f;
+	ship->heading = (gint)(berth % 360);
+	ship->navstat = 5;
+	ship->time = vessel->arrive;
+	ship->lasttime = MAX(vessel->arrive,
+			     now - (gint64)(_hash(fleet->seed, index, now) % 180));
+}
+
+void fleet_get(struct Fleet *fleet, const guint index, const gint64 now,
+	       struct Ship *ship)
+{
+	struct FleetVessel *vessel = &fleet->vessels[index];
+
+	while (now >= vessel->next) {
+		_start_leg(fleet, index, vessel);
+	}
+
+	_info(fleet, index, ship);
+	ship->comment = (gchar *)intern_string(PORTS[vessel->to].name);
+
+	if (now >= vessel->depart && now < vessel->arrive) {
+		_sailing(fleet, index, vessel, now, ship);
+	} else {
+		_moored(fleet, index, vessel, now, ship);
+	}
+}
+
+static void _append_member(GString *out, const gchar *key, const gchar *value)
+{
+	g_string_append_printf(out, "%s\"%s\":\"%s\"",
+			       out->str[out->len - 1] == '{' ? "" : ",",
+			       key, value);
+}
+
+static void _append_int(GString *out, const gchar *key, const gint64 value)
+{
+	gchar buf[32];
+
+	g_snprintf(buf, sizeof(buf), "%" G_GINT64_FORMAT, value);
+	_append_member(out, key, buf);
+}
+
+static void _append_double(GString *out, const gchar *key,
+			   const gdouble value, const gchar *format)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	_append_member(out, key, g_ascii_formatd(buf, sizeof(buf), format, value));
+}
+
+void fleet_append_entry(GString *out, const struct Ship *ship)
+{
+	gchar c[2] = {0, 0};
+
+	g_string_append_c(out, '{');
+	c[0] = ship->class;
+	_append_member(out, "class", c);
+	_append_member(out, "name", ship->name);
+	_append_int(out, "mmsi", ship->mmsi);
+	_append_int(out, "imo", ship->imo);
+	c[0] = ship->type;
+	_append_member(out, "type", c);
+	_append_int(out, "time", ship->time);
+	_append_int(out, "lasttime", ship->lasttime);
+	_append_double(out, "lat", ship->latitude, "%.5f");
+	_append_double(out, "lng", ship->longitude, "%.5f");
+	_append_double(out, "course", ship->course, "%.1f");
+	_append_double(out, "speed", ship->speed, "%.1f");
+	_append_int(out, "heading", ship->heading);
+	_append_int(out, "navstat", ship->navstat);
+	_append_int(out, "vesselclass", ship->vessel_class);
+	_append_double(out, "length", ship->length, "%.0f");
+	_append_double(out, "width", ship->width, "%.0f");
+	_append_double(out, "draught", ship->draught, "%.1f");
+	_append_int(out, "ref_front", ship->ref_front);
+	_append_int(out, "ref_left", ship->ref_left);
+	_append_member(out, "srccall", ship->srccall);
+	_append_member(out, "dstcall", ship->dstcall);
+	_append_member(out, "comment", ship->comment);
+	_append_member(out, "path", ship->path);
+	g_string_append_c(out, '}');
+}
+
+gchar *fleet_response(struct Fleet *fleet, const gchar *names,
+		      const gint64 now)
+{
+	gchar **split = g_strsplit(names, ",", -1);
+	GString *entries = g_string_new(NULL);
+	GString *out;
+	guint found = 0;
+
+	g_mutex_lock(&fleet->lock);
+	for (guint i = 0; split[i]; ++i) {
+		struct Ship ship;
+		guint index;
+
+		if (!fleet_lookup(fleet, g_ascii_strtoll(split[i], NULL, 10),
+				  &index))
+		{
+			continue;
+		}
+
+		fleet_get(fleet, index, now, &ship);
+		if (found++) {
+			g_string_append_c(entries, ',');
+		}
+		fleet_append_entry(entries, &ship);
+	}
+	g_mutex_unlock(&fleet->lock);
+	g_strfreev(split);
+
+	out = g_string_new(NULL);
+	g_string_append_printf(out, "{\"command\":\"get\",\"result\":\"ok\","
+			       "\"what\":\"loc\",\"found\":%u,\"entries\":[%s]}",
+			       found, entries->str);
+	g_string_free(entries, TRUE);
+
+	return g_string_free(out, FALSE);
+}
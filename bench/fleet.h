@@ -0,0 +1,158 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file fleet.h
+ * @brief Simulated fleet of vessels
+ * @details Vessels sail great-circle legs between ports and dwell at the
+ * port between legs. Speed ramps up after leaving and down before arriving,
+ * cruising speed depends on the vessel type. Every vessel has its own
+ * random number state derived from the seed, so the same seed and the same
+ * sequence of times give the same positions, whatever the order vessels are
+ * read in.
+ *
+ * Only the state of the current leg is stored, 40 bytes per vessel,
+ * so fleets of millions of vessels fit in memory. Vessel @c i has MMSI
+ * @ref FLEET_MMSI_BASE + @c i.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <glib.h>
+
+#include "ship_defines.h"
+
+/**
+ * MMSI of the first vessel
+ */
+#define FLEET_MMSI_BASE 230000000
+
+/**
+ * IMO of the first vessel
+ */
+#define FLEET_IMO_BASE 9000000
+
+/**
+ * Seconds to reach cruising speed and to stop
+ */
+#define FLEET_RAMP_TIME 1800
+
+/**
+ * @struct FleetVessel
+ * @brief State of one vessel
+ */
+struct FleetVessel {
+	guint64 rand; /**< Random number state */
+	gint64 depart; /**< Unix time when the current leg starts */
+	gint64 arrive; /**< Unix time when the current leg ends */
+	gint64 next; /**< Unix time when the vessel leaves the destination */
+	gfloat cruise; /**< Cruising speed of the leg in km/h */
+	guint16 from; /**< Port the leg starts from */
+	guint16 to; /**< Destination port */
+};
+
+/**
+ * @struct Fleet
+ * @brief Holds the vessels
+ */
+struct Fleet {
+	guint64 seed; /**< Seed of the fleet */
+	struct FleetVessel *vessels; /**< Vessels */
+	guint len; /**< Number of vessels */
+	GMutex lock; /**< Serializes fleet_response() */
+};
+
+/**
+ * @brief Create fleet
+ *
+ * Vessels start dwelling at random ports at @p start.
+ *
+ * @param[in] len Number of vessels
+ * @param[in] seed Seed of the random numbers
+ * @param[in] start Unix time where the simulation starts
+ * @return struct Fleet*
+ * @note Free with fleet_free()
+ */
+struct Fleet *fleet_new(const guint len, const guint64 seed,
+			const gint64 start);
+
+/**
+ * Free fleet
+ *
+ * @param[in] fleet Struct of type Fleet()
+ * @return Nothing
+ */
+void fleet_free(struct Fleet *fleet);
+
+/**
+ * @brief Find vessel by MMSI
+ *
+ * @param[in] fleet Struct of type Fleet()
+ * @param[in] mmsi MMSI
+ * @param[out] index Index of the vessel
+ * @return gboolean TRUE if the vessel is in the fleet
+ */
+gboolean fleet_lookup(const struct Fleet *fleet, const gint64 mmsi,
+		      guint *index);
+
+/**
+ * @brief Read vessel at time @p now
+ *
+ * Moves the vessel forward to @p now. Times given for one vessel must not
+ * decrease, and the same vessel must not be read by two threads at once.
+ *
+ * @param[in] fleet Struct of type Fleet()
+ * @param[in] index Index of the vessel
+ * @param[in] now Unix time
+ * @param[out] ship Struct of type Ship()
+ * @return Nothing
+ * @note Strings of @p ship are interned and must not be freed or modified.
+ */
+void fleet_get(struct Fleet *fleet, const guint index, const gint64 now,
+	       struct Ship *ship);
+
+/**
+ * @brief Append vessel as aprs.fi response entry
+ *
+ * Numbers are written as strings, like aprs.fi does.
+ *
+ * @param[in] out GString where to append the JSON object
+ * @param[in] ship Struct of type Ship()
+ * @return Nothing
+ */
+void fleet_append_entry(GString *out, const struct Ship *ship);
+
+/**
+ * @brief Build aprs.fi response for requested vessels
+ *
+ * Unknown MMSI's are left out of the response, like aprs.fi does.
+ *
+ * @param[in] fleet Struct of type Fleet()
+ * @param[in] names Comma separated MMSI's
+ * @param[in] now Unix time
+ * @return gchar* JSON
+ * @note Free with g_free()
+ */
+gchar *fleet_response(struct Fleet *fleet, const gchar *names,
+		      const gint64 now);
+
+#endif
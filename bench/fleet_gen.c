@@ -0,0 +1,303 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Generates a simulated fleet, see fleet.h.
+ *
+ *  fleet_gen ships   SQL which fills the Ships table
+ *  fleet_gen replay  aprs.fi responses over a period, one per line
+ *  fleet_gen serve   mock aprs.fi API answering with the current positions
+ */
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "fleet.h"
+#include "mock_api.h"
+
+#define FLEET_GEN_START 1514764800
+#define FLEET_GEN_ROWS 1000
+
+static gint SHIPS = 10000;
+static gint64 SEED = BENCH_SEED;
+static gint64 START = 0;
+static gint HOURS = 24;
+static gint INTERVAL = 600;
+static gint PER_RESPONSE = 20;
+static gchar *OUTPUT = NULL;
+static gboolean SCHEMA = FALSE;
+static gdouble SPEEDUP = 1.0;
+
+static GOptionEntry OPTIONS[] = {
+	{"ships", 'n', 0, G_OPTION_ARG_INT, &SHIPS,
+	 "Number of vessels (default 10000)", "N"},
+	{"seed", 's', 0, G_OPTION_ARG_INT64, &SEED,
+	 "Seed of the fleet", "N"},
+	{"start", 0, 0, G_OPTION_ARG_INT64, &START,
+	 "Unix time where the simulation starts (default 2018-01-01, now for serve)", "TIME"},
+	{"hours", 0, 0, G_OPTION_ARG_INT, &HOURS,
+	 "Hours of positions to replay (default 24)", "N"},
+	{"interval", 0, 0, G_OPTION_ARG_INT, &INTERVAL,
+	 "Seconds between polls of every vessel in replay (default 600)", "SECONDS"},
+	{"per-response", 0, 0, G_OPTION_ARG_INT, &PER_RESPONSE,
+	 "Vessels in one replayed response (default 20)", "N"},
+	{"output", 'o', 0, G_OPTION_ARG_FILENAME, &OUTPUT,
+	 "File to write, default stdout", "FILE"},
+	{"schema", 0, 0, G_OPTION_ARG_NONE, &SCHEMA,
+	 "Create the tables before filling Ships", NULL},
+	{"speedup", 0, 0, G_OPTION_ARG_DOUBLE, &SPEEDUP,
+	 "Simulated seconds per real second when serving (default 1)", "X"},
+	{NULL}
+};
+
+static void _append_sql(GString *out, const gchar *str)
+{
+	g_string_append_c(out, '\'');
+	for (const gchar *c = str; *c; ++c) {
+		if (*c == '\'' || *c == '\\') {
+			g_string_append_c(out, '\\');
+		}
+		g_string_append_c(out, *c);
+	}
+	g_string_append_c(out, '\'');
+}
+
+static void _append_float(GString *out, const gfloat value)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_string_append(out, ", ");
+	g_string_append(out, g_ascii_formatd(buf, sizeof(buf), "%.1f", value));
+}
+
+static gboolean _ships(struct Fleet *fleet, FILE *out)
+{
+	GString *query = g_string_new(NULL);
+
+	if (SCHEMA) {
+		for (guint i = 0; BENCH_SCHEMA[i]; ++i) {
+			fprintf(out, "%s;\n", BENCH_SCHEMA[i]);
+		}
+	}
+
+	fprintf(out, "START TRANSACTION;\n");
+	for (guint i = 0; i < fleet->len; ++i) {
+		struct Ship ship;
+
+		if (i % FLEET_GEN_ROWS == 0) {
+			g_string_assign(query, "INSERT INTO Ships (MMSI, IMO, ShipName, CommentText, ShipLength, Width, Draught, Course, Heading, ShipSpeed, RefFront, RefLeft, PathText, Iclass, TargetType, SrcCall, DstCall, VesselClass, NavStat) VALUES\n");
+		} else {
+			g_string_append(query, ",\n");
+		}
+
+		fleet_get(fleet, i, START, &ship);
+		g_string_append_printf(query, "(%" G_GINT64_FORMAT ", %" G_GINT64_FORMAT ", ",
+				       ship.mmsi, ship.imo);
+		_append_sql(query, ship.name);
+		g_string_append(query, ", ");
+		_append_sql(query, ship.comment);
+		_append_float(query, ship.length);
+		_append_float(query, ship.width);
+		_append_float(query, ship.draught);
+		_append_float(query, ship.course);
+		g_string_append_printf(query, ", %d", ship.heading);
+		_append_float(query, ship.speed);
+		g_string_append_printf(query, ", %d, %d, ", ship.ref_front, ship.ref_left);
+		_append_sql(query, ship.path);
+		g_string_append_printf(query, ", '%c', '%c', ", ship.class, ship.type);
+		_append_sql(query, ship.srccall);
+		g_string_append(query, ", ");
+		_append_sql(query, ship.dstcall);
+		g_string_append_printf(query, ", %d, %d)", ship.vessel_class,
+				       ship.navstat);
+
+		if (i % FLEET_GEN_ROWS == FLEET_GEN_ROWS - 1 || i == fleet->len - 1) {
+			fprintf(out, "%s;\n", query->str);
+		}
+	}
+	fprintf(out, "COMMIT;\n");
+
+	g_string_free(query, TRUE);
+
+	return !ferror(out);
+}
+
+static gboolean _replay(struct Fleet *fleet, FILE *out)
+{
+	GString *response = g_string_new(NULL);
+	gint64 end = START + (gint64)HOURS * 3600;
+	gdouble started = bench_now();
+	gint64 responses = 0;
+
+	// Every vessel is polled once per round, spread over the interval
+	for (gint64 round = START; round < end; round += INTERVAL) {
+		for (guint first = 0; first < fleet->len; first += PER_RESPONSE) {
+			guint last = MIN(first + (guint)PER_RESPONSE, fleet->len);
+			gint64 now = round + (gint64)first * INTERVAL / fleet->len;
+
+			g_string_printf(response, "{\"command\":\"get\",\"result\":\"ok\","
+					"\"what\":\"loc\",\"found\":%u,\"entries\":[",
+					last - first);
+			for (guint i = first; i < last; ++i) {
+				struct Ship ship;
+
+				fleet_get(fleet, i, now, &ship);
+				if (i > first) {
+					g_string_append_c(response, ',');
+				}
+				fleet_append_entry(response, &ship);
+			}
+			g_string_append(response, "]}\n");
+
+			if (fwrite(response->str, 1, response->len, out) != response->len) {
+				g_string_free(response, TRUE);
+				return FALSE;
+			}
+			++responses;
+		}
+	}
+
+	g_printerr("%" G_GINT64_FORMAT " responses in %.1f s\n", responses,
+		   bench_now() - started);
+	g_string_free(response, TRUE);
+
+	return TRUE;
+}
+
+struct Serve {
+	struct Fleet *fleet;
+	gint64 real_start;
+};
+
+static gchar *_respond(const gchar *query, gpointer data)
+{
+	struct Serve *serve = data;
+	gchar *names = mock_api_param(query, "name");
+	gchar *ret;
+	gint64 now;
+
+	now = START + (gint64)((g_get_real_time() - serve->real_start) /
+			       (gdouble)G_USEC_PER_SEC * SPEEDUP);
+	ret = fleet_response(serve->fleet, names ? names : "", now);
+	g_free(names);
+
+	return ret;
+}
+
+static gboolean _quit(gpointer data)
+{
+	g_main_loop_quit(data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean _serve(struct Fleet *fleet)
+{
+	struct Serve serve = {fleet, g_get_real_time()};
+	struct MockApi *mock;
+	GMainLoop *loop;
+	gchar *error = NULL;
+
+	mock = mock_api_new(_respond, &serve, &error);
+	if (!mock) {
+		g_printerr("%s\n", error);
+		g_free(error);
+		return FALSE;
+	}
+
+	// Printed for the api_url option
+	fprintf(stdout, "%s\n", mock_api_url(mock));
+	fflush(stdout);
+
+	loop = g_main_loop_new(NULL, FALSE);
+	g_unix_signal_add(SIGINT, _quit, loop);
+	g_unix_signal_add(SIGTERM, _quit, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+
+	g_printerr("%" G_GINT64_FORMAT " requests served\n",
+		   mock_api_requests(mock));
+	mock_api_free(mock);
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	struct Fleet *fleet;
+	GOptionContext *context;
+	GError *error = NULL;
+	const gchar *mode;
+	gboolean ret;
+	FILE *out = stdout;
+
+	context = g_option_context_new("ships|replay|serve - generate simulated fleet");
+	g_option_context_add_main_entries(context, OPTIONS, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	mode = argc > 1 ? argv[1] : "";
+	if (SHIPS <= 0 || INTERVAL <= 0 || PER_RESPONSE <= 0 || SPEEDUP <= 0.0) {
+		g_printerr("Numbers of ships, interval, per-response and speedup must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	if (START == 0) {
+		START = g_strcmp0(mode, "serve") == 0 ?
+			g_get_real_time() / G_USEC_PER_SEC : FLEET_GEN_START;
+	}
+
+	if (OUTPUT) {
+		out = fopen(OUTPUT, "w");
+		if (!out) {
+			g_printerr("%s: %s\n", OUTPUT, g_strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	fleet = fleet_new((guint)SHIPS, (guint64)SEED, START);
+
+	if (g_strcmp0(mode, "ships") == 0) {
+		ret = _ships(fleet, out);
+	} else if (g_strcmp0(mode, "replay") == 0) {
+		ret = _replay(fleet, out);
+	} else if (g_strcmp0(mode, "serve") == 0) {
+		ret = _serve(fleet);
+	} else {
+		g_printerr("Usage: %s [OPTION...] ships|replay|serve\n", argv[0]);
+		ret = FALSE;
+	}
+
+	if (out != stdout && fclose(out) != 0) {
+		ret = FALSE;
+	}
+	fleet_free(fleet);
+	g_free(OUTPUT);
+
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,233 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "mock_api.h"
+
+static void _respond(GOutputStream *out, const gchar *status,
+		     const gchar *body)
+{
+	gchar *header;
+
+	header = g_strdup_printf("HTTP/1.0 %s\r\n"
+				 "Content-Type: application/json\r\n"
+				 "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+				 "Connection: close\r\n"
+				 "\r\n", status, strlen(body));
+
+	if (g_output_stream_write_all(out, header, strlen(header), NULL, NULL,
+				      NULL))
+	{
+		g_output_stream_write_all(out, body, strlen(body), NULL, NULL,
+					  NULL);
+	}
+
+	g_free(header);
+}
+
+static gboolean _run(GThreadedSocketService *service,
+		     GSocketConnection *connection, GObject *source,
+		     gpointer data)
+{
+	struct MockApi *mock = data;
+	GDataInputStream *in;
+	GOutputStream *out;
+	gchar *line;
+	gchar **request;
+	gchar *body;
+
+	in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+	g_data_input_stream_set_newline_type(in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+	out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+	line = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+	request = g_strsplit(line ? line : "", " ", 3);
+	g_free(line);
+
+	while ((line = g_data_input_stream_read_line(in, NULL, NULL, NULL)) &&
+	       line[0] != '\0')
+	{
+		g_free(line);
+	}
+	g_free(line);
+
+	if (g_strv_length(request) < 2 || g_strcmp0(request[0], "GET") != 0) {
+		_respond(out, "405 Method Not Allowed",
+			 "{\"result\":\"fail\",\"description\":\"method\"}");
+	} else {
+		const gchar *query = strchr(request[1], '?');
+
+		body = mock->handler(query ? query + 1 : "", mock->data);
+		_respond(out, "200 OK", body);
+		g_free(body);
+		__atomic_fetch_add(&mock->requests, 1, __ATOMIC_RELAXED);
+	}
+
+	g_strfreev(request);
+	g_object_unref(in);
+
+	return TRUE;
+}
+
+static void _started(struct MockApi *mock)
+{
+	g_mutex_lock(&mock->lock);
+	mock->started = TRUE;
+	g_cond_signal(&mock->cond);
+	g_mutex_unlock(&mock->lock);
+}
+
+static gboolean _running(gpointer data)
+{
+	_started(data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer _serve(gpointer data)
+{
+	struct MockApi *mock = data;
+	GInetAddress *address;
+	GSocketAddress *socket_address;
+	GSocketAddress *effective = NULL;
+	GSource *source;
+	GError *error = NULL;
+	gboolean ret;
+
+	// Service attaches its source to the thread default context
+	g_main_context_push_thread_default(mock->context);
+
+	mock->service = g_threaded_socket_service_new(MOCK_API_THREADS);
+	address = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+	socket_address = g_inet_socket_address_new(address, 0);
+
+	ret = g_socket_listener_add_address(G_SOCKET_LISTENER(mock->service),
+					    socket_address,
+					    G_SOCKET_TYPE_STREAM,
+					    G_SOCKET_PROTOCOL_TCP,
+					    NULL, &effective, &error);
+	g_object_unref(socket_address);
+	g_object_unref(address);
+
+	if (!ret) {
+		mock->error = g_strconcat("Could not start mock API: ",
+					  error->message, NULL);
+		g_error_free(error);
+		g_main_context_pop_thread_default(mock->context);
+		_started(mock);
+		return NULL;
+	}
+
+	mock->url = g_strdup_printf("http://127.0.0.1:%u/api/get?",
+				    g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(effective)));
+	g_object_unref(effective);
+
+	g_signal_connect(mock->service, "run", G_CALLBACK(_run), mock);
+	g_socket_service_start(mock->service);
+
+	// Signaled from the loop so mock_api_free() can not quit it too early
+	source = g_idle_source_new();
+	g_source_set_callback(source, _running, mock, NULL);
+	g_source_attach(source, mock->context);
+	g_source_unref(source);
+
+	g_main_loop_run(mock->loop);
+
+	g_socket_service_stop(mock->service);
+	g_socket_listener_close(G_SOCKET_LISTENER(mock->service));
+	g_main_context_pop_thread_default(mock->context);
+
+	return NULL;
+}
+
+struct MockApi *mock_api_new(MockApiHandler handler, gpointer data,
+			     gchar **error)
+{
+	struct MockApi *mock = g_new0(struct MockApi, 1);
+
+	mock->handler = handler;
+	mock->data = data;
+	mock->context = g_main_context_new();
+	mock->loop = g_main_loop_new(mock->context, FALSE);
+	g_mutex_init(&mock->lock);
+	g_cond_init(&mock->cond);
+
+	mock->thread = g_thread_new("mock_api", _serve, mock);
+
+	g_mutex_lock(&mock->lock);
+	while (!mock->started) {
+		g_cond_wait(&mock->cond, &mock->lock);
+	}
+	g_mutex_unlock(&mock->lock);
+
+	if (mock->error) {
+		*(error) = mock->error;
+		mock->error = NULL;
+		g_thread_join(mock->thread);
+		mock->thread = NULL;
+		mock_api_free(mock);
+		return NULL;
+	}
+
+	return mock;
+}
+
+void mock_api_free(struct MockApi *mock)
+{
+	if (mock->thread) {
+		g_main_loop_quit(mock->loop);
+		g_thread_join(mock->thread);
+	}
+
+	if (mock->service) {
+		g_object_unref(mock->service);
+	}
+	g_main_loop_unref(mock->loop);
+	g_main_context_unref(mock->context);
+	g_mutex_clear(&mock->lock);
+	g_cond_clear(&mock->cond);
+	g_free(mock->url);
+	g_free(mock);
+}
+
+const gchar *mock_api_url(const struct MockApi *mock)
+{
+	return mock->url;
+}
+
+gint64 mock_api_requests(struct MockApi *mock)
+{
+	return __atomic_load_n(&mock->requests, __ATOMIC_RELAXED);
+}
+
+gchar *mock_api_param(const gchar *query, const gchar *name)
+{
+	gchar **params = g_strsplit(query, "&", -1);
+	gsize len = strlen(name);
+	gchar *ret = NULL;
+
+	for (guint i = 0; params[i] && !ret; ++i) {
+		if (strncmp(params[i], name, len) == 0 && params[i][len] == '=') {
+			ret = g_uri_unescape_string(params[i] + len + 1, NULL);
+		}
+	}
+	g_strfreev(params);
+
+	return ret;
+}
@@ -0,0 +1,116 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file mock_api.h
+ * @brief Local stand-in for the aprs.fi API
+ * @details Serves responses over HTTP on the loopback interface, so the
+ * API calls can be measured and tested without network. Point api.c at it
+ * with api_set_url() and mock_api_url().
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef MOCK_API_H
+#define MOCK_API_H
+
+#include <gio/gio.h>
+
+/**
+ * Number of threads serving requests
+ */
+#define MOCK_API_THREADS 4
+
+/**
+ * @brief Build response to a request
+ *
+ * Called from the server threads.
+ *
+ * @param[in] query Query string of the request, without the leading '?'
+ * @param[in] data User data given to mock_api_new()
+ * @return gchar* Response body, freed by the server
+ */
+typedef gchar *(*MockApiHandler)(const gchar *query, gpointer data);
+
+/**
+ * @struct MockApi
+ * @brief Holds state of the server
+ */
+struct MockApi {
+	GThread *thread; /**< Thread running the main loop of the server */
+	GMainContext *context; /**< Context of @p loop */
+	GMainLoop *loop; /**< Accepts connections */
+	GSocketService *service; /**< Listening service */
+	MockApiHandler handler; /**< Builds the responses */
+	gpointer data; /**< User data of @p handler */
+	gchar *url; /**< API URL of the server */
+	gchar *error; /**< Error message if the server failed to start */
+	GMutex lock; /**< Protects @p started */
+	GCond cond; /**< Signaled when the server has started */
+	gboolean started; /**< Server has started or failed */
+	gint64 requests; /**< Number of requests served */
+};
+
+/**
+ * @brief Start server on a free port
+ *
+ * @param[in] handler Function which builds the responses
+ * @param[in] data User data passed to @p handler
+ * @param[out] error Pointer to gchar where to store error message
+ * @return struct MockApi* or NULL on failure
+ * @note Stop with mock_api_free()
+ */
+struct MockApi *mock_api_new(MockApiHandler handler, gpointer data,
+			     gchar **error);
+
+/**
+ * Stop the server and free it
+ *
+ * @param[in] mock Struct of type MockApi()
+ * @return Nothing
+ */
+void mock_api_free(struct MockApi *mock);
+
+/**
+ * Get URL to pass to api_set_url()
+ *
+ * @param[in] mock Struct of type MockApi()
+ * @return const gchar* URL ending to '?'
+ */
+const gchar *mock_api_url(const struct MockApi *mock);
+
+/**
+ * Read number of requests served
+ *
+ * @param[in] mock Struct of type MockApi()
+ * @return gint64 Requests
+ */
+gint64 mock_api_requests(struct MockApi *mock);
+
+/**
+ * Get value of a query string parameter
+ *
+ * @param[in] query Query string passed to the handler
+ * @param[in] name Name of the parameter
+ * @return gchar* Unescaped value or NULL if the parameter is missing
+ * @note Free with g_free()
+ */
+gchar *mock_api_param(const gchar *query, const gchar *name);
+
+#endif
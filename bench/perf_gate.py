@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+
+# Runs a benchmark and compares its results to the baselines.
+#
+# Usage: perf_gate.py --baseline FILE --local FILE [--update] -- BENCHMARK [ARGS...]
+#
+# Every JSON line printed by the benchmark is matched to the baseline result
+# with the same benchmark, name and parameters. Metrics listed in the
+# "metrics" section of --baseline are compared with their tolerance and the
+# run fails if any of them got worse by more than that.
+#
+# Metrics marked "tracked" do not depend on the machine, like allocation and
+# round trip counts, and their results are in --baseline, which is committed.
+# The other metrics are compared to --local, which is kept in the build
+# directory. With --update, or PERF_UPDATE=1 in the environment, the results
+# of the benchmark replace its results in --local, and a copy of --baseline
+# with the new tracked results is written next to --local to be committed
+# by hand. --baseline itself is never written. A run in which some metric
+# has no baseline exits with the skip status instead of passing.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+# Exit status of a benchmark which can not run here, CTest skips the test
+SKIP = 77
+
+PARAMETERS = ("entries", "threads", "ships", "retention", "batch")
+
+
+def case_key(result):
+    params = tuple((p, result[p]) for p in PARAMETERS if p in result)
+    return (result["benchmark"], result["name"], params)
+
+
+def case_name(key):
+    benchmark, name, params = key
+    return " ".join([benchmark, name] + ["%s=%s" % p for p in params])
+
+
+def change(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) / abs(old)
+
+
+def merge(results, new):
+    benchmarks = {r["benchmark"] for r in new}
+    return [r for r in results if r["benchmark"] not in benchmarks] + new
+
+
+def only_tracked(result, tracked):
+    return {k: v for k, v in result.items()
+            if k in ("benchmark", "name") or k in PARAMETERS or k in tracked}
+
+
+def compare(metrics, tracked, local, results):
+    expected = {key: {case_key(r): r for r in rs}
+                for key, rs in (("tracked", tracked), ("local", local))}
+    regressions = 0
+    missing = 0
+
+    for result in results:
+        key = case_key(result)
+        print(case_name(key))
+
+        unchecked = False
+        for metric, rule in sorted(metrics.items()):
+            source = "tracked" if rule.get("tracked") else "local"
+            old = expected[source].get(key, {}).get(metric)
+            new = result.get(metric)
+            if new is None:
+                continue
+            if old is None:
+                print("    %-24s no baseline" % metric)
+                unchecked = True
+                continue
+
+            delta = change(old, new)
+            worse = -delta if rule["better"] == "higher" else delta
+            status = ""
+            if worse > rule["tolerance"]:
+                status = "REGRESSION"
+                regressions += 1
+            elif worse < -rule["tolerance"]:
+                status = "improved"
+
+            line = ("    %-24s %12.4g -> %-12.4g %+7.1f%% (tolerance %.0f%%) %s"
+                    % (metric, old, new, delta * 100,
+                       rule["tolerance"] * 100, status))
+            print(line.rstrip())
+
+        missing += unchecked
+
+    return regressions, missing
+
+
+def write(path, data):
+    with open(path, "w") as f:
+        json.dump(data, f, indent=2, sort_keys=True)
+        f.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--baseline", required=True)
+    parser.add_argument("--local", required=True)
+    parser.add_argument("--update", action="store_true")
+    parser.add_argument("command", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    command = args.command[1:] if args.command[:1] == ["--"] else args.command
+    if not command:
+        parser.error("benchmark command is missing")
+
+    run = subprocess.run(command, stdout=subprocess.PIPE,
+                         universal_newlines=True)
+    if run.returncode == SKIP:
+        return SKIP
+    if run.returncode != 0:
+        print("%s failed with status %d" % (command[0], run.returncode))
+        return 1
+
+    results = [json.loads(line) for line in run.stdout.splitlines()
+               if line.startswith("{")]
+    if not results:
+        print("%s printed no results" % command[0])
+        return 1
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    tracked = {m for m, r in baseline["metrics"].items() if r.get("tracked")}
+
+    local = {"results": []}
+    if os.path.exists(args.local):
+        with open(args.local) as f:
+            local = json.load(f)
+
+    if args.update or os.environ.get("PERF_UPDATE") == "1":
+        local["results"] = merge(local["results"], results)
+        write(args.local, local)
+        print("Updated %d results in %s" % (len(results), args.local))
+
+        # Tracked results are copied over the committed baseline by hand
+        update = os.path.join(os.path.dirname(os.path.abspath(args.local)),
+                              os.path.basename(args.baseline))
+        if update == os.path.abspath(args.baseline):
+            print("--local has to be outside the directory of --baseline")
+            return 1
+        if os.path.exists(update):
+            with open(update) as f:
+                baseline["results"] = json.load(f)["results"]
+        baseline["results"] = merge(baseline["results"],
+                                    [only_tracked(r, tracked) for r in results])
+        write(update, baseline)
+        print("Wrote tracked results to %s, copy it over %s to commit them"
+              % (update, args.baseline))
+        return 0
+
+    regressions, missing = compare(baseline["metrics"], baseline["results"],
+                                   local["results"], results)
+    if regressions:
+        print("%d metrics regressed" % regressions)
+        return 1
+
+    # A case without a baseline checks nothing, so the test is not a pass
+    if missing:
+        print("%d cases have metrics without a baseline, record them with "
+              "PERF_UPDATE=1" % missing)
+        return SKIP
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,503 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Long-horizon soak test on the simulated clock, see clock.h.
+ *
+ * Runs the API thread against a mock aprs.fi API serving a simulated fleet,
+ * see fleet.h, and a database named shipsoftware_soak_<pid> on a local
+ * MariaDB server, which is dropped at exit. Idle time between updates is
+ * skipped, so a week of operation takes minutes. A line is printed at the
+ * end of every simulated day with the resident set size and the latencies
+ * of the day, and a trend line at the end.
+ */
+
+#include <curl/curl.h>
+#include <math.h>
+#include <mysql.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "api_thread.h"
+#include "bench.h"
+#include "clock.h"
+#include "database.h"
+#include "fleet.h"
+#include "hdr.h"
+#include "intern.h"
+#include "metrics.h"
+#include "mock_api.h"
+
+#define SOAK_START 1514764800
+#define SOAK_DAY 86400
+// Milliseconds between checks of the simulated time
+#define SOAK_POLL_INTERVAL 50
+
+// Operations whose latency is reported every day
+static const enum MetricHistogram REPORTED[] = {
+	METRIC_HIST_API_REQUEST,
+	METRIC_HIST_DB_UPDATE_SHIP,
+	METRIC_HIST_DB_INSERT_GPS,
+	METRIC_HIST_RETENTION,
+	METRIC_HIST_CYCLE,
+};
+
+static gchar *HOST = NULL;
+static gchar *USER = NULL;
+static gchar *PASSWORD = NULL;
+static gint SHIPS = 1000;
+static gint DAYS = 7;
+static gint64 SEED = BENCH_SEED;
+static gint64 REQUESTS_PER_HOUR = 0;
+static gint64 WORKERS = 0;
+static gchar *LOG_FILE = NULL;
+static gdouble MAX_RSS_GROWTH = 0;
+
+static GOptionEntry OPTIONS[] = {
+	{"host", 'h', 0, G_OPTION_ARG_STRING, &HOST,
+	 "MariaDB host (default localhost)", "HOST"},
+	{"user", 'u', 0, G_OPTION_ARG_STRING, &USER,
+	 "User allowed to create databases (default login name)", "USER"},
+	{"password", 'p', 0, G_OPTION_ARG_STRING, &PASSWORD,
+	 "Password (default MYSQL_PWD environment variable)", "PASSWORD"},
+	{"ships", 'n', 0, G_OPTION_ARG_INT, &SHIPS,
+	 "Number of vessels (default 1000)", "N"},
+	{"days", 'd', 0, G_OPTION_ARG_INT, &DAYS,
+	 "Simulated days (default 7)", "N"},
+	{"seed", 's', 0, G_OPTION_ARG_INT64, &SEED,
+	 "Seed of the fleet", "N"},
+	{"requests-per-hour", 0, 0, G_OPTION_ARG_INT64, &REQUESTS_PER_HOUR,
+	 "API request budget (default automatic)", "N"},
+	{"workers", 0, 0, G_OPTION_ARG_INT64, &WORKERS,
+	 "Decode threads and database connections (default automatic)", "N"},
+	{"log", 'l', 0, G_OPTION_ARG_FILENAME, &LOG_FILE,
+	 "File the program log is appended to (default none)", "FILE"},
+	{"max-rss-growth", 0, 0, G_OPTION_ARG_DOUBLE, &MAX_RSS_GROWTH,
+	 "Fail if resident set grows more bytes per day (default no limit)", "BYTES"},
+	{NULL}
+};
+
+static struct Config CONFIG;
+static gchar *DATABASE = NULL;
+
+struct Day {
+	gint64 rss; /**< Resident set size at the end of the day */
+	guint interned; /**< Strings in the intern table at the end of the day */
+	gint64 p99[G_N_ELEMENTS(REPORTED)]; /**< Latencies in nanoseconds */
+};
+
+static gboolean _query(MYSQL *con, const gchar *query)
+{
+	if (mysql_query(con, query)) {
+		g_printerr("%s: %s\n", query, mysql_error(con));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static MYSQL *_connect(const gchar *database)
+{
+	MYSQL *con = mysql_init(NULL);
+
+	if (!mysql_real_connect(con, CONFIG.db_hostname, CONFIG.db_username,
+				CONFIG.db_password, database, 0, NULL, 0))
+	{
+		g_printerr("Connection failed: %s\n", mysql_error(con));
+		mysql_close(con);
+		return NULL;
+	}
+
+	return con;
+}
+
+// Database with the Ships rows of the fleet, the roster of the API thread
+static gboolean _create_schema(struct Fleet *fleet)
+{
+	MYSQL *con = _connect(NULL);
+	gchar *query;
+	gboolean ret;
+
+	if (!con) {
+		return FALSE;
+	}
+
+	query = g_strdup_printf("CREATE DATABASE %s", DATABASE);
+	ret = _query(con, query) && !mysql_select_db(con, DATABASE);
+	g_free(query);
+
+	for (guint i = 0; ret && BENCH_SCHEMA[i]; ++i) {
+		ret = _query(con, BENCH_SCHEMA[i]);
+	}
+
+	for (guint i = 0; ret && i < fleet->len; i += DB_BULK_ROWS) {
+		GString *insert = g_string_new("INSERT INTO Ships (MMSI, IMO) VALUES ");
+
+		for (guint j = i; j < MIN(i + DB_BULK_ROWS, fleet->len); ++j) {
+			struct Ship ship;
+
+			fleet_get(fleet, j, SOAK_START, &ship);
+			g_string_append_printf(insert, "%s(%" G_GINT64_FORMAT
+					       ", %" G_GINT64_FORMAT ")",
+					       j > i ? ", " : "", ship.mmsi,
+					       ship.imo);
+		}
+		ret = _query(con, insert->str);
+		g_string_free(insert, TRUE);
+	}
+
+	mysql_close(con);
+
+	return ret;
+}
+
+static void _drop_schema()
+{
+	MYSQL *con = _connect(NULL);
+	gchar *query;
+
+	if (!con) {
+		return;
+	}
+
+	query = g_strdup_printf("DROP DATABASE IF EXISTS %s", DATABASE);
+	_query(con, query);
+	g_free(query);
+
+	mysql_close(con);
+}
+
+static gchar *_respond(const gchar *query, gpointer data)
+{
+	gchar *names = mock_api_param(query, "name");
+	gchar *ret;
+
+	ret = fleet_response(data, names ? names : "",
+			     clock_real_time() / G_USEC_PER_SEC);
+	g_free(names);
+
+	return ret;
+}
+
+// Resident set size in bytes, -1 if unknown
+static gint64 _rss()
+{
+	FILE *statm = fopen("/proc/self/statm", "r");
+	long pages = -1;
+
+	if (!statm) {
+		return -1;
+	}
+	if (fscanf(statm, "%*s %ld", &pages) != 1) {
+		pages = -1;
+	}
+	fclose(statm);
+
+	return pages < 0 ? -1 : pages * sysconf(_SC_PAGESIZE);
+}
+
+static gpointer _run_api_thread(gpointer data)
+{
+	return api_thread(data);
+}
+
+static void _report_day(const guint day, const gdouble seconds,
+			gint64 *counters, struct HdrHistogram **latency,
+			struct Day *result)
+{
+	struct MetricsSnapshot snapshot;
+	struct HdrHistogram *total = hdr_new();
+	struct HdrHistogram *interval = hdr_new();
+	struct BenchResult *line;
+
+	metrics_read(&snapshot);
+	result->rss = _rss();
+	result->interned = intern_count();
+
+	line = bench_result_new("soak", "day");
+	bench_result_int(line, "day", day);
+	bench_result_int(line, "ships", SHIPS);
+	bench_result_double(line, "seconds", seconds);
+	bench_result_int(line, "requests",
+			 snapshot.counters[METRIC_FETCH_REQUESTS] -
+			 counters[METRIC_FETCH_REQUESTS]);
+	bench_result_int(line, "request_errors",
+			 snapshot.counters[METRIC_FETCH_ERRORS] -
+			 counters[METRIC_FETCH_ERRORS]);
+	bench_result_int(line, "ships_written",
+			 snapshot.counters[METRIC_SHIPS_WRITTEN] -
+			 counters[METRIC_SHIPS_WRITTEN]);
+	bench_result_int(line, "db_errors",
+			 snapshot.counters[METRIC_DB_ERRORS] -
+			 counters[METRIC_DB_ERRORS]);
+	bench_result_int(line, "pipeline_pending",
+			 snapshot.gauges[METRIC_PIPELINE_PENDING]);
+	bench_result_int(line, "rss_bytes", result->rss);
+	bench_result_int(line, "interned_strings", result->interned);
+
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		const gchar *name = metrics_histogram_name(REPORTED[i]);
+		gchar *key;
+
+		metrics_read_histogram(REPORTED[i], total);
+		*interval = *total;
+		hdr_subtract(interval, latency[i]);
+		*latency[i] = *total;
+
+		result->p99[i] = interval->total > 0 ?
+				 hdr_percentile(interval, 99) : -1;
+
+		key = g_strconcat(name, "_p50_seconds", NULL);
+		bench_result_double(line, key, interval->total > 0 ?
+				    hdr_percentile(interval, 50) / 1e9 : NAN);
+		g_free(key);
+		key = g_strconcat(name, "_p99_seconds", NULL);
+		bench_result_double(line, key, result->p99[i] < 0 ? NAN :
+				    result->p99[i] / 1e9);
+		g_free(key);
+	}
+
+	bench_result_print(line);
+	memcpy(counters, snapshot.counters, sizeof(snapshot.counters));
+
+	hdr_free(interval);
+	hdr_free(total);
+}
+
+// Least squares slope of the resident set size over the days
+static gdouble _rss_growth(const struct Day *days, const guint len)
+{
+	gdouble mean_x = 0, mean_y = 0, sxx = 0, sxy = 0;
+
+	for (guint i = 0; i < len; ++i) {
+		if (days[i].rss < 0) {
+			return NAN;
+		}
+		mean_x += i;
+		mean_y += days[i].rss;
+	}
+	mean_x /= len;
+	mean_y /= len;
+
+	for (guint i = 0; i < len; ++i) {
+		sxx += (i - mean_x) * (i - mean_x);
+		sxy += (i - mean_x) * (days[i].rss - mean_y);
+	}
+
+	return sxx > 0 ? sxy / sxx : NAN;
+}
+
+static gboolean _report_trend(const struct Day *days, const guint len,
+			      const gdouble seconds)
+{
+	struct BenchResult *line;
+	gdouble growth;
+
+	// The first day warms up caches and buffers
+	growth = len > 2 ? _rss_growth(days + 1, len - 1) : NAN;
+
+	line = bench_result_new("soak", "trend");
+	bench_result_int(line, "days", len);
+	bench_result_int(line, "ships", SHIPS);
+	bench_result_double(line, "seconds", seconds);
+	bench_result_int(line, "rss_first_bytes", len > 0 ? days[0].rss : -1);
+	bench_result_int(line, "rss_last_bytes", len > 0 ? days[len - 1].rss : -1);
+	bench_result_double(line, "rss_growth_bytes_per_day", growth);
+	bench_result_int(line, "interned_growth",
+			 len > 0 ? days[len - 1].interned - days[0].interned : 0);
+
+	// Ratio of the last day to the second, over 1 if latency grows
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		gchar *key = g_strconcat(metrics_histogram_name(REPORTED[i]),
+					 "_p99_change", NULL);
+
+		bench_result_double(line, key,
+				    len > 2 && days[1].p99[i] > 0 &&
+				    days[len - 1].p99[i] > 0 ?
+				    days[len - 1].p99[i] / (gdouble)days[1].p99[i] :
+				    NAN);
+		g_free(key);
+	}
+	bench_result_print(line);
+
+	if (MAX_RSS_GROWTH > 0 && isfinite(growth) && growth > MAX_RSS_GROWTH) {
+		g_printerr("Resident set grows %.0f bytes per day, limit is %.0f\n",
+			   growth, MAX_RSS_GROWTH);
+		return FALSE;
+	}
+
+	// Every vessel has been polled on the first day, a string interned
+	// after that comes from a field with no bound on its values
+	if (len > 1 && days[len - 1].interned > days[0].interned) {
+		g_printerr("Intern table grew from %u to %u strings after the "
+			   "first day\n", days[0].interned,
+			   days[len - 1].interned);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean _soak(struct Fleet *fleet)
+{
+	struct MockApi *mock;
+	struct HdrHistogram *latency[G_N_ELEMENTS(REPORTED)];
+	struct MetricsSnapshot snapshot;
+	struct Day *days;
+	GThread *thread;
+	gchar *error = NULL;
+	gboolean ret = TRUE;
+	gdouble started, day_started;
+	guint day = 0;
+
+	mock = mock_api_new(_respond, fleet, &error);
+	if (!mock) {
+		g_printerr("%s\n", error);
+		g_free(error);
+		return FALSE;
+	}
+	CONFIG.api_url = mock_api_url(mock);
+
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		latency[i] = hdr_new();
+		metrics_read_histogram(REPORTED[i], latency[i]);
+	}
+	metrics_read(&snapshot);
+	days = g_new0(struct Day, DAYS);
+
+	clock_simulate(SOAK_START);
+	g_atomic_int_set(&RUNNING, 1);
+	thread = g_thread_new("api_thread", _run_api_thread, &CONFIG);
+	started = day_started = bench_now();
+
+	while (day < (guint)DAYS) {
+		if (!g_atomic_int_get(&RUNNING)) {
+			g_printerr("API thread stopped on day %u\n", day + 1);
+			ret = FALSE;
+			break;
+		}
+
+		if (clock_real_time() / G_USEC_PER_SEC <
+		    SOAK_START + (gint64)(day + 1) * SOAK_DAY)
+		{
+			g_usleep(SOAK_POLL_INTERVAL * 1000);
+			continue;
+		}
+
+		_report_day(day + 1, bench_now() - day_started,
+			    snapshot.counters, latency, &days[day]);
+		day_started = bench_now();
+		day++;
+	}
+
+	api_thread_stop();
+	if (GPOINTER_TO_INT(g_thread_join(thread)) != 0) {
+		ret = FALSE;
+	}
+
+	if (!_report_trend(days, day, bench_now() - started)) {
+		ret = FALSE;
+	}
+
+	g_free(days);
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		hdr_free(latency[i]);
+	}
+	mock_api_free(mock);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct Fleet *fleet;
+	GOptionContext *context;
+	GError *error = NULL;
+	gchar *message = NULL;
+	MYSQL *con;
+	gboolean ret;
+
+	bench_init();
+
+	context = g_option_context_new("- run the API thread for days of simulated time");
+	g_option_context_add_main_entries(context, OPTIONS, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if (SHIPS <= 0 || DAYS <= 0) {
+		g_printerr("Ships and days must be at least 1\n");
+		return EXIT_FAILURE;
+	}
+
+	DATABASE = g_strdup_printf("shipsoftware_soak_%d", (gint)getpid());
+	CONFIG.db_name = DATABASE;
+	CONFIG.db_hostname = HOST ? HOST : "localhost";
+	CONFIG.db_username = USER ? USER : g_get_user_name();
+	CONFIG.db_password = PASSWORD ? PASSWORD : g_getenv("MYSQL_PWD");
+	CONFIG.api_key = "soak";
+	CONFIG.journal_dir = "";
+	CONFIG.api_requests_per_hour = REQUESTS_PER_HOUR;
+	CONFIG.workers = WORKERS;
+	CONFIG.log_file = "";
+	CONFIG.log_format = "text";
+
+	if (mysql_library_init(0, NULL, NULL)) {
+		return EXIT_FAILURE;
+	}
+
+	// Without a server there is nothing to run against
+	con = _connect(NULL);
+	if (!con) {
+		mysql_library_end();
+		return BENCH_EXIT_SKIP;
+	}
+	mysql_close(con);
+
+	fleet = fleet_new((guint)SHIPS, (guint64)SEED, SOAK_START);
+	if (!_create_schema(fleet)) {
+		_drop_schema();
+		fleet_free(fleet);
+		mysql_library_end();
+		return EXIT_FAILURE;
+	}
+
+	// Log lines would be mixed with the results on stdout
+	if (!log_start(LOG_FILE ? LOG_FILE : "/dev/null", FALSE, &message)) {
+		g_printerr("%s\n", message);
+		g_free(message);
+	}
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	ret = _soak(fleet);
+
+	curl_global_cleanup();
+	log_stop();
+	_drop_schema();
+	fleet_free(fleet);
+	mysql_library_end();
+	g_free(DATABASE);
+
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
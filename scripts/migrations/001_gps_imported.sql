@@ -0,0 +1,6 @@
+-- Marks the GPS rows written by --import, so that deleting old positions
+-- keeps the live ones and leaves the backfill alone. Apply once, before
+-- running --import; the backend works without it, but then old imported
+-- rows are deleted like the rest.
+
+ALTER TABLE GPS ADD COLUMN Imported TINYINT(1) NOT NULL DEFAULT 0;
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+
+# Converts a file written with --export to CSV.
+#
+# Usage: read_export.py FILE TABLE
+#
+# Rows of TABLE (GPS or Ships) are printed to stdout with a header line.
+# NULL is printed as \N and times as "YYYY-MM-DD HH:MM:SS" in UTC. The file
+# format is described in src/export.h.
+
+import csv
+import datetime
+import mmap
+import sys
+
+MAGIC = b"SSX1"
+
+INT = 1
+FIXED = 2
+TIME = 3
+STRING = 4
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.data[self.pos]
+            self.pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def signed(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def bytes(self, length):
+        value = self.data[self.pos:self.pos + length]
+        self.pos += length
+        return value
+
+    def string(self):
+        return self.bytes(self.varint()).decode("utf-8")
+
+
+def format_value(value, kind, scale):
+    if kind == FIXED:
+        return "%.*f" % (scale, value / 10 ** scale)
+    if kind == TIME:
+        time = datetime.datetime.fromtimestamp(value, datetime.timezone.utc)
+        return time.strftime("%Y-%m-%d %H:%M:%S")
+    return str(value)
+
+
+def read_column(reader, rows, kind, scale):
+    flags = reader.varint()
+    nulls = reader.bytes((rows + 7) // 8) if flags & 1 else None
+    data = Reader(reader.bytes(reader.varint()))
+
+    if kind == STRING:
+        dictionary = [data.string() for _ in range(data.varint())]
+
+    values = []
+    previous = 0
+    for row in range(rows):
+        if nulls and nulls[row // 8] & (1 << (row % 8)):
+            values.append("\\N")
+        elif kind == STRING:
+            values.append(dictionary[data.varint()])
+        else:
+            previous += data.signed()
+            values.append(format_value(previous, kind, scale))
+    return values
+
+
+def read_table(reader, writer, wanted):
+    name = reader.string()
+    if not name:
+        return False
+
+    columns = []
+    for _ in range(reader.varint()):
+        columns.append((reader.string(), reader.varint(), reader.varint()))
+    if name == wanted:
+        writer.writerow([column[0] for column in columns])
+
+    while True:
+        rows = reader.varint()
+        if rows == 0:
+            return True
+        values = [read_column(reader, rows, kind, scale)
+                  for _, kind, scale in columns]
+        if name == wanted:
+            writer.writerows(zip(*values))
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: read_export.py FILE TABLE", file=sys.stderr)
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    if data[:len(MAGIC)] != MAGIC:
+        print("%s: not an export file" % sys.argv[1], file=sys.stderr)
+        return 1
+
+    reader = Reader(data)
+    reader.pos = len(MAGIC)
+    writer = csv.writer(sys.stdout, lineterminator="\n")
+    while read_table(reader, writer, sys.argv[2]):
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -22,10 +22,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include "api.h"
+#include "metrics.h"
+#include "trace.h"
 #include "version.h"
 
 #define API_URL "https://api.aprs.fi/api/get?"
 
+static const gchar *URL = API_URL;
+
 /**
  * @brief Memory structure for cURL
  */
@@ -52,11 +56,18 @@ static size_t copy_to_memory(const void *contents, const size_t size,
 	return realsize;
 }
 
+void api_set_url(const gchar *url)
+{
+	URL = url ? url : API_URL;
+}
+
 gboolean api_get_loc(const gchar *name, const gchar *api_key, gchar **data, gchar **error)
 {
 	struct MemoryStruct chunk;
 	CURL *curl;
 	CURLcode res;
+	gint64 started;
+	gint64 traced;
 	const gchar *user_agent = g_strconcat("shipsoftware-backend-schoolproject/", ShipSoftwareBackend_VERSION, " (+https://github.com/Shipsoftware-schoolproject/shipsoftware-backend)", NULL);
 
 	chunk.memory = malloc(1);
@@ -69,14 +80,21 @@ gboolean api_get_loc(const gchar *name, const gchar *api_key, gchar **data, gcha
 		return FALSE;
 	}
 
-	curl_easy_setopt(curl, CURLOPT_URL, g_strconcat(API_URL, "name=", name,
+	curl_easy_setopt(curl, CURLOPT_URL, g_strconcat(URL, "name=", name,
 							"&what=loc&apikey=",
 							api_key, NULL));
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, copy_to_memory);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
 
+	traced = trace_begin();
+	started = g_get_monotonic_time();
 	res = curl_easy_perform(curl);
+	metrics_observe(METRIC_HIST_API_REQUEST,
+			g_get_monotonic_time() - started);
+	trace_end("api_get_loc", traced);
+	metrics_add(METRIC_FETCH_BYTES, (gint64)chunk.size);
+
 	if (res != CURLE_OK) {
 		*(error) = g_strconcat("API failed: " , curl_easy_strerror(res),
 				       NULL);
@@ -30,6 +30,8 @@
 #ifndef API_H
 #define API_H
 
+#include <glib.h>
+
 /**
  * @brief Get location data of the ships
  *
@@ -47,4 +49,17 @@
 gboolean api_get_loc(const gchar *name, const gchar *api_key, gchar **data,
 		     gchar **error);
 
+/**
+ * @brief Set address of the API
+ *
+ * Used to send requests to a local server, see @c api_url option of the
+ * configuration. Call before api_get_loc() is used.
+ *
+ * @param[in] url URL which the query string is appended to, NULL for the
+ * default @c API_URL
+ * @return Nothing
+ * @note @p url is not copied and has to stay valid.
+ */
+void api_set_url(const gchar *url);
+
 #endif
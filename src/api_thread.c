@@ -17,264 +17,474 @@
  * MA 02110-1301, USA.                                                      *
  ****************************************************************************/
 
-#include <unistd.h>
 #include <string.h>
 #include "api_thread.h"
 #ifdef WITH_GUI
 #include "main_window.h"
 #endif
 #include "api.h"
-#include "json.h"
-
-int RUNNING = 0;
-
-#ifdef WITH_GUI
-static gboolean _update_label(gpointer widget, gboolean color, const char *text)
-{
-	struct label_data *data = g_slice_alloc(sizeof(*data));
-	data->widget = widget;
-	data->color = color;
-	data->text = text;
-
-	g_idle_add(update_label, data);
-
-	return FALSE;
-}
-#endif
+#include "clock.h"
+#include "coalesce.h"
+#include "journal.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "status.h"
+#include "trace.h"
+
+#define ROSTER_INTERVAL 7200
+#define BACKLOG_RETRY_INTERVAL 60
+
+// Operations whose latency is logged after every update cycle
+static const enum MetricHistogram REPORTED[] = {
+	METRIC_HIST_API_REQUEST,
+	METRIC_HIST_DECODE_ENTRY,
+	METRIC_HIST_DB_UPDATE_SHIP,
+	METRIC_HIST_DB_INSERT_GPS,
+	METRIC_HIST_RETENTION,
+};
+
+/**
+ * @brief State of the API thread
+ */
+struct Worker {
+	const struct Config *config; /**< Copy of the configuration */
+	gchar *roster; /**< Comma separated MMSI's of all ships */
+	gint64 roster_loaded; /**< Unix time when roster was last loaded */
+	gint64 backlog_retry; /**< Unix time of last backlog write attempt */
+	struct Coalesce *coalesce; /**< Updates which could not be written */
+	struct Journal *journal; /**< Journal or NULL if disabled */
+	struct Scheduler *scheduler; /**< Per-ship polling schedule */
+	struct Pipeline *pipeline; /**< Decode and persist stages */
+	struct Status status; /**< Last published status */
+	struct HdrHistogram *latency[G_N_ELEMENTS(REPORTED)]; /**< Histograms at the last report */
+	gdouble tokens; /**< API requests which can be made now */
+	gdouble rate; /**< API requests allowed per second */
+	gdouble burst; /**< Maximum value of @p tokens */
+	gboolean imported_checked; /**< Missing Imported column was reported */
+	gboolean terminate; /**< Thread should exit with an error */
+};
+
+gint RUNNING = 0;
+GMutex MUTEX;
+
+static gint RELOAD = 0;
+static GMutex WAKE_MUTEX;
+static GCond WAKE_COND;
+static gboolean WOKEN = FALSE;
 
 gchar *get_datetime()
 {
 	gchar *dt;
 	GDateTime *gdt;
 
-	gdt = g_date_time_new_now_local();
+	gdt = g_date_time_new_from_unix_local(clock_real_time() / G_USEC_PER_SEC);
 	dt = g_date_time_format(gdt, "%F %H:%M:%S");
 	g_date_time_unref(gdt);
 
 	return dt;
 }
 
-void log_message(gpointer message)
+static void _set_budget(struct Worker *worker)
 {
-#ifdef WITH_GUI
-	g_idle_add(add_log_row, message);
-#else
-	gchar *date_time;
-	date_time = get_datetime();
-	g_print("[%s]: %s\n", date_time, (char *)message);
-	g_free(message);
-	g_free(date_time);
-#endif
+	guint sweep;
+
+	sweep = (scheduler_size(worker->scheduler) + SCHEDULER_BATCH_SIZE - 1) /
+		SCHEDULER_BATCH_SIZE;
+	sweep = MAX(sweep, 1);
+
+	if (worker->config->api_requests_per_hour > 0) {
+		worker->rate = worker->config->api_requests_per_hour / 3600.0;
+	} else {
+		worker->rate = (gdouble)sweep / ROSTER_INTERVAL;
+	}
+	worker->burst = MAX(sweep, 1.0);
+
+	metrics_set(METRIC_SHIPS_TRACKED, scheduler_size(worker->scheduler));
+	metrics_set(METRIC_API_BUDGET, (gint64)(worker->rate * 3600.0 + 0.5));
 }
 
-void log_error(gpointer message)
+static void _refresh_roster(struct Worker *worker, const gint64 now)
 {
-#ifdef WITH_GUI
-	g_idle_add(add_log_row, message);
-#else
-	g_printerr("[%s]: %s\n", get_datetime(), (char *)message);
-	g_free(message);
-#endif
+	struct Database *db;
+	gchar *ships;
+	gchar *error;
+
+	db = g_slice_alloc(sizeof(*db));
+	ships = NULL;
+	error = NULL;
+	worker->roster_loaded = now;
+	worker->backlog_retry = now;
+
+	if (!db_init(db, worker->config, &error)) {
+		if (!worker->roster) {
+			worker->terminate = TRUE;
+			log_error(error);
+		} else {
+			log_error(g_strconcat(error, ", buffering updates", NULL));
+			g_free(error);
+		}
+	} else {
+		// Retention falls back to counting every row of a ship
+		if (!db->imported && !worker->imported_checked) {
+			log_message(g_strdup("GPS table has no Imported column, "
+					     "old imported positions are deleted "
+					     "too; apply scripts/migrations/"
+					     "001_gps_imported.sql"));
+		}
+		worker->imported_checked = TRUE;
+
+		// Write updates stored during an outage
+		pipeline_write_backlog(worker->pipeline, db);
+
+		// Get ships MMSI's
+		if (!db_get_ships(db, &ships, &error)) {
+			log_error(error);
+		} else {
+			g_free(worker->roster);
+			worker->roster = ships;
+			if (worker->journal) {
+				journal_save_roster(worker->journal, ships);
+			}
+			scheduler_set_roster(worker->scheduler, ships, now);
+			pipeline_set_fleet_size(worker->pipeline,
+						scheduler_size(worker->scheduler));
+			_set_budget(worker);
+		}
+	}
+
+	db_close_con(db);
+	g_slice_free1(sizeof(*db), db);
 }
 
-static gboolean api_check_result(const gchar *json)
+static void _retry_backlog(struct Worker *worker, const gint64 now)
 {
-	gboolean ret = FALSE;
-	gchar *result;
-
-	if (json_read_string("result", json, &result)) {
-		if (g_ascii_strcasecmp(result, "ok") != 0) {
-			gchar *description;
-			if (json_read_string("description", json, &description))
-			{
-				log_error(g_strconcat("API failed: ",
-						      description, NULL));
-			}
-		} else {
-			ret = TRUE;
+	struct Database *db;
+	gchar *error;
+
+	db = g_slice_alloc(sizeof(*db));
+	error = NULL;
+	worker->backlog_retry = now;
+
+	if (db_init(db, worker->config, &error)) {
+		pipeline_write_backlog(worker->pipeline, db);
+	} else {
+		g_free(error);
+	}
+
+	db_close_con(db);
+	g_slice_free1(sizeof(*db), db);
+}
+
+static guint _count_names(const gchar *names)
+{
+	guint count = 1;
+
+	for (; *names; ++names) {
+		if (*names == ',') {
+			count++;
 		}
+	}
+
+	return count;
+}
+
+static void _fetch_batch(struct Worker *worker, gchar *names,
+			 const gint64 now)
+{
+	gchar *error;
+	gchar *json;
+	gint64 started;
+
+	error = NULL;
+	json = NULL;
+	started = g_get_monotonic_time();
+
+	// Get data from API, decoding and writing is done by the pipeline
+	if (!api_get_loc(names, worker->config->api_key, &json, &error)) {
+		metrics_add(METRIC_FETCH_ERRORS, 1);
+		log_event(LOG_LEVEL_ERROR, "fetch", "api_failed", 0,
+			  g_get_monotonic_time() - started, "%s", error);
+		g_free(error);
+	}
+	metrics_add(METRIC_FETCH_REQUESTS, 1);
+	metrics_add(METRIC_FETCH_TIME, g_get_monotonic_time() - started);
+
+	if (!json) {
+		scheduler_finish_batch(worker->scheduler, names, FALSE, now);
+		g_free(names);
+		return;
+	}
+
+	pipeline_submit(worker->pipeline, json, names, now);
+}
+
+static void _append_duration(GString *line, const gint64 nanoseconds)
+{
+	if (nanoseconds < 1000000) {
+		g_string_append_printf(line, "%.1f us", nanoseconds / 1e3);
+	} else if (nanoseconds < 1000000000) {
+		g_string_append_printf(line, "%.1f ms", nanoseconds / 1e6);
 	} else {
-		log_error("API returned invalid json!");
+		g_string_append_printf(line, "%.2f s", nanoseconds / 1e9);
 	}
-	g_free(result);
+}
 
-	return ret;
+/*
+ * Log percentiles of what has finished since the last report. Persist
+ * workers may still be writing ships of the cycle, those are reported
+ * with the next one.
+ */
+static void _report_latency(struct Worker *worker)
+{
+	struct HdrHistogram *total = hdr_new();
+	struct HdrHistogram *interval = hdr_new();
+	GString *line = g_string_new("Latency p50/p90/p99/p99.9:");
+	static const gdouble percentiles[] = {50, 90, 99, 99.9};
+
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		metrics_read_histogram(REPORTED[i], total);
+		*interval = *total;
+		hdr_subtract(interval, worker->latency[i]);
+		*worker->latency[i] = *total;
+
+		if (interval->total == 0) {
+			continue;
+		}
+
+		g_string_append_printf(line, " %s",
+				       metrics_histogram_name(REPORTED[i]));
+		for (guint j = 0; j < G_N_ELEMENTS(percentiles); ++j) {
+			g_string_append(line, j == 0 ? " " : "/");
+			_append_duration(line, hdr_percentile(interval,
+							      percentiles[j]));
+		}
+		g_string_append_printf(line, " (%" G_GINT64_FORMAT "),",
+				       interval->total);
+	}
+
+	// Drop the last comma
+	if (line->str[line->len - 1] == ',') {
+		g_string_truncate(line, line->len - 1);
+		log_event(LOG_LEVEL_INFO, "cycle", "latency", 0, -1, "%s",
+			  line->str);
+	}
+
+	g_string_free(line, TRUE);
+	hdr_free(interval);
+	hdr_free(total);
+}
+
+static gint64 _next_wakeup(const struct Worker *worker, const gint64 now)
+{
+	gint64 next;
+
+	next = worker->roster_loaded + ROSTER_INTERVAL;
+
+	if (pipeline_has_backlog(worker->pipeline)) {
+		next = MIN(next, worker->backlog_retry + BACKLOG_RETRY_INTERVAL);
+	}
+
+	if (worker->tokens < 1.0 && worker->rate > 0) {
+		next = MIN(next, MAX(scheduler_next_due(worker->scheduler),
+				     now + (gint64)((1.0 - worker->tokens) /
+						    worker->rate) + 1));
+	} else {
+		next = MIN(next, scheduler_next_due(worker->scheduler));
+	}
+
+	return MAX(next, now + 1);
+}
+
+static void _sleep_until(const gint64 end_time)
+{
+	g_mutex_lock(&WAKE_MUTEX);
+	while (!WOKEN) {
+		if (!clock_wait_until(&WAKE_COND, &WAKE_MUTEX, end_time)) {
+			break;
+		}
+	}
+	WOKEN = FALSE;
+	g_mutex_unlock(&WAKE_MUTEX);
+}
+
+static void _wake()
+{
+	g_mutex_lock(&WAKE_MUTEX);
+	WOKEN = TRUE;
+	g_cond_signal(&WAKE_COND);
+	g_mutex_unlock(&WAKE_MUTEX);
+}
+
+void api_thread_stop()
+{
+	g_atomic_int_set(&RUNNING, 0);
+	_wake();
+}
+
+void api_thread_reload()
+{
+	g_atomic_int_set(&RELOAD, 1);
+	_wake();
 }
 
 gpointer api_thread(gpointer config)
 {
-	int sleep_time;
-	int slept;
-	int _running;
 	struct Config *_config;
-	gboolean terminate;
+	struct Worker worker;
+	gint64 refilled;
 
-	sleep_time = 7200;
-	slept = sleep_time;
 	g_mutex_lock(&MUTEX);
-	_running = RUNNING;
 	_config = g_slice_alloc(sizeof((struct Config *)config));
 	if (!_config) {
+		g_mutex_unlock(&MUTEX);
 		log_error(g_strdup("Failed to allocate memory for config!"));
-		g_thread_exit(GINT_TO_POINTER(1));
-		return NULL;
+		g_atomic_int_set(&RUNNING, 0);
+		return GINT_TO_POINTER(1);
 	}
 	_config = g_slice_dup(struct Config, config);
 	g_mutex_unlock(&MUTEX);
-	terminate = FALSE;
-
-#ifdef WITH_GUI
-	g_idle_add(set_button_text, "Stop");
-	_update_label(LABEL_RUNNING, TRUE, "Running");
-#endif
 
-	while (_running) {
-		gchar *error;
-
-		if (slept >= sleep_time) {
-			#ifdef WITH_GUI
-				_update_label(LABEL_RUNNING, TRUE, "Running (updating..)");
-			#endif
-			slept = 0;
-			struct Database *db;
-			gchar *ships;
-			gchar *json;
-			gboolean api_result;
-			gint64 entries;
-
-			error = NULL;
-			db = g_slice_alloc(sizeof(*db));
-			ships = NULL;
-			json = NULL;
-			api_result = FALSE;
-			entries = -1;
-
-			// Open connection
-			if (!db_init(db, _config, &error)) {
-				terminate = TRUE;
-				log_error(error);
-			} else {
-				// Get ships MMSI's
-				if (!db_get_ships(db, &ships, &error)) {
-					log_error(error);
-				}
-			}
+	g_mutex_lock(&WAKE_MUTEX);
+	WOKEN = FALSE;
+	g_mutex_unlock(&WAKE_MUTEX);
+	g_atomic_int_set(&RELOAD, 0);
+
+	memset(&worker, 0, sizeof(worker));
+	worker.config = _config;
+	worker.coalesce = coalesce_new(0);
+	worker.scheduler = scheduler_new();
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		worker.latency[i] = hdr_new();
+	}
+	refilled = clock_real_time() / G_USEC_PER_SEC;
+	api_set_url(_config->api_url[0] != '\0' ? _config->api_url : NULL);
 
-			// Get data from API
-			if (ships) {
-				if (!api_get_loc(ships, _config->api_key, &json,
-						 &error))
-				{
-				   log_error(error);
-				}
-			}
+	if (_config->journal_dir && _config->journal_dir[0] != '\0') {
+		gchar *error = NULL;
 
-			if (json) {
-				api_result = api_check_result(json);
+		worker.journal = journal_open(_config->journal_dir, &error);
+		if (!worker.journal) {
+			log_error(g_strconcat("Journal disabled, ", error, NULL));
+			g_free(error);
+		} else {
+			worker.roster = journal_load_roster(worker.journal);
+			if (worker.roster) {
+				scheduler_set_roster(worker.scheduler,
+						     worker.roster, refilled);
 			}
+		}
+	}
+	worker.pipeline = pipeline_new(_config, worker.scheduler, worker.journal,
+				       worker.coalesce);
+	pipeline_set_fleet_size(worker.pipeline,
+				scheduler_size(worker.scheduler));
+	_set_budget(&worker);
+	worker.tokens = worker.burst;
+
+	worker.status.state = STATUS_IDLE;
+	status_publish(&worker.status);
+
+	while (g_atomic_int_get(&RUNNING)) {
+		gint64 now;
+		gint64 next;
+		gint64 started;
+		gint64 traced;
+		gchar *names;
+		guint requests;
+		guint ships;
+
+		now = clock_real_time() / G_USEC_PER_SEC;
+
+		if (g_atomic_int_compare_and_exchange(&RELOAD, 1, 0) ||
+		    !worker.roster || now - worker.roster_loaded >= ROSTER_INTERVAL) {
+			_refresh_roster(&worker, now);
+		} else if (pipeline_has_backlog(worker.pipeline) &&
+			   now - worker.backlog_retry >= BACKLOG_RETRY_INTERVAL)
+		{
+			_retry_backlog(&worker, now);
+		}
 
-			if (api_result) {
-				if (!json_read_int("found", json, &entries)) {
-					log_error(g_strdup("API did not return entries field!"));
-				}
+		worker.tokens = MIN(worker.tokens + (now - refilled) * worker.rate,
+				    worker.burst);
+		refilled = now;
+
+		traced = trace_begin();
+		started = g_get_monotonic_time();
+		requests = 0;
+		ships = 0;
+
+		while (!worker.terminate && worker.tokens >= 1.0 &&
+		       g_atomic_int_get(&RUNNING) &&
+		       (names = scheduler_next_batch(worker.scheduler, now)) != NULL)
+		{
+			if (requests == 0) {
+				worker.status.state = STATUS_UPDATING;
+				status_publish(&worker.status);
 			}
 
-			for (gint64 i = 0; i < entries; ++i) {
-				struct Ship ship;
-				ship.imo = json_read_entry_int("imo", json, i);
-				ship.name = json_read_entry_string("name", json, i); ship.name = !ship.name ? "" : ship.name;
-				ship.mmsi = json_read_entry_int("mmsi", json, i);
-				ship.course = json_read_entry_float("course", json, i);
-				ship.speed = json_read_entry_float("speed", json, i);
-				ship.comment = json_read_entry_string("comment", json, i);
-				ship.heading = (gint16)json_read_entry_int("heading", json, i);
-				ship.length = json_read_entry_float("length", json, i);
-				ship.width = json_read_entry_float("width", json, i);
-				ship.draught = json_read_entry_float("draught", json, i);
-				ship.ref_front = (gint16)json_read_entry_int("ref_front", json, i);
-				ship.ref_left = (gint16)json_read_entry_int("ref_left", json, i);
-				ship.path = json_read_entry_string("path", json, i);
-				ship.class = json_read_entry_char("class", json, i);
-				ship.type = json_read_entry_char("type", json, i);
-				ship.srccall = json_read_entry_string("srccall", json, i);
-				ship.dstcall = json_read_entry_string("dstcall", json, i);
-				ship.vessel_class = (gint16)json_read_entry_int("vesselclass", json, i);
-				ship.navstat = (gint8)json_read_entry_int("navstat", json, i);
-
-				ship.time = json_read_entry_int("time", json, i);
-				ship.lasttime = json_read_entry_int("lasttime", json, i);
-				ship.latitude = json_read_entry_double("lat", json, i);
-				ship.longitude = json_read_entry_double("lng", json, i);
-
-				error = NULL;
-
-				if (!db_update_ship_info(db, &ship, &error)) {
-					log_error(g_strconcat(ship.name, ": UPDATE Ships failed, ", error, NULL));
-				}
-
-				if (!db_update_ship_gps(db, &ship, &error)) {
-					log_error(g_strconcat(ship.name, ": UPDATE GPS failed, ", error, NULL));
-				}
-
-				if (!db_clean_ship_gps(db, &ship.imo, &error)) {
-					log_error(g_strconcat(ship.name,
-							      ": DELETE of old GPS records failed, ",
-							      error,
-							      NULL));
-				}
-			}
+			requests++;
+			ships += _count_names(names);
+			_fetch_batch(&worker, names, now);
+			worker.tokens -= 1.0;
+		}
 
-#ifdef WITH_GUI
-			if (!terminate)
-				_update_label(LABEL_LAST_UPDATED, TRUE, g_date_time_format(g_date_time_new_now_local(), "%F %H:%M:%S"));
-#endif
+		if (requests > 0) {
+			worker.status.last_update = clock_real_time() / G_USEC_PER_SEC;
+			worker.status.cycle_requests = requests;
+			worker.status.cycle_ships = ships;
+			worker.status.cycle_duration = g_get_monotonic_time() - started;
+
+			metrics_add(METRIC_CYCLES, 1);
+			metrics_set(METRIC_LAST_CYCLE, worker.status.last_update);
+			metrics_observe(METRIC_HIST_CYCLE,
+					worker.status.cycle_duration);
+			trace_end("update_cycle", traced);
+			_report_latency(&worker);
+		}
 
-			if (ships)
-				g_free(ships);
+		if (worker.terminate) {
+			g_atomic_int_set(&RUNNING, 0);
+			break;
+		}
 
-			if (json) {
-				g_free(json);
-			}
+		now = clock_real_time() / G_USEC_PER_SEC;
+		next = _next_wakeup(&worker, now);
 
-			db_close_con(db);
-			g_slice_free1(sizeof(*db), db);
+		if (requests > 0 || worker.status.state != STATUS_IDLE ||
+		    worker.status.next_update != next)
+		{
+			worker.status.state = STATUS_IDLE;
+			worker.status.next_update = next;
+			status_publish(&worker.status);
 		}
 
-		if (terminate) {
-			_running = 0;
-			g_mutex_lock(&MUTEX);
-			RUNNING = 0;
-			g_mutex_unlock(&MUTEX);
-		} else {
-			g_mutex_lock(&MUTEX);
-			_running = RUNNING;
-			g_mutex_unlock(&MUTEX);
-		}
+		_sleep_until(clock_monotonic_time() +
+			     (next - now) * G_TIME_SPAN_SECOND);
+	}
 
-#ifdef WITH_GUI
-		gchar *sec_left;
-		sec_left = g_strdup_printf("%i", (sleep_time - slept));
-		_update_label(LABEL_RUNNING, TRUE,
-			      g_strconcat("Running (next update in ", sec_left,
-					  " seconds)", NULL));
-		g_free(sec_left);
-#endif
+	worker.status.state = STATUS_STOPPED;
+	worker.status.next_update = 0;
+	status_publish(&worker.status);
 
-		if (_running) {
-			sleep(1);
-			++slept;
-		}
+	pipeline_free(worker.pipeline);
+
+	if (coalesce_pending(worker.coalesce) > 0) {
+		log_error(g_strdup_printf("Buffered updates of %u ships were not written",
+					  coalesce_pending(worker.coalesce)));
 	}
+	coalesce_free(worker.coalesce);
+	scheduler_free(worker.scheduler);
+	for (guint i = 0; i < G_N_ELEMENTS(REPORTED); ++i) {
+		hdr_free(worker.latency[i]);
+	}
+	g_free(worker.roster);
 
-#ifdef WITH_GUI
-	g_idle_add(set_button_text, "Start");
-	_update_label(LABEL_RUNNING, FALSE, "Not running");
-	_update_label(LABEL_LAST_UPDATED, FALSE, NULL);
-#endif
+	if (worker.journal) {
+		journal_close(worker.journal);
+	}
 
 	g_slice_free1(sizeof(*_config), _config);
 
-	g_thread_exit(GINT_TO_POINTER(terminate ? 1 : 0));
-
-	return NULL;
+	return GINT_TO_POINTER(worker.terminate ? 1 : 0);
 }
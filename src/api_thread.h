@@ -33,58 +33,53 @@
 
 #include "config.h"
 #include "database.h"
+#include "log.h"
 
-#ifdef WITH_GUI
-/**
- * @see label_data
- */
-extern struct label_data data;
-#endif
-
-int RUNNING; /**< Holds the thread running state */
-GMutex MUTEX; /**< MUTEX */
+extern gint RUNNING; /**< Thread running state, use g_atomic_int_get() */
+extern GMutex MUTEX; /**< MUTEX */
 
 /**
  * @brief Get current local time
  *
- * Return current local time in pretty format
+ * Return current local time in pretty format, read from clock_real_time()
  *
  * @return ghcar
  */
 gchar *get_datetime();
 
 /**
- * @brief Wrapper to print log messages
+ * @brief Ask the thread to stop
  *
- * Prints log messages; if built with GTK support, messages are prepended
- * to @p GTK_LIST_BOX, otherwise they are printed to stdout.
+ * Clears @ref RUNNING and wakes the thread, which exits after the API
+ * request in progress, if any, has been handled.
  *
- * @param[in] message
  * @return Nothing
  */
-void log_message(gpointer message);
+void api_thread_stop();
 
 /**
- * @brief Wrapper to print log error messages
+ * @brief Ask the thread to reload ship roster
  *
- * Prints error log messages; if built with GTK support, messages are prepended
- * to @p GTK_LIST_BOX, otherwise they are printed to stderr.
+ * Wakes the thread and makes it load the ship roster from the database
+ * without waiting for the next scheduled reload.
  *
- * @param[in] message
  * @return Nothing
  */
-void log_error(gpointer message);
+void api_thread_reload();
 
 /**
  * @brief The thread function
  *
  * This is the function which should be threaded, it handles the getting data
- * from the API and inserting it to the database. The thread will run until the
- * the @p RUNNING_STATE is not "0".
+ * from the API and inserting it to the database. The thread will run until
+ * @ref RUNNING is set to 0 with api_thread_stop().
+ *
+ * Between API requests the thread sleeps on a condition variable until the
+ * next ship is due, the next roster reload or the next attempt to write
+ * buffered updates, whichever comes first.
  *
  * @param[in] config Struct of type config()
- * @return gpointer
- * @note Returns always NULL.
+ * @return gpointer 1 if the thread stopped because of an error, otherwise 0
  * @note A copy of @p config is created thus to reload config, thread needs
  * to be restarted.
  */
@@ -0,0 +1,96 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <time.h>
+#include "clock.h"
+
+// Serializes clock_simulate(), readers only use atomics
+static GMutex LOCK;
+static gint SIMULATED = FALSE;
+// Simulated real time minus monotonic time
+static gint64 OFFSET = 0;
+// Time skipped by the simulated waits
+static gint64 SKIPPED = 0;
+
+void clock_simulate(const gint64 start)
+{
+	g_mutex_lock(&LOCK);
+	__atomic_store_n(&SKIPPED, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&OFFSET, start * G_USEC_PER_SEC - g_get_monotonic_time(),
+			 __ATOMIC_RELAXED);
+	// Offsets are published before the flag
+	g_atomic_int_set(&SIMULATED, TRUE);
+	g_mutex_unlock(&LOCK);
+}
+
+gint64 clock_real_time()
+{
+	if (G_LIKELY(!g_atomic_int_get(&SIMULATED))) {
+		return g_get_real_time();
+	}
+
+	return g_get_monotonic_time() +
+	       __atomic_load_n(&SKIPPED, __ATOMIC_RELAXED) +
+	       __atomic_load_n(&OFFSET, __ATOMIC_RELAXED);
+}
+
+gint64 clock_monotonic_time()
+{
+	return g_get_monotonic_time() +
+	       __atomic_load_n(&SKIPPED, __ATOMIC_RELAXED);
+}
+
+gboolean clock_wait_until(GCond *cond, GMutex *mutex, const gint64 end_time)
+{
+	gint64 skipped;
+
+	if (G_LIKELY(!g_atomic_int_get(&SIMULATED))) {
+		return g_cond_wait_until(cond, mutex, end_time);
+	}
+
+	// Skip the rest of the wait, again if another thread skipped meanwhile
+	skipped = __atomic_load_n(&SKIPPED, __ATOMIC_RELAXED);
+	for (;;) {
+		gint64 now = g_get_monotonic_time() + skipped;
+
+		if (end_time <= now ||
+		    __atomic_compare_exchange_n(&SKIPPED, &skipped,
+						skipped + end_time - now, FALSE,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+		{
+			break;
+		}
+	}
+
+	return FALSE;
+}
+
+gint64 clock_thread_cpu_time()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+		return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+	}
+#endif
+
+	return g_get_monotonic_time();
+}
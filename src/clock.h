@@ -0,0 +1,91 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file clock.h
+ * @brief Time source of the API thread
+ * @details The API thread, the pipeline and the log read the time of day
+ * and schedule their waits through the clock, so a long run can be
+ * simulated in much less time. By default the clock is the system clock.
+ *
+ * The simulated clock advances at the speed of the system clock, but a wait
+ * for a timeout returns at once and moves the clock forward to the end of
+ * the wait, so time spent idle between updates takes no time. Durations of
+ * API requests and database operations are still measured with
+ * g_get_monotonic_time(), as the simulated clock may jump while they run.
+ *
+ * Only one thread may wait on the simulated clock. All functions are
+ * thread safe.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <glib.h>
+
+/**
+ * @brief Switch to the simulated clock
+ *
+ * @param[in] start Unix time the clock is set to
+ * @return Nothing
+ * @note Call before starting the API thread
+ */
+void clock_simulate(const gint64 start);
+
+/**
+ * @brief Current wall clock time
+ *
+ * @return gint64 Microseconds since the Unix epoch, like g_get_real_time()
+ */
+gint64 clock_real_time();
+
+/**
+ * @brief Current monotonic time
+ *
+ * @return gint64 Microseconds, like g_get_monotonic_time()
+ */
+gint64 clock_monotonic_time();
+
+/**
+ * @brief Wait on condition variable until the given time
+ *
+ * Same as g_cond_wait_until(), except that @p end_time is in
+ * clock_monotonic_time(). With the simulated clock the function does not
+ * wait, the clock is moved forward to @p end_time instead.
+ *
+ * @param[in] cond Condition variable to wait on
+ * @param[in] mutex Mutex locked by the caller
+ * @param[in] end_time Monotonic time to wait until
+ * @return gboolean FALSE if @p end_time has passed
+ */
+gboolean clock_wait_until(GCond *cond, GMutex *mutex, const gint64 end_time);
+
+/**
+ * @brief CPU time used by the calling thread
+ *
+ * Not affected by the simulated clock. Where the system does not provide
+ * CPU time of a thread, returns g_get_monotonic_time() instead.
+ *
+ * @return gint64 Microseconds
+ */
+gint64 clock_thread_cpu_time();
+
+#endif
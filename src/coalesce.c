@@ -0,0 +1,284 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "coalesce.h"
+#include "api_thread.h"
+#include "intern.h"
+
+static guint _hash(const gint64 mmsi, const guint capacity)
+{
+	guint64 h = (guint64)mmsi * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+
+	return (guint)(h >> 32) & (capacity - 1);
+}
+
+static struct CoalesceSlot *_lookup(struct CoalesceSlot *slots,
+				    const guint capacity, const gint64 mmsi)
+{
+	guint i = _hash(mmsi, capacity);
+
+	while (slots[i].mmsi != 0 && slots[i].mmsi != mmsi) {
+		i = (i + 1) & (capacity - 1);
+	}
+
+	return &slots[i];
+}
+
+static guint _capacity(const guint fleet_size)
+{
+	guint ships = MIN(fleet_size, COALESCE_MAX_SHIPS);
+	guint capacity = 16;
+
+	while (capacity < ships + ships / 3) {
+		capacity *= 2;
+	}
+
+	return capacity;
+}
+
+static void _clear_info(struct CoalesceSlot *slot)
+{
+	g_free(slot->info.name);
+	g_free(slot->info.comment);
+	g_free(slot->info.path);
+	slot->has_info = FALSE;
+}
+
+static void _allocate(struct Coalesce *coalesce, const guint capacity)
+{
+	g_free(coalesce->slots);
+	coalesce->slots = g_new0(struct CoalesceSlot, capacity);
+	coalesce->capacity = capacity;
+	coalesce->used = 0;
+}
+
+struct Coalesce *coalesce_new(guint fleet_size)
+{
+	struct Coalesce *coalesce = g_slice_new0(struct Coalesce);
+
+	coalesce->fleet_size = fleet_size;
+	_allocate(coalesce, _capacity(fleet_size));
+
+	return coalesce;
+}
+
+void coalesce_set_fleet_size(struct Coalesce *coalesce, guint fleet_size)
+{
+	coalesce->fleet_size = fleet_size;
+}
+
+void coalesce_free(struct Coalesce *coalesce)
+{
+	for (guint i = 0; i < coalesce->capacity; ++i) {
+		if (coalesce->slots[i].has_info) {
+			_clear_info(&coalesce->slots[i]);
+		}
+	}
+	g_free(coalesce->slots);
+	g_slice_free(struct Coalesce, coalesce);
+}
+
+void coalesce_put(struct Coalesce *coalesce, const struct Ship *ship)
+{
+	struct CoalesceSlot *slot;
+	struct ShipPosition *pos;
+
+	// Table is sized only while nothing is buffered, so slots never move
+	if (coalesce->pending == 0 &&
+	    (coalesce->capacity != _capacity(coalesce->fleet_size) ||
+	     (coalesce->used + 1) * 4 > coalesce->capacity * 3))
+	{
+		_allocate(coalesce, _capacity(coalesce->fleet_size));
+	}
+
+	slot = _lookup(coalesce->slots, coalesce->capacity, ship->mmsi);
+	if (slot->mmsi == 0) {
+		if ((coalesce->used + 1) * 4 > coalesce->capacity * 3) {
+			++coalesce->dropped;
+			return;
+		}
+		slot->mmsi = ship->mmsi;
+		++coalesce->used;
+	}
+
+	if (!slot->has_info && slot->count == 0) {
+		++coalesce->pending;
+	}
+
+	if (slot->has_info) {
+		_clear_info(slot);
+	}
+	slot->info = *ship;
+	slot->info.name = g_strdup(ship->name);
+	slot->info.comment = g_strdup(ship->comment);
+	slot->info.path = g_strdup(ship->path);
+	slot->info.srccall = (gchar *)intern_string(ship->srccall);
+	slot->info.dstcall = (gchar *)intern_string(ship->dstcall);
+	slot->has_info = TRUE;
+
+	pos = NULL;
+	if (slot->count > 0) {
+		guint newest = (slot->head + slot->count - 1) % COALESCE_TAIL_LENGTH;
+		if (slot->tail[newest].time == ship->time) {
+			pos = &slot->tail[newest];
+		}
+	}
+
+	if (!pos) {
+		if (slot->count == COALESCE_TAIL_LENGTH) {
+			slot->head = (slot->head + 1) % COALESCE_TAIL_LENGTH;
+			--slot->count;
+			++coalesce->dropped;
+		}
+		pos = &slot->tail[(slot->head + slot->count) % COALESCE_TAIL_LENGTH];
+		++slot->count;
+	}
+
+	pos->imo = ship->imo;
+	pos->time = ship->time;
+	pos->lasttime = ship->lasttime;
+	pos->latitude = ship->latitude;
+	pos->longitude = ship->longitude;
+}
+
+guint coalesce_pending(const struct Coalesce *coalesce)
+{
+	return coalesce->pending;
+}
+
+gboolean coalesce_flush(struct Coalesce *coalesce, const struct Database *db,
+			gchar **error)
+{
+	GArray *positions;
+	GArray *starts;
+	guint written;
+	gchar *_error;
+
+	positions = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+	starts = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	for (guint i = 0; i < coalesce->capacity; ++i) {
+		struct CoalesceSlot *slot = &coalesce->slots[i];
+
+		if (!slot->has_info) {
+			continue;
+		}
+
+		_error = NULL;
+		if (!db_update_ship_info(db, &slot->info, &_error)) {
+			if (!db_is_connected(db)) {
+				*(error) = _error;
+				g_array_free(positions, TRUE);
+				g_array_free(starts, TRUE);
+				return FALSE;
+			}
+			log_event(LOG_LEVEL_ERROR, "backlog", "update_ships",
+				  slot->info.mmsi, -1, "%s: UPDATE Ships failed, %s",
+				  slot->info.name, _error);
+			g_free(_error);
+		}
+
+		_clear_info(slot);
+	}
+
+	for (guint i = 0; i < coalesce->capacity; ++i) {
+		struct CoalesceSlot *slot = &coalesce->slots[i];
+
+		g_array_append_val(starts, positions->len);
+		for (guint j = 0; j < slot->count; ++j) {
+			guint k = (slot->head + j) % COALESCE_TAIL_LENGTH;
+			g_array_append_val(positions, slot->tail[k]);
+		}
+	}
+
+	// Positions after the rows which were written stay in the buffer and
+	// are tried again by the next flush
+	_error = NULL;
+	written = 0;
+	db_insert_ship_gps_bulk(db, (struct ShipPosition *)positions->data,
+				positions->len, &written, &_error);
+
+	// Server still answers, so a row was rejected; the rest goes one row
+	// at a time and the rejected rows are dropped
+	if (_error && db_is_connected(db)) {
+		g_free(_error);
+		_error = NULL;
+		for (; written < positions->len; ++written) {
+			struct ShipPosition *pos;
+
+			pos = &g_array_index(positions, struct ShipPosition,
+					     written);
+			if (db_insert_ship_gps_bulk(db, pos, 1, NULL, &_error)) {
+				continue;
+			}
+			if (!db_is_connected(db)) {
+				break;
+			}
+			log_event(LOG_LEVEL_ERROR, "backlog", "insert_gps", 0, -1,
+				  "IMO %" G_GINT64_FORMAT ": INSERT into GPS "
+				  "failed, position dropped, %s", pos->imo,
+				  _error);
+			++coalesce->dropped;
+			g_free(_error);
+			_error = NULL;
+		}
+	}
+
+	for (guint i = 0; i < coalesce->capacity; ++i) {
+		struct CoalesceSlot *slot = &coalesce->slots[i];
+		guint start = g_array_index(starts, guint, i);
+		guint consumed;
+		gint64 imo;
+		gchar *clean_error;
+
+		if (slot->count == 0) {
+			continue;
+		}
+
+		consumed = written > start ? MIN(written - start, slot->count) : 0;
+		imo = slot->tail[(slot->head + slot->count - 1) % COALESCE_TAIL_LENGTH].imo;
+		slot->head = (slot->head + consumed) % COALESCE_TAIL_LENGTH;
+		slot->count -= consumed;
+
+		if (consumed == 0 || slot->count > 0) {
+			continue;
+		}
+
+		--coalesce->pending;
+
+		clean_error = NULL;
+		if (!db_clean_ship_gps(db, &imo, &clean_error)) {
+			log_event(LOG_LEVEL_ERROR, "backlog", "clean_gps", 0, -1,
+				  "DELETE of old GPS records failed, %s",
+				  clean_error);
+			g_free(clean_error);
+		}
+	}
+
+	g_array_free(positions, TRUE);
+	g_array_free(starts, TRUE);
+
+	if (_error) {
+		*(error) = _error;
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,157 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file coalesce.h
+ * @brief Latest-value buffer for ship updates
+ * @details Holds ship updates while the database can not keep up. Buffer is
+ * keyed by MMSI and keeps only the latest ship information and a short tail of
+ * positions for each ship, so memory use depends on the fleet size and not on
+ * how long the database has been unavailable.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <glib.h>
+
+#include "database.h"
+#include "ship_defines.h"
+
+/**
+ * Number of positions kept per ship, older positions are dropped
+ */
+#define COALESCE_TAIL_LENGTH 16
+
+/**
+ * Most ships the buffer is sized for, updates of other ships are dropped
+ */
+#define COALESCE_MAX_SHIPS 65536
+
+/**
+ * @struct CoalesceSlot
+ * @brief One ship in the buffer
+ *
+ * Slot is kept for the MMSI even after it has been flushed, so the slots are
+ * reused on the next outage without rehashing. Slots are reset when the
+ * buffer is empty and the fleet size has changed or the table is full.
+ */
+struct CoalesceSlot {
+	gint64 mmsi; /**< Key, 0 marks unused slot */
+	gboolean has_info; /**< TRUE if @p info has not been written yet */
+	struct Ship info; /**< Latest ship information, callsigns are interned
+			    and the other strings owned while @p has_info */
+	struct ShipPosition tail[COALESCE_TAIL_LENGTH]; /**< Position ring */
+	guint head; /**< Index of the oldest position in @p tail */
+	guint count; /**< Number of positions in @p tail */
+};
+
+/**
+ * @struct Coalesce
+ * @brief Open-addressing hash map of CoalesceSlot()
+ */
+struct Coalesce {
+	struct CoalesceSlot *slots; /**< Slot array */
+	guint capacity; /**< Number of slots, always power of two */
+	guint fleet_size; /**< Number of ships the slots are sized for */
+	guint used; /**< Number of slots with a key */
+	guint pending; /**< Number of slots with unwritten data */
+	guint64 dropped; /**< Positions overwritten before they were written,
+			   which did not fit in the buffer or which the
+			   server rejected */
+};
+
+/**
+ * @brief Create new buffer
+ *
+ * Buffer is sized to hold @p fleet_size ships, but at most
+ * @ref COALESCE_MAX_SHIPS, and it does not grow. Updates of ships which do
+ * not fit are counted in @c dropped.
+ *
+ * @param[in] fleet_size Expected number of ships
+ * @return struct Coalesce*
+ * @note Free with coalesce_free()
+ */
+struct Coalesce *coalesce_new(guint fleet_size);
+
+/**
+ * @brief Set number of ships to size the buffer for
+ *
+ * Slots are reallocated by the next coalesce_put() which finds the buffer
+ * empty; buffered updates are never moved.
+ *
+ * @param[in] coalesce Struct of type Coalesce()
+ * @param[in] fleet_size Number of ships in the roster
+ * @return Nothing
+ */
+void coalesce_set_fleet_size(struct Coalesce *coalesce, guint fleet_size);
+
+/**
+ * Free buffer and all data it holds
+ *
+ * @param[in] coalesce Struct of type Coalesce()
+ * @return Nothing
+ */
+void coalesce_free(struct Coalesce *coalesce);
+
+/**
+ * @brief Store ship update into the buffer
+ *
+ * Replaces previous ship information of the same MMSI and appends the
+ * position to the ships tail. Position with the same @c time than the newest
+ * buffered position replaces it.
+ *
+ * @param[in] coalesce Struct of type Coalesce()
+ * @param[in] ship Struct of type Ship()
+ * @return Nothing
+ * @note Strings of @p ship are copied.
+ */
+void coalesce_put(struct Coalesce *coalesce, const struct Ship *ship);
+
+/**
+ * Number of ships waiting to be written
+ *
+ * @param[in] coalesce Struct of type Coalesce()
+ * @return guint
+ */
+guint coalesce_pending(const struct Coalesce *coalesce);
+
+/**
+ * @brief Write buffered updates to the database
+ *
+ * Writes ship information of every pending ship and all buffered positions
+ * with db_insert_ship_gps_bulk(), then removes old GPS records of the flushed
+ * ships. Ships which were written are released from the buffer.
+ *
+ * @param[in] coalesce Struct of type Coalesce()
+ * @param[in] db Struct of type Database()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE if everything was written, FALSE if the connection
+ * was lost; rest of the data stays in the buffer.
+ * @note Ship information or a position which fails while the connection is
+ * still up is logged and dropped, so a bad record can not block the buffer.
+ * When the bulk insert fails, the rest of the positions are inserted one at
+ * a time to find the bad ones.
+ */
+gboolean coalesce_flush(struct Coalesce *coalesce, const struct Database *db,
+			gchar **error);
+
+#endif
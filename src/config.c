@@ -33,6 +33,13 @@ gboolean load_config(struct Config *config, gchar **contents, gchar **error)
 	config->db_hostname = NULL;
 	config->api_key = NULL;
 	config->log_size = 20;
+	config->journal_dir = g_strdup("journal");
+	config->api_requests_per_hour = 0;
+	config->workers = 0;
+	config->log_file = g_strdup("");
+	config->log_format = g_strdup("text");
+	config->metrics_port = 0;
+	config->api_url = g_strdup("");
 
 	if (!g_file_get_contents("configuration.json", contents, NULL, &_error)) {
 		*(error) = g_strdup(_error->message);
@@ -52,6 +59,13 @@ gboolean parse_config(struct Config *config, const gchar *contents,
 	gchar *hostname;
 	gchar *api_key;
 	gint64 log_size;
+	gchar *journal_dir;
+	gint64 api_requests_per_hour;
+	gint64 workers;
+	gchar *log_file;
+	gchar *log_format;
+	gint64 metrics_port;
+	gchar *api_url;
 
 	ret = "";
 
@@ -94,6 +108,36 @@ gboolean parse_config(struct Config *config, const gchar *contents,
 		config->log_size = log_size;
 	}
 
+	if (json_read_string("journal_dir", contents, &journal_dir)) {
+		config->journal_dir = journal_dir;
+	}
+
+	if (json_read_int("api_requests_per_hour", contents,
+			  &api_requests_per_hour))
+	{
+		config->api_requests_per_hour = MAX(api_requests_per_hour, 0);
+	}
+
+	if (json_read_int("workers", contents, &workers)) {
+		config->workers = MAX(workers, 0);
+	}
+
+	if (json_read_string("log_file", contents, &log_file)) {
+		config->log_file = log_file;
+	}
+
+	if (json_read_string("log_format", contents, &log_format)) {
+		config->log_format = log_format;
+	}
+
+	if (json_read_int("metrics_port", contents, &metrics_port)) {
+		config->metrics_port = metrics_port;
+	}
+
+	if (json_read_string("api_url", contents, &api_url)) {
+		config->api_url = api_url;
+	}
+
 	if (ret[0] != '\0') {
 		*(error) = g_strdup(ret);
 		return FALSE;
@@ -126,6 +170,16 @@ gboolean validate_config(const struct Config *config, gchar **error)
 		ret = g_strconcat(ret, "API key is too long, should be 21 characters\n", NULL);
 	}
 
+	if (g_strcmp0(config->log_format, "text") != 0 &&
+	    g_strcmp0(config->log_format, "json") != 0)
+	{
+		ret = g_strconcat(ret, "Log format should be text or json\n", NULL);
+	}
+
+	if (config->metrics_port < 0 || config->metrics_port > G_MAXUINT16) {
+		ret = g_strconcat(ret, "Metrics port should be between 0 and 65535\n", NULL);
+	}
+
 	if (ret[0] != '\0') {
 		*(error) = g_strdup(ret);
 		return FALSE;
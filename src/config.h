@@ -43,6 +43,13 @@ struct Config {
 	const gchar *db_hostname; /**< Hostname of the database */
 	const gchar *api_key; /**< aprs.fi API key */
 	gint64 log_size; /**< Number of rows to keep in GUI listbox */
+	const gchar *journal_dir; /**< Directory of the write-ahead journal */
+	gint64 api_requests_per_hour; /**< API request budget, 0 for automatic */
+	gint64 workers; /**< Decode threads and database connections, 0 for automatic */
+	const gchar *log_file; /**< File log lines are appended to, empty for stdout */
+	const gchar *log_format; /**< Format of log lines, "text" or "json" */
+	gint64 metrics_port; /**< Port of the metrics endpoint, 0 to disable */
+	const gchar *api_url; /**< API address, empty for aprs.fi */
 };
 
 /**
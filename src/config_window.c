@@ -27,13 +27,20 @@ static gboolean trigger_save(struct new_config *new_config_data, gchar **error)
 
 	ret = FALSE;
 
-	struct Config *new_config = g_slice_alloc(sizeof(*new_config_data));
+	struct Config *new_config = g_slice_alloc(sizeof(*new_config));
 	new_config->db_name = gtk_entry_get_text(GTK_ENTRY(new_config_data->db_name));
 	new_config->db_username = gtk_entry_get_text(GTK_ENTRY(new_config_data->db_username));
 	new_config->db_password = gtk_entry_get_text(GTK_ENTRY(new_config_data->db_password));
 	new_config->db_hostname = gtk_entry_get_text(GTK_ENTRY(new_config_data->db_hostname));
 	new_config->api_key = gtk_entry_get_text(GTK_ENTRY(new_config_data->api_key));
 	new_config->log_size = g_ascii_strtoll(gtk_entry_get_text(GTK_ENTRY(new_config_data->log_size)), NULL, 10);
+	new_config->journal_dir = config->journal_dir;
+	new_config->api_requests_per_hour = config->api_requests_per_hour;
+	new_config->workers = config->workers;
+	new_config->log_file = config->log_file;
+	new_config->log_format = config->log_format;
+	new_config->metrics_port = config->metrics_port;
+	new_config->api_url = config->api_url;
 
 	if (validate_config(new_config, error)) {
 		if (save_config(new_config, error)) {
@@ -61,7 +68,7 @@ static void apply_config(struct new_config *config)
 		show_ok_dialog(config->window, "Error", error);
 	} else {
 		show_ok_dialog(config->window, "Success", "Configuration saved");
-		if (RUNNING == 1) {
+		if (g_atomic_int_get(&RUNNING) == 1) {
 			show_ok_dialog(config->window, "Warning", "Configuration will be applied after the backend is restarted.");
 		}
 	}
@@ -74,7 +81,7 @@ static void ok_clicked(struct new_config *config)
 	if (!trigger_save(config, &error)) {
 		show_ok_dialog(config->window, "Error", error);
 	} else {
-		if (RUNNING == 1) {
+		if (g_atomic_int_get(&RUNNING) == 1) {
 			show_ok_dialog(config->window, "Warning", "Configuration will be applied after the backend is restarted.");
 		}
 		gtk_dialog_response(GTK_DIALOG(config->window), GTK_RESPONSE_OK);
@@ -31,7 +31,7 @@
 #include <gtk/gtk.h>
 #include "config.h"
 
-extern int RUNNING;
+extern gint RUNNING;
 
 /**
  * @see Config()
@@ -0,0 +1,275 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "dashboard.h"
+#include "metrics.h"
+
+#define SPARKLINE_WIDTH 160
+#define SPARKLINE_HEIGHT 20
+
+enum DashboardRowId {
+	ROW_FETCH,
+	ROW_DECODE,
+	ROW_WRITE,
+	ROW_RETENTION,
+	ROW_SHIPS,
+	ROW_QUEUE,
+	ROW_API,
+	ROW_ERRORS,
+	N_ROWS
+};
+
+/**
+ * @brief One metric of the dashboard
+ */
+struct DashboardRow {
+	GtkWidget *value; /**< Label showing the latest value */
+	GtkWidget *sparkline; /**< Drawing area of the history */
+	gdouble history[DASHBOARD_HISTORY]; /**< Ring of samples, NAN if none */
+	guint newest; /**< Index of the latest sample */
+	guint len; /**< Number of samples */
+};
+
+static const gchar *NAMES[N_ROWS] = {
+	"Fetch",
+	"Decode",
+	"DB write",
+	"Retention",
+	"Ships written",
+	"Queue",
+	"API budget",
+	"DB errors",
+};
+
+static struct DashboardRow ROWS[N_ROWS];
+static struct MetricsSnapshot LAST;
+static gboolean HAS_LAST = FALSE;
+
+// Fetch totals of the last DASHBOARD_HISTORY samples for the API budget
+static gint64 REQUESTS[DASHBOARD_HISTORY];
+static guint REQUESTS_LEN = 0;
+static guint REQUESTS_NEWEST = 0;
+
+static gboolean _draw_sparkline(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+	struct DashboardRow *row = data;
+	guint width = gtk_widget_get_allocated_width(widget);
+	guint height = gtk_widget_get_allocated_height(widget);
+	gdouble max = 0;
+	gboolean drawing = FALSE;
+
+	for (guint i = 0; i < row->len; ++i) {
+		gdouble value = row->history[i];
+
+		if (!isnan(value)) {
+			max = MAX(max, value);
+		}
+	}
+
+	if (max <= 0) {
+		max = 1;
+	}
+
+	cairo_set_line_width(cr, 1.0);
+	cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+	cairo_set_source_rgb(cr, 0.0, 0.5, 0.0);
+
+	// Oldest sample on the left, latest at the right edge
+	for (guint i = 0; i < row->len; ++i) {
+		guint index = (row->newest + DASHBOARD_HISTORY - (row->len - 1 - i)) %
+			      DASHBOARD_HISTORY;
+		gdouble value = row->history[index];
+		gdouble x = width - 1 - (gdouble)(row->len - 1 - i) *
+			    (width - 1) / (DASHBOARD_HISTORY - 1);
+		gdouble y = height - 1 - value / max * (height - 2);
+
+		if (isnan(value)) {
+			drawing = FALSE;
+			continue;
+		}
+
+		if (drawing) {
+			cairo_line_to(cr, x, y);
+		} else {
+			cairo_move_to(cr, x, y);
+			drawing = TRUE;
+		}
+	}
+	cairo_stroke(cr);
+
+	return FALSE;
+}
+
+static void _push(const enum DashboardRowId id, const gdouble value,
+		  const gchar *text)
+{
+	struct DashboardRow *row = &ROWS[id];
+
+	row->newest = (row->newest + 1) % DASHBOARD_HISTORY;
+	row->history[row->newest] = value;
+	row->len = MIN(row->len + 1, DASHBOARD_HISTORY);
+
+	if (g_strcmp0(gtk_label_get_text(GTK_LABEL(row->value)), text) != 0) {
+		gtk_label_set_text(GTK_LABEL(row->value), text);
+	}
+
+	if (gtk_widget_get_mapped(row->sparkline)) {
+		gtk_widget_queue_draw(row->sparkline);
+	}
+}
+
+/*
+ * Milliseconds per operation between two snapshots, NAN if there were
+ * no operations
+ */
+static gdouble _latency(const struct MetricsSnapshot *now,
+			const enum MetricCounter count,
+			const enum MetricCounter time)
+{
+	gint64 operations = now->counters[count] - LAST.counters[count];
+
+	if (operations <= 0) {
+		return NAN;
+	}
+
+	return (now->counters[time] - LAST.counters[time]) / 1000.0 / operations;
+}
+
+static void _push_latency(const enum DashboardRowId id, const gdouble value)
+{
+	gchar text[32];
+
+	if (isnan(value)) {
+		g_strlcpy(text, "-", sizeof(text));
+	} else {
+		g_snprintf(text, sizeof(text), "%.1f ms", value);
+	}
+	_push(id, value, text);
+}
+
+static gdouble _requests_per_hour(const struct MetricsSnapshot *now)
+{
+	guint oldest;
+	gdouble seconds;
+
+	REQUESTS_NEWEST = (REQUESTS_NEWEST + 1) % DASHBOARD_HISTORY;
+	REQUESTS[REQUESTS_NEWEST] = now->counters[METRIC_FETCH_REQUESTS];
+	REQUESTS_LEN = MIN(REQUESTS_LEN + 1, DASHBOARD_HISTORY);
+
+	if (REQUESTS_LEN < 2) {
+		return 0;
+	}
+
+	oldest = (REQUESTS_NEWEST + DASHBOARD_HISTORY - (REQUESTS_LEN - 1)) %
+		 DASHBOARD_HISTORY;
+	seconds = (REQUESTS_LEN - 1) * DASHBOARD_INTERVAL / 1000.0;
+
+	return (REQUESTS[REQUESTS_NEWEST] - REQUESTS[oldest]) * 3600.0 / seconds;
+}
+
+static gboolean _sample(gpointer data)
+{
+	struct MetricsSnapshot now;
+	gdouble seconds;
+	gdouble value;
+	gchar text[64];
+
+	metrics_read(&now);
+
+	if (!HAS_LAST) {
+		LAST = now;
+		HAS_LAST = TRUE;
+		return G_SOURCE_CONTINUE;
+	}
+
+	seconds = (now.time - LAST.time) / 1e6;
+	if (seconds <= 0) {
+		return G_SOURCE_CONTINUE;
+	}
+
+	_push_latency(ROW_FETCH, _latency(&now, METRIC_FETCH_REQUESTS,
+					  METRIC_FETCH_TIME));
+	_push_latency(ROW_DECODE, _latency(&now, METRIC_DECODE_BATCHES,
+					   METRIC_DECODE_TIME));
+	_push_latency(ROW_WRITE, _latency(&now, METRIC_WRITE_BATCHES,
+					  METRIC_WRITE_TIME));
+	_push_latency(ROW_RETENTION, _latency(&now, METRIC_RETENTION_SHIPS,
+					      METRIC_RETENTION_TIME));
+
+	value = (now.counters[METRIC_SHIPS_WRITTEN] -
+		 LAST.counters[METRIC_SHIPS_WRITTEN]) / seconds;
+	g_snprintf(text, sizeof(text), "%.0f ships/s", value);
+	_push(ROW_SHIPS, value, text);
+
+	value = now.gauges[METRIC_PIPELINE_PENDING];
+	g_snprintf(text, sizeof(text), "%" G_GINT64_FORMAT,
+		   now.gauges[METRIC_PIPELINE_PENDING]);
+	_push(ROW_QUEUE, value, text);
+
+	value = _requests_per_hour(&now);
+	g_snprintf(text, sizeof(text), "%.0f of %" G_GINT64_FORMAT " requests/h",
+		   value, now.gauges[METRIC_API_BUDGET]);
+	_push(ROW_API, value, text);
+
+	value = (now.counters[METRIC_DB_ERRORS] -
+		 LAST.counters[METRIC_DB_ERRORS]) / seconds;
+	g_snprintf(text, sizeof(text), "%.1f errors/s", value);
+	_push(ROW_ERRORS, value, text);
+
+	LAST = now;
+
+	return G_SOURCE_CONTINUE;
+}
+
+GtkWidget *dashboard_new()
+{
+	GtkWidget *grid;
+
+	grid = gtk_grid_new();
+	gtk_grid_set_row_spacing(GTK_GRID(grid), 2);
+	gtk_grid_set_column_spacing(GTK_GRID(grid), 10);
+
+	for (guint i = 0; i < N_ROWS; ++i) {
+		struct DashboardRow *row = &ROWS[i];
+		GtkWidget *name;
+
+		memset(row, 0, sizeof(*row));
+
+		name = gtk_label_new(NAMES[i]);
+		gtk_label_set_xalign(GTK_LABEL(name), 0);
+		row->value = gtk_label_new("-");
+		gtk_label_set_xalign(GTK_LABEL(row->value), 1);
+		gtk_label_set_width_chars(GTK_LABEL(row->value), 22);
+		row->sparkline = gtk_drawing_area_new();
+		gtk_widget_set_size_request(row->sparkline, SPARKLINE_WIDTH,
+					    SPARKLINE_HEIGHT);
+		g_signal_connect(row->sparkline, "draw",
+				 G_CALLBACK(_draw_sparkline), row);
+
+		gtk_grid_attach(GTK_GRID(grid), name, 0, i, 1, 1);
+		gtk_grid_attach(GTK_GRID(grid), row->value, 1, i, 1, 1);
+		gtk_grid_attach(GTK_GRID(grid), row->sparkline, 2, i, 1, 1);
+	}
+
+	g_timeout_add(DASHBOARD_INTERVAL, _sample, NULL);
+
+	return grid;
+}
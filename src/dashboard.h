@@ -0,0 +1,57 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file dashboard.h
+ * @brief Pipeline dashboard of the main window
+ * @details Shows latency of the fetch, decode, database write and retention
+ * stages, written ships per second, pipeline queue depth, API budget use and
+ * database error rate from metrics.h, each with a sparkline of the last
+ * minute.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <gtk/gtk.h>
+
+/**
+ * Milliseconds between dashboard updates
+ */
+#define DASHBOARD_INTERVAL 500
+
+/**
+ * Number of samples shown in a sparkline
+ */
+#define DASHBOARD_HISTORY 120
+
+/**
+ * @brief Create the dashboard
+ *
+ * Metrics are sampled every @ref DASHBOARD_INTERVAL milliseconds for as
+ * long as the program runs.
+ *
+ * @return GtkWidget*
+ * @note Only one dashboard can be created
+ */
+GtkWidget *dashboard_new();
+
+#endif
@@ -21,11 +21,64 @@
 #include <mysql.h>
 #include <string.h>
 #include "database.h"
+#include "metrics.h"
+#include "trace.h"
+
+static int _execute(MYSQL_STMT *stmt, const enum MetricHistogram histogram,
+		    const gchar *span)
+{
+	gint64 traced = trace_begin();
+	gint64 started = g_get_monotonic_time();
+	int ret = mysql_stmt_execute(stmt);
+
+	metrics_observe(histogram, g_get_monotonic_time() - started);
+	trace_end(span, traced);
+
+	return ret;
+}
+
+static int _query(MYSQL *con, const gchar *query,
+		  const enum MetricHistogram histogram, const gchar *span)
+{
+	gint64 traced = trace_begin();
+	gint64 started = g_get_monotonic_time();
+	int ret = mysql_query(con, query);
+
+	metrics_observe(histogram, g_get_monotonic_time() - started);
+	trace_end(span, traced);
+
+	return ret;
+}
+
+static void _to_mysql_time(const time_t time, MYSQL_TIME *sql_time)
+{
+	struct tm unix_time;
+
+#ifdef __WIN32__
+	gmtime_s(&unix_time, &time);
+#else
+	gmtime_r(&time, &unix_time);
+#endif
+	memset(sql_time, 0, sizeof(*sql_time));
+	sql_time->year = 1900 + (guint)unix_time.tm_year;
+	sql_time->month = 1 + (guint)unix_time.tm_mon;
+	sql_time->day = (guint)unix_time.tm_mday;
+	sql_time->hour = (guint)unix_time.tm_hour;
+	sql_time->minute = (guint)unix_time.tm_min;
+	sql_time->second = (guint)unix_time.tm_sec;
+	sql_time->second_part = 0;
+	sql_time->neg = 0;
+}
 
 gboolean db_init(struct Database *db, const struct Config *config,
 		 gchar **error)
 {
+	gboolean ret = TRUE;
+	gint64 traced = trace_begin();
+
 	db->con = mysql_init(NULL);
+	db->discard = FALSE;
+	db->imported = FALSE;
 
 	if (mysql_real_connect(db->con, config->db_hostname,
 			       config->db_username, config->db_password,
@@ -33,18 +86,29 @@ gboolean db_init(struct Database *db, const struct Config *config,
 	{
 		*(error) = g_strconcat("Connection failed: ",
 				       mysql_error(db->con), NULL);
-		return FALSE;
+		ret = FALSE;
 	} else {
 		if (mysql_query(db->con, g_strconcat("USE ", config->db_name,
 						     NULL)))
 		{
 			*(error) = g_strconcat("Failed to select database: ",
 					       mysql_error(db->con), NULL);
-			return FALSE;
+			ret = FALSE;
+		} else if (!mysql_query(db->con, "SHOW COLUMNS FROM GPS LIKE "
+					"'Imported'"))
+		{
+			MYSQL_RES *result = mysql_store_result(db->con);
+
+			if (result) {
+				db->imported = mysql_num_rows(result) > 0;
+				mysql_free_result(result);
+			}
 		}
 	}
 
-	return TRUE;
+	trace_end("db_init", traced);
+
+	return ret;
 }
 
 void db_close_con(struct Database *db)
@@ -52,18 +116,22 @@ void db_close_con(struct Database *db)
 	mysql_close(db->con);
 }
 
+void db_thread_end()
+{
+	mysql_thread_end();
+}
+
 gboolean db_get_ships(const struct Database *db, gchar **ships, gchar **error)
 {
 	gboolean ret;
 	gchar *query;
 	MYSQL_RES *result;
-	gchar *_ships;
+	GString *_ships;
 
 	ret = FALSE;
 	query = "SELECT MMSI FROM Ships";
-	_ships = NULL;
 
-	if (mysql_query(db->con, query)) {
+	if (_query(db->con, query, METRIC_HIST_DB_GET_SHIPS, "db_get_ships")) {
 		*(error) = g_strconcat("query failed: ", mysql_error(db->con),
 				       NULL);
 	} else {
@@ -78,19 +146,16 @@ gboolean db_get_ships(const struct Database *db, gchar **ships, gchar **error)
 			if (num_rows == 0) {
 				*(error) = g_strdup("there is no ships in the database");
 			} else {
+				// Roster of a large fleet is built in one buffer
+				_ships = g_string_sized_new(num_rows * 10);
 				for (unsigned int i = 0; i < num_rows; ++i) {
 					MYSQL_ROW row = mysql_fetch_row(result);
-					if (_ships == NULL) {
-						_ships = row[0];
-					} else {
-						_ships = g_strconcat(_ships,
-								     ",",
-								     row[0],
-								     NULL);
+					if (i > 0) {
+						g_string_append_c(_ships, ',');
 					}
+					g_string_append(_ships, row[0]);
 				}
-				*(ships) = g_strdup(_ships);
-				g_free(_ships);
+				*(ships) = g_string_free(_ships, FALSE);
 				ret = TRUE;
 			}
 		}
@@ -111,91 +176,94 @@ gboolean db_update_ship_info(const struct Database *db, struct Ship *info,
 	ret = FALSE;
 	query = "UPDATE Ships SET IMO = ?, ShipName = ?, CommentText = ?, ShipLength = ?, Width = ?, Draught = ?, Course = ?, Heading = ?, ShipSpeed = ?, RefFront = ?, RefLeft = ?, PathText = ?, Iclass = ?, TargetType = ?, SrcCall = ?, DstCall = ?, VesselClass = ?, NavStat = ? WHERE MMSI = ?";
 
-	stmt = mysql_stmt_init(db->con);
-	if (!stmt) {
-		*(error) = g_strdup("failed to prepare query, out of memory");
-		return FALSE;
-	}
+	memset(bind, 0, sizeof(bind));
 
-	if (mysql_stmt_prepare(stmt, query, strlen(query))) {
-		*(error) = g_strconcat("query prepare failed, " ,
-				       mysql_stmt_error(stmt), NULL);
-	} else {
-		memset(bind, 0, sizeof(bind));
+	bind[0].buffer_type = MYSQL_TYPE_LONG;
+	bind[0].buffer = &info->imo;
 
-		bind[0].buffer_type = MYSQL_TYPE_LONG;
-		bind[0].buffer = &info->imo;
+	bind[1].buffer_type = MYSQL_TYPE_STRING;
+	bind[1].buffer = info->name;
+	bind[1].buffer_length = strlen(info->name);
+
+	bind[2].buffer_type = MYSQL_TYPE_STRING;
+	bind[2].buffer = info->comment;
+	bind[2].buffer_length = strlen(info->comment);
 
-		bind[1].buffer_type = MYSQL_TYPE_STRING;
-		bind[1].buffer = info->name;
-		bind[1].buffer_length = strlen(info->name);
+	bind[3].buffer_type = MYSQL_TYPE_FLOAT;
+	bind[3].buffer = &info->length;
 
-		bind[2].buffer_type = MYSQL_TYPE_STRING;
-		bind[2].buffer = info->comment;
-		bind[2].buffer_length = strlen(info->comment);
+	bind[4].buffer_type = MYSQL_TYPE_FLOAT;
+	bind[4].buffer = &info->width;
 
-		bind[3].buffer_type = MYSQL_TYPE_FLOAT;
-		bind[3].buffer = &info->length;
+	bind[5].buffer_type = MYSQL_TYPE_FLOAT;
+	bind[5].buffer = &info->draught;
 
-		bind[4].buffer_type = MYSQL_TYPE_FLOAT;
-		bind[4].buffer = &info->width;
+	bind[6].buffer_type = MYSQL_TYPE_FLOAT;
+	bind[6].buffer = &info->course;
 
-		bind[5].buffer_type = MYSQL_TYPE_FLOAT;
-		bind[5].buffer = &info->draught;
+	bind[7].buffer_type = MYSQL_TYPE_LONG;
+	bind[7].buffer = &info->heading;
 
-		bind[6].buffer_type = MYSQL_TYPE_FLOAT;
-		bind[6].buffer = &info->course;
+	bind[8].buffer_type = MYSQL_TYPE_FLOAT;
+	bind[8].buffer = &info->speed;
 
-		bind[7].buffer_type = MYSQL_TYPE_LONG;
-		bind[7].buffer = &info->heading;
+	bind[9].buffer_type = MYSQL_TYPE_LONG;
+	bind[9].buffer = &info->ref_front;
 
-		bind[8].buffer_type = MYSQL_TYPE_FLOAT;
-		bind[8].buffer = &info->speed;
+	bind[10].buffer_type = MYSQL_TYPE_LONG;
+	bind[10].buffer = &info->ref_left;
 
-		bind[9].buffer_type = MYSQL_TYPE_LONG;
-		bind[9].buffer = &info->ref_front;
+	bind[11].buffer_type = MYSQL_TYPE_STRING;
+	bind[11].buffer = info->path;
+	bind[11].buffer_length = strlen(info->path);
 
-		bind[10].buffer_type = MYSQL_TYPE_LONG;
-		bind[10].buffer = &info->ref_left;
+	bind[12].buffer_type = MYSQL_TYPE_STRING;
+	bind[12].buffer = &info->class;
+	bind[12].buffer_length = 1;
 
-		bind[11].buffer_type = MYSQL_TYPE_STRING;
-		bind[11].buffer = info->path;
-		bind[11].buffer_length = strlen(info->path);
+	bind[13].buffer_type = MYSQL_TYPE_STRING;
+	bind[13].buffer = &info->type;
+	bind[13].buffer_length = 1;
 
-		bind[12].buffer_type = MYSQL_TYPE_STRING;
-		bind[12].buffer = &info->class;
-		bind[12].buffer_length = 1;
+	bind[14].buffer_type = MYSQL_TYPE_STRING;
+	bind[14].buffer = info->srccall;
+	bind[14].buffer_length = strlen(info->srccall);
 
-		bind[13].buffer_type = MYSQL_TYPE_STRING;
-		bind[13].buffer = &info->type;
-		bind[13].buffer_length = 1;
+	bind[15].buffer_type = MYSQL_TYPE_STRING;
+	bind[15].buffer = info->dstcall;
+	bind[15].buffer_length = strlen(info->dstcall);
 
-		bind[14].buffer_type = MYSQL_TYPE_STRING;
-		bind[14].buffer = info->srccall;
-		bind[14].buffer_length = strlen(info->srccall);
+	bind[16].buffer_type = MYSQL_TYPE_LONG;
+	bind[16].buffer = &info->vessel_class;
 
-		bind[15].buffer_type = MYSQL_TYPE_STRING;
-		bind[15].buffer = info->dstcall;
-		bind[15].buffer_length = strlen(info->dstcall);
+	bind[17].buffer_type = MYSQL_TYPE_LONG;
+	bind[17].buffer = &info->navstat;
 
-		bind[16].buffer_type = MYSQL_TYPE_LONG;
-		bind[16].buffer = &info->vessel_class;
+	bind[18].buffer_type = MYSQL_TYPE_LONG;
+	bind[18].buffer = &info->mmsi;
 
-		bind[17].buffer_type = MYSQL_TYPE_LONG;
-		bind[17].buffer = &info->navstat;
+	// Null sink stops before the server, after the parameters are filled
+	if (db->discard) {
+		return TRUE;
+	}
 
-		bind[18].buffer_type = MYSQL_TYPE_LONG;
-		bind[18].buffer = &info->mmsi;
+	stmt = mysql_stmt_init(db->con);
+	if (!stmt) {
+		*(error) = g_strdup("failed to prepare query, out of memory");
+		return FALSE;
+	}
 
-		if (mysql_stmt_bind_param(stmt, bind)) {
-			*(error) = g_strdup_printf(mysql_stmt_error(stmt), NULL);
-		} else {
-			if (mysql_stmt_execute(stmt)) {
-				*(error) = g_strdup_printf(mysql_stmt_error(stmt));
-			} else {
-				ret = TRUE;
-			}
-		}
+	if (mysql_stmt_prepare(stmt, query, strlen(query))) {
+		*(error) = g_strconcat("query prepare failed, " ,
+				       mysql_stmt_error(stmt), NULL);
+	} else if (mysql_stmt_bind_param(stmt, bind)) {
+		*(error) = g_strdup_printf(mysql_stmt_error(stmt), NULL);
+	} else if (_execute(stmt, METRIC_HIST_DB_UPDATE_SHIP,
+			    "db_update_ship_info"))
+	{
+		*(error) = g_strdup_printf(mysql_stmt_error(stmt));
+	} else {
+		ret = TRUE;
 	}
 
 	mysql_stmt_close(stmt);
@@ -214,6 +282,11 @@ gboolean db_update_ship_gps(const struct Database *db, struct Ship *info,
 	ret = FALSE;
 	query = "INSERT INTO GPS (IMO, Lat, Lng, RealTime, LastTime) VALUES (?, ?, ?, ?, ?)";
 
+	// Null sink stops before the server
+	if (db->discard) {
+		return TRUE;
+	}
+
 	stmt = mysql_stmt_init(db->con);
 	if (!stmt) {
 		*(error) = g_strdup("failed to prepare query, out of memory");
@@ -224,38 +297,11 @@ gboolean db_update_ship_gps(const struct Database *db, struct Ship *info,
 		*(error) = g_strconcat("query prepare failed: " ,
 				       mysql_stmt_error(stmt), NULL);
 	} else {
-		struct tm unix_time;
-		struct tm unix_lasttime;
 		MYSQL_TIME sql_time;
 		MYSQL_TIME sql_lasttime;
 
-#ifdef __WIN32__
-		gmtime_s(&unix_time, &info->time);
-#else
-		gmtime_r(&info->time, &unix_time);
-#endif
-		sql_time.year = 1900 + (guint)unix_time.tm_year;
-		sql_time.month = 1 + (guint)unix_time.tm_mon;
-		sql_time.day = (guint)unix_time.tm_mday;
-		sql_time.hour = (guint)unix_time.tm_hour;
-		sql_time.minute = (guint)unix_time.tm_min;
-		sql_time.second = (guint)unix_time.tm_sec;
-		sql_time.second_part = 0;
-		sql_time.neg = 0;
-
-#ifdef __WIN32__
-		gmtime_s(&unix_lasttime, &info->lasttime);
-#else
-		gmtime_r(&info->lasttime, &unix_lasttime);
-#endif
-		sql_lasttime.year = 1900 + (guint)unix_lasttime.tm_year;
-		sql_lasttime.month = 1 + (guint)unix_lasttime.tm_mon;
-		sql_lasttime.day = (guint)unix_lasttime.tm_mday;
-		sql_lasttime.hour = (guint)unix_lasttime.tm_hour;
-		sql_lasttime.minute = (guint)unix_lasttime.tm_min;
-		sql_lasttime.second = (guint)unix_lasttime.tm_sec;
-		sql_lasttime.second_part = 0;
-		sql_lasttime.neg = 0;
+		_to_mysql_time(info->time, &sql_time);
+		_to_mysql_time(info->lasttime, &sql_lasttime);
 
 		memset(bind, 0, sizeof(bind));
 
@@ -277,7 +323,9 @@ gboolean db_update_ship_gps(const struct Database *db, struct Ship *info,
 		if (mysql_stmt_bind_param(stmt, bind)) {
 			*(error) = g_strdup_printf(mysql_stmt_error(stmt), NULL);
 		} else {
-			if (mysql_stmt_execute(stmt)) {
+			if (_execute(stmt, METRIC_HIST_DB_INSERT_GPS,
+				     "db_update_ship_gps"))
+			{
 				*(error) = g_strdup_printf(mysql_stmt_error(stmt), NULL);
 			} else {
 				ret = TRUE;
@@ -293,115 +341,349 @@ gboolean db_update_ship_gps(const struct Database *db, struct Ship *info,
 gboolean db_clean_ship_gps(const struct Database *db, const gint64 *imo,
 			   gchar **error)
 {
-	gboolean ret = FALSE;
+	gboolean ret = TRUE;
+	const gchar *filter;
 	gchar *query;
-	gint64 num_rows;
+
+	// Null sink stops before the server
+	if (db->discard) {
+		return TRUE;
+	}
+
+	// Derived table lets the subquery use LIMIT and read the deleted table,
+	// without the Imported column every row of the ship counts
+	filter = db->imported ? " AND Imported = 0" : "";
+	query = g_strdup_printf("DELETE FROM GPS WHERE IMO = %" G_GINT64_FORMAT
+				"%s AND ID NOT IN (SELECT ID FROM"
+				" (SELECT ID FROM GPS WHERE IMO = %" G_GINT64_FORMAT
+				"%s ORDER BY RealTime DESC, ID DESC"
+				" LIMIT %d) AS Newest)",
+				*imo, filter, *imo, filter, DB_GPS_KEEP);
+
+	if (_query(db->con, query, METRIC_HIST_DB_CLEAN_GPS,
+		   "db_clean_ship_gps"))
+	{
+		*(error) = g_strconcat("could not delete old GPS entries: ",
+				       mysql_error(db->con), NULL);
+		ret = FALSE;
+	}
+	g_free(query);
+
+	return ret;
+}
+
+static MYSQL_STMT *_prepare_gps_insert(const struct Database *db,
+				       const guint rows,
+				       const gboolean imported, gchar **error)
+{
 	MYSQL_STMT *stmt;
-	MYSQL_BIND result[1];
+	GString *query;
 
-	query = g_strdup_printf("SELECT COUNT(*) FROM GPS WHERE IMO = %" G_GINT64_FORMAT, *imo);
-	num_rows = 0;
+	if (imported) {
+		query = g_string_new("INSERT INTO GPS (IMO, Lat, Lng, RealTime, LastTime, Imported) VALUES ");
+	} else {
+		query = g_string_new("INSERT INTO GPS (IMO, Lat, Lng, RealTime, LastTime) VALUES ");
+	}
+	for (guint i = 0; i < rows; ++i) {
+		g_string_append(query, i > 0 ? ", " : "");
+		g_string_append(query, imported ? "(?, ?, ?, ?, ?, 1)" : "(?, ?, ?, ?, ?)");
+	}
 
 	stmt = mysql_stmt_init(db->con);
 	if (!stmt) {
 		*(error) = g_strdup("failed to prepare query, out of memory");
+	} else if (mysql_stmt_prepare(stmt, query->str, query->len)) {
+		*(error) = g_strconcat("query prepare failed: ",
+				       mysql_stmt_error(stmt), NULL);
+		mysql_stmt_close(stmt);
+		stmt = NULL;
+	}
+	g_string_free(query, TRUE);
+
+	return stmt;
+}
+
+static gboolean _insert_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 const guint count, const gboolean imported,
+				 guint *written, gchar **error)
+{
+	gboolean ret;
+	guint done;
+	MYSQL_STMT *stmt;
+	guint stmt_rows;
+	MYSQL_BIND bind[DB_BULK_ROWS * 5];
+	MYSQL_TIME times[DB_BULK_ROWS * 2];
+
+	ret = TRUE;
+	done = 0;
+	stmt = NULL;
+	stmt_rows = 0;
+
+	while (done < count) {
+		guint rows = MIN(count - done, DB_BULK_ROWS);
+
+		if (!db->discard && rows != stmt_rows) {
+			if (stmt) {
+				mysql_stmt_close(stmt);
+			}
+			stmt = _prepare_gps_insert(db, rows, imported, error);
+			if (!stmt) {
+				ret = FALSE;
+				break;
+			}
+			stmt_rows = rows;
+		}
+
+		memset(bind, 0, sizeof(bind[0]) * rows * 5);
+		for (guint i = 0; i < rows; ++i) {
+			const struct ShipPosition *pos = &positions[done + i];
+			MYSQL_BIND *row = &bind[i * 5];
+
+			_to_mysql_time(pos->time, &times[i * 2]);
+			_to_mysql_time(pos->lasttime, &times[i * 2 + 1]);
+
+			row[0].buffer_type = MYSQL_TYPE_LONGLONG;
+			row[0].buffer = (void *)&pos->imo;
+
+			row[1].buffer_type = MYSQL_TYPE_DOUBLE;
+			row[1].buffer = (void *)&pos->latitude;
+
+			row[2].buffer_type = MYSQL_TYPE_DOUBLE;
+			row[2].buffer = (void *)&pos->longitude;
+
+			row[3].buffer_type = MYSQL_TYPE_DATETIME;
+			row[3].buffer = &times[i * 2];
+
+			row[4].buffer_type = MYSQL_TYPE_DATETIME;
+			row[4].buffer = &times[i * 2 + 1];
+		}
+
+		// Null sink stops before the server
+		if (db->discard) {
+			done += rows;
+			continue;
+		}
+
+		if (mysql_stmt_bind_param(stmt, bind)) {
+			*(error) = g_strdup(mysql_stmt_error(stmt));
+			ret = FALSE;
+			break;
+		}
+
+		if (_execute(stmt, METRIC_HIST_DB_INSERT_GPS,
+			     "db_insert_ship_gps_bulk"))
+		{
+			*(error) = g_strdup(mysql_stmt_error(stmt));
+			ret = FALSE;
+			break;
+		}
+
+		done += rows;
+	}
+
+	if (stmt) {
+		mysql_stmt_close(stmt);
+	}
+
+	if (written) {
+		*(written) = done;
+	}
+
+	return ret;
+}
+
+gboolean db_insert_ship_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 guint count, guint *written, gchar **error)
+{
+	return _insert_gps_bulk(db, positions, count, FALSE, written, error);
+}
+
+gboolean db_import_ship_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 guint count, gchar **error)
+{
+	if (!db->discard && !db->imported) {
+		*(error) = g_strdup("GPS table has no Imported column, apply "
+				    "scripts/migrations/001_gps_imported.sql");
+		return FALSE;
+	}
+
+	return _insert_gps_bulk(db, positions, count, TRUE, NULL, error);
+}
+
+gboolean db_stream(const struct Database *db, const gchar *query,
+		   DbRowFunc func, gpointer data, gchar **error)
+{
+	MYSQL_RES *result;
+	MYSQL_ROW row;
+	gboolean ret = TRUE;
+
+	if (mysql_real_query(db->con, query, strlen(query))) {
+		*(error) = g_strconcat("query failed: ", mysql_error(db->con),
+				       NULL);
+		return FALSE;
+	}
+
+	// Rows are read from the socket one by one instead of all at once
+	result = mysql_use_result(db->con);
+	if (!result) {
+		*(error) = g_strconcat("couldn't get result set: ",
+				       mysql_error(db->con), NULL);
+		return FALSE;
+	}
+
+	while ((row = mysql_fetch_row(result)) != NULL) {
+		if (!func(row, mysql_fetch_lengths(result), data)) {
+			*(error) = g_strdup("cancelled");
+			ret = FALSE;
+			break;
+		}
+	}
+
+	if (ret && mysql_errno(db->con)) {
+		*(error) = g_strconcat("reading rows failed: ",
+				       mysql_error(db->con), NULL);
+		ret = FALSE;
+	}
+
+	// Rest of the rows have to be read before the connection can be used
+	mysql_free_result(result);
+
+	return ret;
+}
+
+gboolean db_get_imported_files(const struct Database *db, GHashTable *files,
+			       gchar **error)
+{
+	MYSQL_RES *result;
+	MYSQL_ROW row;
+
+	if (mysql_query(db->con, "CREATE TABLE IF NOT EXISTS ImportedFiles ("
+			"Hash CHAR(64) NOT NULL PRIMARY KEY, "
+			"Name VARCHAR(255) NOT NULL, Size BIGINT NOT NULL, "
+			"Positions BIGINT NOT NULL, "
+			"ImportTime TIMESTAMP DEFAULT CURRENT_TIMESTAMP)"))
+	{
+		*(error) = g_strconcat("could not create ImportedFiles table: ",
+				       mysql_error(db->con), NULL);
+		return FALSE;
+	}
+
+	if (mysql_query(db->con, "SELECT Hash FROM ImportedFiles")) {
+		*(error) = g_strconcat("query failed: ", mysql_error(db->con),
+				       NULL);
+		return FALSE;
+	}
+
+	result = mysql_store_result(db->con);
+	if (!result) {
+		*(error) = g_strconcat("couldn't get result set: ",
+				       mysql_error(db->con), NULL);
 		return FALSE;
 	}
 
+	while ((row = mysql_fetch_row(result))) {
+		g_hash_table_add(files, g_strdup(row[0]));
+	}
+	mysql_free_result(result);
+
+	return TRUE;
+}
+
+gboolean db_mark_imported(const struct Database *db, const gchar *hash,
+			  const gchar *name, const gint64 size,
+			  const gint64 positions, gchar **error)
+{
+	const gchar *query = "INSERT INTO ImportedFiles (Hash, Name, Size, Positions) "
+			     "VALUES (?, ?, ?, ?)";
+	MYSQL_STMT *stmt;
+	MYSQL_BIND bind[4];
+	unsigned long hash_length = strlen(hash);
+	unsigned long length = strlen(name);
+	gboolean ret = FALSE;
+
+	// Null sink stops before the server
+	if (db->discard) {
+		return TRUE;
+	}
+
+	stmt = mysql_stmt_init(db->con);
+	if (!stmt) {
+		*(error) = g_strdup("failed to prepare query, out of memory");
+		return FALSE;
+	}
+
+	memset(bind, 0, sizeof(bind));
+	bind[0].buffer_type = MYSQL_TYPE_STRING;
+	bind[0].buffer = (void *)hash;
+	bind[0].buffer_length = hash_length;
+	bind[0].length = &hash_length;
+	bind[1].buffer_type = MYSQL_TYPE_STRING;
+	bind[1].buffer = (void *)name;
+	bind[1].buffer_length = length;
+	bind[1].length = &length;
+	bind[2].buffer_type = MYSQL_TYPE_LONGLONG;
+	bind[2].buffer = (void *)&size;
+	bind[3].buffer_type = MYSQL_TYPE_LONGLONG;
+	bind[3].buffer = (void *)&positions;
+
 	if (mysql_stmt_prepare(stmt, query, strlen(query))) {
-		*(error) = g_strconcat("query prepare failed: " ,
+		*(error) = g_strconcat("query prepare failed: ",
 				       mysql_stmt_error(stmt), NULL);
+	} else if (mysql_stmt_bind_param(stmt, bind) ||
+		   mysql_stmt_execute(stmt))
+	{
+		*(error) = g_strdup(mysql_stmt_error(stmt));
 	} else {
-		memset(result, 0, sizeof(result));
-		result[0].buffer_type = MYSQL_TYPE_LONG;
-		result[0].buffer = (char *)&num_rows;
-		result[0].length = 0;
-
-		if (mysql_stmt_bind_result(stmt, result)) {
-			*(error) = g_strdup_printf(mysql_stmt_error(stmt), NULL);
-		} else {
-			if (mysql_stmt_execute(stmt)) {
-				*(error) = g_strconcat("could not get number of GPS entries: ", mysql_stmt_error(stmt), NULL);
-			} else {
-				if (mysql_stmt_store_result(stmt)) {
-					*(error) = g_strconcat(mysql_stmt_error(stmt), NULL);
-				} else {
-					if (mysql_stmt_fetch(stmt) != 0) {
-						*(error) = g_strconcat("failed to fetch results, ",
-								       mysql_stmt_error(stmt),
-								       NULL);
-					} else {
-						ret = TRUE;
-					}
-					mysql_stmt_free_result(stmt);
-				}
-			}
-		}
+		ret = TRUE;
 	}
 	mysql_stmt_close(stmt);
-	g_free(query);
 
-	if (num_rows == 0)
-		return ret;
+	return ret;
+}
 
-	while (num_rows > 20) {
-		gchar *id_query = g_strdup_printf("SELECT ID FROM GPS WHERE IMO = %" G_GINT64_FORMAT " ORDER BY ID ASC LIMIT 1", *imo);
-		MYSQL_STMT *del_stmt;
-		MYSQL_BIND del_result[1];
-		gint32 log_id;
+gboolean db_is_connected(const struct Database *db)
+{
+	gint64 traced = trace_begin();
+	gboolean ret = mysql_ping(db->con) == 0;
 
-		log_id = 0;
+	trace_end("db_is_connected", traced);
 
-		del_stmt = mysql_stmt_init(db->con);
-		if (!del_stmt) {
-			*(error) = g_strdup("failed to prepare query, out of memory");
-			return FALSE;
-		} else {
-			if (mysql_stmt_prepare(del_stmt, id_query, strlen(id_query))) {
-				*(error) = g_strconcat("query prepare failed: ",
-						       mysql_stmt_error(del_stmt),
-						       NULL);
-			} else {
-				memset(del_result, 0, sizeof(del_result));
-				del_result[0].buffer_type = MYSQL_TYPE_LONG;
-				del_result[0].buffer = (char *)&log_id;
-				del_result[0].length = 0;
-
-				if (mysql_stmt_bind_result(del_stmt, del_result)) {
-					*(error) = g_strdup_printf(mysql_stmt_error(del_stmt), NULL);
-				} else {
-					if (mysql_stmt_execute(del_stmt)) {
-						*(error) = g_strconcat("could not get GPS entry ID: ",
-								       mysql_stmt_error(del_stmt), NULL);
-					} else {
-						if (mysql_stmt_store_result(del_stmt)) {
-							*(error) = g_strconcat(mysql_stmt_error(del_stmt), NULL);
-						} else {
-							if (mysql_stmt_fetch(del_stmt)) {
-								*(error) = g_strconcat(
-									"failed to delete GPS location, ",
-									mysql_stmt_error(del_stmt), NULL);
-							} else {
-								gchar *del_query = g_strdup_printf("DELETE FROM GPS WHERE ID = %" G_GINT32_FORMAT, log_id);
-								if (mysql_query(db->con, del_query)) {
-									*(error) = g_strconcat("query failed, ",
-										mysql_stmt_error(del_stmt), NULL);
-									ret = FALSE;
-								} else {
-									ret = TRUE;
-								}
-								g_free(del_query);
-							}
-							mysql_stmt_free_result(del_stmt);
-						}
-					}
-				}
-			}
-			mysql_stmt_close(del_stmt);
-		}
-		--num_rows;
-		g_free(id_query);
+	return ret;
+}
+
+gboolean db_begin(const struct Database *db, gchar **error)
+{
+	if (mysql_autocommit(db->con, 0)) {
+		*(error) = g_strconcat("could not start transaction: ",
+				       mysql_error(db->con), NULL);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean db_commit(const struct Database *db, gchar **error)
+{
+	gboolean ret = TRUE;
+	gint64 traced = trace_begin();
+
+	if (mysql_commit(db->con)) {
+		*(error) = g_strconcat("commit failed: ", mysql_error(db->con),
+				       NULL);
+		ret = FALSE;
 	}
+	mysql_autocommit(db->con, 1);
+
+	trace_end("db_commit", traced);
 
 	return ret;
 }
+
+void db_rollback(const struct Database *db)
+{
+	mysql_rollback(db->con);
+	mysql_autocommit(db->con, 1);
+}
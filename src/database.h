@@ -32,6 +32,37 @@
 #include "config.h"
 #include "ship_defines.h"
 
+/**
+ * Maximum number of rows in one multi-row INSERT statement
+ */
+#define DB_BULK_ROWS 64
+
+/**
+ * Number of newest GPS records kept for each ship by db_clean_ship_gps()
+ */
+#define DB_GPS_KEEP 20
+
+/**
+ * @brief Called for every row read by db_stream()
+ *
+ * @param[in] row Values of the row as text, NULL for SQL NULL
+ * @param[in] lengths Lengths of the values
+ * @param[in] data User data given to db_stream()
+ * @return gboolean FALSE to stop reading
+ */
+typedef gboolean (*DbRowFunc)(gchar **row, const unsigned long *lengths,
+			      gpointer data);
+
+/**
+ * @enum DbSink
+ * @brief Where the @c --once and @c --import modes write updates
+ */
+enum DbSink {
+	DB_SINK_MYSQL, /**< Database */
+	DB_SINK_NULL, /**< Updates are discarded before the server */
+	DB_SINK_FILE /**< Journal */
+};
+
 /**
  * @struct Database
  * @brief Holds database related data
@@ -39,11 +70,16 @@
  */
 struct Database {
 	gpointer con; /**< Connection handle */
+	gboolean discard; /**< Write functions send nothing to the server */
+	gboolean imported; /**< GPS table has the Imported column */
 };
 
 /**
  * Initialize database connection
  *
+ * Clears @c discard of @p db and sets @c imported if the GPS table has
+ * the Imported column.
+ *
  * @param[in,out] db Struct of type Database()
  * @param[in] config Struct of type Config()
  * @param[out] error Pointer to gchar to store error message
@@ -60,6 +96,15 @@ gboolean db_init(struct Database *db, const struct Config *config,
  */
 void db_close_con(struct Database *db);
 
+/**
+ * @brief Release resources of the calling thread
+ *
+ * Call before exiting a thread which has opened connections.
+ *
+ * @return Nothing
+ */
+void db_thread_end();
+
 /**
  * @brief Get MMSI's of ships
  *
@@ -81,6 +126,8 @@ gboolean db_get_ships(const struct Database *db, gchar **ships, gchar **error);
  * @return gboolean Returns TRUE on success, otherwise FALSE
  * @note IMO seems to vary from time to time, so ship info (including IMO) is
  * updated based on the MMSI
+ * @note With @c discard of @p db the parameters are bound and nothing is
+ * sent to the server
  */
 gboolean db_update_ship_info(const struct Database *db,
 			     struct Ship *info,
@@ -93,13 +140,19 @@ gboolean db_update_ship_info(const struct Database *db,
  * @param[in] info Struct of type Ship()
  * @param[out] error Pointer to gchar where to store error message
  * @return gboolean Returns TRUE on success, otherwise FALSE
+ * @note Does nothing with @c discard of @p db
  */
 gboolean db_update_ship_gps(const struct Database *db,
 			    struct Ship *info,
 			    gchar **error);
 
 /**
- * Remove old records from GPS table
+ * @brief Remove old records from GPS table
+ *
+ * Keeps the @ref DB_GPS_KEEP newest records of the ship by RealTime and
+ * deletes the rest in one statement. Records inserted with
+ * db_import_ship_gps_bulk() are neither kept nor deleted, so a backfill
+ * survives and does not push out the live positions.
  *
  * @param[in] db Struct of type Database()
  * @param[in] IMO Pointer ship IMO
@@ -109,8 +162,137 @@ gboolean db_update_ship_gps(const struct Database *db,
  *
  * @note This could be removed if database had a trigger or event which
  * deletes old records when inserting new record into the table.
+ * @note Without the Imported column of @p db all records of the ship are
+ * counted and imported ones are deleted too
+ * @note Does nothing with @c discard of @p db
  */
 gboolean db_clean_ship_gps(const struct Database *db, const gint64 *imo,
 			   gchar **error);
 
+/**
+ * @brief Insert multiple records into GPS table
+ *
+ * Inserts @p count positions using multi-row INSERT statements of up to
+ * @ref DB_BULK_ROWS rows each.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[in] positions Array of ShipPosition()
+ * @param[in] count Number of positions in @p positions
+ * @param[out] written Number of positions inserted, may be NULL
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE if all positions were inserted, otherwise FALSE
+ * @note Statements are executed in order, on failure the first @p written
+ * positions are already in the database.
+ * @note With @c discard of @p db the parameters are bound and nothing is
+ * sent to the server
+ */
+gboolean db_insert_ship_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 guint count, guint *written, gchar **error);
+
+/**
+ * @brief Insert imported records into GPS table
+ *
+ * Same as db_insert_ship_gps_bulk(), except that the records are marked
+ * imported and db_clean_ship_gps() leaves them alone.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[in] positions Array of ShipPosition()
+ * @param[in] count Number of positions in @p positions
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE if all positions were inserted, otherwise FALSE
+ * @note Fails without the Imported column of @p db, which is added by
+ * scripts/migrations/001_gps_imported.sql
+ */
+gboolean db_import_ship_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 guint count, gchar **error);
+
+/**
+ * @brief Read result of a query row by row
+ *
+ * Rows are fetched from the server as they are read, so memory use does
+ * not depend on the number of rows. The connection can not be used for
+ * anything else until the function returns.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[in] query SELECT statement
+ * @param[in] func Function called for every row
+ * @param[in] data User data passed to @p func
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE if all rows were read, otherwise FALSE
+ */
+gboolean db_stream(const struct Database *db, const gchar *query,
+		   DbRowFunc func, gpointer data, gchar **error);
+
+/**
+ * @brief Read files which have been imported
+ *
+ * Creates the ImportedFiles table if it does not exist. Keys added to
+ * @p files are the SHA-256 hashes of the contents of the files as
+ * lowercase hex.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[in,out] files Set of strings freed with g_free()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE on success, otherwise FALSE
+ */
+gboolean db_get_imported_files(const struct Database *db, GHashTable *files,
+			       gchar **error);
+
+/**
+ * @brief Record file as imported
+ *
+ * Call in the transaction which inserts the positions of the file, so the
+ * file is recorded only if they are committed.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[in] hash SHA-256 hash of the contents as lowercase hex
+ * @param[in] name File name without directory
+ * @param[in] size Size of the file in bytes
+ * @param[in] positions Number of positions inserted from the file
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE on success, otherwise FALSE
+ * @note Does nothing with @c discard of @p db
+ */
+gboolean db_mark_imported(const struct Database *db, const gchar *hash,
+			  const gchar *name, const gint64 size,
+			  const gint64 positions, gchar **error);
+
+/**
+ * Check that the connection to the database is still alive
+ *
+ * @param[in] db Struct of type Database()
+ * @return gboolean Returns TRUE if server answers, otherwise FALSE
+ */
+gboolean db_is_connected(const struct Database *db);
+
+/**
+ * @brief Start a transaction
+ *
+ * Turns autocommit off until db_commit() or db_rollback() is called.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE on success, otherwise FALSE
+ */
+gboolean db_begin(const struct Database *db, gchar **error);
+
+/**
+ * Commit the transaction started with db_begin()
+ *
+ * @param[in] db Struct of type Database()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean Returns TRUE on success, otherwise FALSE
+ */
+gboolean db_commit(const struct Database *db, gchar **error);
+
+/**
+ * Roll back the transaction started with db_begin()
+ *
+ * @param[in] db Struct of type Database()
+ * @return Nothing
+ */
+void db_rollback(const struct Database *db);
+
 #endif
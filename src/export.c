@@ -0,0 +1,449 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "export.h"
+#include "database.h"
+#include "log.h"
+
+/**
+ * @brief Column of a table
+ */
+struct ExportSpec {
+	const gchar *name; /**< Name of the column */
+	enum ExportType type; /**< Encoding */
+	guint scale; /**< Decimals of EXPORT_FIXED */
+};
+
+static const struct ExportSpec GPS_COLUMNS[] = {
+	{"ID", EXPORT_INT, 0},
+	{"IMO", EXPORT_INT, 0},
+	{"Lat", EXPORT_FIXED, 7},
+	{"Lng", EXPORT_FIXED, 7},
+	{"RealTime", EXPORT_TIME, 0},
+	{"LastTime", EXPORT_TIME, 0},
+};
+
+static const struct ExportSpec SHIPS_COLUMNS[] = {
+	{"MMSI", EXPORT_INT, 0},
+	{"IMO", EXPORT_INT, 0},
+	{"ShipName", EXPORT_STRING, 0},
+	{"CommentText", EXPORT_STRING, 0},
+	{"ShipLength", EXPORT_FIXED, 1},
+	{"Width", EXPORT_FIXED, 1},
+	{"Draught", EXPORT_FIXED, 1},
+	{"Course", EXPORT_FIXED, 1},
+	{"Heading", EXPORT_INT, 0},
+	{"ShipSpeed", EXPORT_FIXED, 1},
+	{"RefFront", EXPORT_INT, 0},
+	{"RefLeft", EXPORT_INT, 0},
+	{"PathText", EXPORT_STRING, 0},
+	{"Iclass", EXPORT_STRING, 0},
+	{"TargetType", EXPORT_STRING, 0},
+	{"SrcCall", EXPORT_STRING, 0},
+	{"DstCall", EXPORT_STRING, 0},
+	{"VesselClass", EXPORT_INT, 0},
+	{"NavStat", EXPORT_INT, 0},
+};
+
+/**
+ * @brief Values of a column in the current block
+ */
+struct ExportColumn {
+	const struct ExportSpec *spec; /**< Name and encoding */
+	GByteArray *data; /**< Encoded values or string indexes */
+	GByteArray *nulls; /**< Bitmap of NULL rows */
+	gboolean has_nulls; /**< A row of the block is NULL */
+	gint64 previous; /**< Previous value of the block */
+	gdouble multiplier; /**< 10 to the power of scale */
+	GHashTable *strings; /**< Index + 1 of strings of the block */
+	GByteArray *dictionary; /**< Strings of the block */
+};
+
+/**
+ * @brief Table being exported
+ */
+struct ExportTable {
+	FILE *out; /**< Output file */
+	struct ExportColumn *columns; /**< Columns */
+	guint n_columns; /**< Number of columns */
+	guint rows; /**< Rows in the current block */
+	guint64 total; /**< Rows exported */
+	guint64 bytes; /**< Bytes written */
+	gboolean failed; /**< Writing failed */
+};
+
+static void _put_varint(GByteArray *array, guint64 value)
+{
+	guint8 buffer[10];
+	guint len = 0;
+
+	do {
+		buffer[len] = value & 0x7f;
+		value >>= 7;
+		if (value) {
+			buffer[len] |= 0x80;
+		}
+		++len;
+	} while (value);
+
+	g_byte_array_append(array, buffer, len);
+}
+
+static void _put_signed(GByteArray *array, const gint64 value)
+{
+	_put_varint(array, ((guint64)value << 1) ^ (guint64)(value >> 63));
+}
+
+static void _put_string(GByteArray *array, const gchar *str, const gsize len)
+{
+	_put_varint(array, len);
+	g_byte_array_append(array, (const guint8 *)str, len);
+}
+
+static void _write(struct ExportTable *table, const guint8 *data,
+		   const gsize len)
+{
+	if (table->failed) {
+		return;
+	}
+
+	if (fwrite(data, 1, len, table->out) != len) {
+		table->failed = TRUE;
+	}
+	table->bytes += len;
+}
+
+static void _write_array(struct ExportTable *table, GByteArray *array)
+{
+	_write(table, array->data, array->len);
+	g_byte_array_set_size(array, 0);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static gint64 _days_from_civil(gint64 year, const guint month, const guint day)
+{
+	gint64 era;
+	guint yoe, doy, doe;
+
+	year -= month <= 2;
+	era = (year >= 0 ? year : year - 399) / 400;
+	yoe = (guint)(year - era * 400);
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + (gint64)doe - 719468;
+}
+
+// DATETIME as "YYYY-MM-DD HH:MM:SS" in UTC to Unix time, 0 for zero date
+static gint64 _parse_datetime(const gchar *str, const gsize len)
+{
+	guint field[6] = {0};
+	guint i = 0;
+
+	for (gsize p = 0; p < len && i < G_N_ELEMENTS(field); ++p) {
+		if (g_ascii_isdigit(str[p])) {
+			field[i] = field[i] * 10 + (guint)(str[p] - '0');
+		} else if (str[p] == '.') {
+			break;
+		} else {
+			++i;
+		}
+	}
+
+	if (field[1] == 0 || field[2] == 0) {
+		return 0;
+	}
+
+	return _days_from_civil(field[0], field[1], field[2]) * 86400 +
+	       field[3] * 3600 + field[4] * 60 + field[5];
+}
+
+static void _put_value(struct ExportColumn *column, const gchar *value,
+		       const gsize len)
+{
+	gint64 number;
+	gpointer index;
+
+	switch (column->spec->type) {
+		case EXPORT_INT:
+			number = g_ascii_strtoll(value, NULL, 10);
+			break;
+		case EXPORT_FIXED:
+			number = (gint64)llround(g_ascii_strtod(value, NULL) *
+						 column->multiplier);
+			break;
+		case EXPORT_TIME:
+			number = _parse_datetime(value, len);
+			break;
+		case EXPORT_STRING:
+		default:
+			index = g_hash_table_lookup(column->strings, value);
+			if (!index) {
+				_put_string(column->dictionary, value, len);
+				index = GUINT_TO_POINTER(g_hash_table_size(column->strings) + 1);
+				g_hash_table_insert(column->strings,
+						    g_strndup(value, len), index);
+			}
+			_put_varint(column->data, GPOINTER_TO_UINT(index) - 1);
+			return;
+	}
+
+	_put_signed(column->data, number - column->previous);
+	column->previous = number;
+}
+
+static void _flush_block(struct ExportTable *table)
+{
+	GByteArray *header = g_byte_array_new();
+
+	if (table->rows == 0) {
+		g_byte_array_unref(header);
+		return;
+	}
+
+	_put_varint(header, table->rows);
+	_write_array(table, header);
+
+	for (guint i = 0; i < table->n_columns; ++i) {
+		struct ExportColumn *column = &table->columns[i];
+		GByteArray *count = g_byte_array_new();
+
+		if (column->spec->type == EXPORT_STRING) {
+			_put_varint(count, g_hash_table_size(column->strings));
+		}
+
+		_put_varint(header, column->has_nulls ? 1 : 0);
+		if (column->has_nulls) {
+			g_byte_array_append(header, column->nulls->data,
+					    column->nulls->len);
+		}
+		_put_varint(header, count->len + column->dictionary->len +
+				    column->data->len);
+		_write_array(table, header);
+		_write_array(table, count);
+		_write_array(table, column->dictionary);
+		_write_array(table, column->data);
+		g_byte_array_unref(count);
+
+		g_byte_array_set_size(column->nulls, 0);
+		column->has_nulls = FALSE;
+		column->previous = 0;
+		if (column->strings) {
+			g_hash_table_remove_all(column->strings);
+		}
+	}
+
+	table->rows = 0;
+	g_byte_array_unref(header);
+}
+
+static gboolean _put_row(gchar **row, const unsigned long *lengths,
+			 gpointer data)
+{
+	struct ExportTable *table = data;
+	guint bit = table->rows % 8;
+
+	for (guint i = 0; i < table->n_columns; ++i) {
+		struct ExportColumn *column = &table->columns[i];
+
+		if (bit == 0) {
+			g_byte_array_append(column->nulls, (const guint8 *)"", 1);
+		}
+
+		if (!row[i]) {
+			column->nulls->data[column->nulls->len - 1] |= 1 << bit;
+			column->has_nulls = TRUE;
+		} else {
+			_put_value(column, row[i], lengths[i]);
+		}
+	}
+
+	table->total++;
+	if (++table->rows == EXPORT_BLOCK_ROWS) {
+		_flush_block(table);
+	}
+
+	return !table->failed;
+}
+
+static gboolean _export_table(const struct Database *db, FILE *out,
+			      const gchar *name,
+			      const struct ExportSpec *specs,
+			      const guint n_specs, const gchar *order,
+			      guint64 *rows, guint64 *bytes, gchar **error)
+{
+	struct ExportTable table;
+	GByteArray *header = g_byte_array_new();
+	GString *query = g_string_new("SELECT ");
+	gboolean ret;
+
+	memset(&table, 0, sizeof(table));
+	table.out = out;
+	table.n_columns = n_specs;
+	table.columns = g_new0(struct ExportColumn, n_specs);
+
+	_put_string(header, name, strlen(name));
+	_put_varint(header, n_specs);
+	for (guint i = 0; i < n_specs; ++i) {
+		struct ExportColumn *column = &table.columns[i];
+
+		column->spec = &specs[i];
+		column->data = g_byte_array_sized_new(EXPORT_BLOCK_ROWS * 2);
+		column->nulls = g_byte_array_sized_new(EXPORT_BLOCK_ROWS / 8);
+		column->dictionary = g_byte_array_new();
+		column->multiplier = pow(10, specs[i].scale);
+		if (specs[i].type == EXPORT_STRING) {
+			column->strings = g_hash_table_new_full(g_str_hash,
+								g_str_equal,
+								g_free, NULL);
+		}
+
+		_put_string(header, specs[i].name, strlen(specs[i].name));
+		_put_varint(header, specs[i].type);
+		_put_varint(header, specs[i].scale);
+		g_string_append_printf(query, "%s%s", i > 0 ? ", " : "",
+				       specs[i].name);
+	}
+	g_string_append_printf(query, " FROM %s ORDER BY %s", name, order);
+	_write_array(&table, header);
+
+	ret = db_stream(db, query->str, _put_row, &table, error);
+	if (ret) {
+		_flush_block(&table);
+		_put_varint(header, 0);
+		_write_array(&table, header);
+	}
+
+	// Callback stops the query when writing fails
+	if (table.failed) {
+		g_free(*error);
+		*(error) = g_strconcat("write failed: ", g_strerror(errno), NULL);
+		ret = FALSE;
+	}
+
+	*(rows) = table.total;
+	*(bytes) += table.bytes;
+
+	for (guint i = 0; i < n_specs; ++i) {
+		struct ExportColumn *column = &table.columns[i];
+
+		g_byte_array_unref(column->data);
+		g_byte_array_unref(column->nulls);
+		g_byte_array_unref(column->dictionary);
+		if (column->strings) {
+			g_hash_table_destroy(column->strings);
+		}
+	}
+	g_free(table.columns);
+	g_string_free(query, TRUE);
+	g_byte_array_unref(header);
+
+	return ret;
+}
+
+gint export_run(const struct Config *config, const gchar *path)
+{
+	struct Database db;
+	gchar *part;
+	gchar *error;
+	FILE *out;
+	guint64 gps_rows;
+	guint64 ships_rows;
+	guint64 bytes;
+	gint64 started;
+	gdouble seconds;
+	gboolean ret;
+
+	started = g_get_monotonic_time();
+	error = NULL;
+	gps_rows = ships_rows = 0;
+	bytes = strlen(EXPORT_MAGIC) + 1;
+
+	if (!db_init(&db, config, &error)) {
+		log_error(error);
+		db_close_con(&db);
+		return 1;
+	}
+
+	part = g_strconcat(path, ".part", NULL);
+	out = g_fopen(part, "wb");
+	if (!out) {
+		log_error(g_strconcat("Could not open ", part, ": ",
+				      g_strerror(errno), NULL));
+		g_free(part);
+		db_close_con(&db);
+		return 1;
+	}
+	setvbuf(out, NULL, _IOFBF, EXPORT_BUFFER_SIZE);
+
+	ret = fwrite(EXPORT_MAGIC, 1, strlen(EXPORT_MAGIC), out) ==
+	      strlen(EXPORT_MAGIC);
+	if (!ret) {
+		error = g_strconcat("write failed: ", g_strerror(errno), NULL);
+	}
+
+	ret = ret && _export_table(&db, out, "GPS", GPS_COLUMNS,
+				   G_N_ELEMENTS(GPS_COLUMNS), "ID", &gps_rows,
+				   &bytes, &error);
+	ret = ret && _export_table(&db, out, "Ships", SHIPS_COLUMNS,
+				   G_N_ELEMENTS(SHIPS_COLUMNS), "MMSI",
+				   &ships_rows, &bytes, &error);
+
+	// End of the file
+	if (ret && fputc(0, out) == EOF) {
+		error = g_strconcat("write failed: ", g_strerror(errno), NULL);
+		ret = FALSE;
+	}
+	if (fclose(out) != 0 && ret) {
+		error = g_strconcat("write failed: ", g_strerror(errno), NULL);
+		ret = FALSE;
+	}
+	if (ret && g_rename(part, path) != 0) {
+		error = g_strconcat("Could not rename ", part, ": ",
+				    g_strerror(errno), NULL);
+		ret = FALSE;
+	}
+
+	if (!ret) {
+		log_error(g_strconcat("Export failed: ", error, NULL));
+		g_free(error);
+		g_unlink(part);
+	}
+
+	seconds = (g_get_monotonic_time() - started) / 1e6;
+	g_print("gps_rows=%" G_GUINT64_FORMAT " ships_rows=%" G_GUINT64_FORMAT
+		" bytes=%" G_GUINT64_FORMAT " bytes_per_row=%.1f seconds=%.2f"
+		" rows_per_second=%.0f mb_per_second=%.1f\n",
+		gps_rows, ships_rows, bytes,
+		gps_rows + ships_rows > 0 ?
+		(gdouble)bytes / (gps_rows + ships_rows) : 0,
+		seconds,
+		seconds > 0 ? (gps_rows + ships_rows) / seconds : 0,
+		seconds > 0 ? bytes / seconds / 1e6 : 0);
+
+	g_free(part);
+	db_close_con(&db);
+
+	return ret ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file export.h
+ * @brief Export of GPS history to a compact columnar file
+ * @details Implements the @c --export mode. The GPS and Ships tables are
+ * read row by row with db_stream() and written in blocks of up to
+ * @ref EXPORT_BLOCK_ROWS rows, one column after another, so memory use
+ * does not depend on the size of the tables.
+ *
+ * File starts with @ref EXPORT_MAGIC and is followed by the tables. All
+ * integers are unsigned LEB128 varints, signed values are zigzag encoded
+ * first. A table is
+ *
+ *  - name: varint length and bytes
+ *  - number of columns: varint
+ *  - for each column: name, type (@ref ExportType) and scale, both varints
+ *  - blocks: number of rows as a varint and the columns of the block,
+ *    a block of 0 rows ends the table
+ *
+ * A column of a block is a flags varint, a bitmap of NULL rows if bit 0 of
+ * flags is set, (rows + 7) / 8 bytes with the least significant bit first,
+ * and the byte length of the data followed by the data. Values of NULL rows
+ * are not stored.
+ *
+ *  - @ref EXPORT_INT: differences to the previous value of the block,
+ *    starting from 0
+ *  - @ref EXPORT_FIXED: same, of the value multiplied by 10 to the power
+ *    of scale and rounded
+ *  - @ref EXPORT_TIME: same, of Unix time in seconds, DATETIME values are
+ *    read as UTC like they are written
+ *  - @ref EXPORT_STRING: number of distinct strings of the block, the
+ *    strings as length and bytes, and an index to them for every row
+ *
+ * An empty name ends the file. scripts/read_export.py converts a file to
+ * CSV.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <glib.h>
+
+#include "config.h"
+
+/**
+ * Magic bytes at the start of the file
+ */
+#define EXPORT_MAGIC "SSX1"
+
+/**
+ * Maximum number of rows in a block
+ */
+#define EXPORT_BLOCK_ROWS 65536
+
+/**
+ * Size of the output buffer
+ */
+#define EXPORT_BUFFER_SIZE (4 * 1024 * 1024)
+
+/**
+ * @enum ExportType
+ * @brief Encoding of a column
+ */
+enum ExportType {
+	EXPORT_INT = 1, /**< Delta encoded integer */
+	EXPORT_FIXED = 2, /**< Delta encoded fixed-point number */
+	EXPORT_TIME = 3, /**< Delta encoded Unix time */
+	EXPORT_STRING = 4 /**< Dictionary encoded string */
+};
+
+/**
+ * @brief Export GPS and Ships tables
+ *
+ * Writes to @p path with suffix @c .part and renames the file when it is
+ * complete. Prints a summary line to stdout with the numbers of rows and
+ * bytes and the throughput.
+ *
+ * @param[in] config Struct of type Config()
+ * @param[in] path File to write
+ * @return gint Exit status, 0 on success
+ */
+gint export_run(const struct Config *config, const gchar *path);
+
+#endif
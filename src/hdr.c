@@ -0,0 +1,140 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "hdr.h"
+
+static inline void _bump(gint64 *value, const gint64 add)
+{
+	__atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + add,
+			 __ATOMIC_RELAXED);
+}
+
+static inline gint64 _load(const gint64 *value)
+{
+	return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static inline guint _index(const gint64 value)
+{
+	guint shift;
+
+	if (value < 2 * HDR_SUB_BUCKETS) {
+		return (guint)MAX(value, 0);
+	}
+
+	if (value >> HDR_MAX_BITS) {
+		return HDR_N_BUCKETS - 1;
+	}
+
+	// Top HDR_SUB_BITS + 1 bits of the value select the bucket
+	shift = g_bit_storage((gulong)value) - 1 - HDR_SUB_BITS;
+
+	return shift * HDR_SUB_BUCKETS + (guint)(value >> shift);
+}
+
+// Largest value counted in a bucket
+static gint64 _highest(const guint index)
+{
+	guint shift;
+
+	if (index < 2 * HDR_SUB_BUCKETS) {
+		return index;
+	}
+
+	shift = index / HDR_SUB_BUCKETS - 1;
+
+	return (((gint64)(index - shift * HDR_SUB_BUCKETS) + 1) << shift) - 1;
+}
+
+struct HdrHistogram *hdr_new()
+{
+	return g_new0(struct HdrHistogram, 1);
+}
+
+void hdr_free(struct HdrHistogram *hdr)
+{
+	g_free(hdr);
+}
+
+void hdr_reset(struct HdrHistogram *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+}
+
+void hdr_record(struct HdrHistogram *hdr, const gint64 value,
+		const gint64 count)
+{
+	_bump(&hdr->counts[_index(value)], count);
+	_bump(&hdr->total, count);
+	_bump(&hdr->sum, MAX(value, 0) * count);
+}
+
+void hdr_add(struct HdrHistogram *to, const struct HdrHistogram *from)
+{
+	for (guint i = 0; i < HDR_N_BUCKETS; ++i) {
+		to->counts[i] += _load(&from->counts[i]);
+	}
+	to->total += _load(&from->total);
+	to->sum += _load(&from->sum);
+}
+
+void hdr_subtract(struct HdrHistogram *to, const struct HdrHistogram *from)
+{
+	for (guint i = 0; i < HDR_N_BUCKETS; ++i) {
+		to->counts[i] -= from->counts[i];
+	}
+	to->total -= from->total;
+	to->sum -= from->sum;
+}
+
+gint64 hdr_percentile(const struct HdrHistogram *hdr, const gdouble percentile)
+{
+	gint64 rank;
+	gint64 seen = 0;
+
+	if (hdr->total <= 0) {
+		return 0;
+	}
+
+	// Rank of the value, from 1 to total
+	rank = (gint64)(CLAMP(percentile, 0.0, 100.0) / 100.0 * hdr->total + 0.5);
+	rank = CLAMP(rank, 1, hdr->total);
+
+	for (guint i = 0; i < HDR_N_BUCKETS; ++i) {
+		seen += hdr->counts[i];
+		if (seen >= rank) {
+			return _highest(i);
+		}
+	}
+
+	return _highest(HDR_N_BUCKETS - 1);
+}
+
+gint64 hdr_count_at_or_below(const struct HdrHistogram *hdr,
+			     const gint64 value)
+{
+	gint64 count = 0;
+
+	for (guint i = 0; i < HDR_N_BUCKETS && _highest(i) <= value; ++i) {
+		count += hdr->counts[i];
+	}
+
+	return count;
+}
@@ -0,0 +1,154 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file hdr.h
+ * @brief High dynamic range histogram
+ * @details Counts values from one nanosecond to over an hour with a relative
+ * error below 1%. Every power of two is split into @ref HDR_SUB_BUCKETS
+ * linear buckets, so recording a value is a bit scan, a shift and an add.
+ * Histograms of the same layout can be added and subtracted, so histograms
+ * of several threads can be merged and the change between two readings of
+ * a cumulative histogram is a histogram of the interval.
+ *
+ * Counts are stored with relaxed atomic operations: one thread may record
+ * while others read, and readers never see torn counts.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef HDR_H
+#define HDR_H
+
+#include <glib.h>
+
+/**
+ * Bits of linear buckets per power of two
+ */
+#define HDR_SUB_BITS 7
+
+/**
+ * Linear buckets per power of two
+ */
+#define HDR_SUB_BUCKETS (1 << HDR_SUB_BITS)
+
+/**
+ * Values are below 2^HDR_MAX_BITS, larger values are counted as the largest
+ */
+#define HDR_MAX_BITS 42
+
+/**
+ * Number of buckets
+ */
+#define HDR_N_BUCKETS ((HDR_MAX_BITS - HDR_SUB_BITS + 1) * HDR_SUB_BUCKETS)
+
+/**
+ * @struct HdrHistogram
+ * @brief Counts of values
+ */
+struct HdrHistogram {
+	gint64 counts[HDR_N_BUCKETS]; /**< Values per bucket */
+	gint64 total; /**< Number of values */
+	gint64 sum; /**< Sum of values */
+};
+
+/**
+ * Create empty histogram
+ *
+ * @return struct HdrHistogram*
+ * @note Free with hdr_free()
+ */
+struct HdrHistogram *hdr_new();
+
+/**
+ * Free histogram
+ *
+ * @param[in] hdr Struct of type HdrHistogram()
+ * @return Nothing
+ */
+void hdr_free(struct HdrHistogram *hdr);
+
+/**
+ * Remove all values
+ *
+ * @param[in] hdr Struct of type HdrHistogram()
+ * @return Nothing
+ */
+void hdr_reset(struct HdrHistogram *hdr);
+
+/**
+ * @brief Record a value
+ *
+ * Must not be called by two threads at the same time for one histogram.
+ *
+ * @param[in] hdr Struct of type HdrHistogram()
+ * @param[in] value Value, negative values are counted as 0
+ * @param[in] count How many times the value is recorded
+ * @return Nothing
+ */
+void hdr_record(struct HdrHistogram *hdr, const gint64 value,
+		const gint64 count);
+
+/**
+ * Add counts of another histogram
+ *
+ * @param[in] to Struct of type HdrHistogram() to add to
+ * @param[in] from Struct of type HdrHistogram() to add
+ * @return Nothing
+ */
+void hdr_add(struct HdrHistogram *to, const struct HdrHistogram *from);
+
+/**
+ * @brief Subtract counts of another histogram
+ *
+ * @p from must have been copied from @p to earlier, so no count goes
+ * below zero.
+ *
+ * @param[in] to Struct of type HdrHistogram() to subtract from
+ * @param[in] from Struct of type HdrHistogram() to subtract
+ * @return Nothing
+ */
+void hdr_subtract(struct HdrHistogram *to, const struct HdrHistogram *from);
+
+/**
+ * @brief Value at a percentile
+ *
+ * Returns the largest value which falls in the same bucket as the value
+ * at @p percentile.
+ *
+ * @param[in] hdr Struct of type HdrHistogram()
+ * @param[in] percentile Percentile from 0 to 100
+ * @return gint64 Value, 0 if the histogram is empty
+ */
+gint64 hdr_percentile(const struct HdrHistogram *hdr, const gdouble percentile);
+
+/**
+ * @brief Number of values at or below a value
+ *
+ * Values in the bucket of @p value are counted if the bucket ends at or
+ * below @p value.
+ *
+ * @param[in] hdr Struct of type HdrHistogram()
+ * @param[in] value Value
+ * @return gint64 Number of values
+ */
+gint64 hdr_count_at_or_below(const struct HdrHistogram *hdr,
+			     const gint64 value);
+
+#endif
@@ -0,0 +1,609 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "import.h"
+#include "clock.h"
+#include "database.h"
+#include "journal.h"
+#include "json.h"
+#include "log.h"
+#include "ship_batch.h"
+
+/**
+ * @brief File being imported
+ */
+struct ImportFile {
+	gchar *path; /**< Path of the file */
+	gchar *name; /**< Name without directory */
+	gint64 size; /**< Size in bytes */
+	gchar *hash; /**< SHA-256 of the contents as hex */
+	gboolean skipped; /**< Same contents have been imported */
+	struct ShipBatch *ships; /**< Decoded entries */
+	guint responses; /**< Responses in the file */
+	guint failed; /**< Responses which could not be decoded */
+	gint64 positions; /**< Positions inserted from the file */
+	gint64 decode_cpu; /**< CPU time spent decoding the file */
+	gchar *error; /**< Error if the file could not be read */
+};
+
+/**
+ * @brief Position with the ship it belongs to
+ */
+struct ImportRow {
+	gint64 mmsi; /**< MMSI of the ship */
+	struct ImportFile *file; /**< File the position came from */
+	struct ShipPosition position; /**< Position */
+};
+
+/**
+ * @brief State of the import
+ */
+struct Import {
+	const struct Config *config; /**< Configuration */
+	enum DbSink sink; /**< Where positions are written */
+	struct Database db; /**< Connection */
+	struct Journal *journal; /**< Journal of DB_SINK_FILE */
+	GThreadPool *decoders; /**< Decode files of a group */
+	GMutex lock; /**< Protects @p decoded */
+	GCond cond; /**< Signaled when a file is decoded */
+	guint decoded; /**< Files of the group decoded */
+	GHashTable *last; /**< Time of the last position inserted, by MMSI */
+	gint64 started; /**< Monotonic time when the import started */
+	guint files; /**< Files imported */
+	GHashTable *imported; /**< Hashes of imported files */
+	guint skipped; /**< Files whose contents have been imported */
+	guint unreadable; /**< Files which could not be read */
+	guint64 responses; /**< Responses decoded */
+	guint64 failed; /**< Responses which could not be decoded */
+	guint64 entries; /**< Entries decoded */
+	guint64 positions; /**< Positions inserted */
+	guint64 bytes; /**< Size of the files imported */
+	gint64 decode_cpu; /**< CPU time spent decoding */
+	gint64 dedup_cpu; /**< CPU time spent sorting and deduplicating */
+	gint64 write_cpu; /**< CPU time spent writing */
+};
+
+static void _free_file(struct ImportFile *file)
+{
+	g_free(file->path);
+	g_free(file->name);
+	g_free(file->hash);
+	if (file->ships) {
+		ship_batch_free(file->ships);
+	}
+	g_free(file->error);
+	g_free(file);
+}
+
+static gint _compare_files(gconstpointer a, gconstpointer b)
+{
+	const struct ImportFile *file_a = *(struct ImportFile *const *)a;
+	const struct ImportFile *file_b = *(struct ImportFile *const *)b;
+
+	return strcmp(file_a->name, file_b->name);
+}
+
+static void _add_file(GPtrArray *files, const gchar *path)
+{
+	struct ImportFile *file;
+	GStatBuf st;
+
+	if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return;
+	}
+
+	file = g_new0(struct ImportFile, 1);
+	file->path = g_strdup(path);
+	file->name = g_path_get_basename(path);
+	file->size = (gint64)st.st_size;
+	g_ptr_array_add(files, file);
+}
+
+static gboolean _list_files(gchar **paths, GPtrArray *files)
+{
+	for (guint i = 0; paths[i]; ++i) {
+		GError *_error = NULL;
+		const gchar *name;
+		GDir *dir;
+
+		if (!g_file_test(paths[i], G_FILE_TEST_IS_DIR)) {
+			if (!g_file_test(paths[i], G_FILE_TEST_IS_REGULAR)) {
+				log_error(g_strconcat("No such file ", paths[i], NULL));
+				return FALSE;
+			}
+			_add_file(files, paths[i]);
+			continue;
+		}
+
+		dir = g_dir_open(paths[i], 0, &_error);
+		if (!dir) {
+			log_error(g_strdup(_error->message));
+			g_error_free(_error);
+			return FALSE;
+		}
+		while ((name = g_dir_read_name(dir)) != NULL) {
+			gchar *path = g_build_filename(paths[i], name, NULL);
+
+			_add_file(files, path);
+			g_free(path);
+		}
+		g_dir_close(dir);
+	}
+
+	g_ptr_array_sort(files, _compare_files);
+
+	return TRUE;
+}
+
+static void _decode_file(gpointer data, gpointer user_data)
+{
+	struct ImportFile *file = data;
+	struct Import *import = user_data;
+	GMappedFile *mapped;
+	GError *_error = NULL;
+	const gchar *p;
+	gsize left;
+	gint64 cpu;
+
+	cpu = clock_thread_cpu_time();
+	file->ships = ship_batch_new(64);
+	mapped = g_mapped_file_new(file->path, FALSE, &_error);
+
+	if (!mapped) {
+		file->error = g_strdup(_error->message);
+		g_error_free(_error);
+	} else {
+		p = g_mapped_file_get_contents(mapped);
+		left = g_mapped_file_get_length(mapped);
+
+		// Imported set is changed only between groups
+		file->hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+							 (const guchar *)p, left);
+		if (g_hash_table_contains(import->imported, file->hash)) {
+			file->skipped = TRUE;
+			left = 0;
+		}
+
+		while (left > 0) {
+			gchar *error = NULL;
+			gsize length;
+
+			// Whitespace between and after the responses
+			while (left > 0 && g_ascii_isspace(*p)) {
+				++p;
+				--left;
+			}
+			if (left == 0) {
+				break;
+			}
+
+			length = json_value_length(p, left);
+			if (length == 0) {
+				file->failed++;
+				break;
+			}
+
+			file->responses++;
+			if (!json_read_ships_len(p, length, file->ships, &error)) {
+				file->failed++;
+				g_free(error);
+			}
+			p += length;
+			left -= length;
+		}
+
+		g_mapped_file_unref(mapped);
+	}
+	file->decode_cpu = clock_thread_cpu_time() - cpu;
+
+	g_mutex_lock(&import->lock);
+	import->decoded++;
+	g_cond_signal(&import->cond);
+	g_mutex_unlock(&import->lock);
+}
+
+static gint _compare_rows(gconstpointer a, gconstpointer b)
+{
+	const struct ImportRow *row_a = a;
+	const struct ImportRow *row_b = b;
+
+	if (row_a->mmsi != row_b->mmsi) {
+		return row_a->mmsi < row_b->mmsi ? -1 : 1;
+	}
+	if (row_a->position.time != row_b->position.time) {
+		return row_a->position.time < row_b->position.time ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Sorts positions of the group by MMSI and time and drops all but the
+ * first of each MMSI and time, also ones inserted by the previous group.
+ * Returns the number of positions left in @p rows.
+ */
+static guint _dedup(struct Import *import, struct ImportRow *rows,
+		    const guint len)
+{
+	guint kept = 0;
+
+	qsort(rows, len, sizeof(*rows), _compare_rows);
+
+	for (guint i = 0; i < len; ++i) {
+		gint64 *last;
+
+		if (rows[i].position.time <= 0) {
+			continue;
+		}
+		if (kept > 0 && rows[kept - 1].mmsi == rows[i].mmsi &&
+		    rows[kept - 1].position.time == rows[i].position.time)
+		{
+			continue;
+		}
+
+		last = g_hash_table_lookup(import->last, &rows[i].mmsi);
+		if (last && last[1] == rows[i].position.time) {
+			continue;
+		}
+
+		rows[kept++] = rows[i];
+	}
+
+	// Remember the newest position of every ship for the next group
+	for (guint i = 0; i < kept; ++i) {
+		gint64 *last;
+
+		if (i + 1 < kept && rows[i + 1].mmsi == rows[i].mmsi) {
+			continue;
+		}
+
+		last = g_hash_table_lookup(import->last, &rows[i].mmsi);
+		if (!last) {
+			last = g_new(gint64, 2);
+			last[0] = rows[i].mmsi;
+			g_hash_table_insert(import->last, last, last);
+		}
+		last[1] = rows[i].position.time;
+	}
+
+	return kept;
+}
+
+// Positions and names of the files of the group in one transaction
+static gboolean _insert_group(struct Import *import, GPtrArray *group,
+			      const struct ShipPosition *positions,
+			      const guint count, gchar **error)
+{
+	gboolean ret;
+
+	ret = db_begin(&import->db, error);
+	if (!ret) {
+		return FALSE;
+	}
+
+	ret = db_import_ship_gps_bulk(&import->db, positions, count, error);
+	// Unreadable files are tried again by the next run
+	for (guint i = 0; ret && i < group->len; ++i) {
+		const struct ImportFile *file = g_ptr_array_index(group, i);
+
+		if (file->error || file->skipped) {
+			continue;
+		}
+		ret = db_mark_imported(&import->db, file->hash, file->name,
+				       file->size, file->positions, error);
+	}
+
+	if (ret) {
+		ret = db_commit(&import->db, error);
+	} else {
+		db_rollback(&import->db);
+	}
+
+	return ret;
+}
+
+static gboolean _store_group(struct Import *import,
+			     const struct ImportRow *rows, const guint count,
+			     gchar **error)
+{
+	for (guint i = 0; i < count; ++i) {
+		if (!journal_append_position(import->journal, &rows[i].position,
+					     error))
+		{
+			return FALSE;
+		}
+	}
+
+	return journal_sync(import->journal, error);
+}
+
+static gboolean _write_group(struct Import *import, GPtrArray *group,
+			     gchar **error)
+{
+	struct ImportRow *rows;
+	struct ShipPosition *positions;
+	guint len = 0;
+	guint kept;
+	gboolean ret;
+	gint64 cpu;
+
+	cpu = clock_thread_cpu_time();
+	for (guint i = 0; i < group->len; ++i) {
+		const struct ImportFile *file = g_ptr_array_index(group, i);
+
+		if (!file->skipped) {
+			len += file->ships->len;
+		}
+	}
+
+	rows = g_new(struct ImportRow, MAX(len, 1));
+	positions = g_new(struct ShipPosition, MAX(len, 1));
+	len = 0;
+	for (guint i = 0; i < group->len; ++i) {
+		struct ImportFile *file = g_ptr_array_index(group, i);
+
+		if (file->skipped) {
+			continue;
+		}
+		ship_batch_get_positions(file->ships, 0, positions);
+		for (guint j = 0; j < file->ships->len; ++j) {
+			rows[len].mmsi = file->ships->mmsi[j];
+			rows[len].file = file;
+			rows[len].position = positions[j];
+			len++;
+		}
+	}
+
+	kept = _dedup(import, rows, len);
+	for (guint i = 0; i < kept; ++i) {
+		positions[i] = rows[i].position;
+		rows[i].file->positions++;
+	}
+	import->dedup_cpu += clock_thread_cpu_time() - cpu;
+
+	cpu = clock_thread_cpu_time();
+	if (import->sink == DB_SINK_NULL) {
+		ret = db_import_ship_gps_bulk(&import->db, positions, kept,
+					      error);
+	} else if (import->sink == DB_SINK_FILE) {
+		ret = _store_group(import, rows, kept, error);
+	} else {
+		ret = _insert_group(import, group, positions, kept, error);
+	}
+	import->write_cpu += clock_thread_cpu_time() - cpu;
+
+	if (ret) {
+		import->positions += kept;
+	}
+
+	g_free(positions);
+	g_free(rows);
+
+	return ret;
+}
+
+static gboolean _import_group(struct Import *import, GPtrArray *group)
+{
+	gchar *error = NULL;
+
+	import->decoded = 0;
+	for (guint i = 0; i < group->len; ++i) {
+		g_thread_pool_push(import->decoders, g_ptr_array_index(group, i),
+				   NULL);
+	}
+
+	g_mutex_lock(&import->lock);
+	while (import->decoded < group->len) {
+		g_cond_wait(&import->cond, &import->lock);
+	}
+	g_mutex_unlock(&import->lock);
+
+	for (guint i = 0; i < group->len; ++i) {
+		struct ImportFile *file = g_ptr_array_index(group, i);
+
+		if (file->error) {
+			log_error(g_strconcat(file->path, ": ", file->error, NULL));
+			import->unreadable++;
+			continue;
+		}
+		// Copies in the group are decoded but only the first is imported
+		if (file->skipped ||
+		    g_hash_table_contains(import->imported, file->hash))
+		{
+			file->skipped = TRUE;
+			import->skipped++;
+			continue;
+		}
+		g_hash_table_add(import->imported, g_strdup(file->hash));
+		if (file->failed > 0) {
+			log_error(g_strdup_printf("%s: %u of %u responses could not be decoded",
+						  file->path, file->failed,
+						  file->responses));
+		}
+		import->responses += file->responses;
+		import->failed += file->failed;
+		import->decode_cpu += file->decode_cpu;
+		import->entries += file->ships->len;
+	}
+
+	if (!_write_group(import, group, &error)) {
+		log_error(g_strconcat("Import failed: ", error, NULL));
+		g_free(error);
+		return FALSE;
+	}
+
+	for (guint i = 0; i < group->len; ++i) {
+		const struct ImportFile *file = g_ptr_array_index(group, i);
+
+		if (!file->error && !file->skipped) {
+			import->files++;
+			import->bytes += file->size;
+		}
+	}
+
+	log_message(g_strdup_printf("Imported %u files, %" G_GUINT64_FORMAT
+				    " positions",
+				    import->files, import->positions));
+
+	return TRUE;
+}
+
+static gboolean _check_imported(const struct Database *db, gchar **error)
+{
+	// Without the column retention would delete the backfill
+	if (!db->imported) {
+		*(error) = g_strdup("GPS table has no Imported column, apply "
+				    "scripts/migrations/001_gps_imported.sql "
+				    "before importing");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void _print_summary(const struct Import *import)
+{
+	gdouble seconds = (g_get_monotonic_time() - import->started) / 1e6;
+
+	g_print("files=%u skipped=%u unreadable=%u responses=%" G_GUINT64_FORMAT
+		" failed=%" G_GUINT64_FORMAT " entries=%" G_GUINT64_FORMAT
+		" positions=%" G_GUINT64_FORMAT " seconds=%.2f"
+		" entries_per_second=%.0f positions_per_second=%.0f"
+		" mb_per_second=%.1f decode_cpu_s=%.2f dedup_cpu_s=%.2f"
+		" write_cpu_s=%.2f\n",
+		import->files, import->skipped, import->unreadable,
+		import->responses, import->failed, import->entries,
+		import->positions, seconds,
+		seconds > 0 ? import->entries / seconds : 0,
+		seconds > 0 ? import->positions / seconds : 0,
+		seconds > 0 ? import->bytes / seconds / 1e6 : 0,
+		import->decode_cpu / 1e6, import->dedup_cpu / 1e6,
+		import->write_cpu / 1e6);
+}
+
+gint import_run(const struct Config *config, gchar **paths,
+	       const enum DbSink sink)
+{
+	struct Import import;
+	GPtrArray *files;
+	GPtrArray *group;
+	GHashTable *imported;
+	gchar *error;
+	gboolean ret;
+
+	memset(&import, 0, sizeof(import));
+	import.config = config;
+	import.sink = sink;
+	import.started = g_get_monotonic_time();
+	error = NULL;
+
+	files = g_ptr_array_new_with_free_func((GDestroyNotify)_free_file);
+	if (!_list_files(paths, files)) {
+		g_ptr_array_free(files, TRUE);
+		return 1;
+	}
+
+	imported = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	import.imported = imported;
+	if (sink == DB_SINK_NULL) {
+		import.db.discard = TRUE;
+	} else if (sink == DB_SINK_FILE) {
+		if (!config->journal_dir || config->journal_dir[0] == '\0') {
+			error = g_strdup("Sink `file` needs a journal, set "
+					 "journal_dir");
+		} else {
+			import.journal = journal_open(config->journal_dir, &error);
+		}
+		if (!import.journal) {
+			log_error(error);
+			g_hash_table_destroy(imported);
+			g_ptr_array_free(files, TRUE);
+			return 1;
+		}
+	} else if (!db_init(&import.db, config, &error) ||
+		   !_check_imported(&import.db, &error) ||
+		   !db_get_imported_files(&import.db, imported, &error))
+	{
+		log_error(error);
+		db_close_con(&import.db);
+		g_hash_table_destroy(imported);
+		g_ptr_array_free(files, TRUE);
+		return 1;
+	}
+
+	g_mutex_init(&import.lock);
+	g_cond_init(&import.cond);
+	import.last = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+					    g_free);
+	import.decoders = g_thread_pool_new(_decode_file, &import,
+					    config->workers > 0 ?
+					    (gint)config->workers :
+					    (gint)g_get_num_processors(),
+					    TRUE, NULL);
+
+	ret = TRUE;
+	group = g_ptr_array_new();
+	for (guint i = 0; ret && i <= files->len; ++i) {
+		struct ImportFile *file = i < files->len ?
+					  g_ptr_array_index(files, i) : NULL;
+
+		if (file) {
+			g_ptr_array_add(group, file);
+		}
+
+		if (group->len > 0 &&
+		    (!file || group->len == IMPORT_GROUP_FILES))
+		{
+			ret = _import_group(&import, group);
+
+			// Decoded entries are not needed anymore
+			for (guint j = 0; j < group->len; ++j) {
+				struct ImportFile *done = g_ptr_array_index(group, j);
+
+				ship_batch_free(done->ships);
+				done->ships = NULL;
+			}
+			g_ptr_array_set_size(group, 0);
+		}
+	}
+
+	_print_summary(&import);
+	if (import.unreadable > 0) {
+		ret = FALSE;
+	}
+
+	g_ptr_array_free(group, TRUE);
+	g_thread_pool_free(import.decoders, FALSE, TRUE);
+	g_hash_table_destroy(import.last);
+	g_cond_clear(&import.cond);
+	g_mutex_clear(&import.lock);
+	if (import.journal) {
+		journal_close(import.journal);
+	}
+	if (sink == DB_SINK_MYSQL) {
+		db_close_con(&import.db);
+	}
+	g_hash_table_destroy(imported);
+	g_ptr_array_free(files, TRUE);
+
+	return ret ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file import.h
+ * @brief Offline import of recorded API responses
+ * @details Implements the @c --import mode, which backfills the GPS table
+ * from archived aprs.fi responses. A file holds one response or many one
+ * after another, like one response per line.
+ *
+ * Files are imported in groups of @ref IMPORT_GROUP_FILES in name order.
+ * Files of a group are memory-mapped and decoded in parallel, positions are
+ * sorted by MMSI and time, repeated positions of a ship are dropped and the
+ * rest are inserted with multi-row INSERT statements. Each group is
+ * committed in one transaction together with the SHA-256 hashes of its
+ * files in the ImportedFiles table, so an interrupted import continues from
+ * the first group which was not committed and files with contents already
+ * imported are skipped, whatever their name.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <glib.h>
+
+#include "config.h"
+#include "database.h"
+
+/**
+ * Number of files committed in one transaction
+ */
+#define IMPORT_GROUP_FILES 256
+
+/**
+ * @brief Import files
+ *
+ * Prints a summary line to stdout with the numbers of files, responses and
+ * positions, the throughput and the CPU time of decoding, deduplication and
+ * writing.
+ *
+ * @ref DB_SINK_NULL and @ref DB_SINK_FILE do not connect to the database,
+ * so no file is skipped or marked imported. The null sink binds the INSERT
+ * parameters of the positions and discards them, the file sink stores them
+ * in the journal as updates of their ships.
+ *
+ * @param[in] config Struct of type Config(), @c workers files are decoded
+ * at once
+ * @param[in] paths NULL-terminated array of files and directories, files
+ * of a directory are imported but not its subdirectories
+ * @param[in] sink Where to write the positions
+ * @return gint Exit status, 0 if all files were imported
+ */
+gint import_run(const struct Config *config, gchar **paths,
+	       const enum DbSink sink);
+
+#endif
@@ -0,0 +1,166 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "intern.h"
+
+#define INTERN_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief One part of the table, picked by the hash of the string
+ */
+struct InternShard {
+	GRWLock lock; /**< Protects the fields below */
+	GHashTable *table; /**< Interned strings, key and value are the same */
+	GStringChunk *chunk; /**< Storage of the strings */
+	gsize bytes; /**< Bytes in @p chunk */
+};
+
+/**
+ * @brief Strings the thread has looked up recently, indexed by hash
+ */
+struct InternCache {
+	guint generation; /**< @c GENERATION the entries belong to */
+	const gchar *strings[INTERN_CACHE_SIZE]; /**< Interned strings */
+};
+
+static struct InternShard SHARDS[INTERN_SHARDS];
+// Bumped by intern_free() so the caches of all threads are dropped
+static guint GENERATION = 0;
+static GPrivate CACHE = G_PRIVATE_INIT(g_free);
+static const gchar EMPTY[] = "";
+
+static struct InternCache *_cache()
+{
+	struct InternCache *cache = g_private_get(&CACHE);
+	guint generation = (guint)g_atomic_int_get(&GENERATION);
+
+	if (!cache) {
+		cache = g_new0(struct InternCache, 1);
+		cache->generation = generation;
+		g_private_set(&CACHE, cache);
+	} else if (cache->generation != generation) {
+		memset(cache, 0, sizeof(*cache));
+		cache->generation = generation;
+	}
+
+	return cache;
+}
+
+static const gchar *_lookup(const struct InternShard *shard, const gchar *str)
+{
+	return shard->table ? g_hash_table_lookup(shard->table, str) : NULL;
+}
+
+const gchar *intern_string(const gchar *str)
+{
+	struct InternCache *cache;
+	struct InternShard *shard;
+	const gchar **cached;
+	const gchar *ret;
+	gchar *copy;
+	guint hash;
+
+	if (!str || str[0] == '\0') {
+		return EMPTY;
+	}
+
+	// Almost every string has been seen before, usually by this thread
+	hash = g_str_hash(str);
+	cache = _cache();
+	cached = &cache->strings[hash & (INTERN_CACHE_SIZE - 1)];
+	if (*cached && strcmp(*cached, str) == 0) {
+		return *cached;
+	}
+
+	shard = &SHARDS[(hash >> 16) & (INTERN_SHARDS - 1)];
+
+	g_rw_lock_reader_lock(&shard->lock);
+	ret = _lookup(shard, str);
+	g_rw_lock_reader_unlock(&shard->lock);
+
+	if (!ret) {
+		g_rw_lock_writer_lock(&shard->lock);
+
+		ret = _lookup(shard, str);
+		if (!ret) {
+			if (!shard->table) {
+				shard->table = g_hash_table_new(g_str_hash,
+								g_str_equal);
+				shard->chunk = g_string_chunk_new(INTERN_CHUNK_SIZE);
+			}
+
+			copy = g_string_chunk_insert(shard->chunk, str);
+			g_hash_table_insert(shard->table, copy, copy);
+			shard->bytes += strlen(copy) + 1;
+			ret = copy;
+		}
+
+		g_rw_lock_writer_unlock(&shard->lock);
+	}
+
+	*cached = ret;
+
+	return ret;
+}
+
+guint intern_count()
+{
+	guint count = 0;
+
+	for (guint i = 0; i < INTERN_SHARDS; ++i) {
+		g_rw_lock_reader_lock(&SHARDS[i].lock);
+		count += SHARDS[i].table ? g_hash_table_size(SHARDS[i].table) : 0;
+		g_rw_lock_reader_unlock(&SHARDS[i].lock);
+	}
+
+	return count;
+}
+
+gsize intern_bytes()
+{
+	gsize bytes = 0;
+
+	for (guint i = 0; i < INTERN_SHARDS; ++i) {
+		g_rw_lock_reader_lock(&SHARDS[i].lock);
+		bytes += SHARDS[i].bytes;
+		g_rw_lock_reader_unlock(&SHARDS[i].lock);
+	}
+
+	return bytes;
+}
+
+void intern_free()
+{
+	for (guint i = 0; i < INTERN_SHARDS; ++i) {
+		struct InternShard *shard = &SHARDS[i];
+
+		g_rw_lock_writer_lock(&shard->lock);
+		if (shard->table) {
+			g_hash_table_destroy(shard->table);
+			g_string_chunk_free(shard->chunk);
+			shard->table = NULL;
+			shard->chunk = NULL;
+			shard->bytes = 0;
+		}
+		g_rw_lock_writer_unlock(&shard->lock);
+	}
+
+	g_atomic_int_inc(&GENERATION);
+}
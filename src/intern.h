@@ -0,0 +1,87 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file intern.h
+ * @brief Process wide string interning
+ * @details Callsigns repeat across polls and there is at most a few per
+ * ship. Interned strings are stored only once and live until the program
+ * exits, so two interned strings are equal exactly when the pointers are
+ * equal. Nothing is ever evicted, so only fields with a bounded number of
+ * distinct values may be interned; free text like comments and packet
+ * paths is not.
+ *
+ * The table is split into @ref INTERN_SHARDS shards with their own locks,
+ * and every thread keeps a small cache of the strings it has looked up, so
+ * the common case of a string which has been seen before takes no lock.
+ *
+ * All functions are thread safe.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <glib.h>
+
+/**
+ * Number of shards of the table, power of two
+ */
+#define INTERN_SHARDS 16
+
+/**
+ * Number of strings in the lookup cache of each thread, power of two
+ */
+#define INTERN_CACHE_SIZE 256
+
+/**
+ * @brief Get interned copy of a string
+ *
+ * @param[in] str String to intern, NULL is handled as an empty string
+ * @return const gchar* Canonical copy of @p str
+ * @note Returned string must not be freed or modified
+ */
+const gchar *intern_string(const gchar *str);
+
+/**
+ * Number of distinct interned strings
+ *
+ * @return guint
+ */
+guint intern_count();
+
+/**
+ * Bytes used by interned strings
+ *
+ * @return gsize
+ */
+gsize intern_bytes();
+
+/**
+ * @brief Free all interned strings
+ *
+ * Only for the end of the program, once no other thread uses interned
+ * strings. Every string returned by intern_string() is invalid afterwards.
+ *
+ * @return Nothing
+ */
+void intern_free();
+
+#endif
@@ -0,0 +1,851 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __WIN32__
+	#include <io.h>
+#endif
+#include "journal.h"
+#include "api_thread.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define SEGMENT_SUFFIX ".journal"
+#define BUFFER_SIZE (64 * 1024)
+
+#define HEADER_SIZE (sizeof(JOURNAL_MAGIC) - 1 + sizeof(guint32))
+#define RECORD_SHIP 1
+#define RECORD_POSITION 2
+
+static guint32 crc_table[256];
+
+static void _crc_init()
+{
+	static gsize initialized = 0;
+
+	if (g_once_init_enter(&initialized)) {
+		for (guint32 i = 0; i < 256; ++i) {
+			guint32 c = i;
+			for (gint k = 0; k < 8; ++k) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			crc_table[i] = c;
+		}
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
+static guint32 _crc32(const gchar *data, const gsize len)
+{
+	guint32 c = 0xFFFFFFFFu;
+
+	for (gsize i = 0; i < len; ++i) {
+		c = crc_table[(c ^ (guchar)data[i]) & 0xFF] ^ (c >> 8);
+	}
+
+	return c ^ 0xFFFFFFFFu;
+}
+
+static gboolean _write_all(const gint fd, const gchar *data, gsize len)
+{
+	while (len > 0) {
+		gssize n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+		data += n;
+		len -= (gsize)n;
+	}
+
+	return TRUE;
+}
+
+static gboolean _fsync(const gint fd)
+{
+#ifdef __WIN32__
+	return _commit(fd) == 0;
+#else
+	return fsync(fd) == 0;
+#endif
+}
+
+static gint _compare_segment(gconstpointer a, gconstpointer b)
+{
+	guint x = *(const guint *)a;
+	guint y = *(const guint *)b;
+
+	return x < y ? -1 : (x > y);
+}
+
+static GArray *_list_segments(const gchar *dir)
+{
+	GArray *segments;
+	GDir *gdir;
+	const gchar *name;
+
+	segments = g_array_new(FALSE, FALSE, sizeof(guint));
+	gdir = g_dir_open(dir, 0, NULL);
+	if (!gdir) {
+		return segments;
+	}
+
+	while ((name = g_dir_read_name(gdir)) != NULL) {
+		gchar *end;
+		guint64 id;
+
+		if (!g_str_has_suffix(name, SEGMENT_SUFFIX)) {
+			continue;
+		}
+
+		id = g_ascii_strtoull(name, &end, 10);
+		if (end != name && g_strcmp0(end, SEGMENT_SUFFIX) == 0) {
+			guint _id = (guint)id;
+			g_array_append_val(segments, _id);
+		}
+	}
+	g_dir_close(gdir);
+
+	g_array_sort(segments, _compare_segment);
+
+	return segments;
+}
+
+static gchar *_segment_path(const gchar *dir, const guint id)
+{
+	gchar *name;
+	gchar *path;
+
+	name = g_strdup_printf("%08u" SEGMENT_SUFFIX, id);
+	path = g_build_filename(dir, name, NULL);
+	g_free(name);
+
+	return path;
+}
+
+static void _close_segment(struct Journal *journal)
+{
+	if (journal->fd >= 0) {
+		close(journal->fd);
+		journal->fd = -1;
+	}
+}
+
+static gboolean _open_segment(struct Journal *journal, gchar **error)
+{
+	guint32 version = GUINT32_TO_LE(JOURNAL_VERSION);
+	gchar header[HEADER_SIZE];
+	gchar *path;
+
+	++journal->segment;
+	path = _segment_path(journal->dir, journal->segment);
+	journal->fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0600);
+	if (journal->fd < 0) {
+		*(error) = g_strconcat("could not create journal segment ", path,
+				       ": ", g_strerror(errno), NULL);
+		g_free(path);
+		return FALSE;
+	}
+	g_free(path);
+
+	memcpy(header, JOURNAL_MAGIC, HEADER_SIZE - sizeof(version));
+	memcpy(header + HEADER_SIZE - sizeof(version), &version, sizeof(version));
+	if (!_write_all(journal->fd, header, HEADER_SIZE)) {
+		*(error) = g_strconcat("could not write journal: ",
+				       g_strerror(errno), NULL);
+		_close_segment(journal);
+		return FALSE;
+	}
+
+	journal->segment_size = HEADER_SIZE;
+	++journal->segments;
+
+	return TRUE;
+}
+
+static void _put_u8(GString *buffer, const guint8 value)
+{
+	g_string_append_c(buffer, (gchar)value);
+}
+
+static void _put_u32(GString *buffer, const guint32 value)
+{
+	guint32 le = GUINT32_TO_LE(value);
+
+	g_string_append_len(buffer, (const gchar *)&le, sizeof(le));
+}
+
+static void _put_u64(GString *buffer, const guint64 value)
+{
+	guint64 le = GUINT64_TO_LE(value);
+
+	g_string_append_len(buffer, (const gchar *)&le, sizeof(le));
+}
+
+static void _put_float(GString *buffer, const gfloat value)
+{
+	guint32 bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	_put_u32(buffer, bits);
+}
+
+static void _put_double(GString *buffer, const gdouble value)
+{
+	guint64 bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	_put_u64(buffer, bits);
+}
+
+static void _put_string(GString *buffer, const gchar *str)
+{
+	guint16 len = str ? (guint16)MIN(strlen(str), G_MAXUINT16) : 0;
+	guint16 le = GUINT16_TO_LE(len);
+
+	g_string_append_len(buffer, (const gchar *)&le, sizeof(le));
+	if (len > 0) {
+		g_string_append_len(buffer, str, len);
+	}
+}
+
+static gboolean _get_u8(const gchar **data, const gchar *end, guint8 *value)
+{
+	if (*data + sizeof(*value) > end) {
+		return FALSE;
+	}
+	*(value) = (guint8)**data;
+	*data += sizeof(*value);
+
+	return TRUE;
+}
+
+static gboolean _get_u32(const gchar **data, const gchar *end, guint32 *value)
+{
+	guint32 le;
+
+	if (*data + sizeof(le) > end) {
+		return FALSE;
+	}
+	memcpy(&le, *data, sizeof(le));
+	*(value) = GUINT32_FROM_LE(le);
+	*data += sizeof(le);
+
+	return TRUE;
+}
+
+static gboolean _get_u64(const gchar **data, const gchar *end, guint64 *value)
+{
+	guint64 le;
+
+	if (*data + sizeof(le) > end) {
+		return FALSE;
+	}
+	memcpy(&le, *data, sizeof(le));
+	*(value) = GUINT64_FROM_LE(le);
+	*data += sizeof(le);
+
+	return TRUE;
+}
+
+static gboolean _get_i32(const gchar **data, const gchar *end, gint *value)
+{
+	guint32 bits;
+
+	if (!_get_u32(data, end, &bits)) {
+		return FALSE;
+	}
+	*(value) = (gint32)bits;
+
+	return TRUE;
+}
+
+static gboolean _get_i64(const gchar **data, const gchar *end, gint64 *value)
+{
+	guint64 bits;
+
+	if (!_get_u64(data, end, &bits)) {
+		return FALSE;
+	}
+	*(value) = (gint64)bits;
+
+	return TRUE;
+}
+
+static gboolean _get_time(const gchar **data, const gchar *end, time_t *value)
+{
+	gint64 time;
+
+	if (!_get_i64(data, end, &time)) {
+		return FALSE;
+	}
+	*(value) = (time_t)time;
+
+	return TRUE;
+}
+
+static gboolean _get_float(const gchar **data, const gchar *end, gfloat *value)
+{
+	guint32 bits;
+
+	if (!_get_u32(data, end, &bits)) {
+		return FALSE;
+	}
+	memcpy(value, &bits, sizeof(*value));
+
+	return TRUE;
+}
+
+static gboolean _get_double(const gchar **data, const gchar *end,
+			    gdouble *value)
+{
+	guint64 bits;
+
+	if (!_get_u64(data, end, &bits)) {
+		return FALSE;
+	}
+	memcpy(value, &bits, sizeof(*value));
+
+	return TRUE;
+}
+
+static gboolean _get_char(const gchar **data, const gchar *end, gchar *value)
+{
+	guint8 c;
+
+	if (!_get_u8(data, end, &c)) {
+		return FALSE;
+	}
+	*(value) = (gchar)c;
+
+	return TRUE;
+}
+
+static gboolean _get_string(const gchar **data, const gchar *end, gchar **str)
+{
+	guint16 len;
+
+	if (*data + sizeof(len) > end) {
+		return FALSE;
+	}
+	memcpy(&len, *data, sizeof(len));
+	len = GUINT16_FROM_LE(len);
+	*data += sizeof(len);
+
+	if (*data + len > end) {
+		return FALSE;
+	}
+	*(str) = g_strndup(*data, len);
+	*data += len;
+
+	return TRUE;
+}
+
+static gboolean _get_strings(const gchar **data, const gchar *end,
+			     struct Ship *ship)
+{
+	return _get_string(data, end, &ship->name) &&
+	       _get_string(data, end, &ship->comment) &&
+	       _get_string(data, end, &ship->path) &&
+	       _get_string(data, end, &ship->srccall) &&
+	       _get_string(data, end, &ship->dstcall);
+}
+
+static void _free_ship(gpointer data)
+{
+	struct Ship *ship = data;
+
+	g_free(ship->name);
+	g_free(ship->comment);
+	g_free(ship->path);
+	g_free(ship->srccall);
+	g_free(ship->dstcall);
+	g_slice_free(struct Ship, ship);
+}
+
+static struct Ship *_decode(const gchar *data, const gchar *end)
+{
+	struct Ship *ship;
+	gboolean ok;
+
+	ship = g_slice_new0(struct Ship);
+	ok = _get_i64(&data, end, &ship->imo) &&
+	     _get_i64(&data, end, &ship->mmsi) &&
+	     _get_time(&data, end, &ship->time) &&
+	     _get_time(&data, end, &ship->lasttime) &&
+	     _get_double(&data, end, &ship->latitude) &&
+	     _get_double(&data, end, &ship->longitude) &&
+	     _get_float(&data, end, &ship->course) &&
+	     _get_float(&data, end, &ship->speed) &&
+	     _get_float(&data, end, &ship->length) &&
+	     _get_float(&data, end, &ship->width) &&
+	     _get_float(&data, end, &ship->draught) &&
+	     _get_i32(&data, end, &ship->heading) &&
+	     _get_i32(&data, end, &ship->ref_front) &&
+	     _get_i32(&data, end, &ship->ref_left) &&
+	     _get_i32(&data, end, &ship->vessel_class) &&
+	     _get_i32(&data, end, &ship->navstat) &&
+	     _get_char(&data, end, &ship->class) &&
+	     _get_char(&data, end, &ship->type) &&
+	     _get_strings(&data, end, ship);
+
+	if (!ok) {
+		_free_ship(ship);
+		return NULL;
+	}
+
+	return ship;
+}
+
+static gboolean _decode_position(const gchar *data, const gchar *end,
+				 struct ShipPosition *position)
+{
+	return _get_i64(&data, end, &position->imo) &&
+	       _get_time(&data, end, &position->time) &&
+	       _get_time(&data, end, &position->lasttime) &&
+	       _get_double(&data, end, &position->latitude) &&
+	       _get_double(&data, end, &position->longitude);
+}
+
+struct Journal *journal_open(const gchar *dir, gchar **error)
+{
+	struct Journal *journal;
+	GArray *segments;
+
+	_crc_init();
+
+	if (g_mkdir_with_parents(dir, 0700) != 0) {
+		*(error) = g_strconcat("could not create journal directory ",
+				       dir, ": ", g_strerror(errno), NULL);
+		return NULL;
+	}
+
+	journal = g_slice_new0(struct Journal);
+	journal->dir = g_strdup(dir);
+	journal->fd = -1;
+	journal->buffer = g_string_sized_new(BUFFER_SIZE);
+
+	segments = _list_segments(dir);
+	journal->segments = segments->len;
+	if (segments->len > 0) {
+		journal->segment = g_array_index(segments, guint,
+						 segments->len - 1);
+	}
+	g_array_free(segments, TRUE);
+
+	return journal;
+}
+
+void journal_close(struct Journal *journal)
+{
+	gchar *error = NULL;
+
+	if (!journal_sync(journal, &error)) {
+		log_error(g_strconcat("Journal: ", error, NULL));
+		g_free(error);
+	}
+	_close_segment(journal);
+
+	g_string_free(journal->buffer, TRUE);
+	g_free(journal->dir);
+	g_slice_free(struct Journal, journal);
+}
+
+// Length and CRC are filled in by _end_record() once the payload is in the
+// buffer
+static gsize _begin_record(struct Journal *journal, const guint8 kind)
+{
+	gsize start = journal->buffer->len;
+
+	_put_u32(journal->buffer, 0);
+	_put_u32(journal->buffer, 0);
+	_put_u8(journal->buffer, kind);
+
+	return start;
+}
+
+static gboolean _end_record(struct Journal *journal, const gsize start,
+			    gchar **error)
+{
+	guint32 len;
+	guint32 crc;
+
+	len = (guint32)(journal->buffer->len - start - 2 * sizeof(guint32));
+	crc = _crc32(journal->buffer->str + start + 2 * sizeof(guint32), len);
+	len = GUINT32_TO_LE(len);
+	crc = GUINT32_TO_LE(crc);
+	memcpy(journal->buffer->str + start, &len, sizeof(len));
+	memcpy(journal->buffer->str + start + sizeof(len), &crc, sizeof(crc));
+
+	++journal->unsynced;
+	if (journal->unsynced >= JOURNAL_SYNC_RECORDS ||
+	    journal->buffer->len >= BUFFER_SIZE)
+	{
+		return journal_sync(journal, error);
+	}
+
+	return TRUE;
+}
+
+gboolean journal_append(struct Journal *journal, const struct Ship *ship,
+			gchar **error)
+{
+	gsize start = _begin_record(journal, RECORD_SHIP);
+
+	_put_u64(journal->buffer, (guint64)ship->imo);
+	_put_u64(journal->buffer, (guint64)ship->mmsi);
+	_put_u64(journal->buffer, (guint64)ship->time);
+	_put_u64(journal->buffer, (guint64)ship->lasttime);
+	_put_double(journal->buffer, ship->latitude);
+	_put_double(journal->buffer, ship->longitude);
+	_put_float(journal->buffer, ship->course);
+	_put_float(journal->buffer, ship->speed);
+	_put_float(journal->buffer, ship->length);
+	_put_float(journal->buffer, ship->width);
+	_put_float(journal->buffer, ship->draught);
+	_put_u32(journal->buffer, (guint32)ship->heading);
+	_put_u32(journal->buffer, (guint32)ship->ref_front);
+	_put_u32(journal->buffer, (guint32)ship->ref_left);
+	_put_u32(journal->buffer, (guint32)ship->vessel_class);
+	_put_u32(journal->buffer, (guint32)ship->navstat);
+	_put_u8(journal->buffer, (guint8)ship->class);
+	_put_u8(journal->buffer, (guint8)ship->type);
+	_put_string(journal->buffer, ship->name);
+	_put_string(journal->buffer, ship->comment);
+	_put_string(journal->buffer, ship->path);
+	_put_string(journal->buffer, ship->srccall);
+	_put_string(journal->buffer, ship->dstcall);
+
+	return _end_record(journal, start, error);
+}
+
+gboolean journal_append_position(struct Journal *journal,
+				 const struct ShipPosition *position,
+				 gchar **error)
+{
+	gsize start = _begin_record(journal, RECORD_POSITION);
+
+	_put_u64(journal->buffer, (guint64)position->imo);
+	_put_u64(journal->buffer, (guint64)position->time);
+	_put_u64(journal->buffer, (guint64)position->lasttime);
+	_put_double(journal->buffer, position->latitude);
+	_put_double(journal->buffer, position->longitude);
+
+	return _end_record(journal, start, error);
+}
+
+gboolean journal_sync(struct Journal *journal, gchar **error)
+{
+	if (journal->buffer->len == 0) {
+		return TRUE;
+	}
+
+	if (journal->fd < 0 && !_open_segment(journal, error)) {
+		return FALSE;
+	}
+
+	if (!_write_all(journal->fd, journal->buffer->str,
+			journal->buffer->len) || !_fsync(journal->fd))
+	{
+		*(error) = g_strconcat("could not write journal: ",
+				       g_strerror(errno), NULL);
+		return FALSE;
+	}
+
+	journal->segment_size += journal->buffer->len;
+	g_string_truncate(journal->buffer, 0);
+	journal->unsynced = 0;
+
+	if (journal->segment_size >= JOURNAL_SEGMENT_SIZE) {
+		_close_segment(journal);
+	}
+
+	return TRUE;
+}
+
+gboolean journal_is_empty(const struct Journal *journal)
+{
+	return journal->segments == 0 && journal->buffer->len == 0;
+}
+
+// Version of the segment or 0 if it is not a journal segment, offset is
+// set to the first record
+static guint32 _segment_version(const gchar *contents, const gsize length,
+				gsize *offset)
+{
+	const gsize magic = strlen(JOURNAL_MAGIC);
+	guint32 version;
+
+	if (length < HEADER_SIZE || memcmp(contents, JOURNAL_MAGIC, magic) != 0) {
+		return 0;
+	}
+
+	memcpy(&version, contents + magic, sizeof(version));
+	*(offset) = HEADER_SIZE;
+
+	return GUINT32_FROM_LE(version);
+}
+
+static gboolean _replay_segment(const gchar *path, const struct Database *db,
+				guint *records, gchar **error)
+{
+	gchar *contents;
+	gsize length;
+	gsize offset;
+	guint32 version;
+	GHashTable *latest;
+	GArray *positions;
+	GArray *imported;
+	GHashTableIter iter;
+	gpointer value;
+	gboolean ret;
+
+	if (!g_file_get_contents(path, &contents, &length, NULL)) {
+		*(error) = g_strconcat("could not read ", path, NULL);
+		return FALSE;
+	}
+
+	version = _segment_version(contents, length, &offset);
+	if (version > JOURNAL_VERSION) {
+		*(error) = g_strdup_printf("%s was written by a newer version "
+					   "of the journal (%u)", path, version);
+		g_free(contents);
+		return FALSE;
+	} else if (version == 0) {
+		*(error) = g_strconcat(path, " is not a journal segment", NULL);
+		g_free(contents);
+		return FALSE;
+	}
+
+	latest = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+				       _free_ship);
+	positions = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+	imported = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+
+	while (offset + 2 * sizeof(guint32) <= length) {
+		guint32 header[2];
+		const gchar *payload;
+		const gchar *end;
+		struct Ship *ship;
+		struct ShipPosition pos;
+		guint8 kind;
+
+		memcpy(header, contents + offset, sizeof(header));
+		header[0] = GUINT32_FROM_LE(header[0]);
+		header[1] = GUINT32_FROM_LE(header[1]);
+		if (header[0] > length - offset - sizeof(header) ||
+		    _crc32(contents + offset + sizeof(header), header[0]) != header[1])
+		{
+			log_error(g_strdup_printf("Journal: %s has a damaged record at offset %" G_GSIZE_FORMAT ", rest of the segment ignored",
+						  path, offset));
+			break;
+		}
+
+		payload = contents + offset + sizeof(header);
+		end = payload + header[0];
+		offset += sizeof(header) + header[0];
+
+		if (!_get_u8(&payload, end, &kind)) {
+			continue;
+		} else if (kind == RECORD_POSITION) {
+			// Archived positions, the ship itself is not updated
+			if (_decode_position(payload, end, &pos)) {
+				g_array_append_val(imported, pos);
+				++(*records);
+			}
+			continue;
+		} else if (kind == RECORD_SHIP) {
+			ship = _decode(payload, end);
+		} else {
+			continue;
+		}
+		if (!ship) {
+			continue;
+		}
+
+		pos.imo = ship->imo;
+		pos.time = ship->time;
+		pos.lasttime = ship->lasttime;
+		pos.latitude = ship->latitude;
+		pos.longitude = ship->longitude;
+		g_array_append_val(positions, pos);
+
+		g_hash_table_replace(latest, &ship->mmsi, ship);
+		++(*records);
+	}
+	g_free(contents);
+
+	ret = db_begin(db, error);
+
+	g_hash_table_iter_init(&iter, latest);
+	while (ret && g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct Ship *ship = value;
+		gchar *_error = NULL;
+
+		if (!db_update_ship_info(db, ship, &_error)) {
+			if (!db_is_connected(db)) {
+				*(error) = _error;
+				ret = FALSE;
+			} else {
+				log_event(LOG_LEVEL_ERROR, "backlog", "update_ships",
+					  ship->mmsi, -1,
+					  "%s: UPDATE Ships failed, %s",
+					  ship->name, _error);
+				g_free(_error);
+			}
+		}
+	}
+
+	if (ret) {
+		ret = db_insert_ship_gps_bulk(db,
+					      (struct ShipPosition *)positions->data,
+					      positions->len, NULL, error);
+	}
+	if (ret && imported->len > 0) {
+		ret = db_import_ship_gps_bulk(db,
+					      (struct ShipPosition *)imported->data,
+					      imported->len, error);
+	}
+
+	if (ret) {
+		ret = db_commit(db, error);
+	} else {
+		db_rollback(db);
+	}
+
+	g_hash_table_iter_init(&iter, latest);
+	while (ret && g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct Ship *ship = value;
+		gchar *_error = NULL;
+
+		if (!db_clean_ship_gps(db, &ship->imo, &_error)) {
+			log_event(LOG_LEVEL_ERROR, "backlog", "clean_gps",
+				  ship->mmsi, -1,
+				  "%s: DELETE of old GPS records failed, %s",
+				  ship->name, _error);
+			g_free(_error);
+		}
+	}
+
+	g_array_free(imported, TRUE);
+	g_array_free(positions, TRUE);
+	g_hash_table_destroy(latest);
+
+	return ret;
+}
+
+// Segment is renamed so it does not block the ones after it and can still
+// be looked at or replayed by hand
+static void _quarantine(const gchar *path, gchar *reason)
+{
+	gchar *bad = g_strconcat(path, ".bad", NULL);
+
+	if (g_rename(path, bad) != 0) {
+		log_error(g_strdup_printf("Journal: %s, could not move it aside: %s",
+					  reason, g_strerror(errno)));
+	} else {
+		log_error(g_strdup_printf("Journal: %s, moved to %s", reason,
+					  bad));
+	}
+	g_free(reason);
+	g_free(bad);
+}
+
+gboolean journal_replay(struct Journal *journal, const struct Database *db,
+			guint *records, gchar **error)
+{
+	GArray *segments;
+	guint replayed;
+	gboolean ret;
+
+	if (!journal_sync(journal, error)) {
+		return FALSE;
+	}
+	_close_segment(journal);
+
+	segments = _list_segments(journal->dir);
+	replayed = 0;
+	ret = TRUE;
+
+	for (guint i = 0; i < segments->len; ++i) {
+		gchar *path;
+		gchar *_error;
+
+		path = _segment_path(journal->dir,
+				     g_array_index(segments, guint, i));
+		_error = NULL;
+		ret = _replay_segment(path, db, &replayed, &_error);
+		if (ret) {
+			g_remove(path);
+			--journal->segments;
+		} else if (db_is_connected(db)) {
+			// Server rejected the segment, trying again would fail
+			// the same way
+			_quarantine(path, _error);
+			--journal->segments;
+			ret = TRUE;
+		} else {
+			*(error) = _error;
+		}
+		g_free(path);
+
+		if (!ret) {
+			break;
+		}
+	}
+	g_array_free(segments, TRUE);
+
+	if (records) {
+		*(records) = replayed;
+	}
+
+	return ret;
+}
+
+void journal_save_roster(const struct Journal *journal, const gchar *roster)
+{
+	gchar *path;
+
+	path = g_build_filename(journal->dir, "roster", NULL);
+	g_file_set_contents(path, roster, -1, NULL);
+	g_free(path);
+}
+
+gchar *journal_load_roster(const struct Journal *journal)
+{
+	gchar *path;
+	gchar *roster;
+
+	path = g_build_filename(journal->dir, "roster", NULL);
+	if (!g_file_get_contents(path, &roster, NULL, NULL)) {
+		roster = NULL;
+	}
+	g_free(path);
+
+	return roster;
+}
@@ -0,0 +1,193 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file journal.h
+ * @brief Write-ahead journal for database outages
+ * @details Stores ship updates on local disk while the database can not be
+ * reached and replays them once the connection is back.
+ *
+ * Journal is a directory of segment files named @c NNNNNNNN.journal. Each
+ * segment starts with @ref JOURNAL_MAGIC and a 32-bit @ref JOURNAL_VERSION
+ * and is followed by records of a 32-bit payload length, CRC-32 of the
+ * payload and the payload itself. Payload is a record type byte and the
+ * fields written one by one, so the format does not depend on the compiler
+ * or the layout of struct Ship(). All integers are little-endian.
+ * A record with bad CRC or a truncated record ends the segment, so a torn
+ * write after a crash loses only the updates which were not yet synced.
+ *
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <glib.h>
+
+#include "database.h"
+#include "ship_defines.h"
+
+/**
+ * Magic bytes at the start of each segment
+ */
+#define JOURNAL_MAGIC "SSJR"
+
+/**
+ * Version of the record format, written after @ref JOURNAL_MAGIC
+ */
+#define JOURNAL_VERSION 1
+
+/**
+ * Segment is closed and a new one started after it grows over this size
+ */
+#define JOURNAL_SEGMENT_SIZE (4 * 1024 * 1024)
+
+/**
+ * Number of appended records after which the segment is synced to disk
+ */
+#define JOURNAL_SYNC_RECORDS 256
+
+/**
+ * @struct Journal
+ * @brief Holds state of the journal
+ */
+struct Journal {
+	gchar *dir; /**< Journal directory */
+	gint fd; /**< Segment being written, -1 if none */
+	guint segment; /**< Number of the segment being written */
+	gsize segment_size; /**< Bytes written to the current segment */
+	GString *buffer; /**< Records not yet written to @p fd */
+	guint unsynced; /**< Records appended since last sync */
+	guint segments; /**< Number of segments on disk */
+};
+
+/**
+ * @brief Open journal directory
+ *
+ * Creates the directory if it does not exist and counts segments left by
+ * the previous run.
+ *
+ * @param[in] dir Journal directory
+ * @param[out] error Pointer to gchar where to store error message
+ * @return struct Journal* or NULL on failure
+ * @note Free with journal_close()
+ */
+struct Journal *journal_open(const gchar *dir, gchar **error);
+
+/**
+ * Sync and close journal
+ *
+ * @param[in] journal Struct of type Journal()
+ * @return Nothing
+ */
+void journal_close(struct Journal *journal);
+
+/**
+ * @brief Append ship update to the journal
+ *
+ * Record is buffered and the segment is synced to disk after every
+ * @ref JOURNAL_SYNC_RECORDS records.
+ *
+ * @param[in] journal Struct of type Journal()
+ * @param[in] ship Struct of type Ship()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE on success, otherwise FALSE
+ */
+gboolean journal_append(struct Journal *journal, const struct Ship *ship,
+			gchar **error);
+
+/**
+ * @brief Append archived position to the journal
+ *
+ * Unlike journal_append(), the record holds only the position. Replay
+ * writes it with db_import_ship_gps_bulk() and leaves the ship's row in
+ * Ships table as it is.
+ *
+ * @param[in] journal Struct of type Journal()
+ * @param[in] position Struct of type ShipPosition()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE on success, otherwise FALSE
+ */
+gboolean journal_append_position(struct Journal *journal,
+				 const struct ShipPosition *position,
+				 gchar **error);
+
+/**
+ * Write buffered records and sync the segment to disk
+ *
+ * @param[in] journal Struct of type Journal()
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE on success, otherwise FALSE
+ */
+gboolean journal_sync(struct Journal *journal, gchar **error);
+
+/**
+ * Check are there any records in the journal
+ *
+ * @param[in] journal Struct of type Journal()
+ * @return gboolean TRUE if there is nothing to replay
+ */
+gboolean journal_is_empty(const struct Journal *journal);
+
+/**
+ * @brief Write journal contents to the database
+ *
+ * Segments are replayed oldest first, each in its own transaction. Latest
+ * ship information of each MMSI is written with db_update_ship_info() and
+ * all positions with db_insert_ship_gps_bulk(). Positions appended with
+ * journal_append_position() go to db_import_ship_gps_bulk(). Segment is
+ * deleted after its transaction has been committed.
+ *
+ * Replay stops when the connection is lost. A segment which fails while
+ * the server is still up, like one of a newer @ref JOURNAL_VERSION, a file
+ * without @ref JOURNAL_MAGIC or one with a row the server rejects, is rolled back, logged and renamed with
+ * suffix ".bad", and replay goes on with the next one.
+ *
+ * @param[in] journal Struct of type Journal()
+ * @param[in] db Struct of type Database()
+ * @param[out] records Number of records replayed, may be NULL
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE if all segments were replayed, otherwise FALSE
+ */
+gboolean journal_replay(struct Journal *journal, const struct Database *db,
+			guint *records, gchar **error);
+
+/**
+ * @brief Store ship roster in the journal directory
+ *
+ * Roster is used to keep fetching from the API when the program is
+ * started while the database is down.
+ *
+ * @param[in] journal Struct of type Journal()
+ * @param[in] roster Comma separated MMSI's as returned by db_get_ships()
+ * @return Nothing
+ */
+void journal_save_roster(const struct Journal *journal, const gchar *roster);
+
+/**
+ * Load roster saved with journal_save_roster()
+ *
+ * @param[in] journal Struct of type Journal()
+ * @return gchar* or NULL if there is no roster
+ * @note Returned string should be freed with g_free()
+ */
+gchar *journal_load_roster(const struct Journal *journal);
+
+#endif
@@ -19,7 +19,10 @@
 
 #include <json-glib/json-glib.h>
 #include <string.h>
+#include "intern.h"
 #include "json.h"
+#include "metrics.h"
+#include "trace.h"
 
 static gboolean _get_node(const gchar *member, const gchar *json,
 			  JsonNode **node)
@@ -118,32 +121,72 @@ gboolean json_read_string(const gchar *member, const gchar *json, gchar **value)
 	return TRUE;
 }
 
+static gint64 _node_to_int(JsonNode *node)
+{
+	switch (json_node_get_value_type(node)) {
+		case G_TYPE_INT:
+		case G_TYPE_UINT:
+		case G_TYPE_LONG:
+		case G_TYPE_ULONG:
+		case G_TYPE_INT64:
+		case G_TYPE_UINT64:
+			return json_node_get_int(node);
+		case G_TYPE_STRING:
+			return g_ascii_strtoll(json_node_get_string(node), NULL, 10);
+		default:
+			return 0;
+	}
+}
+
+static gdouble _node_to_double(JsonNode *node)
+{
+	switch (json_node_get_value_type(node)) {
+		case G_TYPE_INT:
+		case G_TYPE_UINT:
+		case G_TYPE_LONG:
+		case G_TYPE_ULONG:
+		case G_TYPE_INT64:
+		case G_TYPE_UINT64:
+			return json_node_get_int(node);
+		case G_TYPE_FLOAT:
+		case G_TYPE_DOUBLE:
+			return json_node_get_double(node);
+		case G_TYPE_STRING:
+			return g_ascii_strtod(json_node_get_string(node), NULL);
+		default:
+			return 0.0;
+	}
+}
+
+static gchar *_node_to_string(JsonNode *node)
+{
+	switch (json_node_get_value_type(node)) {
+		case G_TYPE_INT:
+		case G_TYPE_UINT:
+		case G_TYPE_LONG:
+		case G_TYPE_ULONG:
+		case G_TYPE_INT64:
+		case G_TYPE_UINT64:
+			return g_strdup_printf("%" G_GUINT64_FORMAT,
+					       json_node_get_int(node));
+		case G_TYPE_FLOAT:
+		case G_TYPE_DOUBLE:
+			return g_strdup_printf("%f", json_node_get_double(node));
+		case G_TYPE_STRING:
+			return g_strdup(json_node_get_string(node));
+		default:
+			return NULL;
+	}
+}
+
 gint64 json_read_entry_int(const gchar *member, const gchar *json,
 			   const gint64 index)
 {
 	gint64 ret = 0;
 	JsonNode *node;
-	GType node_type;
 
 	if (_get_node_from_array(member, json, index, &node)) {
-		node_type = json_node_get_value_type(node);
-
-		switch (node_type) {
-			case G_TYPE_INT:
-			case G_TYPE_UINT:
-			case G_TYPE_LONG:
-			case G_TYPE_ULONG:
-			case G_TYPE_INT64:
-			case G_TYPE_UINT64:
-				ret = json_node_get_int(node);
-				break;
-			case G_TYPE_STRING:
-				ret = g_ascii_strtoll(json_node_get_string(node),
-						      NULL, 10);
-				break;
-			default:
-				break;
-		}
+		ret = _node_to_int(node);
 		json_node_free(node);
 	}
 
@@ -155,31 +198,9 @@ gdouble json_read_entry_double(const gchar *member, const gchar *json,
 {
 	gdouble ret = 0.0;
 	JsonNode *node;
-	GType node_type;
 
 	if (_get_node_from_array(member, json, index, &node)) {
-		node_type = json_node_get_value_type(node);
-
-		switch (node_type) {
-			case G_TYPE_INT:
-			case G_TYPE_UINT:
-			case G_TYPE_LONG:
-			case G_TYPE_ULONG:
-			case G_TYPE_INT64:
-			case G_TYPE_UINT64:
-				ret = json_node_get_int(node);
-				break;
-			case G_TYPE_FLOAT:
-			case G_TYPE_DOUBLE:
-				ret = json_node_get_double(node);
-				break;
-			case G_TYPE_STRING:
-				ret = g_ascii_strtod(json_node_get_string(node),
-						     NULL);
-				break;
-			default:
-				break;
-		}
+		ret = _node_to_double(node);
 		json_node_free(node);
 	}
 
@@ -197,32 +218,9 @@ gchar *json_read_entry_string(const gchar *member, const gchar *json,
 {
 	gchar *ret = NULL;
 	JsonNode *node;
-	GType node_type;
 
 	if (_get_node_from_array(member, json, index, &node)) {
-		node_type = json_node_get_value_type(node);
-
-		switch (node_type) {
-			case G_TYPE_INT:
-			case G_TYPE_UINT:
-			case G_TYPE_LONG:
-			case G_TYPE_ULONG:
-			case G_TYPE_INT64:
-			case G_TYPE_UINT64:
-				ret = g_strdup_printf("%" G_GUINT64_FORMAT,
-						      json_node_get_int(node));
-				break;
-			case G_TYPE_FLOAT:
-			case G_TYPE_DOUBLE:
-				ret = g_strdup_printf("%f",
-						      json_node_get_double(node));
-				break;
-			case G_TYPE_STRING:
-				ret = g_strdup(json_node_get_string(node));
-				break;
-			default:
-				break;
-		}
+		ret = _node_to_string(node);
 		json_node_free(node);
 	}
 
@@ -234,36 +232,277 @@ gchar json_read_entry_char(const gchar *member, const gchar *json,
 {
 	gchar *ret = NULL;
 	JsonNode *node;
-	GType node_type;
 
 	if (_get_node_from_array(member, json, index, &node)) {
-		node_type = json_node_get_value_type(node);
-
-		switch (node_type) {
-			case G_TYPE_INT:
-			case G_TYPE_UINT:
-			case G_TYPE_LONG:
-			case G_TYPE_ULONG:
-			case G_TYPE_INT64:
-			case G_TYPE_UINT64:
-				ret = g_strdup_printf("%" G_GUINT64_FORMAT,
-						      json_node_get_int(node));
-				break;
-			case G_TYPE_FLOAT:
-			case G_TYPE_DOUBLE:
-				ret = g_strdup_printf("%f",
-						      json_node_get_double(node));
+		ret = _node_to_string(node);
+		json_node_free(node);
+	}
+
+	if (ret) {
+		gchar c = ret[0];
+		g_free(ret);
+		return c;
+	}
+
+	return (gchar)'0';
+}
+
+static JsonNode *_member(JsonObject *entry, const gchar *member)
+{
+	return entry ? json_object_get_member(entry, member) : NULL;
+}
+
+static gint64 _entry_int(JsonObject *entry, const gchar *member)
+{
+	JsonNode *node = _member(entry, member);
+
+	return node ? _node_to_int(node) : 0;
+}
+
+static gdouble _entry_double(JsonObject *entry, const gchar *member)
+{
+	JsonNode *node = _member(entry, member);
+
+	return node ? _node_to_double(node) : 0.0;
+}
+
+// Callsigns are interned, free text is stored in the batch
+static const gchar *_entry_string(JsonObject *entry, const gchar *member,
+				  struct ShipBatch *batch)
+{
+	JsonNode *node = _member(entry, member);
+	const gchar *ret;
+	gchar *str;
+
+	if (!node) {
+		return batch ? ship_batch_string(batch, NULL) : intern_string(NULL);
+	}
+
+	if (json_node_get_value_type(node) == G_TYPE_STRING) {
+		ret = json_node_get_string(node);
+		return batch ? ship_batch_string(batch, ret) : intern_string(ret);
+	}
+
+	str = _node_to_string(node);
+	ret = batch ? ship_batch_string(batch, str) : intern_string(str);
+	g_free(str);
+
+	return ret;
+}
+
+static gchar _entry_char(JsonObject *entry, const gchar *member)
+{
+	JsonNode *node = _member(entry, member);
+	gchar *str;
+	gchar ret;
+
+	if (!node) {
+		return '0';
+	}
+
+	if (json_node_get_value_type(node) == G_TYPE_STRING) {
+		return json_node_get_string(node)[0];
+	}
+
+	str = _node_to_string(node);
+	ret = str ? str[0] : (gchar)'0';
+	g_free(str);
+
+	return ret;
+}
+
+static void _read_entry(JsonObject *entry, struct ShipBatch *batch,
+			const guint row)
+{
+	batch->imo[row] = _entry_int(entry, "imo");
+	batch->name[row] = _entry_string(entry, "name", batch);
+	batch->mmsi[row] = _entry_int(entry, "mmsi");
+	batch->course[row] = (gfloat)_entry_double(entry, "course");
+	batch->speed[row] = (gfloat)_entry_double(entry, "speed");
+	batch->comment[row] = _entry_string(entry, "comment", batch);
+	batch->heading[row] = (gint16)_entry_int(entry, "heading");
+	batch->length[row] = (gfloat)_entry_double(entry, "length");
+	batch->width[row] = (gfloat)_entry_double(entry, "width");
+	batch->draught[row] = (gfloat)_entry_double(entry, "draught");
+	batch->ref_front[row] = (gint16)_entry_int(entry, "ref_front");
+	batch->ref_left[row] = (gint16)_entry_int(entry, "ref_left");
+	batch->path[row] = _entry_string(entry, "path", batch);
+	batch->class[row] = _entry_char(entry, "class");
+	batch->type[row] = _entry_char(entry, "type");
+	batch->srccall[row] = _entry_string(entry, "srccall", NULL);
+	batch->dstcall[row] = _entry_string(entry, "dstcall", NULL);
+	batch->vessel_class[row] = (gint16)_entry_int(entry, "vesselclass");
+	batch->navstat[row] = (gint8)_entry_int(entry, "navstat");
+
+	batch->time[row] = _entry_int(entry, "time");
+	batch->lasttime[row] = _entry_int(entry, "lasttime");
+	batch->latitude[row] = _entry_double(entry, "lat");
+	batch->longitude[row] = _entry_double(entry, "lng");
+}
+
+static gboolean _read_header(JsonParser *parser, const gchar *json,
+			     const gsize length, gint64 *found, gchar **error)
+{
+	JsonObject *root;
+	const gchar *result;
+
+	if (!json_parser_load_from_data(parser, json, length, NULL) ||
+	    !JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser)))
+	{
+		*(error) = g_strdup("API returned invalid json!");
+		return FALSE;
+	}
+
+	root = json_node_get_object(json_parser_get_root(parser));
+	result = json_object_has_member(root, "result") ?
+		 json_object_get_string_member(root, "result") : NULL;
+
+	if (!result) {
+		*(error) = g_strdup("API returned invalid json!");
+		return FALSE;
+	}
+
+	if (g_ascii_strcasecmp(result, "ok") != 0) {
+		*(error) = g_strconcat("API failed: ",
+				       json_object_has_member(root, "description") ?
+				       json_object_get_string_member(root, "description") :
+				       result,
+				       NULL);
+		return FALSE;
+	}
+
+	if (!json_object_has_member(root, "found")) {
+		*(error) = g_strdup("API did not return entries field!");
+		return FALSE;
+	}
+
+	*(found) = _node_to_int(json_object_get_member(root, "found"));
+
+	return TRUE;
+}
+
+gboolean json_read_ships(const gchar *json, struct ShipBatch *batch,
+			 gchar **error)
+{
+	return json_read_ships_len(json, strlen(json), batch, error);
+}
+
+gboolean json_read_ships_len(const gchar *json, const gsize length,
+			     struct ShipBatch *batch, gchar **error)
+{
+	gboolean ret;
+	JsonParser *parser;
+	gint64 found;
+	guint base;
+	gint64 traced;
+
+	traced = trace_begin();
+	parser = json_parser_new();
+	ret = _read_header(parser, json, length, &found, error);
+
+	if (ret) {
+		JsonObject *root;
+		JsonArray *entries;
+
+		root = json_node_get_object(json_parser_get_root(parser));
+		entries = json_object_has_member(root, "entries") ?
+			  json_object_get_array_member(root, "entries") : NULL;
+		found = entries ? CLAMP(found, 0, json_array_get_length(entries)) : 0;
+		base = batch->len;
+		ship_batch_set_size(batch, base + (guint)found);
+
+		for (guint i = 0; i < (guint)found; ++i) {
+			_read_entry(json_array_get_object_element(entries, i),
+				    batch, base + i);
+		}
+		metrics_add(METRIC_DECODE_ENTRIES, found);
+	} else {
+		metrics_add(METRIC_DECODE_ERRORS, 1);
+	}
+
+	g_object_unref(parser);
+	trace_end("json_read_ships", traced);
+
+	return ret;
+}
+
+static const gchar *_skip_ws(const gchar *p, const gchar *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+		++p;
+	}
+
+	return p;
+}
+
+static const gchar *_skip_string(const gchar *p, const gchar *end)
+{
+	for (++p; p < end; ++p) {
+		if (*p == '\\') {
+			++p;
+		} else if (*p == '"') {
+			return p + 1;
+		}
+	}
+
+	return NULL;
+}
+
+static const gchar *_skip_value(const gchar *p, const gchar *end)
+{
+	guint depth;
+
+	if (p >= end) {
+		return NULL;
+	}
+
+	if (*p == '"') {
+		return _skip_string(p, end);
+	}
+
+	if (*p != '{' && *p != '[') {
+		while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+		       *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+		{
+			++p;
+		}
+		return p;
+	}
+
+	depth = 0;
+	while (p < end) {
+		switch (*p) {
+			case '"':
+				p = _skip_string(p, end);
+				if (!p) {
+					return NULL;
+				}
+				continue;
+			case '{':
+			case '[':
+				++depth;
 				break;
-			case G_TYPE_STRING:
-				ret = g_strdup(json_node_get_string(node));
+			case '}':
+			case ']':
+				if (--depth == 0) {
+					return p + 1;
+				}
 				break;
 			default:
 				break;
 		}
-		json_node_free(node);
+		++p;
 	}
 
-	return ret ? ret[0] : (gchar)'0';
+	return NULL;
+}
+
+gsize json_value_length(const gchar *json, const gsize length)
+{
+	const gchar *end = json + length;
+	const gchar *p = _skip_value(_skip_ws(json, end), end);
+
+	return p ? (gsize)(p - json) : 0;
 }
 
 gboolean save_json_file(const struct Config *config, gchar **error)
@@ -291,6 +530,20 @@ gboolean save_json_file(const struct Config *config, gchar **error)
 	json_builder_add_string_value(builder, config->api_key);
 	json_builder_set_member_name(builder, "log_size");
 	json_builder_add_int_value(builder, config->log_size);
+	json_builder_set_member_name(builder, "journal_dir");
+	json_builder_add_string_value(builder, config->journal_dir);
+	json_builder_set_member_name(builder, "api_requests_per_hour");
+	json_builder_add_int_value(builder, config->api_requests_per_hour);
+	json_builder_set_member_name(builder, "workers");
+	json_builder_add_int_value(builder, config->workers);
+	json_builder_set_member_name(builder, "log_file");
+	json_builder_add_string_value(builder, config->log_file);
+	json_builder_set_member_name(builder, "log_format");
+	json_builder_add_string_value(builder, config->log_format);
+	json_builder_set_member_name(builder, "metrics_port");
+	json_builder_add_int_value(builder, config->metrics_port);
+	json_builder_set_member_name(builder, "api_url");
+	json_builder_add_string_value(builder, config->api_url);
 	json_builder_end_object(builder);
 
 	generator = json_generator_new();
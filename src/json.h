@@ -29,7 +29,10 @@
 #ifndef JSON_H
 #define JSON_H
 
+#include <json-glib/json-glib.h>
+
 #include "config.h"
+#include "ship_batch.h"
 
 /**
  * Read INT value from member
@@ -116,6 +119,51 @@ gchar *json_read_entry_string(const gchar *member, const gchar *json,
 gchar json_read_entry_char(const gchar *member, const gchar *json,
 			   const gint64 index);
 
+/**
+ * @brief Read all ships from API response
+ *
+ * Parses @p json only once, unlike the json_read_entry_*() functions which
+ * parse the whole response for every value.
+ *
+ * Fields missing from an entry are set to zero, strings to an empty string.
+ *
+ * @param[in] json API response
+ * @param[in,out] batch Struct of type ShipBatch() where to append the ships
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE if the API call succeeded, otherwise FALSE
+ */
+gboolean json_read_ships(const gchar *json, struct ShipBatch *batch,
+			 gchar **error);
+
+/**
+ * @brief Read all ships from API response of given length
+ *
+ * Same as json_read_ships(), for responses which are not NUL-terminated,
+ * like ones in a memory-mapped file.
+ *
+ * @param[in] json API response
+ * @param[in] length Length of @p json in bytes
+ * @param[in,out] batch Struct of type ShipBatch() where to append the ships
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE if the API call succeeded, otherwise FALSE
+ */
+gboolean json_read_ships_len(const gchar *json, const gsize length,
+			     struct ShipBatch *batch, gchar **error);
+
+/**
+ * @brief Find end of the first JSON value
+ *
+ * Scans @p json without decoding it, to split a file with many API
+ * responses one after another. Only objects and arrays are checked for
+ * their end, they are not validated.
+ *
+ * @param[in] json Text starting with a JSON value, possibly after whitespace
+ * @param[in] length Length of @p json in bytes
+ * @return gsize Length of the whitespace and the value, 0 if the value does
+ * not end within @p length
+ */
+gsize json_value_length(const gchar *json, const gsize length);
+
 /**
  * Save config struct to file
  *
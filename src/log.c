@@ -0,0 +1,601 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "clock.h"
+#include "log.h"
+#ifdef WITH_GUI
+#include "main_window.h"
+#endif
+
+// Writer checks the ring at least this often even if a wakeup is missed
+#define LOG_WAKE_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+/**
+ * @brief Slot of the ring
+ *
+ * @p sequence equals the ring position the slot can be claimed at, and that
+ * position plus one once the line has been written into it.
+ */
+struct LogRecord {
+	guint sequence; /**< Claim and publish state, see above */
+	enum LogLevel level; /**< Severity */
+	gint64 time; /**< Unix time of the line */
+	const gchar *stage; /**< Part of the program or NULL */
+	const gchar *code; /**< Name of the event or NULL */
+	gint64 mmsi; /**< MMSI or 0 */
+	gint64 latency; /**< Microseconds or -1 */
+	guint suppressed; /**< Lines of the same kind suppressed before this */
+	gchar text[LOG_LINE_LENGTH]; /**< The line */
+};
+
+/**
+ * @brief Rate limit of one kind of lines
+ */
+struct LogLimit {
+	guint key; /**< Kind of lines counted */
+	gint second; /**< Unix time of the current window */
+	gint count; /**< Lines in the current window */
+	guint suppressed; /**< Lines suppressed since last written line */
+};
+
+static struct LogRecord RING[LOG_RING_SIZE];
+static gboolean RING_READY = FALSE;
+static guint HEAD = 0;
+static guint TAIL = 0;
+static guint DROPPED = 0;
+static guint REPORTED = 0;
+// Suppressed lines of rate limit slots taken over by another kind of lines
+static guint EVICTED = 0;
+static guint EVICTED_REPORTED = 0;
+static struct LogLimit LIMITS[LOG_RATE_SLOTS];
+
+static gint STARTED = 0;
+static gint SLEEPING = 0;
+static GThread *THREAD = NULL;
+static GMutex WAKE_MUTEX;
+static GCond WAKE_COND;
+
+// Protects the output, the cached timestamps and the last written line
+static GMutex WRITE_MUTEX;
+static FILE *OUTPUT = NULL;
+static gboolean JSON = FALSE;
+static gint64 STAMP_TIME = -1;
+static gchar STAMP[32];
+static gchar STAMP_ISO[40];
+static struct LogRecord LAST;
+static gboolean HAS_LAST = FALSE;
+static guint REPEATED = 0;
+static gint64 REPEATED_SINCE = 0;
+
+static GPrivate BUFFER = G_PRIVATE_INIT(g_free);
+
+static void _stamp(const gint64 time)
+{
+	GDateTime *gdt;
+	gchar *str;
+
+	if (time == STAMP_TIME) {
+		return;
+	}
+
+	gdt = g_date_time_new_from_unix_local(time);
+	str = g_date_time_format(gdt, "%F %H:%M:%S");
+	g_strlcpy(STAMP, str, sizeof(STAMP));
+	g_free(str);
+	str = g_date_time_format(gdt, "%FT%T%:z");
+	g_strlcpy(STAMP_ISO, str, sizeof(STAMP_ISO));
+	g_free(str);
+	g_date_time_unref(gdt);
+	STAMP_TIME = time;
+}
+
+static void _json_string(GString *line, const gchar *str)
+{
+	g_string_append_c(line, '"');
+	for (; *str; ++str) {
+		switch (*str) {
+		case '"':
+			g_string_append(line, "\\\"");
+			break;
+		case '\\':
+			g_string_append(line, "\\\\");
+			break;
+		case '\n':
+			g_string_append(line, "\\n");
+			break;
+		case '\t':
+			g_string_append(line, "\\t");
+			break;
+		default:
+			if ((guchar)*str < 0x20) {
+				g_string_append_printf(line, "\\u%04x", (guchar)*str);
+			} else {
+				g_string_append_c(line, *str);
+			}
+		}
+	}
+	g_string_append_c(line, '"');
+}
+
+static void _write_json(FILE *stream, const struct LogRecord *record,
+			const guint repeated)
+{
+	GString *line = g_string_sized_new(LOG_LINE_LENGTH + 128);
+
+	g_string_append(line, "{\"time\":\"");
+	g_string_append(line, STAMP_ISO);
+	g_string_append(line, record->level == LOG_LEVEL_ERROR ?
+			"\",\"level\":\"error\"" : "\",\"level\":\"info\"");
+
+	if (record->stage) {
+		g_string_append(line, ",\"stage\":");
+		_json_string(line, record->stage);
+	}
+	if (record->code) {
+		g_string_append(line, ",\"code\":");
+		_json_string(line, record->code);
+	}
+	if (record->mmsi) {
+		g_string_append_printf(line, ",\"mmsi\":%" G_GINT64_FORMAT,
+				       record->mmsi);
+	}
+	if (record->latency >= 0) {
+		g_string_append_printf(line, ",\"latency_ms\":%.3f",
+				       record->latency / 1000.0);
+	}
+	if (record->suppressed) {
+		g_string_append_printf(line, ",\"suppressed\":%u",
+				       record->suppressed);
+	}
+	if (repeated) {
+		g_string_append_printf(line, ",\"repeated\":%u", repeated);
+	}
+
+	g_string_append(line, ",\"message\":");
+	_json_string(line, record->text);
+	g_string_append(line, "}\n");
+
+	fwrite(line->str, 1, line->len, stream);
+	g_string_free(line, TRUE);
+}
+
+static void _write(const struct LogRecord *record, const guint repeated)
+{
+	FILE *stream;
+	gchar suffix[64] = "";
+
+	_stamp(record->time);
+
+	if (record->suppressed) {
+		g_snprintf(suffix, sizeof(suffix),
+			   " (%u similar messages suppressed)",
+			   record->suppressed);
+	}
+
+#ifdef WITH_GUI
+	add_log_row(record->time, g_strconcat(record->text, suffix, NULL));
+	if (!OUTPUT) {
+		return;
+	}
+#endif
+
+	if (OUTPUT) {
+		stream = OUTPUT;
+	} else if (record->level == LOG_LEVEL_ERROR) {
+		stream = stderr;
+	} else {
+		stream = stdout;
+	}
+
+	if (JSON) {
+		_write_json(stream, record, repeated);
+	} else {
+		fprintf(stream, "[%s]: %s%s\n", STAMP, record->text, suffix);
+	}
+}
+
+static void _flush()
+{
+	if (OUTPUT) {
+		fflush(OUTPUT);
+	} else {
+		fflush(stdout);
+	}
+}
+
+static void _flush_repeated()
+{
+	struct LogRecord record;
+
+	if (!REPEATED) {
+		return;
+	}
+
+	record = LAST;
+	record.mmsi = 0;
+	record.latency = -1;
+	record.suppressed = 0;
+	g_snprintf(record.text, sizeof(record.text),
+		   "last message repeated %u times", REPEATED);
+	_write(&record, REPEATED);
+	REPEATED = 0;
+}
+
+static gboolean _same(const struct LogRecord *a, const struct LogRecord *b)
+{
+	return a->level == b->level &&
+	       a->stage == b->stage &&
+	       a->code == b->code &&
+	       a->mmsi == b->mmsi &&
+	       strcmp(a->text, b->text) == 0;
+}
+
+static void _collapse(const struct LogRecord *record)
+{
+	if (HAS_LAST && _same(record, &LAST)) {
+		if (!REPEATED) {
+			REPEATED_SINCE = record->time;
+		}
+		REPEATED++;
+		LAST.time = record->time;
+
+		// Report long runs once a second
+		if (record->time != REPEATED_SINCE) {
+			_flush_repeated();
+		}
+		return;
+	}
+
+	_flush_repeated();
+	_write(record, 0);
+	LAST = *(record);
+	HAS_LAST = TRUE;
+}
+
+static gboolean _ready()
+{
+	struct LogRecord *record = &RING[TAIL & (LOG_RING_SIZE - 1)];
+
+	return g_atomic_int_get(&record->sequence) == TAIL + 1;
+}
+
+static gboolean _drain()
+{
+	struct LogRecord *record;
+	struct LogRecord dropped_record;
+	gboolean wrote = FALSE;
+	guint dropped;
+	guint evicted;
+
+	while (_ready()) {
+		record = &RING[TAIL & (LOG_RING_SIZE - 1)];
+		_collapse(record);
+		g_atomic_int_set(&record->sequence, TAIL + LOG_RING_SIZE);
+		TAIL++;
+		wrote = TRUE;
+	}
+
+	dropped = (guint)g_atomic_int_get(&DROPPED);
+	if (dropped != REPORTED) {
+		memset(&dropped_record, 0, sizeof(dropped_record));
+		dropped_record.level = LOG_LEVEL_ERROR;
+		dropped_record.time = clock_real_time() / G_USEC_PER_SEC;
+		dropped_record.latency = -1;
+		g_snprintf(dropped_record.text, sizeof(dropped_record.text),
+			   "%u log messages dropped", dropped - REPORTED);
+		_collapse(&dropped_record);
+		REPORTED = dropped;
+		wrote = TRUE;
+	}
+
+	evicted = (guint)g_atomic_int_get(&EVICTED);
+	if (evicted != EVICTED_REPORTED) {
+		memset(&dropped_record, 0, sizeof(dropped_record));
+		dropped_record.level = LOG_LEVEL_INFO;
+		dropped_record.time = clock_real_time() / G_USEC_PER_SEC;
+		dropped_record.latency = -1;
+		g_snprintf(dropped_record.text, sizeof(dropped_record.text),
+			   "%u rate limited log messages suppressed",
+			   evicted - EVICTED_REPORTED);
+		_collapse(&dropped_record);
+		EVICTED_REPORTED = evicted;
+		wrote = TRUE;
+	}
+
+	if (wrote) {
+		_flush();
+	}
+
+	return wrote;
+}
+
+static gpointer _writer(gpointer data)
+{
+	gboolean wrote;
+
+	while (g_atomic_int_get(&STARTED)) {
+		g_mutex_lock(&WRITE_MUTEX);
+		wrote = _drain();
+		g_mutex_unlock(&WRITE_MUTEX);
+
+		if (wrote) {
+			continue;
+		}
+
+		g_mutex_lock(&WAKE_MUTEX);
+		g_atomic_int_set(&SLEEPING, 1);
+		if (!_ready() && g_atomic_int_get(&STARTED)) {
+			g_cond_wait_until(&WAKE_COND, &WAKE_MUTEX,
+					  g_get_monotonic_time() + LOG_WAKE_INTERVAL);
+		}
+		g_atomic_int_set(&SLEEPING, 0);
+		g_mutex_unlock(&WAKE_MUTEX);
+
+		// Nothing new arrived, the run of repeated lines has ended
+		g_mutex_lock(&WRITE_MUTEX);
+		if (REPEATED && !_ready()) {
+			_flush_repeated();
+			_flush();
+		}
+		g_mutex_unlock(&WRITE_MUTEX);
+	}
+
+	return NULL;
+}
+
+static guint _key(const enum LogLevel level, const gchar *stage,
+		  const gchar *code)
+{
+	guint key = level;
+
+	key = key * 31 + (stage ? g_str_hash(stage) : 0);
+	key = key * 31 + g_str_hash(code);
+
+	return key;
+}
+
+/*
+ * Returns FALSE if the line should be suppressed. Counters of a slot are
+ * updated without a lock, so the limit is approximate when several threads
+ * log the same kind of line at the same time.
+ */
+static gboolean _limit(const guint key, const gint64 now, guint *suppressed)
+{
+	struct LogLimit *limit = &LIMITS[key & (LOG_RATE_SLOTS - 1)];
+	gint second = (gint)now;
+	gint old = g_atomic_int_get(&limit->second);
+	guint previous;
+
+	*(suppressed) = 0;
+
+	if (old != second || (guint)g_atomic_int_get(&limit->key) != key) {
+		if (g_atomic_int_compare_and_exchange(&limit->second, old, second)) {
+			previous = g_atomic_int_and(&limit->suppressed, 0);
+			if ((guint)g_atomic_int_get(&limit->key) == key) {
+				*(suppressed) = previous;
+			} else {
+				// Slot is taken over by another kind of lines
+				g_atomic_int_add(&EVICTED, previous);
+				g_atomic_int_set(&limit->key, key);
+			}
+			g_atomic_int_set(&limit->count, 1);
+			return TRUE;
+		}
+	}
+
+	if (g_atomic_int_add(&limit->count, 1) >= LOG_RATE_LIMIT) {
+		g_atomic_int_inc(&limit->suppressed);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void _push(const enum LogLevel level, const gchar *stage,
+		  const gchar *code, const gint64 mmsi, const gint64 latency,
+		  const guint suppressed, const gint64 now, const gchar *text)
+{
+	struct LogRecord *record;
+	struct LogRecord direct;
+	guint pos;
+	gint diff;
+
+	if (!g_atomic_int_get(&STARTED)) {
+		record = &direct;
+	} else {
+		pos = (guint)g_atomic_int_get(&HEAD);
+		for (;;) {
+			record = &RING[pos & (LOG_RING_SIZE - 1)];
+			diff = (gint)((guint)g_atomic_int_get(&record->sequence) - pos);
+
+			if (diff == 0) {
+				if (g_atomic_int_compare_and_exchange(&HEAD, pos, pos + 1)) {
+					break;
+				}
+				pos = (guint)g_atomic_int_get(&HEAD);
+			} else if (diff < 0) {
+				// Writer has not caught up, never wait for it
+				g_atomic_int_inc(&DROPPED);
+				return;
+			} else {
+				pos = (guint)g_atomic_int_get(&HEAD);
+			}
+		}
+	}
+
+	record->level = level;
+	record->time = now;
+	record->stage = stage;
+	record->code = code;
+	record->mmsi = mmsi;
+	record->latency = latency;
+	record->suppressed = suppressed;
+	g_strlcpy(record->text, text, LOG_LINE_LENGTH);
+
+	if (record == &direct) {
+		g_mutex_lock(&WRITE_MUTEX);
+		_write(record, 0);
+		_flush();
+		g_mutex_unlock(&WRITE_MUTEX);
+		return;
+	}
+
+	g_atomic_int_set(&record->sequence, pos + 1);
+
+	// Signaling without the mutex may miss the writer, which then wakes
+	// up on its own after LOG_WAKE_INTERVAL
+	if (g_atomic_int_get(&SLEEPING)) {
+		g_cond_signal(&WAKE_COND);
+	}
+}
+
+static void _vevent(const enum LogLevel level, const gchar *stage,
+		    const gchar *code, const gint64 mmsi, const gint64 latency,
+		    const gchar *format, va_list args)
+{
+	gchar *buffer;
+	gint64 now = clock_real_time() / G_USEC_PER_SEC;
+	guint suppressed = 0;
+
+	if (code && !_limit(_key(level, stage, code), now, &suppressed)) {
+		return;
+	}
+
+	buffer = g_private_get(&BUFFER);
+	if (!buffer) {
+		buffer = g_malloc(LOG_LINE_LENGTH);
+		g_private_set(&BUFFER, buffer);
+	}
+
+	g_vsnprintf(buffer, LOG_LINE_LENGTH, format, args);
+	_push(level, stage, code, mmsi, latency, suppressed, now, buffer);
+}
+
+gboolean log_start(const gchar *path, const gboolean json, gchar **error)
+{
+	FILE *output = NULL;
+
+	if (THREAD) {
+		return TRUE;
+	}
+
+	if (path && path[0] != '\0') {
+		output = g_fopen(path, "a");
+		if (!output) {
+			*(error) = g_strconcat("Could not open log file ", path,
+					       ": ", g_strerror(errno), NULL);
+			return FALSE;
+		}
+	}
+
+	if (!RING_READY) {
+		for (guint i = 0; i < LOG_RING_SIZE; ++i) {
+			RING[i].sequence = i;
+		}
+		RING_READY = TRUE;
+	}
+
+	g_mutex_lock(&WRITE_MUTEX);
+	OUTPUT = output;
+	JSON = json;
+	g_mutex_unlock(&WRITE_MUTEX);
+
+	g_atomic_int_set(&STARTED, 1);
+	THREAD = g_thread_new("log", _writer, NULL);
+
+	return TRUE;
+}
+
+void log_stop()
+{
+	if (!THREAD) {
+		return;
+	}
+
+	g_atomic_int_set(&STARTED, 0);
+	g_mutex_lock(&WAKE_MUTEX);
+	g_cond_signal(&WAKE_COND);
+	g_mutex_unlock(&WAKE_MUTEX);
+
+	g_thread_join(THREAD);
+	THREAD = NULL;
+
+	g_mutex_lock(&WRITE_MUTEX);
+	_drain();
+	_flush_repeated();
+	_flush();
+	HAS_LAST = FALSE;
+	if (OUTPUT) {
+		fclose(OUTPUT);
+		OUTPUT = NULL;
+	}
+	JSON = FALSE;
+	g_mutex_unlock(&WRITE_MUTEX);
+}
+
+void log_printf(const enum LogLevel level, const gchar *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	_vevent(level, NULL, NULL, 0, -1, format, args);
+	va_end(args);
+}
+
+void log_event(const enum LogLevel level, const gchar *stage,
+	       const gchar *code, const gint64 mmsi, const gint64 latency,
+	       const gchar *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	_vevent(level, stage, code, mmsi, latency, format, args);
+	va_end(args);
+}
+
+static void _text(const enum LogLevel level, gchar *message)
+{
+	gint64 now = clock_real_time() / G_USEC_PER_SEC;
+	guint suppressed = 0;
+
+	if (_limit(g_str_hash(message) * 31 + level, now, &suppressed)) {
+		_push(level, NULL, NULL, 0, -1, suppressed, now, message);
+	}
+	g_free(message);
+}
+
+void log_message(gpointer message)
+{
+	_text(LOG_LEVEL_INFO, message);
+}
+
+void log_error(gpointer message)
+{
+	_text(LOG_LEVEL_ERROR, message);
+}
+
+guint log_dropped()
+{
+	return (guint)g_atomic_int_get(&DROPPED);
+}
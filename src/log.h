@@ -0,0 +1,153 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file log.h
+ * @brief Asynchronous logger
+ * @details Log lines are formatted in a buffer of the calling thread and
+ * pushed to a fixed size ring, from which a background thread writes them to
+ * stdout and stderr, to a file, and to the GUI log when built with GTK
+ * support. The timestamp is formatted by the background thread and only once
+ * per second. Lines are written as plain text or as JSON objects, one per
+ * line.
+ *
+ * Pushing a line never blocks. When the ring is full the line is dropped and
+ * counted, and the number of dropped lines is written once there is room.
+ *
+ * Lines of the same kind, the same stage and code of log_event() or the same
+ * text otherwise, are limited to @ref LOG_RATE_LIMIT per second. The number
+ * of suppressed lines is attached to the next line of that kind which is
+ * written. If another kind of lines takes over the rate limit slot first,
+ * the count is written as a separate line instead. Consecutive identical lines are written once, followed by a
+ * "last message repeated N times" line.
+ *
+ * Before log_start() and after log_stop() lines are written directly by the
+ * calling thread.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <glib.h>
+
+/**
+ * Number of lines the ring holds, must be a power of two
+ */
+#define LOG_RING_SIZE 2048
+
+/**
+ * Maximum length of a line including the terminating nul, longer lines
+ * are truncated
+ */
+#define LOG_LINE_LENGTH 512
+
+/**
+ * Lines of the same kind written in a second before the rest are suppressed
+ */
+#define LOG_RATE_LIMIT 10
+
+/**
+ * Number of kinds of lines rate limited separately, must be a power of two
+ */
+#define LOG_RATE_SLOTS 256
+
+/**
+ * @enum LogLevel
+ * @brief Severity of a log line
+ */
+enum LogLevel {
+	LOG_LEVEL_INFO, /**< Written to stdout */
+	LOG_LEVEL_ERROR /**< Written to stderr */
+};
+
+/**
+ * @brief Start the writer thread
+ *
+ * @param[in] path File to append lines to, NULL or empty string writes
+ * to stdout and stderr, or only to the GUI log when built with GTK support
+ * @param[in] json Write JSON lines instead of plain text, the GUI log always
+ * gets plain text
+ * @param[out] error Error message
+ * @return gboolean TRUE on success, otherwise FALSE
+ * @note Logging keeps working when starting fails
+ */
+gboolean log_start(const gchar *path, const gboolean json, gchar **error);
+
+/**
+ * Write remaining lines and stop the writer thread
+ *
+ * @return Nothing
+ */
+void log_stop();
+
+/**
+ * @brief Log formatted line
+ *
+ * @param[in] level Severity of the line
+ * @param[in] format printf() style format
+ * @return Nothing
+ */
+void log_printf(const enum LogLevel level, const gchar *format, ...)
+	G_GNUC_PRINTF(2, 3);
+
+/**
+ * @brief Log formatted line with structured fields
+ *
+ * Lines with the same @p stage and @p code are rate limited together, the
+ * check is made before formatting so suppressed lines are cheap.
+ *
+ * @param[in] level Severity of the line
+ * @param[in] stage Part of the program, like "fetch" or "persist", or NULL
+ * @param[in] code Stable name of the event, like "update_ships", or NULL
+ * @param[in] mmsi MMSI of the ship or 0
+ * @param[in] latency Duration in microseconds or -1
+ * @param[in] format printf() style format
+ * @return Nothing
+ * @note @p stage and @p code must be string literals
+ */
+void log_event(const enum LogLevel level, const gchar *stage,
+	       const gchar *code, const gint64 mmsi, const gint64 latency,
+	       const gchar *format, ...) G_GNUC_PRINTF(6, 7);
+
+/**
+ * @brief Log message
+ *
+ * @param[in] message Message, freed by the logger
+ * @return Nothing
+ */
+void log_message(gpointer message);
+
+/**
+ * @brief Log error message
+ *
+ * @param[in] message Message, freed by the logger
+ * @return Nothing
+ */
+void log_error(gpointer message);
+
+/**
+ * Number of lines dropped because the ring was full
+ *
+ * @return guint
+ */
+guint log_dropped();
+
+#endif
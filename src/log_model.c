@@ -0,0 +1,323 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include "log_model.h"
+
+/**
+ * @brief Line of the log
+ */
+struct LogModelRow {
+	gint64 time; /**< Unix time */
+	gchar *message; /**< Log line */
+};
+
+struct _LogModel {
+	GObject parent;
+	struct LogModelRow *rows; /**< Ring of @p capacity rows */
+	guint capacity; /**< Maximum number of lines */
+	guint newest; /**< Slot of the first row */
+	guint len; /**< Number of lines */
+	gint stamp; /**< Changed whenever iterators become invalid */
+};
+
+static void log_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(LogModel, log_model, G_TYPE_OBJECT,
+			G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+					      log_model_tree_model_init))
+
+static struct LogModelRow *_row(LogModel *model, const guint index)
+{
+	return &model->rows[(model->newest + model->capacity - index) %
+			    model->capacity];
+}
+
+static void _set_iter(LogModel *model, GtkTreeIter *iter, const guint index)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = GUINT_TO_POINTER(index);
+}
+
+static guint _index(GtkTreeIter *iter)
+{
+	return GPOINTER_TO_UINT(iter->user_data);
+}
+
+static GtkTreeModelFlags _get_flags(GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint _get_n_columns(GtkTreeModel *tree_model)
+{
+	return LOG_MODEL_N_COLUMNS;
+}
+
+static GType _get_column_type(GtkTreeModel *tree_model, gint index)
+{
+	return G_TYPE_STRING;
+}
+
+static gboolean _get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter,
+			  GtkTreePath *path)
+{
+	LogModel *model = LOG_MODEL(tree_model);
+	gint index;
+
+	if (gtk_tree_path_get_depth(path) != 1) {
+		return FALSE;
+	}
+
+	index = gtk_tree_path_get_indices(path)[0];
+	if (index < 0 || (guint)index >= model->len) {
+		return FALSE;
+	}
+
+	_set_iter(model, iter, (guint)index);
+
+	return TRUE;
+}
+
+static GtkTreePath *_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return gtk_tree_path_new_from_indices((gint)_index(iter), -1);
+}
+
+static void _get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
+		       gint column, GValue *value)
+{
+	struct LogModelRow *row = _row(LOG_MODEL(tree_model), _index(iter));
+	GDateTime *gdt;
+
+	g_value_init(value, G_TYPE_STRING);
+
+	if (column == LOG_MODEL_COLUMN_MESSAGE) {
+		g_value_set_string(value, row->message);
+	} else {
+		// Only asked for visible rows and tooltips
+		gdt = g_date_time_new_from_unix_local(row->time);
+		g_value_take_string(value, g_date_time_format(gdt, "%F %H:%M:%S"));
+		g_date_time_unref(gdt);
+	}
+}
+
+static gboolean _iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	guint index = _index(iter) + 1;
+
+	if (index >= LOG_MODEL(tree_model)->len) {
+		return FALSE;
+	}
+
+	iter->user_data = GUINT_TO_POINTER(index);
+
+	return TRUE;
+}
+
+static gboolean _iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	guint index = _index(iter);
+
+	if (index == 0) {
+		return FALSE;
+	}
+
+	iter->user_data = GUINT_TO_POINTER(index - 1);
+
+	return TRUE;
+}
+
+static gboolean _iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter,
+			       GtkTreeIter *parent)
+{
+	LogModel *model = LOG_MODEL(tree_model);
+
+	if (parent || model->len == 0) {
+		return FALSE;
+	}
+
+	_set_iter(model, iter, 0);
+
+	return TRUE;
+}
+
+static gboolean _iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint _iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return iter ? 0 : (gint)LOG_MODEL(tree_model)->len;
+}
+
+static gboolean _iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+				GtkTreeIter *parent, gint n)
+{
+	LogModel *model = LOG_MODEL(tree_model);
+
+	if (parent || n < 0 || (guint)n >= model->len) {
+		return FALSE;
+	}
+
+	_set_iter(model, iter, (guint)n);
+
+	return TRUE;
+}
+
+static gboolean _iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter,
+			     GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+static void log_model_tree_model_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags = _get_flags;
+	iface->get_n_columns = _get_n_columns;
+	iface->get_column_type = _get_column_type;
+	iface->get_iter = _get_iter;
+	iface->get_path = _get_path;
+	iface->get_value = _get_value;
+	iface->iter_next = _iter_next;
+	iface->iter_previous = _iter_previous;
+	iface->iter_children = _iter_children;
+	iface->iter_has_child = _iter_has_child;
+	iface->iter_n_children = _iter_n_children;
+	iface->iter_nth_child = _iter_nth_child;
+	iface->iter_parent = _iter_parent;
+}
+
+static void _remove_last(LogModel *model)
+{
+	struct LogModelRow *row = _row(model, model->len - 1);
+	GtkTreePath *path;
+
+	g_free(row->message);
+	row->message = NULL;
+	model->len--;
+	model->stamp++;
+
+	path = gtk_tree_path_new_from_indices((gint)model->len, -1);
+	gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+	gtk_tree_path_free(path);
+}
+
+static void log_model_finalize(GObject *object)
+{
+	LogModel *model = LOG_MODEL(object);
+
+	for (guint i = 0; i < model->len; ++i) {
+		g_free(_row(model, i)->message);
+	}
+	g_free(model->rows);
+
+	G_OBJECT_CLASS(log_model_parent_class)->finalize(object);
+}
+
+static void log_model_class_init(LogModelClass *klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = log_model_finalize;
+}
+
+static void log_model_init(LogModel *model)
+{
+	model->rows = NULL;
+	model->capacity = 0;
+	model->newest = 0;
+	model->len = 0;
+	model->stamp = g_random_int();
+}
+
+LogModel *log_model_new(const guint capacity)
+{
+	LogModel *model = g_object_new(LOG_TYPE_MODEL, NULL);
+
+	log_model_set_capacity(model, capacity);
+
+	return model;
+}
+
+void log_model_set_capacity(LogModel *model, const guint capacity)
+{
+	struct LogModelRow *rows;
+
+	if (capacity == model->capacity) {
+		return;
+	}
+
+	while (model->len > capacity) {
+		_remove_last(model);
+	}
+
+	// Oldest row goes to slot 0 and the first row to slot len - 1
+	rows = g_new0(struct LogModelRow, MAX(capacity, 1));
+	for (guint i = 0; i < model->len; ++i) {
+		rows[model->len - 1 - i] = *(_row(model, i));
+	}
+
+	g_free(model->rows);
+	model->rows = rows;
+	model->capacity = capacity;
+	if (model->len > 0) {
+		model->newest = model->len - 1;
+	} else {
+		model->newest = capacity > 0 ? capacity - 1 : 0;
+	}
+}
+
+guint log_model_get_capacity(LogModel *model)
+{
+	return model->capacity;
+}
+
+void log_model_prepend(LogModel *model, const gint64 time, gchar *message)
+{
+	struct LogModelRow *row;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	if (model->capacity == 0) {
+		g_free(message);
+		return;
+	}
+
+	if (model->len == model->capacity) {
+		_remove_last(model);
+	}
+
+	model->newest = (model->newest + 1) % model->capacity;
+	row = &model->rows[model->newest];
+	row->time = time;
+	row->message = message;
+	model->len++;
+	model->stamp++;
+
+	path = gtk_tree_path_new_from_indices(0, -1);
+	_set_iter(model, &iter, 0);
+	gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+	gtk_tree_path_free(path);
+}
+
+void log_model_clear(LogModel *model)
+{
+	while (model->len > 0) {
+		_remove_last(model);
+	}
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file log_model.h
+ * @brief Tree model of the GUI log
+ * @details GtkTreeModel which keeps a fixed number of log lines in a ring
+ * buffer, newest line first. A GtkTreeView showing it creates cells only
+ * for the visible rows, so large logs stay cheap, and adding a line to a
+ * full log drops the oldest one without moving the others.
+ *
+ * The model must be used from the GTK main thread only.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef LOG_MODEL_H
+#define LOG_MODEL_H
+
+#include <gtk/gtk.h>
+
+/**
+ * @enum LogModelColumn
+ * @brief Columns of the model
+ */
+enum LogModelColumn {
+	LOG_MODEL_COLUMN_MESSAGE, /**< Log line, G_TYPE_STRING */
+	LOG_MODEL_COLUMN_TIME, /**< Local time of the line, G_TYPE_STRING */
+	LOG_MODEL_N_COLUMNS /**< Number of columns */
+};
+
+#define LOG_TYPE_MODEL (log_model_get_type())
+G_DECLARE_FINAL_TYPE(LogModel, log_model, LOG, MODEL, GObject)
+
+/**
+ * Create new model
+ *
+ * @param[in] capacity Maximum number of lines
+ * @return LogModel*
+ * @note Free with g_object_unref()
+ */
+LogModel *log_model_new(const guint capacity);
+
+/**
+ * @brief Change maximum number of lines
+ *
+ * Oldest lines which do not fit are removed.
+ *
+ * @param[in] model LogModel
+ * @param[in] capacity Maximum number of lines
+ * @return Nothing
+ */
+void log_model_set_capacity(LogModel *model, const guint capacity);
+
+/**
+ * Maximum number of lines
+ *
+ * @param[in] model LogModel
+ * @return guint
+ */
+guint log_model_get_capacity(LogModel *model);
+
+/**
+ * @brief Add line as the first row
+ *
+ * Removes the oldest line if the model is full.
+ *
+ * @param[in] model LogModel
+ * @param[in] time Unix time of the line
+ * @param[in] message Log line, the model takes ownership
+ * @return Nothing
+ */
+void log_model_prepend(LogModel *model, const gint64 time, gchar *message);
+
+/**
+ * Remove all lines
+ *
+ * @param[in] model LogModel
+ * @return Nothing
+ */
+void log_model_clear(LogModel *model);
+
+#endif
@@ -25,15 +25,79 @@
 	#include <string.h>
 	#include "config.h"
 	#include "api_thread.h"
+	#include "export.h"
+	#include "import.h"
+	#include "intern.h"
+	#include "metrics_server.h"
+	#include "once.h"
+	#include "trace.h"
 	#include "version.h"
 #endif
+#include "log.h"
 
 #ifdef __WIN32__
 	#include <windows.h>
 #endif
 
+#if !defined(WITH_GUI) && defined(G_OS_UNIX)
+	#include <glib-unix.h>
+	#include <signal.h>
+#endif
+
 #ifndef WITH_GUI
 struct Config *config;
+static GMainLoop *loop;
+static const gchar *trace_file = NULL;
+static const gchar *export_file = NULL;
+static enum DbSink sink = DB_SINK_MYSQL;
+static gboolean once = FALSE;
+static gchar **import_paths = NULL;
+
+static gboolean quit_loop(gpointer data)
+{
+	g_main_loop_quit(loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer run_api_thread(gpointer data)
+{
+	gpointer ret = api_thread(data);
+
+	g_idle_add(quit_loop, NULL);
+
+	return ret;
+}
+
+#ifdef G_OS_UNIX
+static gboolean stop_signal(gpointer data)
+{
+	log_message(g_strdup("Stopping"));
+	api_thread_stop();
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean reload_signal(gpointer data)
+{
+	api_thread_reload();
+
+	return G_SOURCE_CONTINUE;
+}
+#endif
+
+static gboolean dump_trace(gpointer data)
+{
+	gchar *error;
+
+	if (!trace_dump(trace_file, &error)) {
+		log_error(error);
+	} else {
+		log_message(g_strconcat("Trace written to ", trace_file, NULL));
+	}
+
+	return G_SOURCE_CONTINUE;
+}
 
 static void print_version()
 {
@@ -42,12 +106,29 @@ static void print_version()
 
 static void print_help()
 {
-	g_print("Usage: shipsoftware_backend [OPTION]\n");
+	g_print("Usage: shipsoftware_backend [OPTION]... [--import PATH... [-- PATH...]]\n");
 	g_print("\n");
 	g_print("Without options the program will start and run until stopped.\n");
+	g_print("SIGINT or SIGTERM stops the program, SIGHUP reloads ship roster.\n");
 	g_print("\n");
 	g_print(" -H --help\t\t\tPrint this help and exit\n");
 	g_print("    --version\t\t\tPrint program version and exit\n");
+	g_print("    --once\t\t\tFetch and write every ship once and exit,\n");
+	g_print("\t\t\t\texit status is 0 on success, 1 if nothing\n");
+	g_print("\t\t\t\tcould be done and 2 if some ships were not\n");
+	g_print("\t\t\t\tupdated\n");
+	g_print("    --import PATH...\t\tImport recorded API responses from files\n");
+	g_print("\t\t\t\tand directories to the GPS table and exit,\n");
+	g_print("\t\t\t\tfiles already imported are skipped; options\n");
+	g_print("\t\t\t\tcan come before or after the paths, paths\n");
+	g_print("\t\t\t\tafter `--` are not read as options\n");
+	g_print("    --sink=SINK\t\t\tWhere --once and --import write updates:\n");
+	g_print("\t\t\t\tmysql (default), file to store them in the\n");
+	g_print("\t\t\t\tjournal or null to prepare and discard them\n");
+	g_print("    --export=FILE\t\tWrite GPS and Ships tables to FILE in\n");
+	g_print("\t\t\t\tcompact columnar format and exit\n");
+	g_print("    --trace=FILE\t\tRecord spans of the update cycle and write\n");
+	g_print("\t\t\t\tthem to FILE on SIGUSR1 and at exit\n");
 	g_print("\nProgram was compiled without GUI support\n");
 }
 #endif
@@ -55,6 +136,9 @@ static void print_help()
 int main(int argc, char *argv[])
 {
 	gint status = 0;
+#ifndef WITH_GUI
+	gint64 started = g_get_monotonic_time();
+#endif
 
 #ifdef WITH_GUI
 	GtkApplication *app;
@@ -68,25 +152,77 @@ int main(int argc, char *argv[])
 	status = g_application_run(G_APPLICATION(app), argc, argv);
 
 	g_object_unref(app);
+	log_stop();
 #else
 	gchar *config_contents;
 	gchar *error;
 	gint config_valid;
 	GThread *thread;
+	guint paths = 0;
+	gboolean paths_only = FALSE;
 
-	if (argc > 1) {
-		if (strcmp(argv[1], "-H") == 0 || strcmp(argv[1], "--help") == 0) {
+	for (gint i = 1; i < argc; ++i) {
+		// After --import every argument which is not an option is a path
+		if (import_paths && (paths_only || argv[i][0] != '-')) {
+			import_paths[paths++] = argv[i];
+			continue;
+		}
+
+		if (import_paths && strcmp(argv[i], "--") == 0) {
+			paths_only = TRUE;
+		} else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "--help") == 0) {
 			print_help();
 			return 0;
-		} else if (strcmp(argv[1], "--version") == 0) {
+		} else if (strcmp(argv[i], "--version") == 0) {
 			print_version();
 			return 0;
+		} else if (strcmp(argv[i], "--once") == 0) {
+			once = TRUE;
+		} else if (strcmp(argv[i], "--import") == 0) {
+			if (!import_paths) {
+				import_paths = g_new0(gchar *, argc);
+			}
+		} else if (g_str_has_prefix(argv[i], "--sink=")) {
+			const gchar *name = argv[i] + strlen("--sink=");
+
+			if (strcmp(name, "mysql") == 0) {
+				sink = DB_SINK_MYSQL;
+			} else if (strcmp(name, "file") == 0) {
+				sink = DB_SINK_FILE;
+			} else if (strcmp(name, "null") == 0) {
+				sink = DB_SINK_NULL;
+			} else {
+				g_printerr("Invalid sink `%s`!\n", name);
+				return 1;
+			}
+		} else if (g_str_has_prefix(argv[i], "--export=") &&
+			   argv[i][strlen("--export=")] != '\0')
+		{
+			export_file = argv[i] + strlen("--export=");
+		} else if (g_str_has_prefix(argv[i], "--trace=") &&
+			   argv[i][strlen("--trace=")] != '\0')
+		{
+			trace_file = argv[i] + strlen("--trace=");
 		} else {
-			g_printerr("Invalid option `%s`!\n", argv[1]);
+			g_printerr("Invalid option `%s`!\n", argv[i]);
 			return 1;
 		}
 	}
 
+	if (import_paths && paths == 0) {
+		g_printerr("Option `--import` needs a path!\n");
+		return 1;
+	}
+
+	if (sink != DB_SINK_MYSQL && !once && !import_paths) {
+		g_printerr("Option `--sink` needs `--once` or `--import`!\n");
+		return 1;
+	}
+
+	if (trace_file) {
+		trace_enable();
+	}
+
 	config_valid = 0;
 	config = g_slice_alloc(sizeof(*config));
 
@@ -107,15 +243,68 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (config_valid) {
-		RUNNING = 1;
+	if (config_valid && (once || import_paths || export_file)) {
+		// Without a log file lines are written directly, no thread needed
+		if ((config->log_file[0] != '\0' ||
+		     g_strcmp0(config->log_format, "json") == 0) &&
+		    !log_start(config->log_file,
+			       g_strcmp0(config->log_format, "json") == 0,
+			       &error))
+		{
+			log_error(error);
+		}
+
+		if (export_file) {
+			status = export_run(config, export_file);
+		} else if (import_paths) {
+			status = import_run(config, import_paths, sink);
+		} else {
+			status = once_run(config, started, sink);
+		}
+		if (trace_file) {
+			dump_trace(NULL);
+		}
+		log_stop();
+	} else if (config_valid) {
+		if (!log_start(config->log_file,
+			       g_strcmp0(config->log_format, "json") == 0,
+			       &error))
+		{
+			log_error(error);
+		}
+
+		g_atomic_int_set(&RUNNING, 1);
 		log_message(g_strdup("Started"));
-		thread = g_thread_new("api_thread", api_thread, (gpointer)config);
+		loop = g_main_loop_new(NULL, FALSE);
+		if (config->metrics_port > 0 &&
+		    !metrics_server_start(config->metrics_port, &error))
+		{
+			log_error(error);
+		}
+#ifdef G_OS_UNIX
+		g_unix_signal_add(SIGINT, stop_signal, NULL);
+		g_unix_signal_add(SIGTERM, stop_signal, NULL);
+		g_unix_signal_add(SIGHUP, reload_signal, NULL);
+		if (trace_file) {
+			g_unix_signal_add(SIGUSR1, dump_trace, NULL);
+		}
+#endif
+		thread = g_thread_new("api_thread", run_api_thread, (gpointer)config);
+		g_main_loop_run(loop);
 		status = GPOINTER_TO_INT(g_thread_join(thread));
-		g_thread_unref(thread);
+		metrics_server_stop();
+		g_main_loop_unref(loop);
+		if (trace_file) {
+			dump_trace(NULL);
+		}
+		log_stop();
+	} else if (once || import_paths || export_file) {
+		status = 1;
 	}
 
+	intern_free();
 	g_slice_free1(sizeof(*config), config);
+	g_free(import_paths);
 #endif
 
 	return status;
@@ -23,121 +23,211 @@
 #include "api_thread.h"
 #include "dialogs.h"
 #include "config_window.h"
+#include "dashboard.h"
+#include "log_model.h"
+#include "status.h"
 #include "logo.xpm"
 
 #define COLOR_GREEN "#008000"
 #define COLOR_RED "#FF0000"
 
+// Milliseconds log lines are collected before they are added to the view
+#define LOG_DELIVERY_INTERVAL 16
+
+// Milliseconds between checks for a new status of the API thread
+#define STATUS_POLL_INTERVAL 250
+
+/**
+ * @brief Log line waiting to be added to the view
+ */
+struct log_line {
+	gint64 time; /**< Unix time */
+	gchar *message; /**< Log line */
+};
+
 struct Config *config;
-GMutex MUTEX;
 GtkWidget *LABEL_RUNNING;
 GtkWidget *LABEL_LAST_UPDATED;
 GtkWidget *BUTTON_START;
-GtkWidget *LISTBOX_LOGS;
+GtkWidget *TREEVIEW_LOGS;
+
+static LogModel *LOG_VIEW_MODEL = NULL;
+static GMutex LOG_LINES_MUTEX;
+static GQueue LOG_LINES = G_QUEUE_INIT;
+static guint LOG_LINES_LIMIT = G_MAXUINT;
+static guint LOG_DELIVERY = 0;
+static GThread *API_THREAD = NULL;
 
-gboolean add_log_row(void *message)
+static void _free_log_line(gpointer data)
 {
-	GtkWidget *row;
-	GtkWidget *item;
-	GList *rows;
+	struct log_line *line = data;
 
-	row = gtk_list_box_row_new();
-	gtk_widget_set_tooltip_text(GTK_WIDGET(row), get_datetime());
-	item = gtk_label_new(message);
+	g_free(line->message);
+	g_slice_free(struct log_line, line);
+}
 
-	gtk_label_set_xalign(GTK_LABEL(item), 0);
-	gtk_container_add(GTK_CONTAINER(row), item);
+static guint _log_capacity()
+{
+	gint64 log_size;
 
 	g_mutex_lock(&MUTEX);
-	gtk_list_box_insert(GTK_LIST_BOX(LISTBOX_LOGS), GTK_WIDGET(row), 0);
-
-	rows = gtk_container_get_children(GTK_CONTAINER(LISTBOX_LOGS));
-	if (g_list_length(rows) > config->log_size) {
-		while (g_list_length(rows) > config->log_size) {
-			GList *last_row = g_list_last(rows);
-			gtk_container_remove(GTK_CONTAINER(LISTBOX_LOGS),
-					     last_row->data);
-			rows = g_list_remove(rows, last_row->data);
-		}
-	}
-	g_free(message);
+	log_size = config->log_size;
 	g_mutex_unlock(&MUTEX);
 
-	gtk_widget_show_all(row);
-
-	return FALSE;
+	return (guint)CLAMP(log_size, 0, G_MAXINT);
 }
 
-void clear_logs()
+static gboolean _deliver_logs(gpointer data)
 {
-	GList *rows;
+	GQueue lines;
+	struct log_line *line;
+	guint capacity;
 
-	g_mutex_lock(&MUTEX);
-	rows = gtk_container_get_children(GTK_CONTAINER(LISTBOX_LOGS));
+	// Lines logged before the window exists wait for it
+	if (!LOG_VIEW_MODEL) {
+		return G_SOURCE_CONTINUE;
+	}
 
-	while (rows) {
-		gtk_container_remove(GTK_CONTAINER(LISTBOX_LOGS),
-				     GTK_WIDGET(rows->data));
-		rows = rows->next;
+	capacity = _log_capacity();
+	log_model_set_capacity(LOG_VIEW_MODEL, capacity);
+
+	g_mutex_lock(&LOG_LINES_MUTEX);
+	lines = LOG_LINES;
+	g_queue_init(&LOG_LINES);
+	LOG_LINES_LIMIT = capacity;
+	LOG_DELIVERY = 0;
+	g_mutex_unlock(&LOG_LINES_MUTEX);
+
+	while ((line = g_queue_pop_head(&lines))) {
+		log_model_prepend(LOG_VIEW_MODEL, line->time, line->message);
+		g_slice_free(struct log_line, line);
 	}
-	g_mutex_unlock(&MUTEX);
 
-	g_list_free(rows);
+	return G_SOURCE_REMOVE;
 }
 
-gboolean set_button_text(void *text)
+void add_log_row(const gint64 time, gchar *message)
 {
-	gtk_widget_set_sensitive(BUTTON_START, TRUE);
-	gtk_button_set_label(GTK_BUTTON(BUTTON_START), text);
+	struct log_line *line = g_slice_new(struct log_line);
 
-	return FALSE;
+	line->time = time;
+	line->message = message;
+
+	g_mutex_lock(&LOG_LINES_MUTEX);
+	g_queue_push_tail(&LOG_LINES, line);
+
+	// Lines which would be trimmed right away are never shown
+	while (LOG_LINES.length > LOG_LINES_LIMIT) {
+		_free_log_line(g_queue_pop_head(&LOG_LINES));
+	}
+
+	if (!LOG_DELIVERY) {
+		LOG_DELIVERY = g_timeout_add(LOG_DELIVERY_INTERVAL,
+					     _deliver_logs, NULL);
+	}
+	g_mutex_unlock(&LOG_LINES_MUTEX);
 }
 
-gboolean update_label(gpointer data)
+void clear_logs()
+{
+	log_model_clear(LOG_VIEW_MODEL);
+}
+
+static void _set_label(GtkWidget *label, const gboolean color,
+		       const gchar *text)
 {
-	char *color;
 	const char *format = "<span foreground=\"%s\">%s</span>";
-	struct label_data *args = data;
+	gchar *markup;
+
+	markup = g_markup_printf_escaped(format,
+					 color ? COLOR_GREEN : COLOR_RED,
+					 text);
+	gtk_label_set_markup(GTK_LABEL(label), markup);
+	g_free(markup);
+}
+
+static gchar *_format_time(const gint64 time, const gchar *format)
+{
+	GDateTime *gdt;
+	gchar *str;
+
+	gdt = g_date_time_new_from_unix_local(time);
+	str = g_date_time_format(gdt, format);
+	g_date_time_unref(gdt);
 
-	if (args->color) {
-		color = COLOR_GREEN;
+	return str;
+}
+
+static void _render_status(const struct Status *status)
+{
+	gboolean running = status->state != STATUS_STOPPED;
+	gchar *text;
+	gchar *stamp;
+
+	if (status->state == STATUS_UPDATING) {
+		text = g_strdup("Running (updating..)");
+	} else if (running && status->next_update > 0) {
+		text = _format_time(status->next_update,
+				    "Running (next update at %H:%M:%S)");
+	} else if (running) {
+		text = g_strdup("Running");
 	} else {
-		color = COLOR_RED;
+		text = g_strdup("Not running");
 	}
+	_set_label(LABEL_RUNNING, running, text);
+	g_free(text);
 
-	if (args->text == NULL) {
-		args->text = gtk_label_get_text(GTK_LABEL(args->widget));
+	if (status->last_update > 0) {
+		stamp = _format_time(status->last_update, "%F %H:%M:%S");
+		text = g_strdup_printf("%s (%u requests, %u ships in %.1f s)",
+				       stamp, status->cycle_requests,
+				       status->cycle_ships,
+				       status->cycle_duration / 1e6);
+		_set_label(LABEL_LAST_UPDATED, running, text);
+		g_free(text);
+		g_free(stamp);
+	} else {
+		_set_label(LABEL_LAST_UPDATED, FALSE, "Never");
 	}
 
-	gtk_label_set_markup(GTK_LABEL(args->widget),
-			     g_markup_printf_escaped(format, color, args->text));
+	gtk_button_set_label(GTK_BUTTON(BUTTON_START),
+			     running ? "Stop" : "Start");
+	// Snapshot of a thread which was asked to stop still says running,
+	// the button waits until the thread reports that it stopped
+	gtk_widget_set_sensitive(BUTTON_START,
+				 !running || g_atomic_int_get(&RUNNING));
+}
+
+static gboolean _poll_status(gpointer data)
+{
+	static guint rendered = 0;
+	struct Status status;
+
+	// Nothing to do unless the API thread has published something new
+	if (status_version() == rendered) {
+		return G_SOURCE_CONTINUE;
+	}
 
-	g_slice_free1(sizeof(*args), args);
+	rendered = status_read(&status);
+	_render_status(&status);
 
-	return FALSE;
+	return G_SOURCE_CONTINUE;
 }
 
 void start_clicked()
 {
-	GThread *thread;
-	int _running;
-
-	g_mutex_lock(&MUTEX);
 	gtk_widget_set_sensitive(BUTTON_START, FALSE);
-	_running = RUNNING;
-	g_mutex_unlock(&MUTEX);
 
-	if (_running) {
-		g_mutex_lock(&MUTEX);
-		gtk_widget_set_sensitive(BUTTON_START, FALSE);
-		RUNNING = 0;
-		g_mutex_unlock(&MUTEX);
+	if (g_atomic_int_get(&RUNNING)) {
+		api_thread_stop();
 	} else {
-		g_mutex_lock(&MUTEX);
-		RUNNING = 1;
-		g_mutex_unlock(&MUTEX);
-		thread = g_thread_new("api_thread", api_thread, config);
-		g_thread_unref(thread);
+		// Old thread has published its last status, wait for it to
+		// release the journal and the connections
+		if (API_THREAD) {
+			g_thread_join(API_THREAD);
+		}
+		g_atomic_int_set(&RUNNING, 1);
+		API_THREAD = g_thread_new("api_thread", api_thread, config);
 	}
 }
 
@@ -173,10 +263,13 @@ void activate_mainwindow(GtkApplication *app)
 	char *text;
 	GtkWidget *status_area;
 	GtkWidget *button_area;
+	GtkWidget *dashboard;
 	GtkWidget *log_area;
 	GtkWidget *scroll_container;
 	GtkWidget *bottom_area;
 	GtkWidget *button_clear_log;
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
 	GtkWidget *main_box;
 	gchar *config_contents;
 	gchar *error;
@@ -185,7 +278,7 @@ void activate_mainwindow(GtkApplication *app)
 
 	window = gtk_application_window_new(app);
 	gtk_window_set_title(GTK_WINDOW(window), "ShipSoftware-backend");
-	gtk_window_set_default_size(GTK_WINDOW(window), 600, 380);
+	gtk_window_set_default_size(GTK_WINDOW(window), 600, 560);
 	gtk_window_set_icon(GTK_WINDOW(window),
 			    gdk_pixbuf_new_from_xpm_data(logo_xpm));
 
@@ -235,11 +328,32 @@ void activate_mainwindow(GtkApplication *app)
 			   FALSE, 0);
 	gtk_box_pack_start(GTK_BOX(button_area), button_clear_log, FALSE, FALSE, 10);
 
+	dashboard = gtk_expander_new("Pipeline");
+	gtk_expander_set_expanded(GTK_EXPANDER(dashboard), TRUE);
+	gtk_container_add(GTK_CONTAINER(dashboard), dashboard_new());
+	gtk_container_set_border_width(GTK_CONTAINER(dashboard), 10);
+
 	log_area = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-	LISTBOX_LOGS = gtk_list_box_new();
+	LOG_VIEW_MODEL = log_model_new(0);
+	TREEVIEW_LOGS = gtk_tree_view_new_with_model(GTK_TREE_MODEL(LOG_VIEW_MODEL));
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+	column = gtk_tree_view_column_new_with_attributes("Message", renderer,
+							  "text",
+							  LOG_MODEL_COLUMN_MESSAGE,
+							  NULL);
+	gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_expand(column, TRUE);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(TREEVIEW_LOGS), column);
+	gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(TREEVIEW_LOGS), FALSE);
+	gtk_tree_view_set_enable_search(GTK_TREE_VIEW(TREEVIEW_LOGS), FALSE);
+	gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(TREEVIEW_LOGS),
+					 LOG_MODEL_COLUMN_TIME);
+	// Rows are measured once instead of every row being laid out
+	gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(TREEVIEW_LOGS), TRUE);
 	bottom_area = gtk_fixed_new();
 	scroll_container = gtk_scrolled_window_new(NULL, NULL);
-	gtk_container_add(GTK_CONTAINER(scroll_container), LISTBOX_LOGS);
+	gtk_container_add(GTK_CONTAINER(scroll_container), TREEVIEW_LOGS);
 	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll_container),
 				       GTK_POLICY_AUTOMATIC,
 				       GTK_POLICY_AUTOMATIC);
@@ -250,6 +364,7 @@ void activate_mainwindow(GtkApplication *app)
 	gtk_box_pack_start(GTK_BOX(main_box), menubar, FALSE, FALSE, 0);
 	gtk_box_pack_start(GTK_BOX(main_box), status_area, FALSE, FALSE, 0);
 	gtk_box_pack_start(GTK_BOX(main_box), button_area, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(main_box), dashboard, FALSE, FALSE, 0);
 	gtk_box_pack_start(GTK_BOX(log_area), scroll_container, TRUE, TRUE, 10);
 	gtk_box_pack_start(GTK_BOX(main_box), log_area, TRUE, TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(main_box), bottom_area, FALSE, FALSE, 0);
@@ -261,6 +376,7 @@ void activate_mainwindow(GtkApplication *app)
 	g_signal_connect(BUTTON_START, "clicked", G_CALLBACK(start_clicked), NULL);
 	g_signal_connect(button_clear_log, "clicked", G_CALLBACK(clear_logs), NULL);
 	g_signal_connect(G_OBJECT(window), "key_press_event", G_CALLBACK(keypress_event), NULL);
+	g_timeout_add(STATUS_POLL_INTERVAL, _poll_status, NULL);
 
 	gtk_widget_show_all(window);
 
@@ -301,4 +417,11 @@ void activate_mainwindow(GtkApplication *app)
 			log_error(error_message);
 		}
 	}
+
+	if (config_valid &&
+	    !log_start(config->log_file,
+		       g_strcmp0(config->log_format, "json") == 0, &error))
+	{
+		log_error(error);
+	}
 }
@@ -32,65 +32,36 @@
 #include <gtk/gtk.h>
 #include "config.h"
 
-/**
- * @struct label_data
- * @brief Struct to hold data for label
- *
- * Holds needed data to update GTK_LABEL with wanted properties
- */
-struct label_data {
-	GtkWidget *widget; /**< GTK_LABEL which properties to change */
-	gboolean color; /**< Text color */
-	const char *text; /**< Text which to put in the label */
-};
-
-int RUNNING;
-GMutex MUTEX; /**< Shared mutex between main_window() and api_thread() */
-GtkWidget *LISTBOX_LOGS; /**< Listbox for the logs */
-GtkWidget *LABEL_RUNNING; /**< Label for running state */
-GtkWidget *BUTTON_START; /**< Start button */
-GtkWidget *LABEL_LAST_UPDATED; /**< Last updated label */
+extern gint RUNNING;
+extern GMutex MUTEX; /**< Shared mutex between main_window() and api_thread() */
+extern GtkWidget *TREEVIEW_LOGS; /**< Tree view of the logs */
+extern GtkWidget *LABEL_RUNNING; /**< Label for running state */
+extern GtkWidget *BUTTON_START; /**< Start button */
+extern GtkWidget *LABEL_LAST_UPDATED; /**< Last updated label */
 
 /**
- * @brief Prepends row with message to GTK_LIST_BOX
+ * @brief Add log line to the top of the log view
  *
- * Prepends a row with @c message to GTK_LIST_BOX and sets tooltip with
- * current date and time.
+ * Lines are collected and added to the view together at most every
+ * 16 milliseconds. The time of the line is shown as a tooltip. Can be
+ * called from any thread.
  *
- * @param[in] message Message for the row
- * @return gboolean
- * @note Returns always FALSE
+ * @param[in] time Unix time of the line
+ * @param[in] message Log line
+ * @return Nothing
  * @note @p message will be freed with g_free()
  */
-gboolean add_log_row(void *message);
+void add_log_row(const gint64 time, gchar *message);
 
 /**
- * Clears all rows from GTK_LIST_BOX
+ * Clears all rows from the log view
  *
  * @return Nothing
  */
 void clear_logs();
 
 /**
- * Sets START_BUTTON text to supplied text
- *
- * @param[in] text
- * @return gboolean
- * @note Returns always FALSE
- */
-gboolean set_button_text(void *text);
-
-/**
- * Updates label
- *
- * @param[in] data Struct of type label_data()
- * @return gboolean
- * @note Retuns always FALSE
- */
-gboolean update_label(gpointer data);
-
-/**
- * Toggle @ref RUNNING variable
+ * Start the api_thread() or ask it to stop
  *
  * @return Nothing
  */
@@ -106,6 +77,9 @@ void start_clicked();
  * If user does not want to open config_window(), program cannot be started.
  * Otherwise START_BUTTON is made clickable.
  *
+ * Status labels and START_BUTTON are refreshed from status_read() on a
+ * timer, only when the api_thread() has published a new status.
+ *
  * @param[in] app GtkApplication
  * @return Nothing
  */
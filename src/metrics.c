@@ -0,0 +1,378 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "metrics.h"
+
+/**
+ * @brief Metrics of one thread
+ */
+struct MetricsShard {
+	gint64 counters[METRIC_N_COUNTERS]; /**< Written only by the owner */
+	struct HdrHistogram *histograms[METRIC_N_HISTOGRAMS]; /**< Allocated on first use, written only by the owner */
+};
+
+/**
+ * @brief Name and help text of a metric
+ */
+struct MetricInfo {
+	const gchar *name; /**< Prometheus metric name */
+	const gchar *labels; /**< Labels without braces or NULL */
+	const gchar *help; /**< Help text */
+	gboolean micros; /**< Value is in microseconds, exported in seconds */
+};
+
+static const gchar *OPERATIONS[METRIC_N_HISTOGRAMS] = {
+	"api_request",
+	"decode",
+	"decode_entry",
+	"get_ships",
+	"update_ship",
+	"insert_gps",
+	"clean_gps",
+	"retention",
+	"cycle",
+};
+
+static const struct MetricInfo COUNTER_INFO[METRIC_N_COUNTERS] = {
+	{"shipsoftware_api_requests_total", NULL, "API requests made", FALSE},
+	{"shipsoftware_api_errors_total", NULL, "API requests which failed", FALSE},
+	{"shipsoftware_api_seconds_total", NULL, "Time spent in API requests", TRUE},
+	{"shipsoftware_api_response_bytes_total", NULL, "Bytes of API responses", FALSE},
+	{"shipsoftware_decode_batches_total", NULL, "API responses decoded", FALSE},
+	{"shipsoftware_decode_entries_total", NULL, "Ship entries decoded", FALSE},
+	{"shipsoftware_decode_errors_total", NULL, "API responses which could not be decoded", FALSE},
+	{"shipsoftware_decode_seconds_total", NULL, "Time spent decoding API responses", TRUE},
+	{"shipsoftware_db_write_batches_total", NULL, "Batches written to the database", FALSE},
+	{"shipsoftware_db_write_seconds_total", NULL, "Time spent in Ships updates and GPS inserts", TRUE},
+	{"shipsoftware_retention_ships_total", NULL, "Ships whose old GPS records were deleted", FALSE},
+	{"shipsoftware_retention_seconds_total", NULL, "Time spent deleting old GPS records", TRUE},
+	{"shipsoftware_ships_written_total", NULL, "Ships written to the database", FALSE},
+	{"shipsoftware_ships_stored_total", NULL, "Ships stored in the journal or coalesce buffer", FALSE},
+	{"shipsoftware_db_errors_total", NULL, "Failed database operations", FALSE},
+	{"shipsoftware_update_cycles_total", NULL, "Update cycles completed", FALSE},
+};
+
+static const struct MetricInfo GAUGE_INFO[METRIC_N_GAUGES] = {
+	{"shipsoftware_pipeline_pending", NULL, "Batches and ships in the pipeline", FALSE},
+	{"shipsoftware_ships_tracked", NULL, "Ships in the roster", FALSE},
+	{"shipsoftware_api_budget_requests_per_hour", NULL, "API requests allowed per hour", FALSE},
+	{"shipsoftware_last_cycle_timestamp_seconds", NULL, "Unix time when the last update cycle ended", FALSE},
+};
+
+static const struct MetricInfo HISTOGRAM_INFO[METRIC_N_HISTOGRAMS] = {
+	{"shipsoftware_api_request_duration_seconds", NULL, "Duration of API requests", TRUE},
+	{"shipsoftware_decode_duration_seconds", NULL, "Duration of decoding one API response", TRUE},
+	{"shipsoftware_decode_entry_duration_seconds", NULL, "Duration of decoding one ship entry, averaged over a response", TRUE},
+	{"shipsoftware_db_statement_duration_seconds", "statement=\"get_ships\"", "Duration of database statements", TRUE},
+	{"shipsoftware_db_statement_duration_seconds", "statement=\"update_ship\"", "Duration of database statements", TRUE},
+	{"shipsoftware_db_statement_duration_seconds", "statement=\"insert_gps\"", "Duration of database statements", TRUE},
+	{"shipsoftware_db_statement_duration_seconds", "statement=\"clean_gps\"", "Duration of database statements", TRUE},
+	{"shipsoftware_retention_duration_seconds", NULL, "Duration of deleting old GPS records of one ship", TRUE},
+	{"shipsoftware_update_cycle_duration_seconds", NULL, "Duration of update cycles", TRUE},
+};
+
+// Upper bounds of Prometheus buckets in microseconds, from 1 us to an hour
+static const gint64 BOUNDS[] = {
+	1, 5, 10, 50,
+	100, 250, 500,
+	1000, 2500, 5000,
+	10000, 25000, 50000,
+	100000, 250000, 500000,
+	1000000, 2500000, 5000000,
+	10000000, 30000000, 60000000,
+	300000000, 1200000000, G_GINT64_CONSTANT(3600000000),
+};
+
+static const gdouble QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+static void _retire(gpointer data);
+
+static GMutex LOCK;
+static GPtrArray *SHARDS = NULL;
+static struct MetricsShard RETIRED;
+static gint64 GAUGES[METRIC_N_GAUGES];
+static GPrivate SHARD = G_PRIVATE_INIT(_retire);
+
+/*
+ * Only the owning thread writes its shard, so a relaxed load and store is
+ * enough. The atomics only keep readers from seeing torn 64-bit values.
+ */
+static inline void _bump(gint64 *value, const gint64 add)
+{
+	__atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + add,
+			 __ATOMIC_RELAXED);
+}
+
+static inline gint64 _load(const gint64 *value)
+{
+	return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static void _sum(struct MetricsShard *to, const struct MetricsShard *from)
+{
+	for (guint i = 0; i < METRIC_N_COUNTERS; ++i) {
+		to->counters[i] += _load(&from->counters[i]);
+	}
+}
+
+// Metrics of an exiting thread are folded into RETIRED
+static void _retire(gpointer data)
+{
+	struct MetricsShard *shard = data;
+
+	g_mutex_lock(&LOCK);
+	_sum(&RETIRED, shard);
+	for (guint i = 0; i < METRIC_N_HISTOGRAMS; ++i) {
+		if (!shard->histograms[i]) {
+			continue;
+		}
+
+		if (!RETIRED.histograms[i]) {
+			RETIRED.histograms[i] = hdr_new();
+		}
+		hdr_add(RETIRED.histograms[i], shard->histograms[i]);
+		hdr_free(shard->histograms[i]);
+	}
+	g_ptr_array_remove_fast(SHARDS, shard);
+	g_mutex_unlock(&LOCK);
+
+	g_slice_free(struct MetricsShard, shard);
+}
+
+static struct MetricsShard *_shard()
+{
+	struct MetricsShard *shard = g_private_get(&SHARD);
+
+	if (shard) {
+		return shard;
+	}
+
+	shard = g_slice_new0(struct MetricsShard);
+	g_private_set(&SHARD, shard);
+
+	g_mutex_lock(&LOCK);
+	if (!SHARDS) {
+		SHARDS = g_ptr_array_new();
+	}
+	g_ptr_array_add(SHARDS, shard);
+	g_mutex_unlock(&LOCK);
+
+	return shard;
+}
+
+static struct HdrHistogram *_histogram(const enum MetricHistogram histogram)
+{
+	struct MetricsShard *shard = _shard();
+
+	if (G_UNLIKELY(!shard->histograms[histogram])) {
+		// Readers look at the pointer while holding the lock
+		g_mutex_lock(&LOCK);
+		shard->histograms[histogram] = hdr_new();
+		g_mutex_unlock(&LOCK);
+	}
+
+	return shard->histograms[histogram];
+}
+
+void metrics_add(const enum MetricCounter counter, const gint64 value)
+{
+	_bump(&_shard()->counters[counter], value);
+}
+
+void metrics_set(const enum MetricGauge gauge, const gint64 value)
+{
+	__atomic_store_n(&GAUGES[gauge], value, __ATOMIC_RELAXED);
+}
+
+void metrics_observe(const enum MetricHistogram histogram, const gint64 value)
+{
+	hdr_record(_histogram(histogram), value * 1000, 1);
+}
+
+void metrics_observe_items(const enum MetricHistogram histogram,
+			   const gint64 value, const gint64 items)
+{
+	if (items <= 0) {
+		return;
+	}
+
+	hdr_record(_histogram(histogram), value * 1000 / items, items);
+}
+
+const gchar *metrics_histogram_name(const enum MetricHistogram histogram)
+{
+	return OPERATIONS[histogram];
+}
+
+void metrics_read(struct MetricsSnapshot *snapshot)
+{
+	struct MetricsShard total;
+
+	snapshot->time = g_get_monotonic_time();
+
+	g_mutex_lock(&LOCK);
+	memcpy(total.counters, RETIRED.counters, sizeof(total.counters));
+	for (guint i = 0; SHARDS && i < SHARDS->len; ++i) {
+		_sum(&total, g_ptr_array_index(SHARDS, i));
+	}
+	g_mutex_unlock(&LOCK);
+
+	memcpy(snapshot->counters, total.counters, sizeof(total.counters));
+
+	for (guint i = 0; i < METRIC_N_GAUGES; ++i) {
+		snapshot->gauges[i] = __atomic_load_n(&GAUGES[i], __ATOMIC_RELAXED);
+	}
+}
+
+void metrics_read_histogram(const enum MetricHistogram histogram,
+			    struct HdrHistogram *hdr)
+{
+	hdr_reset(hdr);
+
+	g_mutex_lock(&LOCK);
+	if (RETIRED.histograms[histogram]) {
+		hdr_add(hdr, RETIRED.histograms[histogram]);
+	}
+	for (guint i = 0; SHARDS && i < SHARDS->len; ++i) {
+		struct MetricsShard *shard = g_ptr_array_index(SHARDS, i);
+
+		if (shard->histograms[histogram]) {
+			hdr_add(hdr, shard->histograms[histogram]);
+		}
+	}
+	g_mutex_unlock(&LOCK);
+}
+
+static void _append_header(GString *out, const gchar *name, const gchar *help,
+			   const gchar *type, const gchar **previous)
+{
+	// Metrics with labels share one header
+	if (g_strcmp0(*previous, name) == 0) {
+		return;
+	}
+	*previous = name;
+
+	g_string_append_printf(out, "# HELP %s %s\n", name, help);
+	g_string_append_printf(out, "# TYPE %s %s\n", name, type);
+}
+
+static void _append_value(GString *out, const gchar *name,
+			  const gchar *suffix, const gchar *labels,
+			  const gchar *extra, const gint64 value,
+			  const gdouble scale)
+{
+	gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_string_append(out, name);
+	g_string_append(out, suffix);
+
+	if (labels || extra) {
+		g_string_append_printf(out, "{%s%s%s}", labels ? labels : "",
+				       labels && extra ? "," : "",
+				       extra ? extra : "");
+	}
+
+	if (scale != 0) {
+		g_ascii_dtostr(number, sizeof(number), value * scale);
+		g_string_append_printf(out, " %s\n", number);
+	} else {
+		g_string_append_printf(out, " %" G_GINT64_FORMAT "\n", value);
+	}
+}
+
+gchar *metrics_prometheus()
+{
+	struct MetricsSnapshot snapshot;
+	struct HdrHistogram *histograms[METRIC_N_HISTOGRAMS];
+	GString *out = g_string_sized_new(16384);
+	const gchar *previous = NULL;
+	gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar *labels;
+
+	metrics_read(&snapshot);
+
+	for (guint i = 0; i < METRIC_N_COUNTERS; ++i) {
+		const struct MetricInfo *info = &COUNTER_INFO[i];
+
+		_append_header(out, info->name, info->help, "counter", &previous);
+		_append_value(out, info->name, "", info->labels, NULL,
+			      snapshot.counters[i], info->micros ? 1e-6 : 0);
+	}
+
+	for (guint i = 0; i < METRIC_N_GAUGES; ++i) {
+		const struct MetricInfo *info = &GAUGE_INFO[i];
+
+		_append_header(out, info->name, info->help, "gauge", &previous);
+		_append_value(out, info->name, "", info->labels, NULL,
+			      snapshot.gauges[i], info->micros ? 1e-6 : 0);
+	}
+
+	for (guint i = 0; i < METRIC_N_HISTOGRAMS; ++i) {
+		const struct MetricInfo *info = &HISTOGRAM_INFO[i];
+		struct HdrHistogram *hdr = hdr_new();
+
+		histograms[i] = hdr;
+		metrics_read_histogram(i, hdr);
+
+		_append_header(out, info->name, info->help, "histogram",
+			       &previous);
+
+		for (guint j = 0; j < G_N_ELEMENTS(BOUNDS); ++j) {
+			g_ascii_dtostr(number, sizeof(number), BOUNDS[j] / 1e6);
+			labels = g_strdup_printf("le=\"%s\"", number);
+			_append_value(out, info->name, "_bucket", info->labels,
+				      labels,
+				      hdr_count_at_or_below(hdr, BOUNDS[j] * 1000),
+				      0);
+			g_free(labels);
+		}
+		_append_value(out, info->name, "_bucket", info->labels,
+			      "le=\"+Inf\"", hdr->total, 0);
+		_append_value(out, info->name, "_sum", info->labels, NULL,
+			      hdr->sum, 1e-9);
+		_append_value(out, info->name, "_count", info->labels, NULL,
+			      hdr->total, 0);
+	}
+
+	// Percentiles the histogram buckets are too coarse for
+	for (guint i = 0; i < METRIC_N_HISTOGRAMS; ++i) {
+		_append_header(out, "shipsoftware_latency_quantile_seconds",
+			       "Percentiles of durations since start", "gauge",
+			       &previous);
+
+		for (guint j = 0; histograms[i]->total > 0 &&
+		     j < G_N_ELEMENTS(QUANTILES); ++j)
+		{
+			g_ascii_dtostr(number, sizeof(number), QUANTILES[j]);
+			labels = g_strdup_printf("operation=\"%s\",quantile=\"%s\"",
+						 OPERATIONS[i], number);
+			_append_value(out, "shipsoftware_latency_quantile_seconds",
+				      "", labels, NULL,
+				      hdr_percentile(histograms[i],
+						     QUANTILES[j] * 100),
+				      1e-9);
+			g_free(labels);
+		}
+
+		hdr_free(histograms[i]);
+	}
+
+	return g_string_free(out, FALSE);
+}
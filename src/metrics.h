@@ -0,0 +1,197 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file metrics.h
+ * @brief In-process counters, gauges and histograms
+ * @details Counters and histograms are kept per thread: updating one only
+ * touches memory of the calling thread with relaxed atomic stores, so it
+ * needs no lock and never waits for a reader. Readers sum the values of all
+ * threads. Values of threads which have exited are kept, so totals never
+ * decrease.
+ *
+ * Gauges hold the latest value set by any thread.
+ *
+ * Histograms are high dynamic range histograms, see hdr.h, of durations in
+ * nanoseconds. Histograms of all threads are merged when read, and
+ * percentiles of any interval can be taken from the difference of two
+ * readings.
+ *
+ * Every metric has a name and help text in Prometheus conventions and
+ * metrics_prometheus() formats all of them in the Prometheus text
+ * exposition format. Times are exported in seconds. Histogram buckets are
+ * taken from the high dynamic range histograms, so a value within 1% of a
+ * bucket bound may be counted in the next bucket.
+ *
+ * All functions are thread safe.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <glib.h>
+
+#include "hdr.h"
+
+/**
+ * @enum MetricCounter
+ * @brief Counters, times are in microseconds
+ */
+enum MetricCounter {
+	METRIC_FETCH_REQUESTS, /**< API requests made */
+	METRIC_FETCH_ERRORS, /**< API requests which failed */
+	METRIC_FETCH_TIME, /**< Time spent in API requests */
+	METRIC_FETCH_BYTES, /**< Bytes of API responses */
+	METRIC_DECODE_BATCHES, /**< API responses decoded */
+	METRIC_DECODE_ENTRIES, /**< Ship entries decoded */
+	METRIC_DECODE_ERRORS, /**< API responses which could not be decoded */
+	METRIC_DECODE_TIME, /**< Time spent decoding */
+	METRIC_WRITE_BATCHES, /**< Batches written to the database */
+	METRIC_WRITE_TIME, /**< Time spent in Ships updates and GPS inserts */
+	METRIC_RETENTION_SHIPS, /**< Ships whose old GPS records were deleted */
+	METRIC_RETENTION_TIME, /**< Time spent deleting old GPS records */
+	METRIC_SHIPS_WRITTEN, /**< Ships written to the database */
+	METRIC_SHIPS_STORED, /**< Ships stored in the journal or coalesce buffer */
+	METRIC_DB_ERRORS, /**< Failed database operations */
+	METRIC_CYCLES, /**< Update cycles completed */
+	METRIC_N_COUNTERS /**< Number of counters */
+};
+
+/**
+ * @enum MetricGauge
+ * @brief Gauges
+ */
+enum MetricGauge {
+	METRIC_PIPELINE_PENDING, /**< Batches and ships in the pipeline */
+	METRIC_SHIPS_TRACKED, /**< Ships in the roster */
+	METRIC_API_BUDGET, /**< API requests allowed per hour */
+	METRIC_LAST_CYCLE, /**< Unix time when the last update cycle ended */
+	METRIC_N_GAUGES /**< Number of gauges */
+};
+
+/**
+ * @enum MetricHistogram
+ * @brief Histograms of durations
+ */
+enum MetricHistogram {
+	METRIC_HIST_API_REQUEST, /**< HTTP request to the API */
+	METRIC_HIST_DECODE, /**< Decoding one API response */
+	METRIC_HIST_DECODE_ENTRY, /**< Decoding one ship entry */
+	METRIC_HIST_DB_GET_SHIPS, /**< Reading the ship roster */
+	METRIC_HIST_DB_UPDATE_SHIP, /**< Ships table update of one ship */
+	METRIC_HIST_DB_INSERT_GPS, /**< GPS insert of one ship or a batch */
+	METRIC_HIST_DB_CLEAN_GPS, /**< Statement deleting old GPS records */
+	METRIC_HIST_RETENTION, /**< Deleting old GPS records of one ship */
+	METRIC_HIST_CYCLE, /**< Update cycle */
+	METRIC_N_HISTOGRAMS /**< Number of histograms */
+};
+
+/**
+ * @struct MetricsSnapshot
+ * @brief Values of all metrics at one time
+ */
+struct MetricsSnapshot {
+	gint64 time; /**< Monotonic time of the snapshot */
+	gint64 counters[METRIC_N_COUNTERS]; /**< Counter totals */
+	gint64 gauges[METRIC_N_GAUGES]; /**< Gauge values */
+};
+
+/**
+ * Add to a counter
+ *
+ * @param[in] counter Counter to add to
+ * @param[in] value Value to add
+ * @return Nothing
+ */
+void metrics_add(const enum MetricCounter counter, const gint64 value);
+
+/**
+ * Set a gauge
+ *
+ * @param[in] gauge Gauge to set
+ * @param[in] value New value
+ * @return Nothing
+ */
+void metrics_set(const enum MetricGauge gauge, const gint64 value);
+
+/**
+ * Record a duration in a histogram
+ *
+ * @param[in] histogram Histogram to record to
+ * @param[in] value Duration in microseconds
+ * @return Nothing
+ */
+void metrics_observe(const enum MetricHistogram histogram, const gint64 value);
+
+/**
+ * @brief Record a duration shared by many items
+ *
+ * Records the average duration of an item once for every item, for items
+ * too fast to time one by one.
+ *
+ * @param[in] histogram Histogram to record to
+ * @param[in] value Duration of all items in microseconds
+ * @param[in] items Number of items
+ * @return Nothing
+ */
+void metrics_observe_items(const enum MetricHistogram histogram,
+			   const gint64 value, const gint64 items);
+
+/**
+ * Name of the operation a histogram measures
+ *
+ * @param[in] histogram Histogram
+ * @return const gchar* Name like @c update_ship
+ */
+const gchar *metrics_histogram_name(const enum MetricHistogram histogram);
+
+/**
+ * @brief Read all metrics
+ *
+ * Values are read without stopping the threads updating them, so a
+ * snapshot may miss updates made while it is being taken.
+ *
+ * @param[out] snapshot Struct of type MetricsSnapshot()
+ * @return Nothing
+ */
+void metrics_read(struct MetricsSnapshot *snapshot);
+
+/**
+ * @brief Read a histogram merged from all threads
+ *
+ * @param[in] histogram Histogram to read
+ * @param[out] hdr Struct of type HdrHistogram(), durations in nanoseconds
+ * @return Nothing
+ */
+void metrics_read_histogram(const enum MetricHistogram histogram,
+			    struct HdrHistogram *hdr);
+
+/**
+ * @brief Format all metrics in the Prometheus text format
+ *
+ * Metric names start with @c shipsoftware_.
+ *
+ * @return gchar* Text of version 0.0.4 of the format
+ * @note Free with g_free()
+ */
+gchar *metrics_prometheus();
+
+#endif
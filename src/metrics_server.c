@@ -0,0 +1,138 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <gio/gio.h>
+#include <string.h>
+#include "metrics.h"
+#include "metrics_server.h"
+
+static GSocketService *SERVICE = NULL;
+
+static void _respond(GOutputStream *out, const gchar *status,
+		     const gchar *type, const gchar *body)
+{
+	gchar *header;
+
+	header = g_strdup_printf("HTTP/1.0 %s\r\n"
+				 "Content-Type: %s\r\n"
+				 "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+				 "Connection: close\r\n"
+				 "\r\n", status, type, strlen(body));
+
+	if (g_output_stream_write_all(out, header, strlen(header), NULL, NULL,
+				      NULL))
+	{
+		g_output_stream_write_all(out, body, strlen(body), NULL, NULL,
+					  NULL);
+	}
+
+	g_free(header);
+}
+
+static gboolean _run(GThreadedSocketService *service,
+		     GSocketConnection *connection, GObject *source,
+		     gpointer data)
+{
+	GDataInputStream *in;
+	GOutputStream *out;
+	gchar *line;
+	gchar **request;
+	gchar *body;
+
+	g_socket_set_timeout(g_socket_connection_get_socket(connection),
+			     METRICS_SERVER_TIMEOUT);
+	in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+	g_data_input_stream_set_newline_type(in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+	out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+	line = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+	request = g_strsplit(line ? line : "", " ", 3);
+	g_free(line);
+
+	// Headers are read only to get to the end of the request
+	while ((line = g_data_input_stream_read_line(in, NULL, NULL, NULL)) &&
+	       line[0] != '\0')
+	{
+		g_free(line);
+	}
+	g_free(line);
+
+	if (g_strv_length(request) < 2 || g_strcmp0(request[0], "GET") != 0) {
+		_respond(out, "405 Method Not Allowed", "text/plain",
+			 "Method not allowed\n");
+	} else if (g_strcmp0(request[1], "/metrics") != 0) {
+		_respond(out, "404 Not Found", "text/plain", "Not found\n");
+	} else {
+		body = metrics_prometheus();
+		_respond(out, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+			 body);
+		g_free(body);
+	}
+
+	g_strfreev(request);
+	g_object_unref(in);
+
+	return TRUE;
+}
+
+gboolean metrics_server_start(const gint64 port, gchar **error)
+{
+	GInetAddress *address;
+	GSocketAddress *socket_address;
+	GError *_error = NULL;
+	gboolean ret;
+
+	SERVICE = g_threaded_socket_service_new(METRICS_SERVER_THREADS);
+	address = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+	socket_address = g_inet_socket_address_new(address, (guint16)port);
+
+	ret = g_socket_listener_add_address(G_SOCKET_LISTENER(SERVICE),
+					    socket_address,
+					    G_SOCKET_TYPE_STREAM,
+					    G_SOCKET_PROTOCOL_TCP,
+					    NULL, NULL, &_error);
+	g_object_unref(socket_address);
+	g_object_unref(address);
+
+	if (!ret) {
+		*(error) = g_strconcat("Could not start metrics server: ",
+				       _error->message, NULL);
+		g_error_free(_error);
+		g_object_unref(SERVICE);
+		SERVICE = NULL;
+		return FALSE;
+	}
+
+	g_signal_connect(SERVICE, "run", G_CALLBACK(_run), NULL);
+	g_socket_service_start(SERVICE);
+
+	return TRUE;
+}
+
+void metrics_server_stop()
+{
+	if (!SERVICE) {
+		return;
+	}
+
+	g_socket_service_stop(SERVICE);
+	g_socket_listener_close(G_SOCKET_LISTENER(SERVICE));
+	g_object_unref(SERVICE);
+	SERVICE = NULL;
+}
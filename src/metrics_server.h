@@ -0,0 +1,64 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file metrics_server.h
+ * @brief HTTP endpoint for Prometheus
+ * @details Serves metrics_prometheus() at @c /metrics on the loopback
+ * interface. Requests are answered on a small pool of threads, so a slow
+ * client can not hold up the main loop.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <glib.h>
+
+/**
+ * Number of requests answered at the same time
+ */
+#define METRICS_SERVER_THREADS 2
+
+/**
+ * Seconds a client has to send its request
+ */
+#define METRICS_SERVER_TIMEOUT 5
+
+/**
+ * @brief Start listening on 127.0.0.1
+ *
+ * Connections are accepted by the main loop of the calling thread.
+ *
+ * @param[in] port TCP port
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE on success, otherwise FALSE
+ * @note Stop with metrics_server_stop()
+ */
+gboolean metrics_server_start(const gint64 port, gchar **error);
+
+/**
+ * Stop listening
+ *
+ * @return Nothing
+ */
+void metrics_server_stop();
+
+#endif
@@ -0,0 +1,324 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "once.h"
+#include "api.h"
+#include "clock.h"
+#include "database.h"
+#include "journal.h"
+#include "json.h"
+#include "log.h"
+#include "pipeline.h"
+#include "scheduler.h"
+
+/**
+ * @brief State of the cycle
+ */
+struct Once {
+	const struct Config *config; /**< Configuration */
+	struct Database db; /**< Connection */
+	gboolean connected; /**< @p db can be written to */
+	struct Journal *journal; /**< Journal, opened when first needed */
+	gboolean replayed; /**< Journal has been checked for a backlog */
+	struct ShipBatch *batch; /**< Ships of the current request */
+	gint64 started; /**< Monotonic time when the program started */
+	gint64 first_request; /**< Time from start to first request */
+	gint64 fetch_time; /**< Time spent in API requests */
+	gint64 decode_time; /**< Time spent decoding */
+	gint64 write_time; /**< Time spent writing */
+	gint64 fetch_cpu; /**< CPU time spent in API requests */
+	gint64 decode_cpu; /**< CPU time spent decoding */
+	gint64 write_cpu; /**< CPU time spent writing */
+	guint requests; /**< API requests made */
+	guint failed; /**< API requests which failed or could not be decoded */
+	guint ships; /**< Ships decoded */
+	guint written; /**< Ships written to the database */
+	guint stored; /**< Ships stored in the journal */
+	guint lost; /**< Ships neither written nor stored */
+};
+
+// Next SCHEDULER_BATCH_SIZE MMSI's of the roster, NULL at the end
+static gchar *_next_names(const gchar **roster)
+{
+	const gchar *start = *roster;
+	const gchar *end = start;
+	guint count = 0;
+
+	if (*start == '\0') {
+		return NULL;
+	}
+
+	for (; *end != '\0'; ++end) {
+		if (*end == ',' && ++count == SCHEDULER_BATCH_SIZE) {
+			break;
+		}
+	}
+	*(roster) = *end != '\0' ? end + 1 : end;
+
+	return g_strndup(start, end - start);
+}
+
+static struct Journal *_journal(struct Once *once)
+{
+	const gchar *dir = once->config->journal_dir;
+	gchar *error;
+
+	if (once->journal || !dir || dir[0] == '\0') {
+		return once->journal;
+	}
+
+	error = NULL;
+	once->journal = journal_open(dir, &error);
+	if (!once->journal) {
+		log_error(g_strconcat("Journal disabled, ", error, NULL));
+		g_free(error);
+	}
+
+	return once->journal;
+}
+
+// Updates stored by an earlier run have to be written first
+static void _replay(struct Once *once)
+{
+	gchar *error;
+	guint records;
+
+	once->replayed = TRUE;
+	if (!_journal(once) || journal_is_empty(once->journal)) {
+		return;
+	}
+
+	error = NULL;
+	records = 0;
+	if (!journal_replay(once->journal, &once->db, &records, &error)) {
+		log_error(g_strconcat("Replaying journal failed: ", error, NULL));
+		g_free(error);
+		once->connected = FALSE;
+		return;
+	}
+
+	log_message(g_strdup_printf("Replayed %u journaled updates", records));
+}
+
+static void _store(struct Once *once, const guint first)
+{
+	const struct ShipBatch *batch = once->batch;
+	gchar *error;
+
+	for (guint i = first; i < batch->len; ++i) {
+		struct Ship ship;
+
+		error = NULL;
+		ship_batch_get(batch, i, &ship);
+
+		if (_journal(once) &&
+		    journal_append(once->journal, &ship, &error))
+		{
+			once->stored++;
+			continue;
+		}
+
+		if (error) {
+			log_error(g_strconcat("Journal: ", error, NULL));
+			g_free(error);
+		}
+		once->lost++;
+	}
+}
+
+static void _write(struct Once *once)
+{
+	guint written;
+	gint64 started;
+	gint64 cpu;
+
+	if (!once->replayed) {
+		_replay(once);
+	}
+
+	written = 0;
+	started = g_get_monotonic_time();
+	cpu = clock_thread_cpu_time();
+	if (once->connected) {
+		if (!pipeline_write(&once->db, once->batch, &written)) {
+			log_error(g_strdup("Lost connection to database"));
+			once->connected = FALSE;
+		}
+	}
+	if (written < once->batch->len) {
+		_store(once, written);
+	}
+	once->write_time += g_get_monotonic_time() - started;
+	once->write_cpu += clock_thread_cpu_time() - cpu;
+	once->written += written;
+}
+
+static void _update(struct Once *once, const gchar *names)
+{
+	gchar *error;
+	gchar *json;
+	gint64 started;
+	gint64 cpu;
+
+	error = NULL;
+	json = NULL;
+	started = g_get_monotonic_time();
+	cpu = clock_thread_cpu_time();
+	if (once->requests++ == 0) {
+		once->first_request = started - once->started;
+	}
+
+	if (!api_get_loc(names, once->config->api_key, &json, &error)) {
+		log_error(g_strconcat("API request failed: ", error, NULL));
+		g_free(error);
+		once->failed++;
+		return;
+	}
+	once->fetch_time += g_get_monotonic_time() - started;
+	once->fetch_cpu += clock_thread_cpu_time() - cpu;
+
+	started = g_get_monotonic_time();
+	cpu = clock_thread_cpu_time();
+	ship_batch_clear(once->batch);
+	if (!json_read_ships(json, once->batch, &error)) {
+		log_error(g_strconcat("Invalid API response: ", error, NULL));
+		g_free(error);
+		once->failed++;
+	}
+	g_free(json);
+	once->decode_time += g_get_monotonic_time() - started;
+	once->decode_cpu += clock_thread_cpu_time() - cpu;
+	once->ships += once->batch->len;
+
+	if (once->batch->len > 0) {
+		_write(once);
+	}
+}
+
+static void _print_summary(const struct Once *once)
+{
+	gint64 total = g_get_monotonic_time() - once->started;
+
+	g_print("requests=%u failed=%u ships=%u written=%u stored=%u lost=%u "
+		"first_request_ms=%.2f fetch_ms=%.2f decode_ms=%.2f "
+		"write_ms=%.2f total_ms=%.2f entries_per_second=%.0f "
+		"fetch_cpu_ms=%.2f decode_cpu_ms=%.2f write_cpu_ms=%.2f\n",
+		once->requests, once->failed, once->ships, once->written,
+		once->stored, once->lost, once->first_request / 1e3,
+		once->fetch_time / 1e3, once->decode_time / 1e3,
+		once->write_time / 1e3, total / 1e3,
+		total > 0 ? once->ships * 1e6 / total : 0,
+		once->fetch_cpu / 1e3, once->decode_cpu / 1e3,
+		once->write_cpu / 1e3);
+}
+
+gint once_run(const struct Config *config, const gint64 started,
+	     const enum DbSink sink)
+{
+	struct Once once;
+	const gchar *cursor;
+	gchar *roster;
+	gchar *names;
+	gchar *error;
+	gint status;
+
+	memset(&once, 0, sizeof(once));
+	once.config = config;
+	once.started = started;
+	error = NULL;
+	roster = NULL;
+
+	api_set_url(config->api_url[0] != '\0' ? config->api_url : NULL);
+
+	if (sink == DB_SINK_MYSQL) {
+		if (!db_init(&once.db, config, &error) ||
+		    !db_get_ships(&once.db, &roster, &error))
+		{
+			log_error(error);
+			db_close_con(&once.db);
+			_print_summary(&once);
+			return ONCE_EXIT_FAILURE;
+		}
+		once.connected = TRUE;
+	} else {
+		// Other sinks leave the database and the journal as they were,
+		// roster is the one the daemon saved in the journal directory
+		once.replayed = TRUE;
+		once.db.discard = sink == DB_SINK_NULL;
+		once.connected = sink == DB_SINK_NULL;
+		if (!_journal(&once)) {
+			error = g_strdup("Sinks `file` and `null` need a journal, "
+					 "set journal_dir");
+		} else if (!(roster = journal_load_roster(once.journal))) {
+			error = g_strconcat("No roster in ", config->journal_dir,
+					    ", run with the database once or "
+					    "write comma separated MMSI's to "
+					    "the file `roster` there", NULL);
+		}
+		if (error) {
+			log_error(error);
+			if (once.journal) {
+				journal_close(once.journal);
+			}
+			_print_summary(&once);
+			return ONCE_EXIT_FAILURE;
+		}
+	}
+
+	once.batch = ship_batch_new(SCHEDULER_BATCH_SIZE);
+
+	cursor = roster;
+	while ((names = _next_names(&cursor)) != NULL) {
+		_update(&once, names);
+		g_free(names);
+	}
+
+	if (once.journal) {
+		if (once.stored > 0 && !journal_sync(once.journal, &error)) {
+			log_error(g_strconcat("Journal: ", error, NULL));
+			g_free(error);
+			once.lost += once.stored;
+			once.stored = 0;
+		}
+		journal_close(once.journal);
+	}
+
+	_print_summary(&once);
+
+	if (once.written == 0 && once.requests > 0 &&
+	    once.failed == once.requests)
+	{
+		status = ONCE_EXIT_FAILURE;
+	} else if (once.failed > 0 || once.lost > 0 ||
+		   (once.stored > 0 && sink != DB_SINK_FILE))
+	{
+		status = ONCE_EXIT_PARTIAL;
+	} else {
+		status = ONCE_EXIT_OK;
+	}
+
+	ship_batch_free(once.batch);
+	if (sink == DB_SINK_MYSQL) {
+		db_close_con(&once.db);
+	}
+	g_free(roster);
+
+	return status;
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file once.h
+ * @brief Single update cycle for job schedulers
+ * @details Implements the @c --once mode: every ship of the roster is
+ * fetched, decoded and written once on the calling thread, and the program
+ * exits. Nothing else is started; there are no decode or persist threads,
+ * no scheduler and no metrics endpoint. The journal is opened only if it
+ * has to be replayed or updates can not be written.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef ONCE_H
+#define ONCE_H
+
+#include <glib.h>
+
+#include "config.h"
+#include "database.h"
+
+/**
+ * Exit status when every ship was fetched and written
+ */
+#define ONCE_EXIT_OK 0
+
+/**
+ * Exit status when nothing could be done, like when the database can not
+ * be reached
+ */
+#define ONCE_EXIT_FAILURE 1
+
+/**
+ * Exit status when some API requests failed or some updates were stored in
+ * the journal or lost, except with @ref DB_SINK_FILE which stores every
+ * update in the journal
+ */
+#define ONCE_EXIT_PARTIAL 2
+
+/**
+ * @brief Run one update cycle
+ *
+ * Prints a summary line to stdout with the numbers of requests and ships,
+ * the time from @p started to the first API request and the time and CPU
+ * time spent fetching, decoding and writing.
+ *
+ * With @ref DB_SINK_MYSQL the roster is read from the database. Other
+ * sinks do not connect to the database and use the roster saved in the
+ * journal directory, see journal_load_roster(). With @ref DB_SINK_NULL the
+ * updates are prepared for writing and discarded, with @ref DB_SINK_FILE
+ * they are stored in the journal. Neither replays the journal.
+ *
+ * @param[in] config Struct of type Config()
+ * @param[in] started Monotonic time when the program started
+ * @param[in] sink Where to write the updates
+ * @return gint Exit status, @ref ONCE_EXIT_OK, @ref ONCE_EXIT_FAILURE or
+ * @ref ONCE_EXIT_PARTIAL
+ */
+gint once_run(const struct Config *config, const gint64 started,
+	     const enum DbSink sink);
+
+#endif
@@ -0,0 +1,601 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include "pipeline.h"
+#include "api_thread.h"
+#include "clock.h"
+#include "json.h"
+#include "metrics.h"
+#include "trace.h"
+
+/* Pushed to a persister queue to stop the worker */
+static gint STOP;
+
+static void _finish(struct Pipeline *pipeline, const guint count)
+{
+	g_mutex_lock(&pipeline->lock);
+	pipeline->pending -= count;
+	metrics_set(METRIC_PIPELINE_PENDING, pipeline->pending);
+	g_cond_broadcast(&pipeline->changed);
+	g_mutex_unlock(&pipeline->lock);
+}
+
+static gboolean _has_backlog(const struct Pipeline *pipeline)
+{
+	return (pipeline->journal && !journal_is_empty(pipeline->journal)) ||
+	       coalesce_pending(pipeline->coalesce) > 0;
+}
+
+static void _store_updates(struct PipelinePersister *persister,
+			   const struct ShipBatch *batch, const guint first)
+{
+	struct Pipeline *pipeline = persister->pipeline;
+
+	g_mutex_lock(&pipeline->backlog_lock);
+	for (guint i = first; i < batch->len; ++i) {
+		struct Ship ship;
+		gchar *error;
+
+		error = NULL;
+		ship_batch_get(batch, i, &ship);
+
+		if (pipeline->journal &&
+		    journal_append(pipeline->journal, &ship, &error))
+		{
+			persister->stored = TRUE;
+			continue;
+		}
+
+		if (error) {
+			log_event(LOG_LEVEL_ERROR, "persist", "journal_append",
+				  ship.mmsi, -1, "Journal: %s", error);
+			g_free(error);
+		}
+		coalesce_put(pipeline->coalesce, &ship);
+	}
+	g_mutex_unlock(&pipeline->backlog_lock);
+}
+
+static void _sync_journal(struct PipelinePersister *persister)
+{
+	struct Pipeline *pipeline = persister->pipeline;
+	gchar *error;
+
+	error = NULL;
+	persister->stored = FALSE;
+
+	g_mutex_lock(&pipeline->backlog_lock);
+	if (!journal_sync(pipeline->journal, &error)) {
+		log_event(LOG_LEVEL_ERROR, "persist", "journal_sync", 0, -1,
+			  "Journal: %s", error);
+		g_free(error);
+	}
+	g_mutex_unlock(&pipeline->backlog_lock);
+}
+
+static gboolean _connect(struct PipelinePersister *persister)
+{
+	gchar *error;
+
+	if (persister->connected) {
+		return TRUE;
+	}
+
+	if (clock_monotonic_time() < persister->reconnect_at) {
+		return FALSE;
+	}
+
+	error = NULL;
+	if (!db_init(&persister->db, persister->pipeline->config, &error)) {
+		metrics_add(METRIC_DB_ERRORS, 1);
+		log_event(LOG_LEVEL_ERROR, "persist", "connect", 0, -1,
+			  "%s, buffering updates", error);
+		g_free(error);
+		db_close_con(&persister->db);
+		persister->reconnect_at = clock_monotonic_time() +
+			PIPELINE_RECONNECT_INTERVAL * G_TIME_SPAN_SECOND;
+		return FALSE;
+	}
+
+	persister->connected = TRUE;
+
+	return TRUE;
+}
+
+static void _free_written(gpointer data)
+{
+	struct Ship *ship = data;
+
+	g_free(ship->name);
+	g_free(ship->comment);
+	g_free(ship->path);
+	g_slice_free(struct Ship, ship);
+}
+
+/*
+ * Writes ship information of all rows which have changed since they were
+ * last written, then their positions with bulk inserts. On lost connection
+ * @p written is the number of rows which are completely in the database.
+ * Without @p last_written every row is written.
+ */
+static gboolean _write_batch(const struct Database *db,
+			     GHashTable *last_written,
+			     const struct ShipBatch *batch, guint *written)
+{
+	struct ShipPosition *positions;
+	guint inserted;
+	gchar *error;
+	gint64 started;
+
+	*(written) = 0;
+	started = g_get_monotonic_time();
+
+	for (guint i = 0; i < batch->len; ++i) {
+		struct Ship *last;
+		struct Ship ship;
+
+		last = NULL;
+		if (last_written) {
+			last = g_hash_table_lookup(last_written, &batch->mmsi[i]);
+		}
+		if (last && ship_batch_info_equal(batch, i, last)) {
+			continue;
+		}
+
+		error = NULL;
+		ship_batch_get(batch, i, &ship);
+
+		if (!db_update_ship_info(db, &ship, &error)) {
+			metrics_add(METRIC_DB_ERRORS, 1);
+			if (!db_is_connected(db)) {
+				g_free(error);
+				return FALSE;
+			}
+			log_event(LOG_LEVEL_ERROR, "persist", "update_ships",
+				  ship.mmsi, -1, "%s: UPDATE Ships failed, %s",
+				  ship.name, error);
+			g_free(error);
+			if (last) {
+				g_hash_table_remove(last_written, &ship.mmsi);
+			}
+			continue;
+		}
+
+		if (!last_written) {
+			continue;
+		}
+		if (!last) {
+			last = g_slice_new0(struct Ship);
+			g_hash_table_insert(last_written, &last->mmsi, last);
+		}
+		// Free text of the batch is gone after the batch is freed
+		g_free(last->name);
+		g_free(last->comment);
+		g_free(last->path);
+		*(last) = ship;
+		last->name = g_strdup(ship.name);
+		last->comment = g_strdup(ship.comment);
+		last->path = g_strdup(ship.path);
+	}
+
+	positions = g_new(struct ShipPosition, batch->len);
+	ship_batch_get_positions(batch, 0, positions);
+
+	error = NULL;
+	inserted = 0;
+	if (!db_insert_ship_gps_bulk(db, positions, batch->len, &inserted,
+				     &error))
+	{
+		metrics_add(METRIC_DB_ERRORS, 1);
+		if (!db_is_connected(db)) {
+			*(written) = inserted;
+			g_free(error);
+			g_free(positions);
+			return FALSE;
+		}
+		log_event(LOG_LEVEL_ERROR, "persist", "insert_gps", 0, -1,
+			  "INSERT GPS failed, %s", error);
+		g_free(error);
+	}
+	g_free(positions);
+
+	metrics_add(METRIC_WRITE_BATCHES, 1);
+	metrics_add(METRIC_WRITE_TIME, g_get_monotonic_time() - started);
+	started = g_get_monotonic_time();
+
+	for (guint i = 0; i < batch->len; ++i) {
+		gint64 ship_started = g_get_monotonic_time();
+
+		error = NULL;
+		if (!db_clean_ship_gps(db, &batch->imo[i], &error)) {
+			metrics_add(METRIC_DB_ERRORS, 1);
+			log_event(LOG_LEVEL_ERROR, "persist", "clean_gps",
+				  batch->mmsi[i], -1,
+				  "%s: DELETE of old GPS records failed, %s",
+				  batch->name[i], error);
+			g_free(error);
+		}
+		metrics_observe(METRIC_HIST_RETENTION,
+				g_get_monotonic_time() - ship_started);
+	}
+
+	metrics_add(METRIC_RETENTION_SHIPS, batch->len);
+	metrics_add(METRIC_RETENTION_TIME, g_get_monotonic_time() - started);
+
+	*(written) = batch->len;
+
+	return TRUE;
+}
+
+static void _persist_batch(struct PipelinePersister *persister,
+			   const struct ShipBatch *batch)
+{
+	struct Pipeline *pipeline = persister->pipeline;
+	gboolean backlog;
+	guint written;
+
+	// Older updates have to be written first
+	g_mutex_lock(&pipeline->backlog_lock);
+	backlog = _has_backlog(pipeline);
+	g_mutex_unlock(&pipeline->backlog_lock);
+
+	written = 0;
+	if (!backlog && _connect(persister)) {
+		if (_write_batch(&persister->db, persister->written, batch,
+				 &written))
+		{
+			metrics_add(METRIC_SHIPS_WRITTEN, written);
+			return;
+		}
+		metrics_add(METRIC_SHIPS_WRITTEN, written);
+
+		log_event(LOG_LEVEL_ERROR, "persist", "connection_lost", 0, -1,
+			  "Lost connection to database, buffering updates");
+		db_close_con(&persister->db);
+		persister->connected = FALSE;
+		persister->reconnect_at = clock_monotonic_time() +
+			PIPELINE_RECONNECT_INTERVAL * G_TIME_SPAN_SECOND;
+	}
+
+	// Replayed updates may overwrite what has been written
+	g_hash_table_remove_all(persister->written);
+	_store_updates(persister, batch, written);
+	metrics_add(METRIC_SHIPS_STORED, batch->len - written);
+}
+
+static gpointer _persist(gpointer data)
+{
+	struct PipelinePersister *persister = data;
+
+	for (;;) {
+		struct ShipBatch *batch = g_async_queue_pop(persister->queue);
+		guint count;
+		gint64 traced;
+
+		if (batch == (gpointer)&STOP) {
+			break;
+		}
+
+		count = batch->len;
+		traced = trace_begin();
+		_persist_batch(persister, batch);
+		trace_end("persist_batch", traced);
+		ship_batch_free(batch);
+
+		if (persister->stored &&
+		    g_async_queue_length(persister->queue) <= 0)
+		{
+			_sync_journal(persister);
+		}
+
+		_finish(persister->pipeline, count);
+	}
+
+	if (persister->connected) {
+		db_close_con(&persister->db);
+	}
+	db_thread_end();
+	g_hash_table_destroy(persister->written);
+
+	return NULL;
+}
+
+static void _free_batch(struct PipelineBatch *batch)
+{
+	g_free(batch->json);
+	g_free(batch->names);
+	if (batch->ships) {
+		ship_batch_free(batch->ships);
+	}
+	g_slice_free(struct PipelineBatch, batch);
+}
+
+/*
+ * Called with pipeline->lock held. Ships are given to persisters by MMSI so
+ * all updates of a ship are written by the same worker, in order.
+ */
+static void _dispatch(struct Pipeline *pipeline, struct PipelineBatch *batch)
+{
+	struct ShipBatch **parts;
+
+	scheduler_update(pipeline->scheduler, batch->ships, batch->now);
+	scheduler_finish_batch(pipeline->scheduler, batch->names,
+			       batch->answered, batch->now);
+
+	parts = g_new0(struct ShipBatch *, pipeline->workers);
+	for (guint i = 0; i < batch->ships->len; ++i) {
+		guint worker = (guint)((guint64)batch->ships->mmsi[i] %
+				       pipeline->workers);
+
+		if (!parts[worker]) {
+			parts[worker] = ship_batch_new(batch->ships->len);
+		}
+		ship_batch_append_row(parts[worker], batch->ships, i);
+	}
+
+	for (guint i = 0; i < pipeline->workers; ++i) {
+		if (parts[i]) {
+			g_async_queue_push(pipeline->persisters[i].queue, parts[i]);
+		}
+	}
+	g_free(parts);
+
+	// Ships are counted as pending, the batch itself is finished
+	pipeline->pending += batch->ships->len;
+	pipeline->pending -= 1;
+	metrics_set(METRIC_PIPELINE_PENDING, pipeline->pending);
+	g_cond_broadcast(&pipeline->changed);
+}
+
+static void _decode(gpointer data, gpointer user_data)
+{
+	struct PipelineBatch *batch = data;
+	struct Pipeline *pipeline = user_data;
+	gchar *error;
+	gint64 started;
+	gint64 duration;
+	gint64 traced;
+
+	error = NULL;
+	traced = trace_begin();
+	started = g_get_monotonic_time();
+	batch->ships = ship_batch_new(SCHEDULER_BATCH_SIZE);
+
+	batch->answered = json_read_ships(batch->json, batch->ships, &error);
+	if (!batch->answered) {
+		log_event(LOG_LEVEL_ERROR, "decode", "invalid_response", 0, -1,
+			  "%s", error);
+		g_free(error);
+	}
+	g_free(batch->json);
+	batch->json = NULL;
+
+	duration = g_get_monotonic_time() - started;
+	metrics_add(METRIC_DECODE_BATCHES, 1);
+	metrics_add(METRIC_DECODE_TIME, duration);
+	metrics_observe(METRIC_HIST_DECODE, duration);
+	metrics_observe_items(METRIC_HIST_DECODE_ENTRY, duration,
+			      batch->ships->len);
+	trace_end("decode", traced);
+
+	g_mutex_lock(&pipeline->lock);
+	batch->decoded = TRUE;
+	while ((batch = g_queue_peek_head(&pipeline->order)) != NULL &&
+	       batch->decoded)
+	{
+		g_queue_pop_head(&pipeline->order);
+		_dispatch(pipeline, batch);
+		_free_batch(batch);
+	}
+	g_mutex_unlock(&pipeline->lock);
+}
+
+struct Pipeline *pipeline_new(const struct Config *config,
+			      struct Scheduler *scheduler,
+			      struct Journal *journal,
+			      struct Coalesce *coalesce)
+{
+	struct Pipeline *pipeline = g_slice_new0(struct Pipeline);
+
+	pipeline->config = config;
+	pipeline->scheduler = scheduler;
+	pipeline->journal = journal;
+	pipeline->coalesce = coalesce;
+	pipeline->workers = config->workers > 0 ? (guint)config->workers :
+						  g_get_num_processors();
+	g_mutex_init(&pipeline->backlog_lock);
+	g_mutex_init(&pipeline->lock);
+	g_cond_init(&pipeline->changed);
+	g_queue_init(&pipeline->order);
+
+	pipeline->decoders = g_thread_pool_new(_decode, pipeline,
+					       (gint)pipeline->workers, TRUE,
+					       NULL);
+
+	pipeline->persisters = g_new0(struct PipelinePersister,
+				      pipeline->workers);
+	for (guint i = 0; i < pipeline->workers; ++i) {
+		struct PipelinePersister *persister = &pipeline->persisters[i];
+
+		persister->pipeline = pipeline;
+		persister->queue = g_async_queue_new();
+		persister->written = g_hash_table_new_full(g_int64_hash,
+							   g_int64_equal,
+							   NULL,
+							   _free_written);
+		persister->thread = g_thread_new("persist", _persist, persister);
+	}
+
+	return pipeline;
+}
+
+void pipeline_free(struct Pipeline *pipeline)
+{
+	pipeline_wait(pipeline);
+	g_thread_pool_free(pipeline->decoders, FALSE, TRUE);
+
+	for (guint i = 0; i < pipeline->workers; ++i) {
+		g_async_queue_push(pipeline->persisters[i].queue, &STOP);
+	}
+	for (guint i = 0; i < pipeline->workers; ++i) {
+		g_thread_join(pipeline->persisters[i].thread);
+		g_async_queue_unref(pipeline->persisters[i].queue);
+	}
+	g_free(pipeline->persisters);
+
+	g_cond_clear(&pipeline->changed);
+	g_mutex_clear(&pipeline->lock);
+	g_mutex_clear(&pipeline->backlog_lock);
+	g_slice_free(struct Pipeline, pipeline);
+}
+
+void pipeline_submit(struct Pipeline *pipeline, gchar *json, gchar *names,
+		     const gint64 now)
+{
+	struct PipelineBatch *batch = g_slice_new0(struct PipelineBatch);
+
+	batch->json = json;
+	batch->names = names;
+	batch->now = now;
+
+	g_mutex_lock(&pipeline->lock);
+	while (pipeline->pending >= PIPELINE_MAX_PENDING) {
+		g_cond_wait(&pipeline->changed, &pipeline->lock);
+	}
+	g_queue_push_tail(&pipeline->order, batch);
+	++pipeline->pending;
+	metrics_set(METRIC_PIPELINE_PENDING, pipeline->pending);
+	g_mutex_unlock(&pipeline->lock);
+
+	g_thread_pool_push(pipeline->decoders, batch, NULL);
+}
+
+void pipeline_wait(struct Pipeline *pipeline)
+{
+	g_mutex_lock(&pipeline->lock);
+	while (pipeline->pending > 0) {
+		g_cond_wait(&pipeline->changed, &pipeline->lock);
+	}
+	g_mutex_unlock(&pipeline->lock);
+}
+
+gboolean pipeline_write(const struct Database *db,
+			const struct ShipBatch *batch, guint *written)
+{
+	gboolean ret;
+	gint64 traced;
+
+	traced = trace_begin();
+	ret = _write_batch(db, NULL, batch, written);
+	metrics_add(METRIC_SHIPS_WRITTEN, *written);
+	trace_end("persist_batch", traced);
+
+	return ret;
+}
+
+gboolean pipeline_has_backlog(struct Pipeline *pipeline)
+{
+	gboolean ret;
+
+	g_mutex_lock(&pipeline->backlog_lock);
+	ret = _has_backlog(pipeline);
+	g_mutex_unlock(&pipeline->backlog_lock);
+
+	return ret;
+}
+
+void pipeline_set_fleet_size(struct Pipeline *pipeline, guint fleet_size)
+{
+	g_mutex_lock(&pipeline->backlog_lock);
+	coalesce_set_fleet_size(pipeline->coalesce, fleet_size);
+	g_mutex_unlock(&pipeline->backlog_lock);
+}
+
+static gboolean _flush_coalesce(const struct Database *db,
+				struct Coalesce *coalesce)
+{
+	gchar *error;
+	guint pending;
+
+	error = NULL;
+	pending = coalesce_pending(coalesce);
+
+	if (!coalesce_flush(coalesce, db, &error)) {
+		log_event(LOG_LEVEL_ERROR, "backlog", "coalesce_flush", 0, -1,
+			  "Writing buffered updates failed: %s", error);
+		g_free(error);
+		return FALSE;
+	}
+
+	log_event(LOG_LEVEL_INFO, "backlog", NULL, 0, -1,
+		  "Wrote buffered updates of %u ships, %" G_GUINT64_FORMAT
+		  " positions dropped so far", pending, coalesce->dropped);
+
+	return TRUE;
+}
+
+static gboolean _replay_journal(const struct Database *db,
+				struct Journal *journal)
+{
+	gchar *error;
+	guint records;
+	gint64 started;
+
+	error = NULL;
+	records = 0;
+	started = g_get_monotonic_time();
+
+	if (!journal_replay(journal, db, &records, &error)) {
+		log_event(LOG_LEVEL_ERROR, "backlog", "journal_replay", 0,
+			  g_get_monotonic_time() - started,
+			  "Replaying journal failed: %s", error);
+		g_free(error);
+		return FALSE;
+	}
+
+	log_event(LOG_LEVEL_INFO, "backlog", NULL, 0,
+		  g_get_monotonic_time() - started,
+		  "Replayed %u journaled updates in %.1f seconds", records,
+		  (g_get_monotonic_time() - started) / 1e6);
+
+	return TRUE;
+}
+
+gboolean pipeline_write_backlog(struct Pipeline *pipeline,
+				const struct Database *db)
+{
+	gboolean ret;
+
+	ret = TRUE;
+	pipeline_wait(pipeline);
+
+	g_mutex_lock(&pipeline->backlog_lock);
+
+	if (pipeline->journal && !journal_is_empty(pipeline->journal)) {
+		ret = _replay_journal(db, pipeline->journal);
+	}
+
+	if (ret && coalesce_pending(pipeline->coalesce) > 0) {
+		ret = _flush_coalesce(db, pipeline->coalesce);
+	}
+
+	g_mutex_unlock(&pipeline->backlog_lock);
+
+	return ret;
+}
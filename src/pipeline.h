@@ -0,0 +1,202 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file pipeline.h
+ * @brief Decode and persist stages of the update cycle
+ * @details API responses fetched by the API thread are decoded on a pool of
+ * decode threads and the ships are written to the database by persist
+ * workers, each of which owns its own database connection.
+ *
+ * Decoded batches are handed to the persist workers in the order they were
+ * submitted and each MMSI always goes to the same worker, so updates of one
+ * ship are written in the order they were fetched. Updates which can not be
+ * written are stored in the journal, or in the coalesce buffer if the journal
+ * is disabled or fails.
+ *
+ * Persist workers remember the ship information they have written and skip
+ * the Ships table update when it has not changed.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <glib.h>
+
+#include "coalesce.h"
+#include "config.h"
+#include "database.h"
+#include "journal.h"
+#include "scheduler.h"
+#include "ship_batch.h"
+
+/**
+ * Seconds a persist worker waits before reconnecting to the database
+ */
+#define PIPELINE_RECONNECT_INTERVAL 5
+
+/**
+ * Number of batches and ships in flight after which pipeline_submit() blocks
+ */
+#define PIPELINE_MAX_PENDING 4096
+
+/**
+ * @struct PipelineBatch
+ * @brief API response waiting to be decoded
+ */
+struct PipelineBatch {
+	gchar *json; /**< API response */
+	gchar *names; /**< MMSI's which were requested */
+	gint64 now; /**< Unix time when the batch was fetched */
+	struct ShipBatch *ships; /**< Decoded ships */
+	gboolean decoded; /**< Decode stage has finished */
+	gboolean answered; /**< Response was decoded without errors */
+};
+
+/**
+ * @struct PipelinePersister
+ * @brief Persist worker
+ */
+struct PipelinePersister {
+	struct Pipeline *pipeline; /**< Pipeline the worker belongs to */
+	GThread *thread; /**< Worker thread */
+	GAsyncQueue *queue; /**< ShipBatch() waiting to be written */
+	struct Database db; /**< Connection of the worker */
+	gboolean connected; /**< @p db is connected */
+	gint64 reconnect_at; /**< Monotonic time of next connection attempt */
+	gboolean stored; /**< Updates were stored in the journal since sync */
+	GHashTable *written; /**< Ship information last written, by MMSI */
+};
+
+/**
+ * @struct Pipeline
+ * @brief Holds state of the pipeline
+ */
+struct Pipeline {
+	const struct Config *config; /**< Configuration */
+	struct Scheduler *scheduler; /**< Rescheduled from decoded ships */
+	struct Journal *journal; /**< Journal or NULL if disabled */
+	struct Coalesce *coalesce; /**< Buffer for updates not journaled */
+	GMutex backlog_lock; /**< Protects @p journal and @p coalesce */
+	GThreadPool *decoders; /**< Decode stage */
+	struct PipelinePersister *persisters; /**< Persist stage */
+	guint workers; /**< Number of decode threads and persist workers */
+	GMutex lock; /**< Protects @p order and @p pending */
+	GCond changed; /**< Signaled when @p pending decreases */
+	GQueue order; /**< PipelineBatch() in submission order */
+	guint pending; /**< Batches and ships not yet finished */
+};
+
+/**
+ * @brief Start decode threads and persist workers
+ *
+ * Number of threads is taken from @c workers of @p config, or the number
+ * of processors if it is @c 0.
+ *
+ * @param[in] config Struct of type Config()
+ * @param[in] scheduler Struct of type Scheduler()
+ * @param[in] journal Struct of type Journal() or NULL
+ * @param[in] coalesce Struct of type Coalesce()
+ * @return struct Pipeline*
+ * @note Free with pipeline_free()
+ */
+struct Pipeline *pipeline_new(const struct Config *config,
+			      struct Scheduler *scheduler,
+			      struct Journal *journal,
+			      struct Coalesce *coalesce);
+
+/**
+ * Finish all submitted batches and stop the threads
+ *
+ * @param[in] pipeline Struct of type Pipeline()
+ * @return Nothing
+ */
+void pipeline_free(struct Pipeline *pipeline);
+
+/**
+ * @brief Submit fetched API response
+ *
+ * Blocks while there are more than @ref PIPELINE_MAX_PENDING batches and
+ * ships in flight.
+ *
+ * @param[in] pipeline Struct of type Pipeline()
+ * @param[in] json API response, freed by the pipeline
+ * @param[in] names MMSI's from scheduler_next_batch(), freed by the pipeline
+ * @param[in] now Unix time when the batch was fetched
+ * @return Nothing
+ */
+void pipeline_submit(struct Pipeline *pipeline, gchar *json, gchar *names,
+		     const gint64 now);
+
+/**
+ * Wait until all submitted batches have been written or stored
+ *
+ * @param[in] pipeline Struct of type Pipeline()
+ * @return Nothing
+ */
+void pipeline_wait(struct Pipeline *pipeline);
+
+/**
+ * @brief Write decoded ships on the calling thread
+ *
+ * Writes @p batch the way the persist workers do, except that the Ships
+ * table is updated for every row. Used where there are no workers, like
+ * the @c --once mode.
+ *
+ * @param[in] db Struct of type Database()
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[out] written Number of rows which are completely in the database
+ * @return gboolean FALSE if the connection was lost, otherwise TRUE
+ */
+gboolean pipeline_write(const struct Database *db,
+			const struct ShipBatch *batch, guint *written);
+
+/**
+ * Check are there updates in the journal or coalesce buffer
+ *
+ * @param[in] pipeline Struct of type Pipeline()
+ * @return gboolean TRUE if there are updates to write
+ */
+gboolean pipeline_has_backlog(struct Pipeline *pipeline);
+
+/**
+ * Size the coalesce buffer for the roster, see coalesce_set_fleet_size()
+ *
+ * @param[in] pipeline Struct of type Pipeline()
+ * @param[in] fleet_size Number of ships in the roster
+ * @return Nothing
+ */
+void pipeline_set_fleet_size(struct Pipeline *pipeline, guint fleet_size);
+
+/**
+ * @brief Write updates stored during an outage
+ *
+ * Waits for the pipeline to drain, then replays the journal and flushes
+ * the coalesce buffer.
+ *
+ * @param[in] pipeline Struct of type Pipeline()
+ * @param[in] db Struct of type Database()
+ * @return gboolean TRUE if everything was written, otherwise FALSE
+ */
+gboolean pipeline_write_backlog(struct Pipeline *pipeline,
+				const struct Database *db);
+
+#endif
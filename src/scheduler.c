@@ -0,0 +1,336 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include "scheduler.h"
+
+#define NAVSTAT_AT_ANCHOR 1
+#define NAVSTAT_MOORED 5
+#define NAVSTAT_AGROUND 6
+
+static struct ScheduledShip *_at(const struct Scheduler *scheduler,
+				 const guint i)
+{
+	return g_ptr_array_index(scheduler->heap, i);
+}
+
+static void _swap(struct Scheduler *scheduler, const guint a, const guint b)
+{
+	struct ScheduledShip *x = _at(scheduler, a);
+	struct ScheduledShip *y = _at(scheduler, b);
+
+	g_ptr_array_index(scheduler->heap, a) = y;
+	g_ptr_array_index(scheduler->heap, b) = x;
+	y->index = a;
+	x->index = b;
+}
+
+static void _sift_up(struct Scheduler *scheduler, guint i)
+{
+	while (i > 0) {
+		guint parent = (i - 1) / 2;
+
+		if (_at(scheduler, parent)->due <= _at(scheduler, i)->due) {
+			break;
+		}
+		_swap(scheduler, i, parent);
+		i = parent;
+	}
+}
+
+static void _sift_down(struct Scheduler *scheduler, guint i)
+{
+	guint len = scheduler->heap->len;
+
+	for (;;) {
+		guint left = 2 * i + 1;
+		guint right = left + 1;
+		guint smallest = i;
+
+		if (left < len && _at(scheduler, left)->due < _at(scheduler, smallest)->due) {
+			smallest = left;
+		}
+		if (right < len && _at(scheduler, right)->due < _at(scheduler, smallest)->due) {
+			smallest = right;
+		}
+		if (smallest == i) {
+			break;
+		}
+		_swap(scheduler, i, smallest);
+		i = smallest;
+	}
+}
+
+static void _push(struct Scheduler *scheduler, struct ScheduledShip *entry)
+{
+	entry->index = scheduler->heap->len;
+	g_ptr_array_add(scheduler->heap, entry);
+	_sift_up(scheduler, entry->index);
+}
+
+static void _remove(struct Scheduler *scheduler, struct ScheduledShip *entry)
+{
+	guint i = entry->index;
+	guint last = scheduler->heap->len - 1;
+
+	if (i != last) {
+		_swap(scheduler, i, last);
+	}
+	g_ptr_array_set_size(scheduler->heap, last);
+
+	if (i < last) {
+		_sift_down(scheduler, i);
+		_sift_up(scheduler, i);
+	}
+}
+
+static void _reschedule(struct Scheduler *scheduler,
+			struct ScheduledShip *entry, const gint64 due)
+{
+	entry->due = due;
+	_sift_down(scheduler, entry->index);
+	_sift_up(scheduler, entry->index);
+}
+
+static gint _interval(const struct ScheduledShip *entry, const time_t lasttime,
+		      const gint navstat, const gfloat speed)
+{
+	gint interval;
+
+	if (entry->lasttime != 0 && lasttime <= entry->lasttime) {
+		return MIN(entry->interval * 2, SCHEDULER_MAX_INTERVAL);
+	}
+
+	switch (navstat) {
+		case NAVSTAT_AT_ANCHOR:
+		case NAVSTAT_MOORED:
+		case NAVSTAT_AGROUND:
+			return SCHEDULER_MAX_INTERVAL;
+		default:
+			break;
+	}
+
+	if (speed < 1.0f) {
+		return SCHEDULER_STATIONARY_INTERVAL;
+	}
+
+	interval = (gint)(SCHEDULER_TARGET_DISTANCE / speed * 3600.0);
+
+	return CLAMP(interval, SCHEDULER_MIN_INTERVAL,
+		     SCHEDULER_STATIONARY_INTERVAL);
+}
+
+static void _free_entry(gpointer data)
+{
+	g_slice_free(struct ScheduledShip, data);
+}
+
+struct Scheduler *scheduler_new()
+{
+	struct Scheduler *scheduler = g_slice_new(struct Scheduler);
+
+	g_mutex_init(&scheduler->lock);
+	scheduler->heap = g_ptr_array_new();
+	scheduler->ships = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+						 NULL, _free_entry);
+
+	return scheduler;
+}
+
+void scheduler_free(struct Scheduler *scheduler)
+{
+	g_ptr_array_free(scheduler->heap, TRUE);
+	g_hash_table_destroy(scheduler->ships);
+	g_mutex_clear(&scheduler->lock);
+	g_slice_free(struct Scheduler, scheduler);
+}
+
+void scheduler_set_roster(struct Scheduler *scheduler, const gchar *roster,
+			  const gint64 now)
+{
+	gchar **mmsis;
+	GHashTableIter iter;
+	gpointer value;
+
+	g_mutex_lock(&scheduler->lock);
+
+	g_hash_table_iter_init(&iter, scheduler->ships);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		((struct ScheduledShip *)value)->seen = FALSE;
+	}
+
+	mmsis = g_strsplit(roster, ",", -1);
+	for (guint i = 0; mmsis[i] != NULL; ++i) {
+		gint64 mmsi = g_ascii_strtoll(mmsis[i], NULL, 10);
+		struct ScheduledShip *entry;
+
+		if (mmsi <= 0) {
+			continue;
+		}
+
+		entry = g_hash_table_lookup(scheduler->ships, &mmsi);
+		if (!entry) {
+			entry = g_slice_new0(struct ScheduledShip);
+			entry->mmsi = mmsi;
+			entry->due = now;
+			entry->interval = SCHEDULER_STATIONARY_INTERVAL;
+			g_hash_table_insert(scheduler->ships, &entry->mmsi, entry);
+			_push(scheduler, entry);
+		}
+		entry->seen = TRUE;
+	}
+	g_strfreev(mmsis);
+
+	g_hash_table_iter_init(&iter, scheduler->ships);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct ScheduledShip *entry = value;
+
+		if (!entry->seen) {
+			_remove(scheduler, entry);
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+
+	g_mutex_unlock(&scheduler->lock);
+}
+
+guint scheduler_size(struct Scheduler *scheduler)
+{
+	guint size;
+
+	g_mutex_lock(&scheduler->lock);
+	size = scheduler->heap->len;
+	g_mutex_unlock(&scheduler->lock);
+
+	return size;
+}
+
+static gint64 _next_due(const struct Scheduler *scheduler)
+{
+	if (scheduler->heap->len == 0) {
+		return G_MAXINT64;
+	}
+
+	return _at(scheduler, 0)->due;
+}
+
+gint64 scheduler_next_due(struct Scheduler *scheduler)
+{
+	gint64 due;
+
+	g_mutex_lock(&scheduler->lock);
+	due = _next_due(scheduler);
+	g_mutex_unlock(&scheduler->lock);
+
+	return due;
+}
+
+gchar *scheduler_next_batch(struct Scheduler *scheduler, const gint64 now)
+{
+	struct ScheduledShip *taken[SCHEDULER_BATCH_SIZE];
+	guint count;
+	GString *names;
+
+	g_mutex_lock(&scheduler->lock);
+
+	if (_next_due(scheduler) > now) {
+		g_mutex_unlock(&scheduler->lock);
+		return NULL;
+	}
+
+	count = 0;
+	while (count < SCHEDULER_BATCH_SIZE && scheduler->heap->len > 0) {
+		taken[count] = _at(scheduler, 0);
+		_remove(scheduler, taken[count]);
+		++count;
+	}
+
+	names = g_string_new(NULL);
+
+	for (guint i = 0; i < count; ++i) {
+		struct ScheduledShip *entry = taken[i];
+
+		entry->pending = TRUE;
+		entry->due = now + entry->interval;
+		_push(scheduler, entry);
+
+		g_string_append_printf(names, i == 0 ? "%" G_GINT64_FORMAT
+						     : ",%" G_GINT64_FORMAT,
+				       entry->mmsi);
+	}
+
+	g_mutex_unlock(&scheduler->lock);
+
+	return g_string_free(names, FALSE);
+}
+
+void scheduler_update(struct Scheduler *scheduler,
+		      const struct ShipBatch *batch, const gint64 now)
+{
+	g_mutex_lock(&scheduler->lock);
+
+	for (guint i = 0; i < batch->len; ++i) {
+		struct ScheduledShip *entry;
+
+		entry = g_hash_table_lookup(scheduler->ships, &batch->mmsi[i]);
+		if (!entry) {
+			continue;
+		}
+
+		entry->interval = _interval(entry, batch->lasttime[i],
+					    batch->navstat[i], batch->speed[i]);
+		entry->lasttime = batch->lasttime[i];
+		entry->pending = FALSE;
+		_reschedule(scheduler, entry, now + entry->interval);
+	}
+
+	g_mutex_unlock(&scheduler->lock);
+}
+
+void scheduler_finish_batch(struct Scheduler *scheduler, const gchar *names,
+			    const gboolean answered, const gint64 now)
+{
+	gchar **mmsis;
+
+	mmsis = g_strsplit(names, ",", -1);
+
+	g_mutex_lock(&scheduler->lock);
+
+	for (guint i = 0; mmsis[i] != NULL; ++i) {
+		gint64 mmsi = g_ascii_strtoll(mmsis[i], NULL, 10);
+		struct ScheduledShip *entry;
+
+		entry = g_hash_table_lookup(scheduler->ships, &mmsi);
+		if (!entry || !entry->pending) {
+			continue;
+		}
+
+		// Failed request says nothing about the ship, it is tried
+		// again after its current interval
+		if (answered) {
+			entry->interval = MIN(entry->interval * 2,
+					      SCHEDULER_MAX_INTERVAL);
+		}
+		entry->pending = FALSE;
+		_reschedule(scheduler, entry, now + entry->interval);
+	}
+
+	g_mutex_unlock(&scheduler->lock);
+
+	g_strfreev(mmsis);
+}
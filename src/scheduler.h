@@ -0,0 +1,183 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file scheduler.h
+ * @brief Per-ship polling scheduler
+ * @details Decides which ships are fetched from the API next. Every ship has
+ * its own polling interval based on its last reported speed, navigational
+ * status and how often it has been reporting new positions. Ships are kept
+ * in a priority queue ordered by the time they are due, and due ships are
+ * packed into API requests of @ref SCHEDULER_BATCH_SIZE ships.
+ *
+ * All functions are thread safe.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <glib.h>
+
+#include "ship_batch.h"
+
+/**
+ * Maximum number of ships in one API request
+ */
+#define SCHEDULER_BATCH_SIZE 20
+
+/**
+ * Shortest polling interval in seconds
+ */
+#define SCHEDULER_MIN_INTERVAL 600
+
+/**
+ * Polling interval of ships which are not moving
+ */
+#define SCHEDULER_STATIONARY_INTERVAL 7200
+
+/**
+ * Longest polling interval, used for moored and anchored ships
+ */
+#define SCHEDULER_MAX_INTERVAL 14400
+
+/**
+ * Distance in kilometers a moving ship may travel between polls
+ */
+#define SCHEDULER_TARGET_DISTANCE 10.0
+
+/**
+ * @struct ScheduledShip
+ * @brief Scheduling state of one ship
+ */
+struct ScheduledShip {
+	gint64 mmsi; /**< Ship MMSI number */
+	gint64 due; /**< Unix time when the ship should be fetched */
+	gint interval; /**< Current polling interval in seconds */
+	time_t lasttime; /**< Last reported @c lasttime of the ship */
+	gboolean pending; /**< Ship is in a batch which has not finished */
+	gboolean seen; /**< Used while replacing the roster */
+	guint index; /**< Position in the heap */
+};
+
+/**
+ * @struct Scheduler
+ * @brief Priority queue of ScheduledShip()
+ */
+struct Scheduler {
+	GMutex lock; /**< Protects all fields */
+	GPtrArray *heap; /**< Binary min-heap ordered by @c due */
+	GHashTable *ships; /**< ScheduledShip() by MMSI */
+};
+
+/**
+ * Create new scheduler
+ *
+ * @return struct Scheduler*
+ * @note Free with scheduler_free()
+ */
+struct Scheduler *scheduler_new();
+
+/**
+ * Free scheduler
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @return Nothing
+ */
+void scheduler_free(struct Scheduler *scheduler);
+
+/**
+ * @brief Replace the set of ships to poll
+ *
+ * New ships are due immediately, ships which are not in @p roster anymore
+ * are removed. Schedule of the other ships is kept.
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @param[in] roster Comma separated MMSI's as returned by db_get_ships()
+ * @param[in] now Current unix time
+ * @return Nothing
+ */
+void scheduler_set_roster(struct Scheduler *scheduler, const gchar *roster,
+			  const gint64 now);
+
+/**
+ * Number of ships in the scheduler
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @return guint
+ */
+guint scheduler_size(struct Scheduler *scheduler);
+
+/**
+ * Time when the next ship is due
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @return gint64 Unix time or @c G_MAXINT64 if there are no ships
+ */
+gint64 scheduler_next_due(struct Scheduler *scheduler);
+
+/**
+ * @brief Take next batch of ships to fetch
+ *
+ * Takes all ships which are due at @p now, up to @ref SCHEDULER_BATCH_SIZE,
+ * and fills the rest of the batch with ships which are due next. Ships are
+ * moved forward by their interval so they are not taken again if the API
+ * returns nothing for them.
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @param[in] now Current unix time
+ * @return gchar* Comma separated MMSI's or NULL if no ship is due
+ * @note Returned string should be freed with g_free()
+ * @note Call scheduler_finish_batch() with the returned string after the
+ * results have been handled.
+ */
+gchar *scheduler_next_batch(struct Scheduler *scheduler, const gint64 now);
+
+/**
+ * @brief Reschedule ships from their latest data
+ *
+ * Interval is based on ships speed and navigational status. If the ship has
+ * not reported since the previous poll, interval is doubled instead.
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] now Current unix time
+ * @return Nothing
+ */
+void scheduler_update(struct Scheduler *scheduler,
+		      const struct ShipBatch *batch, const gint64 now);
+
+/**
+ * @brief Finish batch taken with scheduler_next_batch()
+ *
+ * If the API answered, ships of the batch which it did not return are
+ * backed off by doubling their interval. If the request failed or the
+ * response could not be read, the ships keep their interval.
+ *
+ * @param[in] scheduler Struct of type Scheduler()
+ * @param[in] names MMSI's returned by scheduler_next_batch()
+ * @param[in] answered TRUE if the API returned a valid response
+ * @param[in] now Current unix time
+ * @return Nothing
+ */
+void scheduler_finish_batch(struct Scheduler *scheduler, const gchar *names,
+			    const gboolean answered, const gint64 now);
+
+#endif
@@ -0,0 +1,303 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <string.h>
+#include "ship_batch.h"
+
+#define STRING_CHUNK_SIZE 1024
+
+static void _reserve(struct ShipBatch *batch, const guint len)
+{
+	guint capacity;
+
+	if (len <= batch->capacity) {
+		return;
+	}
+
+	capacity = MAX(batch->capacity, 16);
+	while (capacity < len) {
+		capacity *= 2;
+	}
+
+	batch->mmsi = g_renew(gint64, batch->mmsi, capacity);
+	batch->imo = g_renew(gint64, batch->imo, capacity);
+	batch->time = g_renew(time_t, batch->time, capacity);
+	batch->lasttime = g_renew(time_t, batch->lasttime, capacity);
+	batch->latitude = g_renew(gdouble, batch->latitude, capacity);
+	batch->longitude = g_renew(gdouble, batch->longitude, capacity);
+	batch->speed = g_renew(gfloat, batch->speed, capacity);
+	batch->course = g_renew(gfloat, batch->course, capacity);
+	batch->length = g_renew(gfloat, batch->length, capacity);
+	batch->width = g_renew(gfloat, batch->width, capacity);
+	batch->draught = g_renew(gfloat, batch->draught, capacity);
+	batch->heading = g_renew(gint16, batch->heading, capacity);
+	batch->ref_front = g_renew(gint16, batch->ref_front, capacity);
+	batch->ref_left = g_renew(gint16, batch->ref_left, capacity);
+	batch->vessel_class = g_renew(gint16, batch->vessel_class, capacity);
+	batch->navstat = g_renew(gint8, batch->navstat, capacity);
+	batch->class = g_renew(gchar, batch->class, capacity);
+	batch->type = g_renew(gchar, batch->type, capacity);
+	batch->name = g_renew(const gchar *, batch->name, capacity);
+	batch->comment = g_renew(const gchar *, batch->comment, capacity);
+	batch->path = g_renew(const gchar *, batch->path, capacity);
+	batch->srccall = g_renew(const gchar *, batch->srccall, capacity);
+	batch->dstcall = g_renew(const gchar *, batch->dstcall, capacity);
+
+	batch->capacity = capacity;
+}
+
+struct ShipBatch *ship_batch_new(const guint capacity)
+{
+	struct ShipBatch *batch = g_slice_new0(struct ShipBatch);
+
+	_reserve(batch, capacity);
+
+	return batch;
+}
+
+void ship_batch_free(struct ShipBatch *batch)
+{
+	g_free(batch->mmsi);
+	g_free(batch->imo);
+	g_free(batch->time);
+	g_free(batch->lasttime);
+	g_free(batch->latitude);
+	g_free(batch->longitude);
+	g_free(batch->speed);
+	g_free(batch->course);
+	g_free(batch->length);
+	g_free(batch->width);
+	g_free(batch->draught);
+	g_free(batch->heading);
+	g_free(batch->ref_front);
+	g_free(batch->ref_left);
+	g_free(batch->vessel_class);
+	g_free(batch->navstat);
+	g_free(batch->class);
+	g_free(batch->type);
+	g_free(batch->name);
+	g_free(batch->comment);
+	g_free(batch->path);
+	g_free(batch->srccall);
+	g_free(batch->dstcall);
+	if (batch->strings) {
+		g_string_chunk_free(batch->strings);
+	}
+
+	g_slice_free(struct ShipBatch, batch);
+}
+
+void ship_batch_clear(struct ShipBatch *batch)
+{
+	batch->len = 0;
+	if (batch->strings) {
+		g_string_chunk_clear(batch->strings);
+	}
+}
+
+const gchar *ship_batch_string(struct ShipBatch *batch, const gchar *str)
+{
+	if (!str || str[0] == '\0') {
+		return "";
+	}
+
+	if (!batch->strings) {
+		batch->strings = g_string_chunk_new(STRING_CHUNK_SIZE);
+	}
+
+	return g_string_chunk_insert(batch->strings, str);
+}
+
+void ship_batch_set_size(struct ShipBatch *batch, const guint len)
+{
+	guint old = batch->len;
+
+	_reserve(batch, len);
+	batch->len = len;
+
+	if (len <= old) {
+		return;
+	}
+
+	memset(&batch->mmsi[old], 0, (len - old) * sizeof(*batch->mmsi));
+	memset(&batch->imo[old], 0, (len - old) * sizeof(*batch->imo));
+	memset(&batch->time[old], 0, (len - old) * sizeof(*batch->time));
+	memset(&batch->lasttime[old], 0, (len - old) * sizeof(*batch->lasttime));
+	memset(&batch->latitude[old], 0, (len - old) * sizeof(*batch->latitude));
+	memset(&batch->longitude[old], 0, (len - old) * sizeof(*batch->longitude));
+	memset(&batch->speed[old], 0, (len - old) * sizeof(*batch->speed));
+	memset(&batch->course[old], 0, (len - old) * sizeof(*batch->course));
+	memset(&batch->length[old], 0, (len - old) * sizeof(*batch->length));
+	memset(&batch->width[old], 0, (len - old) * sizeof(*batch->width));
+	memset(&batch->draught[old], 0, (len - old) * sizeof(*batch->draught));
+	memset(&batch->heading[old], 0, (len - old) * sizeof(*batch->heading));
+	memset(&batch->ref_front[old], 0, (len - old) * sizeof(*batch->ref_front));
+	memset(&batch->ref_left[old], 0, (len - old) * sizeof(*batch->ref_left));
+	memset(&batch->vessel_class[old], 0, (len - old) * sizeof(*batch->vessel_class));
+	memset(&batch->navstat[old], 0, (len - old) * sizeof(*batch->navstat));
+	memset(&batch->class[old], '0', len - old);
+	memset(&batch->type[old], '0', len - old);
+
+	for (guint i = old; i < len; ++i) {
+		batch->name[i] = "";
+		batch->comment[i] = "";
+		batch->path[i] = "";
+		batch->srccall[i] = intern_string(NULL);
+		batch->dstcall[i] = intern_string(NULL);
+	}
+}
+
+guint ship_batch_append(struct ShipBatch *batch, const struct Ship *ship)
+{
+	guint i = batch->len;
+
+	_reserve(batch, i + 1);
+	batch->len = i + 1;
+
+	batch->mmsi[i] = ship->mmsi;
+	batch->imo[i] = ship->imo;
+	batch->time[i] = ship->time;
+	batch->lasttime[i] = ship->lasttime;
+	batch->latitude[i] = ship->latitude;
+	batch->longitude[i] = ship->longitude;
+	batch->speed[i] = ship->speed;
+	batch->course[i] = ship->course;
+	batch->length[i] = ship->length;
+	batch->width[i] = ship->width;
+	batch->draught[i] = ship->draught;
+	batch->heading[i] = (gint16)ship->heading;
+	batch->ref_front[i] = (gint16)ship->ref_front;
+	batch->ref_left[i] = (gint16)ship->ref_left;
+	batch->vessel_class[i] = (gint16)ship->vessel_class;
+	batch->navstat[i] = (gint8)ship->navstat;
+	batch->class[i] = ship->class;
+	batch->type[i] = ship->type;
+
+	batch->name[i] = ship_batch_string(batch, ship->name);
+	batch->comment[i] = ship_batch_string(batch, ship->comment);
+	batch->path[i] = ship_batch_string(batch, ship->path);
+	batch->srccall[i] = intern_string(ship->srccall);
+	batch->dstcall[i] = intern_string(ship->dstcall);
+
+	return i;
+}
+
+guint ship_batch_append_row(struct ShipBatch *batch,
+			    const struct ShipBatch *src, const guint row)
+{
+	guint i = batch->len;
+
+	_reserve(batch, i + 1);
+	batch->len = i + 1;
+
+	batch->mmsi[i] = src->mmsi[row];
+	batch->imo[i] = src->imo[row];
+	batch->time[i] = src->time[row];
+	batch->lasttime[i] = src->lasttime[row];
+	batch->latitude[i] = src->latitude[row];
+	batch->longitude[i] = src->longitude[row];
+	batch->speed[i] = src->speed[row];
+	batch->course[i] = src->course[row];
+	batch->length[i] = src->length[row];
+	batch->width[i] = src->width[row];
+	batch->draught[i] = src->draught[row];
+	batch->heading[i] = src->heading[row];
+	batch->ref_front[i] = src->ref_front[row];
+	batch->ref_left[i] = src->ref_left[row];
+	batch->vessel_class[i] = src->vessel_class[row];
+	batch->navstat[i] = src->navstat[row];
+	batch->class[i] = src->class[row];
+	batch->type[i] = src->type[row];
+
+	batch->name[i] = ship_batch_string(batch, src->name[row]);
+	batch->comment[i] = ship_batch_string(batch, src->comment[row]);
+	batch->path[i] = ship_batch_string(batch, src->path[row]);
+	// Already interned
+	batch->srccall[i] = src->srccall[row];
+	batch->dstcall[i] = src->dstcall[row];
+
+	return i;
+}
+
+void ship_batch_get(const struct ShipBatch *batch, const guint row,
+		    struct Ship *ship)
+{
+	ship->mmsi = batch->mmsi[row];
+	ship->imo = batch->imo[row];
+	ship->time = batch->time[row];
+	ship->lasttime = batch->lasttime[row];
+	ship->latitude = batch->latitude[row];
+	ship->longitude = batch->longitude[row];
+	ship->speed = batch->speed[row];
+	ship->course = batch->course[row];
+	ship->length = batch->length[row];
+	ship->width = batch->width[row];
+	ship->draught = batch->draught[row];
+	ship->heading = batch->heading[row];
+	ship->ref_front = batch->ref_front[row];
+	ship->ref_left = batch->ref_left[row];
+	ship->vessel_class = batch->vessel_class[row];
+	ship->navstat = batch->navstat[row];
+	ship->class = batch->class[row];
+	ship->type = batch->type[row];
+
+	ship->name = (gchar *)batch->name[row];
+	ship->comment = (gchar *)batch->comment[row];
+	ship->path = (gchar *)batch->path[row];
+	ship->srccall = (gchar *)batch->srccall[row];
+	ship->dstcall = (gchar *)batch->dstcall[row];
+}
+
+gboolean ship_batch_info_equal(const struct ShipBatch *batch, const guint row,
+			       const struct Ship *ship)
+{
+	return batch->mmsi[row] == ship->mmsi &&
+	       batch->imo[row] == ship->imo &&
+	       strcmp(batch->name[row], ship->name) == 0 &&
+	       strcmp(batch->comment[row], ship->comment) == 0 &&
+	       strcmp(batch->path[row], ship->path) == 0 &&
+	       batch->srccall[row] == ship->srccall &&
+	       batch->dstcall[row] == ship->dstcall &&
+	       batch->speed[row] == ship->speed &&
+	       batch->course[row] == ship->course &&
+	       batch->length[row] == ship->length &&
+	       batch->width[row] == ship->width &&
+	       batch->draught[row] == ship->draught &&
+	       batch->heading[row] == ship->heading &&
+	       batch->ref_front[row] == ship->ref_front &&
+	       batch->ref_left[row] == ship->ref_left &&
+	       batch->vessel_class[row] == ship->vessel_class &&
+	       batch->navstat[row] == ship->navstat &&
+	       batch->class[row] == ship->class &&
+	       batch->type[row] == ship->type;
+}
+
+void ship_batch_get_positions(const struct ShipBatch *batch, const guint first,
+			      struct ShipPosition *positions)
+{
+	for (guint i = first; i < batch->len; ++i) {
+		struct ShipPosition *pos = &positions[i - first];
+
+		pos->imo = batch->imo[i];
+		pos->time = batch->time[i];
+		pos->lasttime = batch->lasttime[i];
+		pos->latitude = batch->latitude[i];
+		pos->longitude = batch->longitude[i];
+	}
+}
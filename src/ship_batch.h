@@ -0,0 +1,190 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file ship_batch.h
+ * @brief Column-wise storage of many ships
+ * @details Holds a batch of ships as one array per field instead of an
+ * array of struct Ship(). Loops which touch only a few fields, like filling
+ * bind buffers for GPS inserts or rescheduling ships, read contiguous
+ * memory. Callsign columns hold interned strings, see intern.h, so equal
+ * callsigns can be compared by pointer. Names, comments and paths are free
+ * text with no bound on the number of distinct values, they are copied
+ * into storage owned by the batch and freed with it.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef SHIP_BATCH_H
+#define SHIP_BATCH_H
+
+#include <glib.h>
+
+#include "intern.h"
+#include "ship_defines.h"
+
+/**
+ * @struct ShipBatch
+ * @brief Ships stored as columns
+ *
+ * Row @c i of the batch is made of element @c i of every column.
+ */
+struct ShipBatch {
+	guint len; /**< Number of rows */
+	guint capacity; /**< Allocated rows */
+
+	gint64 *mmsi; /**< Ship MMSI numbers */
+	gint64 *imo; /**< Ship IMO numbers */
+	time_t *time; /**< Time when the target first reported the position */
+	time_t *lasttime; /**< Time when the target last reported the position */
+	gdouble *latitude; /**< Latitudes in decimal degrees */
+	gdouble *longitude; /**< Longitudes in decimal degrees */
+	gfloat *speed; /**< Speeds in km/h */
+	gfloat *course; /**< Courses in degrees */
+	gfloat *length; /**< Ship lengths in meters */
+	gfloat *width; /**< Ship widths in meters */
+	gfloat *draught; /**< Ship draughts in meters */
+	gint16 *heading; /**< Headings */
+	gint16 *ref_front; /**< AIS reference distances from the front */
+	gint16 *ref_left; /**< AIS reference distances from the left */
+	gint16 *vessel_class; /**< AIS class codes */
+	gint8 *navstat; /**< AIS navigational status codes */
+	gchar *class; /**< Class of station identifiers */
+	gchar *type; /**< Target types */
+
+	const gchar **name; /**< Ship names, in @p strings */
+	const gchar **comment; /**< APRS comments or AIS destinations, in @p strings */
+	const gchar **path; /**< Packet paths, in @p strings */
+	const gchar **srccall; /**< Source callsigns, interned */
+	const gchar **dstcall; /**< Destination callsigns, interned */
+
+	GStringChunk *strings; /**< Storage of the free text columns, NULL
+				 until the first string is stored */
+};
+
+/**
+ * Create new empty batch
+ *
+ * @param[in] capacity Number of rows to allocate
+ * @return struct ShipBatch*
+ * @note Free with ship_batch_free()
+ */
+struct ShipBatch *ship_batch_new(const guint capacity);
+
+/**
+ * Free batch
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @return Nothing
+ */
+void ship_batch_free(struct ShipBatch *batch);
+
+/**
+ * Remove all rows
+ *
+ * Strings stored in the batch are freed.
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @return Nothing
+ */
+void ship_batch_clear(struct ShipBatch *batch);
+
+/**
+ * @brief Resize batch
+ *
+ * New rows are zeroed and their strings are empty.
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] len New number of rows
+ * @return Nothing
+ */
+void ship_batch_set_size(struct ShipBatch *batch, const guint len);
+
+/**
+ * Append ship to the batch
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] ship Struct of type Ship(), strings are copied
+ * @return guint Index of the new row
+ */
+guint ship_batch_append(struct ShipBatch *batch, const struct Ship *ship);
+
+/**
+ * Append row of another batch
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] src Batch to copy from
+ * @param[in] row Row in @p src
+ * @return guint Index of the new row
+ */
+guint ship_batch_append_row(struct ShipBatch *batch,
+			    const struct ShipBatch *src, const guint row);
+
+/**
+ * @brief Read row as struct Ship()
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] row Row to read
+ * @param[out] ship Struct of type Ship()
+ * @return Nothing
+ * @note Strings of @p ship must not be freed or modified. Name, comment and
+ * path are valid until @p batch is cleared or freed.
+ */
+void ship_batch_get(const struct ShipBatch *batch, const guint row,
+		    struct Ship *ship);
+
+/**
+ * @brief Compare ship information of a row
+ *
+ * Compares the fields written to the Ships table, GPS fields are ignored.
+ * Callsigns are compared by pointer, so @p ship must hold interned
+ * callsigns.
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] row Row to compare
+ * @param[in] ship Struct of type Ship()
+ * @return gboolean TRUE if the information is the same
+ */
+gboolean ship_batch_info_equal(const struct ShipBatch *batch, const guint row,
+			       const struct Ship *ship);
+
+/**
+ * @brief Store a free text string in the batch
+ *
+ * Used for the name, comment and path columns.
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] str String to copy, NULL is handled as an empty string
+ * @return const gchar* Copy of @p str, valid until @p batch is cleared or
+ * freed
+ */
+const gchar *ship_batch_string(struct ShipBatch *batch, const gchar *str);
+
+/**
+ * Fill GPS records of rows starting from @p first
+ *
+ * @param[in] batch Struct of type ShipBatch()
+ * @param[in] first First row
+ * @param[out] positions Array of at least @c len - @p first elements
+ * @return Nothing
+ */
+void ship_batch_get_positions(const struct ShipBatch *batch, const guint first,
+			      struct ShipPosition *positions);
+
+#endif
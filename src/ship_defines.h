@@ -62,4 +62,18 @@ struct Ship {
 	gdouble longitude; /**< Longitude in decimal degrees, east is positive */
 };
 
+/**
+ * @struct ShipPosition
+ * @brief Holds single GPS record of a ship
+ *
+ * Contains the fields of one row in GPS table, used for bulk inserts.
+ */
+struct ShipPosition {
+	gint64 imo; /**< Ship IMO number */
+	time_t time; /**< Time when the target first reported this position */
+	time_t lasttime; /**< Time when the target last reported this position */
+	gdouble latitude; /**< Latitude in decimal degrees, north is positive */
+	gdouble longitude; /**< Longitude in decimal degrees, east is positive */
+};
+
 #endif //SHIPSOFTWAREBACKEND_SHIP_DEFINES_H
@@ -0,0 +1,49 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include "status.h"
+
+static GMutex LOCK;
+static struct Status STATUS = { STATUS_STOPPED, 0, 0, 0, 0, 0 };
+static guint VERSION = 0;
+
+void status_publish(const struct Status *status)
+{
+	g_mutex_lock(&LOCK);
+	STATUS = *(status);
+	g_atomic_int_inc(&VERSION);
+	g_mutex_unlock(&LOCK);
+}
+
+guint status_version()
+{
+	return (guint)g_atomic_int_get(&VERSION);
+}
+
+guint status_read(struct Status *status)
+{
+	guint version;
+
+	g_mutex_lock(&LOCK);
+	*(status) = STATUS;
+	version = VERSION;
+	g_mutex_unlock(&LOCK);
+
+	return version;
+}
@@ -0,0 +1,87 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file status.h
+ * @brief Status of the API thread
+ * @details The API thread publishes a snapshot of its status whenever it
+ * changes. Readers check the version first, which is a single atomic read,
+ * and copy the snapshot only when it has changed, so polling costs nothing
+ * while the program is idle.
+ *
+ * All functions are thread safe.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <glib.h>
+
+/**
+ * @enum StatusState
+ * @brief What the API thread is doing
+ */
+enum StatusState {
+	STATUS_STOPPED, /**< Thread is not running */
+	STATUS_IDLE, /**< Waiting for the next update */
+	STATUS_UPDATING /**< Fetching ships */
+};
+
+/**
+ * @struct Status
+ * @brief Snapshot of the API thread status
+ */
+struct Status {
+	enum StatusState state; /**< What the thread is doing */
+	gint64 next_update; /**< Unix time of the next update, 0 if unknown */
+	gint64 last_update; /**< Unix time of the last update, 0 if never */
+	guint cycle_requests; /**< API requests made in the last update */
+	guint cycle_ships; /**< Ships requested in the last update */
+	gint64 cycle_duration; /**< Duration of the last update in microseconds */
+};
+
+/**
+ * Publish new status
+ *
+ * @param[in] status Struct of type Status()
+ * @return Nothing
+ */
+void status_publish(const struct Status *status);
+
+/**
+ * @brief Version of the published status
+ *
+ * Increases every time status is published, starting from @c 0 before the
+ * first status.
+ *
+ * @return guint
+ */
+guint status_version();
+
+/**
+ * Copy the published status
+ *
+ * @param[out] status Struct of type Status()
+ * @return guint Version of the copied status
+ */
+guint status_read(struct Status *status);
+
+#endif
@@ -0,0 +1,184 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <glib/gstdio.h>
+#include "trace.h"
+
+/**
+ * @brief One recorded span
+ */
+struct TraceSpan {
+	const gchar *name; /**< Name of the span */
+	gint64 start; /**< Monotonic start time */
+	gint64 duration; /**< Duration in microseconds */
+	guint thread; /**< Number of the recording thread */
+};
+
+/**
+ * @brief Spans recorded by one thread
+ *
+ * Rings of exited threads are reused by new threads, so every span keeps
+ * the number of the thread which recorded it.
+ */
+struct TraceRing {
+	struct TraceSpan spans[TRACE_RING_SIZE]; /**< Written only by the owner */
+	guint64 head; /**< Number of spans ever written */
+	guint thread; /**< Number of the owning thread */
+};
+
+static void _release(gpointer data);
+
+gint TRACE_ENABLED = 0;
+
+static GMutex LOCK;
+static GPtrArray *RINGS = NULL; /* Every ring ever allocated */
+static GPtrArray *FREE = NULL; /* Rings of exited threads */
+static guint THREADS = 0;
+static GPrivate RING = G_PRIVATE_INIT(_release);
+
+static void _release(gpointer data)
+{
+	struct TraceRing *ring = data;
+
+	g_mutex_lock(&LOCK);
+	g_ptr_array_add(FREE, ring);
+	g_mutex_unlock(&LOCK);
+}
+
+static struct TraceRing *_ring()
+{
+	struct TraceRing *ring = g_private_get(&RING);
+
+	if (ring) {
+		return ring;
+	}
+
+	g_mutex_lock(&LOCK);
+	if (!RINGS) {
+		RINGS = g_ptr_array_new();
+		FREE = g_ptr_array_new();
+	}
+
+	if (FREE->len > 0) {
+		ring = g_ptr_array_remove_index_fast(FREE, FREE->len - 1);
+	} else {
+		ring = g_new0(struct TraceRing, 1);
+		g_ptr_array_add(RINGS, ring);
+	}
+
+	ring->thread = ++THREADS;
+	g_mutex_unlock(&LOCK);
+
+	g_private_set(&RING, ring);
+
+	return ring;
+}
+
+void trace_enable()
+{
+	g_atomic_int_set(&TRACE_ENABLED, 1);
+}
+
+void trace_record(const gchar *name, const gint64 start)
+{
+	struct TraceRing *ring = _ring();
+	guint64 head = ring->head;
+	struct TraceSpan *span = &ring->spans[head % TRACE_RING_SIZE];
+
+	span->name = name;
+	span->start = start;
+	span->duration = g_get_monotonic_time() - start;
+	span->thread = ring->thread;
+
+	// Span is complete before it is published
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void _write_span(FILE *file, const struct TraceSpan *span,
+			gboolean *first)
+{
+	fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+		"\"tid\":%u,\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+		*first ? "" : ",", span->name, span->thread, span->start,
+		span->duration);
+	*first = FALSE;
+}
+
+static void _write_ring(FILE *file, const struct TraceRing *ring,
+			struct TraceSpan *copy, gboolean *first)
+{
+	guint64 head;
+	guint64 oldest;
+	guint64 overwritten;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	oldest = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+	for (guint64 i = oldest; i < head; ++i) {
+		copy[i - oldest] = ring->spans[i % TRACE_RING_SIZE];
+	}
+
+	// Slots the owner wrote while they were copied are dropped, including
+	// the one it may be writing now, which holds index head - SIZE
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	overwritten = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	overwritten = overwritten >= TRACE_RING_SIZE ?
+		      overwritten - TRACE_RING_SIZE + 1 : 0;
+
+	for (guint64 i = MAX(oldest, overwritten); i < head; ++i) {
+		_write_span(file, &copy[i - oldest], first);
+	}
+}
+
+gboolean trace_dump(const gchar *path, gchar **error)
+{
+	FILE *file;
+	struct TraceSpan *copy;
+	gboolean first = TRUE;
+
+	file = g_fopen(path, "w");
+	if (!file) {
+		*(error) = g_strdup_printf("Could not open trace file `%s`: %s",
+					   path, g_strerror(errno));
+		return FALSE;
+	}
+
+	copy = g_new(struct TraceSpan, TRACE_RING_SIZE);
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+	g_mutex_lock(&LOCK);
+	for (guint i = 0; RINGS && i < RINGS->len; ++i) {
+		_write_ring(file, g_ptr_array_index(RINGS, i), copy, &first);
+	}
+	g_mutex_unlock(&LOCK);
+
+	fputs("\n]}\n", file);
+	g_free(copy);
+
+	if (fclose(file) != 0) {
+		*(error) = g_strdup_printf("Could not write trace file `%s`: %s",
+					   path, g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,104 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file trace.h
+ * @brief Spans of the update cycle in Chrome trace event format
+ * @details Code around API requests, decoding and database calls records
+ * spans with trace_begin() and trace_end(). Spans go to a ring buffer of
+ * the recording thread, so recording takes no lock, and trace_dump() writes
+ * the latest spans of every thread as Chrome trace event JSON which can be
+ * opened in Perfetto or chrome://tracing.
+ *
+ * Tracing is off until trace_enable() is called. While it is off,
+ * trace_begin() and trace_end() only test one global flag.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+/**
+ * Number of spans kept per thread
+ */
+#define TRACE_RING_SIZE 8192
+
+/**
+ * Tracing is enabled, use trace_enable() to set
+ */
+extern gint TRACE_ENABLED;
+
+/**
+ * Start recording spans
+ *
+ * @return Nothing
+ */
+void trace_enable();
+
+/**
+ * @brief Record a finished span
+ *
+ * Use trace_end() instead.
+ *
+ * @param[in] name Name of the span, must be a string literal
+ * @param[in] start Monotonic time when the span started
+ * @return Nothing
+ */
+void trace_record(const gchar *name, const gint64 start);
+
+/**
+ * @brief Write recorded spans to a file
+ *
+ * Spans are read while other threads keep recording, spans overwritten
+ * during the dump are left out.
+ *
+ * @param[in] path File to write
+ * @param[out] error Pointer to gchar where to store error message
+ * @return gboolean TRUE on success, otherwise FALSE
+ */
+gboolean trace_dump(const gchar *path, gchar **error);
+
+/**
+ * Start a span
+ *
+ * @return gint64 Start time to pass to trace_end(), 0 if tracing is off
+ */
+static inline gint64 trace_begin()
+{
+	return G_UNLIKELY(TRACE_ENABLED) ? g_get_monotonic_time() : 0;
+}
+
+/**
+ * End a span started with trace_begin()
+ *
+ * @param[in] name Name of the span, must be a string literal
+ * @param[in] start Return value of trace_begin()
+ * @return Nothing
+ */
+static inline void trace_end(const gchar *name, const gint64 start)
+{
+	if (G_UNLIKELY(start != 0)) {
+		trace_record(name, start);
+	}
+}
+
+#endif
@@ -0,0 +1,187 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "fake.h"
+#include "log.h"
+
+struct FakeDatabase FAKE_DB;
+
+void fake_database_reset()
+{
+	if (!FAKE_DB.positions) {
+		FAKE_DB.positions = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+		FAKE_DB.imported = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+		FAKE_DB.pending = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+		FAKE_DB.pending_imported = g_array_new(FALSE, FALSE, sizeof(struct ShipPosition));
+	}
+
+	FAKE_DB.connected = TRUE;
+	FAKE_DB.reject_imo = 0;
+	FAKE_DB.ship_updates = 0;
+	FAKE_DB.commits = 0;
+	FAKE_DB.rollbacks = 0;
+	g_array_set_size(FAKE_DB.positions, 0);
+	g_array_set_size(FAKE_DB.imported, 0);
+	g_array_set_size(FAKE_DB.pending, 0);
+	g_array_set_size(FAKE_DB.pending_imported, 0);
+	FAKE_DB.stream = NULL;
+}
+
+static gboolean _insert(GArray *array, const struct ShipPosition *positions,
+			const guint count, gchar **error)
+{
+	if (!FAKE_DB.connected) {
+		*(error) = g_strdup("server has gone away");
+		return FALSE;
+	}
+
+	for (guint i = 0; i < count; ++i) {
+		if (positions[i].imo == FAKE_DB.reject_imo) {
+			*(error) = g_strdup_printf("IMO %" G_GINT64_FORMAT
+						   " rejected", positions[i].imo);
+			return FALSE;
+		}
+	}
+	g_array_append_vals(array, positions, count);
+
+	return TRUE;
+}
+
+gboolean db_init(struct Database *db, const struct Config *config,
+		 gchar **error)
+{
+	memset(db, 0, sizeof(*db));
+	db->imported = TRUE;
+
+	return TRUE;
+}
+
+void db_close_con(struct Database *db)
+{
+}
+
+gboolean db_update_ship_info(const struct Database *db, struct Ship *info,
+			     gchar **error)
+{
+	if (!FAKE_DB.connected) {
+		*(error) = g_strdup("server has gone away");
+		return FALSE;
+	}
+	++FAKE_DB.ship_updates;
+
+	return TRUE;
+}
+
+gboolean db_clean_ship_gps(const struct Database *db, const gint64 *imo,
+			   gchar **error)
+{
+	return TRUE;
+}
+
+gboolean db_insert_ship_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 guint count, guint *written, gchar **error)
+{
+	gboolean ret = _insert(FAKE_DB.pending, positions, count, error);
+
+	if (written) {
+		*(written) = ret ? count : 0;
+	}
+
+	return ret;
+}
+
+gboolean db_import_ship_gps_bulk(const struct Database *db,
+				 const struct ShipPosition *positions,
+				 guint count, gchar **error)
+{
+	return _insert(FAKE_DB.pending_imported, positions, count, error);
+}
+
+gboolean db_stream(const struct Database *db, const gchar *query,
+		   DbRowFunc func, gpointer data, gchar **error)
+{
+	if (!FAKE_DB.stream(query, func, data)) {
+		*(error) = g_strdup("query stopped");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean db_is_connected(const struct Database *db)
+{
+	return FAKE_DB.connected;
+}
+
+gboolean db_begin(const struct Database *db, gchar **error)
+{
+	g_array_set_size(FAKE_DB.pending, 0);
+	g_array_set_size(FAKE_DB.pending_imported, 0);
+
+	return TRUE;
+}
+
+gboolean db_commit(const struct Database *db, gchar **error)
+{
+	g_array_append_vals(FAKE_DB.positions, FAKE_DB.pending->data,
+			    FAKE_DB.pending->len);
+	g_array_append_vals(FAKE_DB.imported, FAKE_DB.pending_imported->data,
+			    FAKE_DB.pending_imported->len);
+	g_array_set_size(FAKE_DB.pending, 0);
+	g_array_set_size(FAKE_DB.pending_imported, 0);
+	++FAKE_DB.commits;
+
+	return TRUE;
+}
+
+void db_rollback(const struct Database *db)
+{
+	g_array_set_size(FAKE_DB.pending, 0);
+	g_array_set_size(FAKE_DB.pending_imported, 0);
+	++FAKE_DB.rollbacks;
+}
+
+void log_event(const enum LogLevel level, const gchar *stage,
+	       const gchar *code, const gint64 mmsi, const gint64 latency,
+	       const gchar *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	g_printerr("%s %s: ", stage, code);
+	vfprintf(stderr, format, args);
+	g_printerr("\n");
+	va_end(args);
+}
+
+void log_message(gpointer message)
+{
+	g_printerr("%s\n", (gchar *)message);
+	g_free(message);
+}
+
+void log_error(gpointer message)
+{
+	g_printerr("%s\n", (gchar *)message);
+	g_free(message);
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/**
+ * @file fake.h
+ * @brief Stand-ins for database.c and log.c in the unit tests
+ * @details Writes go to arrays in @ref FAKE_DB instead of a server, so the
+ * tests run without MariaDB. Positions inserted inside a transaction are
+ * kept aside until db_commit() and dropped by db_rollback(). Log lines are
+ * printed to stderr.
+ * @author Tomi Lähteenmäki
+ * @license This project is licensed under GNU General Public License, Version 2
+ */
+
+#ifndef FAKE_H
+#define FAKE_H
+
+#include <glib.h>
+
+#include "database.h"
+
+/**
+ * @brief Called by db_stream() to feed the rows of @p query
+ *
+ * @param[in] query Query given to db_stream()
+ * @param[in] func Function to call for every row
+ * @param[in] data User data of @p func
+ * @return gboolean FALSE if @p func stopped the query
+ */
+typedef gboolean (*FakeStreamFunc)(const gchar *query, DbRowFunc func,
+				   gpointer data);
+
+/**
+ * @struct FakeDatabase
+ * @brief What the fake database has been given
+ */
+struct FakeDatabase {
+	gboolean connected; /**< Returned by db_is_connected() */
+	gint64 reject_imo; /**< Inserts of this IMO fail as a data error */
+	guint ship_updates; /**< Calls of db_update_ship_info() */
+	guint commits; /**< Calls of db_commit() */
+	guint rollbacks; /**< Calls of db_rollback() */
+	GArray *positions; /**< Committed ShipPosition() of the update cycle */
+	GArray *imported; /**< Committed imported ShipPosition() */
+	GArray *pending; /**< Positions of the open transaction */
+	GArray *pending_imported; /**< Imported positions of the transaction */
+	FakeStreamFunc stream; /**< Source of the rows of db_stream() */
+};
+
+extern struct FakeDatabase FAKE_DB;
+
+/**
+ * Empty @ref FAKE_DB and mark it connected
+ *
+ * @return Nothing
+ */
+void fake_database_reset();
+
+#endif
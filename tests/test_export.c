@@ -0,0 +1,199 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Export of generated GPS and Ships rows read back with
+ * scripts/read_export.py.
+ *
+ * Usage: test_export PYTHON SCRIPT
+ */
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include "export.h"
+#include "fake.h"
+
+#define GPS_ROWS (EXPORT_BLOCK_ROWS + 1000)
+#define SHIPS_ROWS 40
+#define SHIPS_COLUMNS 19
+
+static const gchar *PYTHON;
+static const gchar *SCRIPT;
+
+/**
+ * Rows given to the export and what read_export.py should print
+ */
+struct Expected {
+	GString *gps; /**< CSV of GPS */
+	GString *ships; /**< CSV of Ships */
+};
+
+static gboolean _row(GString *csv, gchar **row, const guint columns,
+		     DbRowFunc func, gpointer data)
+{
+	unsigned long lengths[SHIPS_COLUMNS];
+
+	for (guint i = 0; i < columns; ++i) {
+		lengths[i] = row[i] ? strlen(row[i]) : 0;
+		g_string_append_printf(csv, i > 0 ? ",%s" : "%s",
+				       row[i] ? row[i] : "\\N");
+	}
+	g_string_append_c(csv, '\n');
+
+	return func(row, lengths, data);
+}
+
+static gboolean _stream_gps(GString *csv, DbRowFunc func, gpointer data)
+{
+	gchar *row[6];
+	gboolean ret = TRUE;
+
+	g_string_append(csv, "ID,IMO,Lat,Lng,RealTime,LastTime\n");
+
+	for (guint i = 0; ret && i < GPS_ROWS; ++i) {
+		row[0] = g_strdup_printf("%u", i + 1);
+		row[1] = g_strdup_printf("%u", 9000000 + i % 500);
+		row[2] = g_strdup_printf("%.7f", 60.0 + (i % 1000) * 0.0001234567);
+		row[3] = g_strdup_printf("%.7f", -25.0 + i * 0.0000003);
+		row[4] = g_strdup_printf("2024-%02u-%02u %02u:%02u:%02u",
+					 1 + i % 12, 1 + i % 28, i % 24,
+					 i % 60, (i * 7) % 60);
+		row[5] = i % 10 == 0 ? NULL :
+			 g_strdup_printf("2023-12-31 23:%02u:00", i % 60);
+
+		ret = _row(csv, row, G_N_ELEMENTS(row), func, data);
+
+		for (guint j = 0; j < G_N_ELEMENTS(row); ++j) {
+			g_free(row[j]);
+		}
+	}
+
+	return ret;
+}
+
+static gboolean _stream_ships(GString *csv, DbRowFunc func, gpointer data)
+{
+	gchar *row[SHIPS_COLUMNS];
+	gboolean ret = TRUE;
+
+	g_string_append(csv, "MMSI,IMO,ShipName,CommentText,ShipLength,Width,"
+			"Draught,Course,Heading,ShipSpeed,RefFront,RefLeft,"
+			"PathText,Iclass,TargetType,SrcCall,DstCall,"
+			"VesselClass,NavStat\n");
+
+	for (guint i = 0; ret && i < SHIPS_ROWS; ++i) {
+		for (guint j = 0; j < SHIPS_COLUMNS; ++j) {
+			// Every column has NULLs and strings repeat in a block
+			if ((i + j) % 7 == 0) {
+				row[j] = NULL;
+			} else if (j == 2 || j == 3 || (j >= 12 && j <= 16)) {
+				row[j] = g_strdup_printf("text %u", (i * (j + 1)) % 5);
+			} else if ((j >= 4 && j <= 7) || j == 9) {
+				row[j] = g_strdup_printf("%.1f", (i % 20) * 10.5);
+			} else {
+				row[j] = g_strdup_printf("%d", j == 0 ? 230000000 + (gint)i :
+							 (gint)(i * 31 + j) % 1000 - 500);
+			}
+		}
+
+		ret = _row(csv, row, G_N_ELEMENTS(row), func, data);
+
+		for (guint j = 0; j < G_N_ELEMENTS(row); ++j) {
+			g_free(row[j]);
+		}
+	}
+
+	return ret;
+}
+
+static struct Expected EXPECTED;
+
+static gboolean _stream(const gchar *query, DbRowFunc func, gpointer data)
+{
+	if (strstr(query, " FROM GPS ")) {
+		return _stream_gps(EXPECTED.gps, func, data);
+	}
+
+	return _stream_ships(EXPECTED.ships, func, data);
+}
+
+static gchar *_read_back(const gchar *path, const gchar *table)
+{
+	const gchar *argv[] = {PYTHON, SCRIPT, path, table, NULL};
+	gchar *output = NULL;
+	gint status;
+	GError *error = NULL;
+
+	g_spawn_sync(NULL, (gchar **)argv, NULL, G_SPAWN_DEFAULT, NULL, NULL,
+		     &output, NULL, &status, &error);
+	g_assert_no_error(error);
+	g_assert_cmpint(status, ==, 0);
+
+	return output;
+}
+
+static void test_read_back(void)
+{
+	struct Config config = {0};
+	gchar *dir = g_dir_make_tmp("test_export-XXXXXX", NULL);
+	gchar *path = g_build_filename(dir, "out.ssx", NULL);
+	gchar *part = g_strconcat(path, ".part", NULL);
+	gchar *output;
+
+	fake_database_reset();
+	FAKE_DB.stream = _stream;
+	EXPECTED.gps = g_string_new(NULL);
+	EXPECTED.ships = g_string_new(NULL);
+
+	g_assert_cmpint(export_run(&config, path), ==, 0);
+	g_assert_true(g_file_test(path, G_FILE_TEST_EXISTS));
+	g_assert_false(g_file_test(part, G_FILE_TEST_EXISTS));
+
+	output = _read_back(path, "GPS");
+	g_assert_cmpstr(output, ==, EXPECTED.gps->str);
+	g_free(output);
+
+	output = _read_back(path, "Ships");
+	g_assert_cmpstr(output, ==, EXPECTED.ships->str);
+	g_free(output);
+
+	g_string_free(EXPECTED.ships, TRUE);
+	g_string_free(EXPECTED.gps, TRUE);
+	g_unlink(path);
+	g_rmdir(dir);
+	g_free(part);
+	g_free(path);
+	g_free(dir);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	if (argc != 3) {
+		g_printerr("Usage: %s PYTHON SCRIPT\n", argv[0]);
+		return 1;
+	}
+	PYTHON = argv[1];
+	SCRIPT = argv[2];
+
+	g_test_add_func("/export/read_back", test_read_back);
+
+	return g_test_run();
+}
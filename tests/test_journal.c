@@ -0,0 +1,253 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Journal written, synced and replayed into the fake database, including
+ * the segments replay has to move aside or keep.
+ */
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include "fake.h"
+#include "journal.h"
+
+struct Fixture {
+	gchar *dir; /**< Temporary journal directory */
+	struct Database db; /**< Handle given to journal_replay() */
+};
+
+static void _setup(struct Fixture *fixture, gconstpointer data)
+{
+	fixture->dir = g_dir_make_tmp("test_journal-XXXXXX", NULL);
+	g_assert_nonnull(fixture->dir);
+	memset(&fixture->db, 0, sizeof(fixture->db));
+	fake_database_reset();
+}
+
+static void _teardown(struct Fixture *fixture, gconstpointer data)
+{
+	GDir *dir = g_dir_open(fixture->dir, 0, NULL);
+	const gchar *name;
+
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		gchar *path = g_build_filename(fixture->dir, name, NULL);
+
+		g_remove(path);
+		g_free(path);
+	}
+	g_dir_close(dir);
+	g_rmdir(fixture->dir);
+	g_free(fixture->dir);
+}
+
+static gchar *_path(const struct Fixture *fixture, const gchar *name)
+{
+	return g_build_filename(fixture->dir, name, NULL);
+}
+
+static void _ship(struct Ship *ship, const gint64 mmsi, const time_t time)
+{
+	memset(ship, 0, sizeof(*ship));
+	ship->mmsi = mmsi;
+	ship->imo = mmsi + 1000;
+	ship->time = time;
+	ship->lasttime = time + 30;
+	ship->latitude = 60.1234567;
+	ship->longitude = -24.9876543;
+	ship->speed = 12.5f;
+	ship->course = 271.5f;
+	ship->heading = 270;
+	ship->navstat = 0;
+	ship->class = 'i';
+	ship->type = 'a';
+	ship->name = "TEST VESSEL";
+	ship->comment = "";
+	ship->path = "TCPIP*,qAI,OH2MP";
+	ship->srccall = "230000001";
+	ship->dstcall = "ais";
+}
+
+// Appends ships of MMSI 230000001..3, 230000001 twice, and one archived
+// position
+static void _write(const struct Fixture *fixture)
+{
+	struct Journal *journal;
+	struct ShipPosition position;
+	struct Ship ship;
+	gchar *error = NULL;
+
+	journal = journal_open(fixture->dir, &error);
+	g_assert_nonnull(journal);
+
+	for (guint i = 0; i < 4; ++i) {
+		_ship(&ship, 230000001 + i % 3, 1700000000 + i * 600);
+		g_assert_true(journal_append(journal, &ship, &error));
+	}
+
+	position.imo = 9000001;
+	position.time = 1600000000;
+	position.lasttime = 1600000060;
+	position.latitude = 59.5;
+	position.longitude = 21.25;
+	g_assert_true(journal_append_position(journal, &position, &error));
+
+	journal_close(journal);
+}
+
+static gboolean _replay(const struct Fixture *fixture, guint *records)
+{
+	struct Journal *journal;
+	gchar *error = NULL;
+	gboolean ret;
+
+	journal = journal_open(fixture->dir, &error);
+	ret = journal_replay(journal, &fixture->db, records, &error);
+	g_free(error);
+	if (ret) {
+		g_assert_true(journal_is_empty(journal));
+	}
+	journal_close(journal);
+
+	return ret;
+}
+
+static void test_round_trip(struct Fixture *fixture, gconstpointer data)
+{
+	struct ShipPosition *pos;
+	guint records = 0;
+
+	_write(fixture);
+
+	g_assert_true(_replay(fixture, &records));
+	g_assert_cmpuint(records, ==, 5);
+	g_assert_cmpuint(FAKE_DB.commits, ==, 1);
+	// Latest information of each ship
+	g_assert_cmpuint(FAKE_DB.ship_updates, ==, 3);
+	g_assert_cmpuint(FAKE_DB.positions->len, ==, 4);
+	g_assert_cmpuint(FAKE_DB.imported->len, ==, 1);
+
+	pos = &g_array_index(FAKE_DB.positions, struct ShipPosition, 3);
+	g_assert_cmpint(pos->imo, ==, 230001001);
+	g_assert_cmpint(pos->time, ==, 1700001800);
+	g_assert_cmpint(pos->lasttime, ==, 1700001830);
+	g_assert_cmpfloat(pos->latitude, ==, 60.1234567);
+	g_assert_cmpfloat(pos->longitude, ==, -24.9876543);
+
+	pos = &g_array_index(FAKE_DB.imported, struct ShipPosition, 0);
+	g_assert_cmpint(pos->imo, ==, 9000001);
+	g_assert_cmpfloat(pos->longitude, ==, 21.25);
+
+	// Replayed segment is deleted
+	fake_database_reset();
+	g_assert_true(_replay(fixture, &records));
+	g_assert_cmpuint(records, ==, 0);
+	g_assert_cmpuint(FAKE_DB.positions->len, ==, 0);
+}
+
+static void test_truncated_tail(struct Fixture *fixture, gconstpointer data)
+{
+	gchar *path = _path(fixture, "00000001.journal");
+	gchar *contents;
+	gsize length;
+	guint records = 0;
+
+	_write(fixture);
+
+	// Torn write of the last record, a position record is 49 bytes
+	g_assert_true(g_file_get_contents(path, &contents, &length, NULL));
+	g_assert_true(g_file_set_contents(path, contents, length - 20, NULL));
+	g_free(contents);
+
+	g_assert_true(_replay(fixture, &records));
+	g_assert_cmpuint(records, ==, 4);
+	g_assert_cmpuint(FAKE_DB.positions->len, ==, 4);
+	g_assert_cmpuint(FAKE_DB.imported->len, ==, 0);
+	g_assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+
+	g_free(path);
+}
+
+static void test_rejected(struct Fixture *fixture, gconstpointer data)
+{
+	gchar *path = _path(fixture, "00000001.journal");
+	gchar *bad = _path(fixture, "00000001.journal.bad");
+
+	_write(fixture);
+
+	FAKE_DB.reject_imo = 230001002;
+	g_assert_true(_replay(fixture, NULL));
+	g_assert_cmpuint(FAKE_DB.rollbacks, ==, 1);
+	g_assert_cmpuint(FAKE_DB.positions->len, ==, 0);
+	g_assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+	g_assert_true(g_file_test(bad, G_FILE_TEST_EXISTS));
+
+	g_free(bad);
+	g_free(path);
+}
+
+static void test_disconnected(struct Fixture *fixture, gconstpointer data)
+{
+	gchar *path = _path(fixture, "00000001.journal");
+
+	_write(fixture);
+
+	FAKE_DB.connected = FALSE;
+	g_assert_false(_replay(fixture, NULL));
+	g_assert_true(g_file_test(path, G_FILE_TEST_EXISTS));
+
+	FAKE_DB.connected = TRUE;
+	g_assert_true(_replay(fixture, NULL));
+	g_assert_cmpuint(FAKE_DB.positions->len, ==, 4);
+
+	g_free(path);
+}
+
+static void test_foreign_file(struct Fixture *fixture, gconstpointer data)
+{
+	gchar *path = _path(fixture, "00000001.journal");
+	gchar *bad = _path(fixture, "00000001.journal.bad");
+
+	g_assert_true(g_file_set_contents(path, "not a journal", -1, NULL));
+
+	g_assert_true(_replay(fixture, NULL));
+	g_assert_cmpuint(FAKE_DB.commits, ==, 0);
+	g_assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+	g_assert_true(g_file_test(bad, G_FILE_TEST_EXISTS));
+
+	g_free(bad);
+	g_free(path);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add("/journal/round_trip", struct Fixture, NULL, _setup,
+		   test_round_trip, _teardown);
+	g_test_add("/journal/truncated_tail", struct Fixture, NULL, _setup,
+		   test_truncated_tail, _teardown);
+	g_test_add("/journal/rejected", struct Fixture, NULL, _setup,
+		   test_rejected, _teardown);
+	g_test_add("/journal/disconnected", struct Fixture, NULL, _setup,
+		   test_disconnected, _teardown);
+	g_test_add("/journal/foreign_file", struct Fixture, NULL, _setup,
+		   test_foreign_file, _teardown);
+
+	return g_test_run();
+}
@@ -0,0 +1,200 @@
+/****************************************************************************
+ * Copyright (c) 2018 Tomi Lähteenmäki <lihis@lihis.net>                    *
+ *                                                                          *
+ * This program is free software; you can redistribute it and/or modify     *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation; either version 2 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with this program; if not, write to the Free Software              *
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,               *
+ * MA 02110-1301, USA.                                                      *
+ ****************************************************************************/
+
+/*
+ * Order in which the scheduler hands out ships and how their intervals
+ * follow the data the API returns.
+ */
+
+#include "scheduler.h"
+
+#define NOW 1700000000
+
+static gchar *_roster(const guint first, const guint count)
+{
+	GString *roster = g_string_new(NULL);
+
+	for (guint i = first; i < first + count; ++i) {
+		g_string_append_printf(roster, i > first ? ",%u" : "%u", i);
+	}
+
+	return g_string_free(roster, FALSE);
+}
+
+static void test_new_ships_due(void)
+{
+	struct Scheduler *scheduler = scheduler_new();
+	gchar *names;
+	gchar **split;
+
+	scheduler_set_roster(scheduler, "1,2,3", NOW);
+	g_assert_cmpuint(scheduler_size(scheduler), ==, 3);
+	g_assert_cmpint(scheduler_next_due(scheduler), ==, NOW);
+	g_assert_null(scheduler_next_batch(scheduler, NOW - 1));
+
+	names = scheduler_next_batch(scheduler, NOW);
+	split = g_strsplit(names, ",", -1);
+	g_assert_cmpuint(g_strv_length(split), ==, 3);
+	g_assert_true(g_strv_contains((const gchar * const *)split, "1"));
+	g_assert_true(g_strv_contains((const gchar * const *)split, "2"));
+	g_assert_true(g_strv_contains((const gchar * const *)split, "3"));
+
+	// Taken ships move forward even before the batch finishes
+	g_assert_null(scheduler_next_batch(scheduler, NOW));
+	g_assert_cmpint(scheduler_next_due(scheduler), ==,
+			NOW + SCHEDULER_STATIONARY_INTERVAL);
+
+	g_strfreev(split);
+	g_free(names);
+	scheduler_free(scheduler);
+}
+
+static void test_due_first(void)
+{
+	struct Scheduler *scheduler = scheduler_new();
+	gchar *roster = _roster(1, SCHEDULER_BATCH_SIZE + 5);
+	gchar **first;
+	gchar **second;
+	gchar *names;
+
+	scheduler_set_roster(scheduler, roster, NOW);
+
+	names = scheduler_next_batch(scheduler, NOW);
+	first = g_strsplit(names, ",", -1);
+	g_free(names);
+	g_assert_cmpuint(g_strv_length(first), ==, SCHEDULER_BATCH_SIZE);
+
+	// Five ships still due come before the ones just taken
+	names = scheduler_next_batch(scheduler, NOW);
+	second = g_strsplit(names, ",", -1);
+	g_free(names);
+	g_assert_cmpuint(g_strv_length(second), ==, SCHEDULER_BATCH_SIZE);
+	for (guint i = 0; i < 5; ++i) {
+		g_assert_false(g_strv_contains((const gchar * const *)first,
+					       second[i]));
+	}
+	for (guint i = 5; i < SCHEDULER_BATCH_SIZE; ++i) {
+		g_assert_true(g_strv_contains((const gchar * const *)first,
+					      second[i]));
+	}
+
+	g_strfreev(second);
+	g_strfreev(first);
+	g_free(roster);
+	scheduler_free(scheduler);
+}
+
+static void test_interval_order(void)
+{
+	struct Scheduler *scheduler = scheduler_new();
+	struct ShipBatch *batch = ship_batch_new(3);
+	gchar *names;
+
+	scheduler_set_roster(scheduler, "1,2,3", NOW);
+	names = scheduler_next_batch(scheduler, NOW);
+	g_free(names);
+
+	// Moving, stopped and moored ship
+	ship_batch_set_size(batch, 3);
+	for (guint i = 0; i < 3; ++i) {
+		batch->mmsi[i] = 3 - i;
+		batch->lasttime[i] = NOW - 60;
+	}
+	batch->speed[2] = 60.0f;
+	batch->speed[1] = 0.0f;
+	batch->navstat[0] = 5;
+	scheduler_update(scheduler, batch, NOW);
+
+	g_assert_cmpint(scheduler_next_due(scheduler), ==,
+			NOW + SCHEDULER_MIN_INTERVAL);
+	g_assert_null(scheduler_next_batch(scheduler,
+					   NOW + SCHEDULER_MIN_INTERVAL - 1));
+
+	names = scheduler_next_batch(scheduler, NOW + SCHEDULER_MIN_INTERVAL);
+	g_assert_cmpstr(names, ==, "1,2,3");
+	g_free(names);
+
+	ship_batch_free(batch);
+	scheduler_free(scheduler);
+}
+
+static void test_backoff(void)
+{
+	struct Scheduler *scheduler = scheduler_new();
+	gchar *names;
+
+	scheduler_set_roster(scheduler, "1", NOW);
+
+	// Failed request keeps the interval
+	names = scheduler_next_batch(scheduler, NOW);
+	scheduler_finish_batch(scheduler, names, FALSE, NOW);
+	g_free(names);
+	g_assert_cmpint(scheduler_next_due(scheduler), ==,
+			NOW + SCHEDULER_STATIONARY_INTERVAL);
+
+	// Answer without the ship doubles it
+	names = scheduler_next_batch(scheduler, NOW + SCHEDULER_STATIONARY_INTERVAL);
+	scheduler_finish_batch(scheduler, names, TRUE,
+			       NOW + SCHEDULER_STATIONARY_INTERVAL);
+	g_free(names);
+	g_assert_cmpint(scheduler_next_due(scheduler), ==,
+			NOW + SCHEDULER_STATIONARY_INTERVAL +
+			MIN(2 * SCHEDULER_STATIONARY_INTERVAL,
+			    SCHEDULER_MAX_INTERVAL));
+
+	scheduler_free(scheduler);
+}
+
+static void test_roster_change(void)
+{
+	struct Scheduler *scheduler = scheduler_new();
+	gchar *names;
+	gchar **split;
+
+	scheduler_set_roster(scheduler, "1,2,3", NOW);
+	names = scheduler_next_batch(scheduler, NOW);
+	g_free(names);
+
+	// Kept ships keep their schedule, the new one is due at once
+	scheduler_set_roster(scheduler, "2,3,4", NOW + 60);
+	g_assert_cmpuint(scheduler_size(scheduler), ==, 3);
+	names = scheduler_next_batch(scheduler, NOW + 60);
+	split = g_strsplit(names, ",", -1);
+	g_assert_cmpuint(g_strv_length(split), ==, 3);
+	g_assert_cmpstr(split[0], ==, "4");
+	g_assert_false(g_strv_contains((const gchar * const *)split, "1"));
+
+	g_strfreev(split);
+	g_free(names);
+
+	scheduler_free(scheduler);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/scheduler/new_ships_due", test_new_ships_due);
+	g_test_add_func("/scheduler/due_first", test_due_first);
+	g_test_add_func("/scheduler/interval_order", test_interval_order);
+	g_test_add_func("/scheduler/backoff", test_backoff);
+	g_test_add_func("/scheduler/roster_change", test_roster_change);
+
+	return g_test_run();
+}